@@ -0,0 +1,83 @@
+#include "alloc_count.h"
+
+#include <stdlib.h>
+
+/* Counting relies on replacing the allocator entry points of the C library,
+ * which glibc supports by design. Elsewhere the counts are not available. */
+#if defined __GLIBC__ && defined ECHMET_COMPILER_GCC_LIKE
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t num, size_t size);
+extern void * __libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+/* The replacements must be visible to the shared libraries, the C++ runtime included */
+#define REPLACEMENT __attribute__ ((visibility ("default")))
+
+static unsigned long long allocations;
+static unsigned long long bytes;
+
+static
+void record(const size_t size)
+{
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&bytes, size, __ATOMIC_RELAXED);
+}
+
+REPLACEMENT void * malloc(size_t size)
+{
+	void *ptr = __libc_malloc(size);
+	if (ptr != NULL)
+		record(size);
+
+	return ptr;
+}
+
+REPLACEMENT void * calloc(size_t num, size_t size)
+{
+	void *ptr = __libc_calloc(num, size);
+	if (ptr != NULL)
+		record(num * size);
+
+	return ptr;
+}
+
+REPLACEMENT void * realloc(void *ptr, size_t size)
+{
+	void *new_ptr = __libc_realloc(ptr, size);
+	if (new_ptr != NULL)
+		record(size);
+
+	return new_ptr;
+}
+
+REPLACEMENT void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+int alloc_count_supported(void)
+{
+	return 1;
+}
+
+void alloc_count_get(struct AllocCount *count)
+{
+	count->allocations = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+	count->bytes = __atomic_load_n(&bytes, __ATOMIC_RELAXED);
+}
+
+#else
+
+int alloc_count_supported(void)
+{
+	return 0;
+}
+
+void alloc_count_get(struct AllocCount *count)
+{
+	count->allocations = 0;
+	count->bytes = 0;
+}
+
+#endif /* __GLIBC__ */
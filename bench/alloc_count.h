@@ -0,0 +1,27 @@
+#ifndef ECHMET_UPD_BENCH_ALLOC_COUNT_H
+#define ECHMET_UPD_BENCH_ALLOC_COUNT_H
+
+/*!
+ * Cumulative allocation counts of the whole process
+ */
+struct AllocCount {
+	unsigned long long allocations;	/*!< Number of successful allocations, reallocations included */
+	unsigned long long bytes;	/*!< Number of bytes requested */
+};
+
+/*!
+ * Checks whether allocations can be counted on this platform
+ *
+ * @retval 1 Allocations are counted
+ * @retval 0 Counting is not supported, the counts stay zero
+ */
+int alloc_count_supported(void);
+
+/*!
+ * Reads the current allocation counts
+ *
+ * @param[out] count The counts
+ */
+void alloc_count_get(struct AllocCount *count);
+
+#endif /* ECHMET_UPD_BENCH_ALLOC_COUNT_H */
@@ -0,0 +1,599 @@
+#ifndef _WIN32
+	#define _POSIX_C_SOURCE 200809L
+#endif /* _WIN32 */
+
+#include "alloc_count.h"
+#include "manifest_gen.h"
+
+#include "../src/allocator.h"
+#include "../src/list_comparator.h"
+#include "../src/list_parser.h"
+#include "../src/timing.h"
+
+#include <echmetupdatecheck.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef ECHMET_PLATFORM_WIN32
+	#include "loopback_server.h"
+
+	#include <unistd.h>
+
+	#define HAVE_LOOPBACK_SERVER
+#endif /* ECHMET_PLATFORM_WIN32 */
+
+#define MAX_PATH_LENGTH 4096
+
+struct Options {
+	struct ManifestParams manifest;
+	size_t iterations;
+	size_t num_checked;
+	const char *url;
+	int loopback;
+	unsigned long latency_ms;
+	unsigned long bandwidth;
+	int chunked;
+	int gzip;
+};
+
+struct Result {
+	const char *name;
+	size_t iterations;
+	size_t ops_per_iteration;
+	unsigned long long bytes_per_iteration;
+	uint64_t total_ns;
+	struct AllocCount allocs;
+	EUPDRetCode tRet;
+};
+
+struct Measurement {
+	uint64_t start;
+	struct AllocCount allocs;
+};
+
+static
+void begin(struct Measurement *m)
+{
+	alloc_count_get(&m->allocs);
+	m->start = timing_now_ns();
+}
+
+static
+void end(const struct Measurement *m, struct Result *r)
+{
+	struct AllocCount now;
+
+	r->total_ns = timing_now_ns() - m->start;
+	alloc_count_get(&now);
+
+	r->allocs.allocations = now.allocations - m->allocs.allocations;
+	r->allocs.bytes = now.bytes - m->allocs.bytes;
+}
+
+static
+void bench_parse(const struct Options *opts, const char *text, const size_t length, struct Result *r)
+{
+	struct Measurement m;
+	size_t idx;
+
+	r->name = "parser_parse";
+	r->ops_per_iteration = 1;
+	r->bytes_per_iteration = length;
+	r->tRet = EUPD_OK;
+
+	begin(&m);
+	for (idx = 0; idx < opts->iterations; idx++) {
+		struct SoftwareList sw_list;
+
+		memset(&sw_list, 0, sizeof(struct SoftwareList));
+
+		r->tRet = parser_parse(text, length, &sw_list);
+		parser_free_list(&sw_list);
+		if (EUPD_IS_ERROR(r->tRet))
+			break;
+	}
+	end(&m, r);
+
+	r->iterations = idx;
+}
+
+static
+void bench_compare(const struct Options *opts, const struct SoftwareList *sw_list,
+		   const struct EUPDInSoftware *checked, struct Result *r)
+{
+	struct Measurement m;
+	size_t idx;
+
+	r->name = "comparator_compare";
+	r->ops_per_iteration = opts->num_checked;
+	r->bytes_per_iteration = 0;
+	r->tRet = EUPD_OK;
+
+	begin(&m);
+	for (idx = 0; idx < opts->iterations; idx++) {
+		size_t jdx;
+
+		for (jdx = 0; jdx < opts->num_checked; jdx++) {
+			EUPDUpdateStatus status;
+			struct EUPDVersion version;
+
+			r->tRet = comparator_compare(sw_list, &checked[jdx], &status, &version, NULL);
+			if (r->tRet != EUPD_OK)
+				goto out;
+		}
+	}
+out:
+	end(&m, r);
+
+	r->iterations = idx;
+}
+
+static
+void bench_set_link(const struct Options *opts, const struct SoftwareList *sw_list,
+		    const struct EUPDInSoftware *checked, struct Result *r)
+{
+	struct Measurement m;
+	size_t idx;
+
+	r->name = "parser_set_link";
+	r->ops_per_iteration = opts->num_checked;
+	r->bytes_per_iteration = 0;
+	r->tRet = EUPD_OK;
+
+	begin(&m);
+	for (idx = 0; idx < opts->iterations; idx++) {
+		size_t jdx;
+
+		for (jdx = 0; jdx < opts->num_checked; jdx++) {
+			struct EUPDResult result;
+
+			r->tRet = parser_set_link(sw_list, checked[jdx].name, &result);
+			if (r->tRet != EUPD_OK)
+				goto out;
+			mem_free(result.link);
+		}
+	}
+out:
+	end(&m, r);
+
+	r->iterations = idx;
+}
+
+static
+void bench_check_many(const struct Options *opts, const char *url, const struct EUPDInSoftware *checked,
+		      const size_t length, struct Result *r)
+{
+	struct Measurement m;
+	size_t idx;
+
+	r->name = "updater_check_many";
+	r->ops_per_iteration = opts->num_checked;
+	r->bytes_per_iteration = length;
+	r->tRet = EUPD_OK;
+
+	/* Measure the library itself, not a shared cache */
+	updater_set_cache_daemon(NULL);
+	updater_set_check_server(NULL);
+
+	/* Global initialization is not a part of the measured checks */
+	updater_global_init();
+
+	begin(&m);
+	for (idx = 0; idx < opts->iterations; idx++) {
+		struct EUPDResult *results;
+		size_t num_results;
+
+		r->tRet = updater_check_many(url, checked, opts->num_checked, &results, &num_results, 1);
+		if (EUPD_IS_ERROR(r->tRet))
+			break;
+		updater_free_result_list(results, num_results);
+	}
+	end(&m, r);
+
+	r->iterations = idx;
+}
+
+/*!
+ * Fetches the list once more as a manifest snapshot to report
+ * how much memory the parsed list holds and how much the parse needs
+ */
+static
+EUPDRetCode measure_memory(const char *url, struct EUPDMemoryUsage *usage)
+{
+	EUPDManifest *manifest;
+	EUPDRetCode tRet;
+
+	memset(usage, 0, sizeof(struct EUPDMemoryUsage));
+
+	tRet = updater_manifest_fetch(url, 1, &manifest);
+	if (EUPD_IS_ERROR(tRet))
+		return tRet;
+
+	updater_manifest_memory(manifest, usage);
+	updater_manifest_unref(manifest);
+
+	return tRet;
+}
+
+static
+void print_memory(const struct EUPDMemoryUsage *usage)
+{
+	printf("  \"memory\": {\n");
+	printf("    \"items\": %lu,\n", (unsigned long)usage->items);
+	printf("    \"versions\": %lu,\n", (unsigned long)usage->versions);
+	printf("    \"links\": %lu,\n", (unsigned long)usage->links);
+	printf("    \"index\": %lu,\n", (unsigned long)usage->index);
+	printf("    \"metadata\": %lu,\n", (unsigned long)usage->metadata);
+	printf("    \"total\": %lu,\n", (unsigned long)usage->total);
+	printf("    \"parse_peak\": %llu\n", usage->parse_peak);
+	printf("  },\n");
+}
+
+static
+void print_result(const struct Result *r, const int last)
+{
+	const double ops = (double)r->iterations * (double)r->ops_per_iteration;
+	const double secs = (double)r->total_ns / 1.0e9;
+
+	printf("    {\n");
+	printf("      \"name\": \"%s\",\n", r->name);
+	printf("      \"status\": \"%s\",\n", updater_error_to_str(r->tRet));
+	printf("      \"iterations\": %lu,\n", (unsigned long)r->iterations);
+	printf("      \"ops_per_iteration\": %lu,\n", (unsigned long)r->ops_per_iteration);
+	printf("      \"total_ns\": %llu,\n", (unsigned long long)r->total_ns);
+	printf("      \"ns_per_op\": %.1f,\n", ops > 0.0 ? (double)r->total_ns / ops : 0.0);
+	printf("      \"ops_per_sec\": %.1f,\n", secs > 0.0 ? ops / secs : 0.0);
+	if (r->bytes_per_iteration > 0)
+		printf("      \"bytes_per_sec\": %.1f,\n", secs > 0.0 ? (double)r->bytes_per_iteration * (double)r->iterations / secs : 0.0);
+	else
+		printf("      \"bytes_per_sec\": null,\n");
+
+	if (alloc_count_supported() && ops > 0.0) {
+		printf("      \"allocations_per_op\": %.2f,\n", (double)r->allocs.allocations / ops);
+		printf("      \"allocated_bytes_per_op\": %.1f\n", (double)r->allocs.bytes / ops);
+	} else {
+		printf("      \"allocations_per_op\": null,\n");
+		printf("      \"allocated_bytes_per_op\": null\n");
+	}
+	printf("    }%s\n", last ? "" : ",");
+}
+
+static
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --items N          Number of items in the generated list (default 1000)\n"
+		"  --versions N       Number of versions of each item (default 8)\n"
+		"  --name-length N    Length of software names, 1 to 32 (default 16)\n"
+		"  --link-length N    Length of download links, at least 16 (default 64)\n"
+		"  --checked N        Number of software checked per iteration (default 100)\n"
+		"  --iterations N     Number of iterations of each benchmark (default 100)\n"
+		"  --seed N           Seed of the list generator (default 1)\n"
+		"  --url URL          Serve the end-to-end benchmark from URL instead of a local file.\n"
+		"                     The URL shall serve the list generated with the same options.\n"
+#ifdef HAVE_LOOPBACK_SERVER
+		"  --loopback         Serve the end-to-end benchmark from an in-process HTTP server\n"
+		"  --latency MS       Delay of the loopback server responses\n"
+		"  --bandwidth B      Transfer rate cap of the loopback server in bytes per second\n"
+		"  --chunked          Loopback server uses chunked transfer encoding\n"
+		"  --gzip             Loopback server compresses the list if the client accepts gzip\n"
+#endif /* HAVE_LOOPBACK_SERVER */
+		"  --dump             Print the generated list and exit\n",
+		name);
+}
+
+static
+int parse_size(const char *str, size_t *value)
+{
+	char *end;
+	const unsigned long v = strtoul(str, &end, 10);
+
+	if (*str == '\0' || *end != '\0')
+		return -1;
+
+	*value = (size_t)v;
+	return 0;
+}
+
+static
+int parse_options(const int argc, char *argv[], struct Options *opts, int *dump)
+{
+	int idx;
+
+	opts->manifest.num_items = 1000;
+	opts->manifest.num_versions = 8;
+	opts->manifest.name_length = 16;
+	opts->manifest.link_length = 64;
+	opts->manifest.seed = 1;
+	opts->iterations = 100;
+	opts->num_checked = 100;
+	opts->url = NULL;
+	opts->loopback = 0;
+	opts->latency_ms = 0;
+	opts->bandwidth = 0;
+	opts->chunked = 0;
+	opts->gzip = 0;
+	*dump = 0;
+
+	for (idx = 1; idx < argc; idx++) {
+		const char *arg = argv[idx];
+		size_t *target = NULL;
+		size_t seed;
+
+		if (strcmp(arg, "--dump") == 0) {
+			*dump = 1;
+			continue;
+		}
+#ifdef HAVE_LOOPBACK_SERVER
+		else if (strcmp(arg, "--loopback") == 0) {
+			opts->loopback = 1;
+			continue;
+		} else if (strcmp(arg, "--chunked") == 0) {
+			opts->loopback = 1;
+			opts->chunked = 1;
+			continue;
+		} else if (strcmp(arg, "--gzip") == 0) {
+			opts->loopback = 1;
+			opts->gzip = 1;
+			continue;
+		}
+#endif /* HAVE_LOOPBACK_SERVER */
+
+		if (idx + 1 >= argc)
+			return -1;
+
+		if (strcmp(arg, "--items") == 0)
+			target = &opts->manifest.num_items;
+		else if (strcmp(arg, "--versions") == 0)
+			target = &opts->manifest.num_versions;
+		else if (strcmp(arg, "--name-length") == 0)
+			target = &opts->manifest.name_length;
+		else if (strcmp(arg, "--link-length") == 0)
+			target = &opts->manifest.link_length;
+		else if (strcmp(arg, "--checked") == 0)
+			target = &opts->num_checked;
+		else if (strcmp(arg, "--iterations") == 0)
+			target = &opts->iterations;
+		else if (strcmp(arg, "--seed") == 0) {
+			if (parse_size(argv[++idx], &seed) != 0)
+				return -1;
+			opts->manifest.seed = (unsigned int)seed;
+			continue;
+		} else if (strcmp(arg, "--url") == 0) {
+			opts->url = argv[++idx];
+			continue;
+		}
+#ifdef HAVE_LOOPBACK_SERVER
+		else if (strcmp(arg, "--latency") == 0 || strcmp(arg, "--bandwidth") == 0) {
+			size_t value;
+
+			if (parse_size(argv[idx + 1], &value) != 0)
+				return -1;
+			if (strcmp(arg, "--latency") == 0)
+				opts->latency_ms = (unsigned long)value;
+			else
+				opts->bandwidth = (unsigned long)value;
+			opts->loopback = 1;
+			idx++;
+			continue;
+		}
+#endif /* HAVE_LOOPBACK_SERVER */
+		else
+			return -1;
+
+		if (parse_size(argv[++idx], target) != 0)
+			return -1;
+	}
+
+	if (opts->manifest.num_items < 1 || opts->num_checked < 1)
+		return -1;
+	if (opts->loopback && opts->url != NULL)
+		return -1;
+	if (opts->num_checked > opts->manifest.num_items)
+		opts->num_checked = opts->manifest.num_items;
+
+	return 0;
+}
+
+/*!
+ * Stores the generated list in a new temporary file and builds
+ * a <tt>file://</tt> URL pointing to it
+ *
+ * @param[in] text The list
+ * @param[in] length Length of the list
+ * @param[out] path Path of the file, shall be removed by the caller
+ * @param[out] url The URL
+ * @param[in] url_size Size of the url buffer
+ *
+ * @return Zero on success, -1 on failure
+ */
+static
+int write_manifest(const char *text, const size_t length, char *path, char *url, const size_t url_size)
+{
+	FILE *fh;
+#ifdef ECHMET_PLATFORM_WIN32
+	char *name = _tempnam(NULL, "eupd_bench_");
+
+	if (name == NULL || strlen(name) >= MAX_PATH_LENGTH) {
+		free(name);
+		return -1;
+	}
+	strcpy(path, name);
+	free(name);
+
+	fh = fopen(path, "wb");
+#else
+	const char *tmpdir = getenv("TMPDIR");
+	int fd;
+
+	if (tmpdir == NULL || tmpdir[0] == '\0')
+		tmpdir = "/tmp";
+	if ((size_t)snprintf(path, MAX_PATH_LENGTH, "%s/eupd_bench_XXXXXX", tmpdir) >= MAX_PATH_LENGTH)
+		return -1;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return -1;
+
+	fh = fdopen(fd, "wb");
+	if (fh == NULL)
+		close(fd);
+#endif /* ECHMET_PLATFORM_WIN32 */
+	if (fh == NULL) {
+		remove(path);
+		return -1;
+	}
+
+	if (fwrite(text, 1, length, fh) != length) {
+		fclose(fh);
+		remove(path);
+		return -1;
+	}
+	fclose(fh);
+
+#ifdef ECHMET_PLATFORM_WIN32
+	snprintf(url, url_size, "file:///%s", path);
+#else
+	snprintf(url, url_size, "file://%s", path);
+#endif /* ECHMET_PLATFORM_WIN32 */
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct Options opts;
+	struct SoftwareList sw_list;
+	struct EUPDInSoftware *checked;
+	struct Result results[4];
+	struct EUPDMemoryUsage memory;
+	EUPDRetCode memory_ret;
+	char file_path[MAX_PATH_LENGTH];
+	char file_url[MAX_PATH_LENGTH + 64];
+#ifdef HAVE_LOOPBACK_SERVER
+	LoopbackServer *srv = NULL;
+#endif /* HAVE_LOOPBACK_SERVER */
+	const char *url;
+	int stored = 0;
+	char *text;
+	size_t length;
+	size_t idx;
+	int dump;
+	int ret = EXIT_FAILURE;
+
+	if (parse_options(argc, argv, &opts, &dump) != 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	text = manifest_generate(&opts.manifest, &length);
+	if (text == NULL) {
+		fprintf(stderr, "Cannot generate list of updates with the given parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	if (dump) {
+		fwrite(text, 1, length, stdout);
+		free(text);
+		return EXIT_SUCCESS;
+	}
+
+	checked = malloc(sizeof(struct EUPDInSoftware) * opts.num_checked);
+	if (checked == NULL)
+		goto out;
+
+	/* Spread the checked software evenly over the list */
+	for (idx = 0; idx < opts.num_checked; idx++)
+		manifest_software(&opts.manifest, idx * (opts.manifest.num_items / opts.num_checked), &checked[idx]);
+
+	if (opts.url != NULL)
+		url = opts.url;
+#ifdef HAVE_LOOPBACK_SERVER
+	else if (opts.loopback) {
+		struct LoopbackRoute route;
+
+		memset(&route, 0, sizeof(struct LoopbackRoute));
+		route.path = "/list.json";
+		route.body = text;
+		route.body_length = length;
+		route.latency_ms = opts.latency_ms;
+		route.bandwidth = opts.bandwidth;
+		route.chunked = opts.chunked;
+		route.gzip = opts.gzip;
+
+		if (loopback_start(&srv, 0) != 0 || loopback_add_route(srv, &route) != 0) {
+			fprintf(stderr, "Cannot start the loopback server\n");
+			goto out_2;
+		}
+		snprintf(file_url, sizeof(file_url), "http://127.0.0.1:%u/list.json", loopback_port(srv));
+		url = file_url;
+	}
+#endif /* HAVE_LOOPBACK_SERVER */
+	else {
+		if (write_manifest(text, length, file_path, file_url, sizeof(file_url)) != 0) {
+			fprintf(stderr, "Cannot store the generated list\n");
+			goto out_2;
+		}
+		stored = 1;
+		url = file_url;
+	}
+
+	memset(&sw_list, 0, sizeof(struct SoftwareList));
+	if (parser_parse(text, length, &sw_list) != EUPD_OK) {
+		fprintf(stderr, "Generated list cannot be parsed\n");
+		parser_free_list(&sw_list);
+		goto out_2;
+	}
+	parser_build_index(&sw_list);
+
+	bench_parse(&opts, text, length, &results[0]);
+	bench_compare(&opts, &sw_list, checked, &results[1]);
+	bench_set_link(&opts, &sw_list, checked, &results[2]);
+	bench_check_many(&opts, url, checked, length, &results[3]);
+	memory_ret = measure_memory(url, &memory);
+
+	parser_free_list(&sw_list);
+
+	printf("{\n");
+	printf("  \"manifest\": {\n");
+	printf("    \"items\": %lu,\n", (unsigned long)opts.manifest.num_items);
+	printf("    \"versions\": %lu,\n", (unsigned long)opts.manifest.num_versions);
+	printf("    \"name_length\": %lu,\n", (unsigned long)opts.manifest.name_length);
+	printf("    \"link_length\": %lu,\n", (unsigned long)opts.manifest.link_length);
+	printf("    \"seed\": %u,\n", opts.manifest.seed);
+	printf("    \"bytes\": %lu\n", (unsigned long)length);
+	printf("  },\n");
+	printf("  \"checked\": %lu,\n", (unsigned long)opts.num_checked);
+	printf("  \"url\": \"%s\",\n", url);
+	printf("  \"allocations_counted\": %s,\n", alloc_count_supported() ? "true" : "false");
+	print_memory(&memory);
+	printf("  \"benchmarks\": [\n");
+	for (idx = 0; idx < 4; idx++)
+		print_result(&results[idx], idx == 3);
+	printf("  ]\n");
+	printf("}\n");
+
+	ret = EUPD_IS_ERROR(memory_ret) ? EXIT_FAILURE : EXIT_SUCCESS;
+	for (idx = 0; idx < 4; idx++) {
+		if (EUPD_IS_ERROR(results[idx].tRet))
+			ret = EXIT_FAILURE;
+	}
+
+	updater_global_cleanup();
+
+out_2:
+	if (stored)
+		remove(file_path);
+#ifdef HAVE_LOOPBACK_SERVER
+	if (srv != NULL)
+		loopback_stop(srv);
+#endif /* HAVE_LOOPBACK_SERVER */
+	free(checked);
+out:
+	free(text);
+
+	return ret;
+}
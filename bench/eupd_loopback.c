@@ -0,0 +1,243 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "loopback_server.h"
+#include "manifest_gen.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static volatile sig_atomic_t terminate;
+
+static
+void on_signal(int sig)
+{
+	(void)sig;
+	terminate = 1;
+}
+
+static
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"Serves a list of updates at http://127.0.0.1:PORT/PATH until interrupted.\n"
+		"  --port N           Port to listen on, 0 picks a free port (default 8080)\n"
+		"  --path PATH        Path the list is served at (default /list.json)\n"
+		"  --file FILE        Serve content of FILE instead of a generated list\n"
+		"  --items N          Number of items in the generated list (default 1000)\n"
+		"  --versions N       Number of versions of each item (default 8)\n"
+		"  --name-length N    Length of software names, 1 to 32 (default 16)\n"
+		"  --link-length N    Length of download links, at least 16 (default 64)\n"
+		"  --seed N           Seed of the list generator (default 1)\n"
+		"  --latency MS       Delay before each response\n"
+		"  --bandwidth B      Maximum transfer rate in bytes per second\n"
+		"  --chunked          Use chunked transfer encoding\n"
+		"  --chunk-size N     Size of chunks (default 4096)\n"
+		"  --gzip             Compress the list for clients that accept gzip\n"
+		"  --status N         Respond with HTTP status N instead of the list\n"
+		"  --etag TAG         ETag of the list, empty to send none (default derived from the content)\n"
+		"  --delta FILE       Serve content of FILE as a patch to clients that hold the revision --delta-base\n"
+		"  --delta-base TAG   ETag of the revision the patch applies to\n",
+		name);
+}
+
+static
+int parse_ulong(const char *str, unsigned long *value)
+{
+	char *end;
+
+	*value = strtoul(str, &end, 10);
+
+	return (*str == '\0' || *end != '\0') ? -1 : 0;
+}
+
+static
+char * read_file(const char *path, size_t *length)
+{
+	FILE *fh = fopen(path, "rb");
+	char *data = NULL;
+	size_t capacity = 0;
+
+	*length = 0;
+	if (fh == NULL)
+		return NULL;
+
+	for (;;) {
+		size_t got;
+
+		if (*length == capacity) {
+			char *grown;
+
+			capacity = capacity > 0 ? capacity * 2 : 65536;
+			grown = realloc(data, capacity);
+			if (grown == NULL) {
+				free(data);
+				fclose(fh);
+				return NULL;
+			}
+			data = grown;
+		}
+
+		got = fread(data + *length, 1, capacity - *length, fh);
+		if (got == 0)
+			break;
+		*length += got;
+	}
+
+	fclose(fh);
+
+	return data;
+}
+
+int main(int argc, char *argv[])
+{
+	struct ManifestParams params;
+	struct LoopbackRoute route;
+	struct LoopbackCounters counters;
+	LoopbackServer *srv;
+	const char *file = NULL;
+	const char *delta_file = NULL;
+	char *delta = NULL;
+	unsigned long port = 8080;
+	char *body;
+	int idx;
+
+	params.num_items = 1000;
+	params.num_versions = 8;
+	params.name_length = 16;
+	params.link_length = 64;
+	params.seed = 1;
+
+	memset(&route, 0, sizeof(struct LoopbackRoute));
+	route.path = "/list.json";
+
+	for (idx = 1; idx < argc; idx++) {
+		const char *arg = argv[idx];
+		unsigned long value = 0;
+
+		if (strcmp(arg, "--chunked") == 0) {
+			route.chunked = 1;
+			continue;
+		} else if (strcmp(arg, "--gzip") == 0) {
+			route.gzip = 1;
+			continue;
+		}
+
+		if (idx + 1 >= argc) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		if (strcmp(arg, "--path") == 0) {
+			route.path = argv[++idx];
+			continue;
+		} else if (strcmp(arg, "--file") == 0) {
+			file = argv[++idx];
+			continue;
+		} else if (strcmp(arg, "--etag") == 0) {
+			route.etag = argv[++idx];
+			continue;
+		} else if (strcmp(arg, "--delta") == 0) {
+			delta_file = argv[++idx];
+			continue;
+		} else if (strcmp(arg, "--delta-base") == 0) {
+			route.delta_base = argv[++idx];
+			continue;
+		}
+
+		if (parse_ulong(argv[++idx], &value) != 0) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		if (strcmp(arg, "--port") == 0 && value <= 65535)
+			port = value;
+		else if (strcmp(arg, "--items") == 0)
+			params.num_items = value;
+		else if (strcmp(arg, "--versions") == 0)
+			params.num_versions = value;
+		else if (strcmp(arg, "--name-length") == 0)
+			params.name_length = value;
+		else if (strcmp(arg, "--link-length") == 0)
+			params.link_length = value;
+		else if (strcmp(arg, "--seed") == 0)
+			params.seed = (unsigned int)value;
+		else if (strcmp(arg, "--latency") == 0)
+			route.latency_ms = value;
+		else if (strcmp(arg, "--bandwidth") == 0)
+			route.bandwidth = value;
+		else if (strcmp(arg, "--chunk-size") == 0)
+			route.chunk_size = value;
+		else if (strcmp(arg, "--status") == 0)
+			route.status = (int)value;
+		else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (file != NULL)
+		body = read_file(file, &route.body_length);
+	else
+		body = manifest_generate(&params, &route.body_length);
+	if (body == NULL) {
+		fprintf(stderr, "Cannot prepare the content to serve\n");
+		return EXIT_FAILURE;
+	}
+	route.body = body;
+
+	if (delta_file != NULL) {
+		if (route.delta_base == NULL) {
+			usage(argv[0]);
+			free(body);
+			return EXIT_FAILURE;
+		}
+
+		delta = read_file(delta_file, &route.delta_length);
+		if (delta == NULL) {
+			fprintf(stderr, "Cannot read the patch\n");
+			free(body);
+			return EXIT_FAILURE;
+		}
+		route.delta = delta;
+	}
+
+	if (loopback_start(&srv, (unsigned short)port) != 0) {
+		fprintf(stderr, "Cannot start the server\n");
+		free(body);
+		free(delta);
+		return EXIT_FAILURE;
+	}
+
+	if (loopback_add_route(srv, &route) != 0) {
+		fprintf(stderr, "Cannot set up the route\n");
+		loopback_stop(srv);
+		free(body);
+		free(delta);
+		return EXIT_FAILURE;
+	}
+	free(body);
+	free(delta);
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	printf("Serving http://127.0.0.1:%u%s\n", loopback_port(srv), route.path);
+	fflush(stdout);
+
+	while (!terminate) {
+		const struct timespec ts = { 0, 100000000L };
+		nanosleep(&ts, NULL);
+	}
+
+	loopback_counters(srv, &counters);
+	loopback_stop(srv);
+
+	printf("Served %lu requests (%lu not modified, %lu deltas) over %lu connections\n",
+	       counters.requests, counters.not_modified, counters.deltas, counters.connections);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,842 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "loopback_server.h"
+
+#include "../src/threading.h"
+#include "../src/timing.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef EUPD_BENCH_HAVE_ZLIB
+	#include <zlib.h>
+#endif /* EUPD_BENCH_HAVE_ZLIB */
+
+#define REQUEST_BUFFER_SIZE 16384
+#define DEFAULT_CHUNK_SIZE 4096
+#define THROTTLE_SLICES_PER_SEC 50
+
+struct Route {
+	struct Route *next;
+	long refcount;			/*!< Guarded by \p LoopbackServer::lock */
+	char *path;
+	char *body;
+	size_t body_length;
+	char *gzip_body;		/*!< Compressed content, <tt>NULL</tt> if compression is disabled */
+	size_t gzip_length;
+	char etag[64];
+	char *delta;			/*!< Patch of the revision \p delta_base, <tt>NULL</tt> if there is none */
+	size_t delta_length;
+	char delta_base[64];
+	int status;
+	unsigned long latency_ms;
+	unsigned long bandwidth;
+	int chunked;
+	size_t chunk_size;
+};
+
+struct Connection {
+	struct Connection *next;
+	LoopbackServer *srv;
+	int fd;
+	Thread thread;
+	volatile int done;
+};
+
+struct LoopbackServer {
+	int listen_fd;
+	unsigned short port;
+	Thread acceptor;
+	volatile int stopping;
+	Mutex lock;
+	struct Route *routes;
+	struct Connection *connections;
+	struct LoopbackCounters counters;
+};
+
+struct Throttle {
+	unsigned long bandwidth;
+	uint64_t start;
+	unsigned long long sent;
+};
+
+static
+void sleep_ns(const uint64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t)(ns / 1000000000ULL);
+	ts.tv_nsec = (long)(ns % 1000000000ULL);
+
+	while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+		;
+}
+
+static
+const char * reason_phrase(const int status)
+{
+	switch (status) {
+	case 200:
+		return "OK";
+	case 226:
+		return "IM Used";
+	case 304:
+		return "Not Modified";
+	case 400:
+		return "Bad Request";
+	case 403:
+		return "Forbidden";
+	case 404:
+		return "Not Found";
+	case 431:
+		return "Request Header Fields Too Large";
+	case 500:
+		return "Internal Server Error";
+	case 502:
+		return "Bad Gateway";
+	case 503:
+		return "Service Unavailable";
+	default:
+		return "Unknown";
+	}
+}
+
+#ifdef EUPD_BENCH_HAVE_ZLIB
+static
+int gzip_compress(const char *data, const size_t length, char **out, size_t *out_length)
+{
+	z_stream zs;
+	uLong bound;
+	char *buf;
+
+	memset(&zs, 0, sizeof(z_stream));
+	/* 16 added to the window bits selects the gzip wrapper */
+	if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return -1;
+
+	bound = deflateBound(&zs, (uLong)length);
+	buf = malloc(bound);
+	if (buf == NULL) {
+		deflateEnd(&zs);
+		return -1;
+	}
+
+	zs.next_in = (Bytef *)data;
+	zs.avail_in = (uInt)length;
+	zs.next_out = (Bytef *)buf;
+	zs.avail_out = (uInt)bound;
+
+	if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+		deflateEnd(&zs);
+		free(buf);
+		return -1;
+	}
+
+	*out = buf;
+	*out_length = zs.total_out;
+	deflateEnd(&zs);
+
+	return 0;
+}
+#else
+static
+uint32_t crc32_update(const unsigned char *data, const size_t length)
+{
+	uint32_t crc = 0xFFFFFFFFU;
+	size_t idx;
+
+	for (idx = 0; idx < length; idx++) {
+		int bit;
+
+		crc ^= data[idx];
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+	}
+
+	return crc ^ 0xFFFFFFFFU;
+}
+
+static
+void put_le32(unsigned char *p, const uint32_t v)
+{
+	p[0] = (unsigned char)(v & 0xFF);
+	p[1] = (unsigned char)((v >> 8) & 0xFF);
+	p[2] = (unsigned char)((v >> 16) & 0xFF);
+	p[3] = (unsigned char)((v >> 24) & 0xFF);
+}
+
+/*!
+ * Wraps the content into a valid gzip stream made of stored deflate blocks.
+ * Used when zlib is not available, the client still has to decode the stream.
+ */
+static
+int gzip_compress(const char *data, const size_t length, char **out, size_t *out_length)
+{
+	static const unsigned char HEADER[10] = { 0x1F, 0x8B, 0x08, 0, 0, 0, 0, 0, 0, 0xFF };
+	const size_t num_blocks = length / 65535 + 1;
+	unsigned char *buf;
+	unsigned char *p;
+	size_t offset = 0;
+	size_t idx;
+
+	buf = malloc(sizeof(HEADER) + num_blocks * 5 + length + 8);
+	if (buf == NULL)
+		return -1;
+
+	memcpy(buf, HEADER, sizeof(HEADER));
+	p = buf + sizeof(HEADER);
+
+	for (idx = 0; idx < num_blocks; idx++) {
+		const size_t len = (length - offset > 65535) ? 65535 : length - offset;
+
+		*p++ = (idx + 1 == num_blocks) ? 1 : 0;
+		p[0] = (unsigned char)(len & 0xFF);
+		p[1] = (unsigned char)(len >> 8);
+		p[2] = (unsigned char)(~len & 0xFF);
+		p[3] = (unsigned char)((~len >> 8) & 0xFF);
+		p += 4;
+
+		memcpy(p, data + offset, len);
+		p += len;
+		offset += len;
+	}
+
+	put_le32(p, crc32_update((const unsigned char *)data, length));
+	put_le32(p + 4, (uint32_t)length);
+	p += 8;
+
+	*out = (char *)buf;
+	*out_length = (size_t)(p - buf);
+
+	return 0;
+}
+#endif /* EUPD_BENCH_HAVE_ZLIB */
+
+static
+void route_unref(LoopbackServer *srv, struct Route *route)
+{
+	long refcount;
+
+	mutex_lock(&srv->lock);
+	refcount = --route->refcount;
+	mutex_unlock(&srv->lock);
+
+	if (refcount > 0)
+		return;
+
+	free(route->path);
+	free(route->body);
+	free(route->gzip_body);
+	free(route->delta);
+	free(route);
+}
+
+static
+struct Route * find_route(LoopbackServer *srv, const char *path, const size_t path_len)
+{
+	struct Route *route;
+
+	mutex_lock(&srv->lock);
+	for (route = srv->routes; route != NULL; route = route->next) {
+		if (strlen(route->path) == path_len && memcmp(route->path, path, path_len) == 0) {
+			route->refcount++;
+			break;
+		}
+	}
+	mutex_unlock(&srv->lock);
+
+	return route;
+}
+
+static
+int send_raw(const int fd, const char *data, size_t length)
+{
+	while (length > 0) {
+		const ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		data += sent;
+		length -= (size_t)sent;
+	}
+
+	return 0;
+}
+
+/*!
+ * Sends data no faster than the bandwidth cap allows
+ */
+static
+int send_throttled(const int fd, const char *data, size_t length, struct Throttle *t)
+{
+	size_t slice;
+
+	if (t->bandwidth == 0)
+		return send_raw(fd, data, length);
+
+	slice = t->bandwidth / THROTTLE_SLICES_PER_SEC;
+	if (slice < 1)
+		slice = 1;
+
+	while (length > 0) {
+		const size_t len = length < slice ? length : slice;
+		uint64_t due;
+		uint64_t now;
+
+		if (send_raw(fd, data, len) != 0)
+			return -1;
+		data += len;
+		length -= len;
+		t->sent += len;
+
+		due = t->start + (uint64_t)(t->sent * 1000000000ULL / t->bandwidth);
+		now = timing_now_ns();
+		if (due > now)
+			sleep_ns(due - now);
+	}
+
+	return 0;
+}
+
+static
+int send_status(const int fd, const int status, const int keep_alive)
+{
+	char buf[256];
+	const int len = snprintf(buf, sizeof(buf),
+				 "HTTP/1.1 %d %s\r\n"
+				 "Content-Type: text/plain\r\n"
+				 "Content-Length: %lu\r\n"
+				 "%s"
+				 "\r\n"
+				 "%s",
+				 status, reason_phrase(status),
+				 (unsigned long)strlen(reason_phrase(status)),
+				 keep_alive ? "" : "Connection: close\r\n",
+				 reason_phrase(status));
+
+	return send_raw(fd, buf, (size_t)len);
+}
+
+static
+int send_body(const int fd, const struct Route *route, const char *body, const size_t length, struct Throttle *t)
+{
+	size_t offset;
+
+	if (!route->chunked)
+		return send_throttled(fd, body, length, t);
+
+	for (offset = 0; offset < length; offset += route->chunk_size) {
+		const size_t len = (length - offset < route->chunk_size) ? length - offset : route->chunk_size;
+		char size_line[32];
+		const int sl = snprintf(size_line, sizeof(size_line), "%lx\r\n", (unsigned long)len);
+
+		if (send_throttled(fd, size_line, (size_t)sl, t) != 0)
+			return -1;
+		if (send_throttled(fd, body + offset, len, t) != 0)
+			return -1;
+		if (send_throttled(fd, "\r\n", 2, t) != 0)
+			return -1;
+	}
+
+	return send_throttled(fd, "0\r\n\r\n", 5, t);
+}
+
+/*!
+ * Finds value of a request header
+ *
+ * @param[in] headers Header lines of the request
+ * @param[in] end End of the header lines
+ * @param[in] name Name of the header including the colon
+ * @param[out] length Length of the value
+ *
+ * @return Pointer to the value or <tt>NULL</tt> if the header is not present
+ */
+static
+const char * find_header(const char *headers, const char *end, const char *name, size_t *length)
+{
+	const size_t name_len = strlen(name);
+	const char *line = headers;
+
+	while (line < end) {
+		const char *eol = strstr(line, "\r\n");
+		if (eol == NULL || eol > end)
+			eol = end;
+
+		if ((size_t)(eol - line) > name_len && strncasecmp(line, name, name_len) == 0) {
+			const char *value = line + name_len;
+
+			while (value < eol && (*value == ' ' || *value == '\t'))
+				value++;
+			*length = (size_t)(eol - value);
+			return value;
+		}
+
+		line = eol + 2;
+	}
+
+	return NULL;
+}
+
+static
+int contains_token(const char *value, const size_t length, const char *token)
+{
+	const size_t token_len = strlen(token);
+	size_t idx;
+
+	for (idx = 0; idx + token_len <= length; idx++) {
+		if (strncasecmp(value + idx, token, token_len) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/*!
+ * Serves one request
+ *
+ * @return Zero if the connection may be kept alive, -1 if it shall be closed
+ */
+static
+int serve_request(LoopbackServer *srv, const int fd, const char *request, const char *headers_end)
+{
+	const char *method_end = strchr(request, ' ');
+	const char *path;
+	const char *path_end;
+	const char *headers;
+	const char *value;
+	size_t value_len;
+	struct Route *route;
+	struct Throttle throttle;
+	int keep_alive;
+	int head;
+	int ret = 0;
+
+	if (method_end == NULL || method_end > headers_end) {
+		send_status(fd, 400, 0);
+		return -1;
+	}
+
+	path = method_end + 1;
+	path_end = strchr(path, ' ');
+	if (path_end == NULL || path_end > headers_end) {
+		send_status(fd, 400, 0);
+		return -1;
+	}
+
+	headers = strstr(path_end, "\r\n") + 2;
+	head = (size_t)(method_end - request) == 4 && strncmp(request, "HEAD", 4) == 0;
+
+	keep_alive = strncmp(path_end + 1, "HTTP/1.1", 8) == 0;
+	value = find_header(headers, headers_end, "Connection:", &value_len);
+	if (value != NULL)
+		keep_alive = !contains_token(value, value_len, "close");
+
+	mutex_lock(&srv->lock);
+	srv->counters.requests++;
+	mutex_unlock(&srv->lock);
+
+	route = find_route(srv, path, (size_t)(path_end - path));
+	if (route == NULL) {
+		if (send_status(fd, 404, keep_alive) != 0)
+			return -1;
+		return keep_alive ? 0 : -1;
+	}
+
+	if (route->latency_ms > 0)
+		sleep_ns((uint64_t)route->latency_ms * 1000000ULL);
+
+	throttle.bandwidth = route->bandwidth;
+	throttle.start = timing_now_ns();
+	throttle.sent = 0;
+
+	if (route->status != 200) {
+		ret = send_status(fd, route->status, keep_alive);
+		goto out;
+	}
+
+	value = find_header(headers, headers_end, "If-None-Match:", &value_len);
+	if (value != NULL && route->etag[0] != '\0' &&
+	    value_len == strlen(route->etag) && memcmp(value, route->etag, value_len) == 0) {
+		char buf[256];
+		const int len = snprintf(buf, sizeof(buf),
+					 "HTTP/1.1 304 Not Modified\r\n"
+					 "ETag: %s\r\n"
+					 "%s"
+					 "\r\n",
+					 route->etag,
+					 keep_alive ? "" : "Connection: close\r\n");
+
+		mutex_lock(&srv->lock);
+		srv->counters.not_modified++;
+		mutex_unlock(&srv->lock);
+
+		ret = send_throttled(fd, buf, (size_t)len, &throttle);
+		goto out;
+	} else if (route->delta != NULL && value != NULL &&
+		   value_len == strlen(route->delta_base) && memcmp(value, route->delta_base, value_len) == 0 &&
+		   (value = find_header(headers, headers_end, "A-IM:", &value_len)) != NULL &&
+		   contains_token(value, value_len, "eupd-delta")) {
+		char buf[512];
+		const int len = snprintf(buf, sizeof(buf),
+					 "HTTP/1.1 226 IM Used\r\n"
+					 "Content-Type: application/json\r\n"
+					 "Content-Length: %lu\r\n"
+					 "ETag: %s\r\n"
+					 "IM: eupd-delta\r\n"
+					 "%s"
+					 "\r\n",
+					 (unsigned long)route->delta_length,
+					 route->etag,
+					 keep_alive ? "" : "Connection: close\r\n");
+
+		mutex_lock(&srv->lock);
+		srv->counters.deltas++;
+		mutex_unlock(&srv->lock);
+
+		ret = send_throttled(fd, buf, (size_t)len, &throttle);
+		if (ret == 0 && !head)
+			ret = send_throttled(fd, route->delta, route->delta_length, &throttle);
+	} else {
+		const char *body = route->body;
+		size_t length = route->body_length;
+		int gzip = 0;
+		char buf[512];
+		char length_line[64];
+		char etag_line[96];
+		int len;
+
+		value = find_header(headers, headers_end, "Accept-Encoding:", &value_len);
+		if (route->gzip_body != NULL && value != NULL && contains_token(value, value_len, "gzip")) {
+			body = route->gzip_body;
+			length = route->gzip_length;
+			gzip = 1;
+		}
+
+		if (route->chunked)
+			snprintf(length_line, sizeof(length_line), "Transfer-Encoding: chunked\r\n");
+		else
+			snprintf(length_line, sizeof(length_line), "Content-Length: %lu\r\n", (unsigned long)length);
+
+		if (route->etag[0] != '\0')
+			snprintf(etag_line, sizeof(etag_line), "ETag: %s\r\n", route->etag);
+		else
+			etag_line[0] = '\0';
+
+		len = snprintf(buf, sizeof(buf),
+			       "HTTP/1.1 200 OK\r\n"
+			       "Content-Type: application/json\r\n"
+			       "%s%s%s%s"
+			       "\r\n",
+			       length_line,
+			       etag_line,
+			       gzip ? "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n" : "",
+			       keep_alive ? "" : "Connection: close\r\n");
+
+		ret = send_throttled(fd, buf, (size_t)len, &throttle);
+		if (ret == 0 && !head)
+			ret = send_body(fd, route, body, length, &throttle);
+	}
+
+out:
+	route_unref(srv, route);
+
+	return (ret == 0 && keep_alive) ? 0 : -1;
+}
+
+static
+void serve_connection(void *arg)
+{
+	struct Connection *conn = arg;
+	char buf[REQUEST_BUFFER_SIZE + 1];
+	size_t have = 0;
+
+	for (;;) {
+		char *headers_end;
+		ssize_t got;
+
+		buf[have] = '\0';
+		headers_end = strstr(buf, "\r\n\r\n");
+		if (headers_end != NULL) {
+			const size_t consumed = (size_t)(headers_end - buf) + 4;
+
+			/* Request bodies are not expected, anything that follows is the next request */
+			if (serve_request(conn->srv, conn->fd, buf, headers_end + 2) != 0)
+				break;
+
+			memmove(buf, buf + consumed, have - consumed);
+			have -= consumed;
+			continue;
+		}
+
+		if (have == REQUEST_BUFFER_SIZE) {
+			send_status(conn->fd, 431, 0);
+			break;
+		}
+
+		got = recv(conn->fd, buf + have, REQUEST_BUFFER_SIZE - have, 0);
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			break;
+		have += (size_t)got;
+	}
+
+	shutdown(conn->fd, SHUT_RDWR);
+	conn->done = 1;
+}
+
+/*!
+ * Joins finished connections
+ *
+ * @param[in] srv The server
+ * @param[in] all Close and join also the connections that are still open
+ */
+static
+void reap_connections(LoopbackServer *srv, const int all)
+{
+	struct Connection *reaped = NULL;
+	struct Connection **pp;
+
+	mutex_lock(&srv->lock);
+	pp = &srv->connections;
+	while (*pp != NULL) {
+		struct Connection *conn = *pp;
+
+		if (!all && !conn->done) {
+			pp = &conn->next;
+			continue;
+		}
+
+		*pp = conn->next;
+		conn->next = reaped;
+		reaped = conn;
+	}
+	mutex_unlock(&srv->lock);
+
+	/* Connection threads take the lock too, they must be joined without it */
+	while (reaped != NULL) {
+		struct Connection *conn = reaped;
+
+		reaped = conn->next;
+
+		/* Wakes up the connection if it is still waiting for a request */
+		shutdown(conn->fd, SHUT_RDWR);
+		thread_join(&conn->thread);
+		close(conn->fd);
+		free(conn);
+	}
+}
+
+static
+void accept_loop(void *arg)
+{
+	LoopbackServer *srv = arg;
+
+	while (!srv->stopping) {
+		struct Connection *conn;
+		const int fd = accept(srv->listen_fd, NULL, NULL);
+
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+
+		conn = malloc(sizeof(struct Connection));
+		if (conn == NULL) {
+			close(fd);
+			continue;
+		}
+		conn->srv = srv;
+		conn->fd = fd;
+		conn->done = 0;
+
+		reap_connections(srv, 0);
+
+		mutex_lock(&srv->lock);
+		if (thread_create(&conn->thread, serve_connection, conn) != 0) {
+			mutex_unlock(&srv->lock);
+			close(fd);
+			free(conn);
+			continue;
+		}
+		conn->next = srv->connections;
+		srv->connections = conn;
+		srv->counters.connections++;
+		mutex_unlock(&srv->lock);
+	}
+}
+
+int loopback_add_route(LoopbackServer *srv, const struct LoopbackRoute *route)
+{
+	struct Route *r = calloc(1, sizeof(struct Route));
+	struct Route **pp;
+	const size_t path_len = strlen(route->path);
+
+	if (r == NULL)
+		return -1;
+
+	r->refcount = 1;
+	r->status = route->status != 0 ? route->status : 200;
+	r->latency_ms = route->latency_ms;
+	r->bandwidth = route->bandwidth;
+	r->chunked = route->chunked;
+	r->chunk_size = route->chunk_size != 0 ? route->chunk_size : DEFAULT_CHUNK_SIZE;
+
+	r->path = malloc(path_len + 1);
+	r->body = malloc(route->body_length + 1);
+	if (r->path == NULL || r->body == NULL)
+		goto err_out;
+	memcpy(r->path, route->path, path_len + 1);
+	memcpy(r->body, route->body, route->body_length);
+	r->body_length = route->body_length;
+
+	if (route->gzip) {
+		if (gzip_compress(r->body, r->body_length, &r->gzip_body, &r->gzip_length) != 0)
+			goto err_out;
+	}
+
+	if (route->delta != NULL && route->delta_base != NULL) {
+		r->delta = malloc(route->delta_length + 1);
+		if (r->delta == NULL)
+			goto err_out;
+		memcpy(r->delta, route->delta, route->delta_length);
+		r->delta_length = route->delta_length;
+		snprintf(r->delta_base, sizeof(r->delta_base), "%s", route->delta_base);
+	}
+
+	if (route->etag != NULL)
+		snprintf(r->etag, sizeof(r->etag), "%s", route->etag);
+	else {
+		uint32_t h = 2166136261U;
+		size_t idx;
+
+		for (idx = 0; idx < r->body_length; idx++) {
+			h ^= (unsigned char)r->body[idx];
+			h *= 16777619U;
+		}
+		snprintf(r->etag, sizeof(r->etag), "\"%08x-%lx\"", h, (unsigned long)r->body_length);
+	}
+
+	mutex_lock(&srv->lock);
+	for (pp = &srv->routes; *pp != NULL; pp = &(*pp)->next) {
+		if (strcmp((*pp)->path, r->path) == 0) {
+			struct Route *old = *pp;
+
+			r->next = old->next;
+			*pp = r;
+			mutex_unlock(&srv->lock);
+
+			route_unref(srv, old);
+			return 0;
+		}
+	}
+	r->next = srv->routes;
+	srv->routes = r;
+	mutex_unlock(&srv->lock);
+
+	return 0;
+
+err_out:
+	free(r->path);
+	free(r->body);
+	free(r->gzip_body);
+	free(r->delta);
+	free(r);
+
+	return -1;
+}
+
+void loopback_counters(LoopbackServer *srv, struct LoopbackCounters *counters)
+{
+	mutex_lock(&srv->lock);
+	*counters = srv->counters;
+	mutex_unlock(&srv->lock);
+}
+
+unsigned short loopback_port(const LoopbackServer *srv)
+{
+	return srv->port;
+}
+
+int loopback_start(LoopbackServer **srv, const unsigned short port)
+{
+	LoopbackServer *s = calloc(1, sizeof(LoopbackServer));
+	struct sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	const int one = 1;
+
+	if (s == NULL)
+		return -1;
+
+	s->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (s->listen_fd < 0)
+		goto err_out;
+	setsockopt(s->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(s->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+		goto err_out_2;
+	if (listen(s->listen_fd, 128) != 0)
+		goto err_out_2;
+	if (getsockname(s->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0)
+		goto err_out_2;
+	s->port = ntohs(addr.sin_port);
+
+	if (mutex_init(&s->lock) != 0)
+		goto err_out_2;
+
+	if (thread_create(&s->acceptor, accept_loop, s) != 0)
+		goto err_out_3;
+
+	*srv = s;
+
+	return 0;
+
+err_out_3:
+	mutex_destroy(&s->lock);
+err_out_2:
+	close(s->listen_fd);
+err_out:
+	free(s);
+
+	return -1;
+}
+
+void loopback_stop(LoopbackServer *srv)
+{
+	srv->stopping = 1;
+
+	/* Wakes up the acceptor blocked in accept() */
+	shutdown(srv->listen_fd, SHUT_RDWR);
+	thread_join(&srv->acceptor);
+	close(srv->listen_fd);
+
+	reap_connections(srv, 1);
+
+	while (srv->routes != NULL) {
+		struct Route *r = srv->routes;
+
+		srv->routes = r->next;
+		route_unref(srv, r);
+	}
+
+	mutex_destroy(&srv->lock);
+	free(srv);
+}
@@ -0,0 +1,91 @@
+#ifndef ECHMET_UPD_BENCH_LOOPBACK_SERVER_H
+#define ECHMET_UPD_BENCH_LOOPBACK_SERVER_H
+
+#include <stddef.h>
+
+/*
+ * Minimal HTTP/1.1 server bound to 127.0.0.1 that serves lists of updates
+ * from memory. Responses can be slowed down and reshaped to emulate
+ * real servers in deterministic end-to-end measurements.
+ */
+
+typedef struct LoopbackServer LoopbackServer;
+
+/*!
+ * Content served at one path and the way it is served
+ */
+struct LoopbackRoute {
+	const char *path;		/*!< Request path, e.g. <tt>/list.json</tt> */
+	const char *body;		/*!< Content to serve. Ignored if \p status is not 200. */
+	size_t body_length;		/*!< Length of the content */
+	const char *etag;		/*!< ETag of the content including quotes. <tt>NULL</tt> to derive one from the content,
+					     empty string to send no ETag. */
+	int status;			/*!< HTTP status code of the response. Zero means 200. */
+	unsigned long latency_ms;	/*!< Delay before the response is sent */
+	unsigned long bandwidth;	/*!< Maximum transfer rate in bytes per second. Zero means unlimited. */
+	int chunked;			/*!< Use chunked transfer encoding */
+	size_t chunk_size;		/*!< Size of chunks. Zero means 4096 bytes. */
+	int gzip;			/*!< Compress the content if the client accepts gzip encoding */
+	const char *delta;		/*!< Patch served with 226 IM Used to clients that accept deltas and
+					     hold the revision \p delta_base. <tt>NULL</tt> to serve no patch. */
+	size_t delta_length;		/*!< Length of the patch */
+	const char *delta_base;		/*!< ETag of the revision the patch applies to including quotes */
+};
+
+/*!
+ * Counters of served requests
+ */
+struct LoopbackCounters {
+	unsigned long requests;		/*!< Number of requests received */
+	unsigned long not_modified;	/*!< Number of 304 Not Modified responses */
+	unsigned long deltas;		/*!< Number of 226 IM Used responses */
+	unsigned long connections;	/*!< Number of accepted connections */
+};
+
+/*!
+ * Adds or replaces a route. The content is copied.
+ *
+ * @param[in] srv The server
+ * @param[in] route The route
+ *
+ * @retval 0 Success
+ * @retval -1 Insufficient memory or the content cannot be compressed
+ */
+int loopback_add_route(LoopbackServer *srv, const struct LoopbackRoute *route);
+
+/*!
+ * Reads counters of served requests
+ *
+ * @param[in] srv The server
+ * @param[out] counters The counters
+ */
+void loopback_counters(LoopbackServer *srv, struct LoopbackCounters *counters);
+
+/*!
+ * Returns the port the server listens on
+ *
+ * @param[in] srv The server
+ *
+ * @return The port
+ */
+unsigned short loopback_port(const LoopbackServer *srv);
+
+/*!
+ * Starts the server
+ *
+ * @param[out] srv The server
+ * @param[in] port Port to listen on. Zero lets the system pick a free port.
+ *
+ * @retval 0 Success
+ * @retval -1 The server cannot be started
+ */
+int loopback_start(LoopbackServer **srv, const unsigned short port);
+
+/*!
+ * Stops the server, closes all connections and frees the server
+ *
+ * @param[in] srv The server
+ */
+void loopback_stop(LoopbackServer *srv);
+
+#endif /* ECHMET_UPD_BENCH_LOOPBACK_SERVER_H */
@@ -0,0 +1,195 @@
+#include "manifest_gen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NAME_LENGTH 32
+#define MIN_LINK_LENGTH 16
+
+static const char LINK_PREFIX[] = "https://example.com/";
+
+struct TextBuffer {
+	char *data;
+	size_t length;
+	size_t capacity;
+};
+
+/*!
+ * Minimal deterministic generator, the list must look the same on every platform
+ */
+static
+unsigned int next_random(unsigned int *state)
+{
+	*state = *state * 1103515245U + 12345U;
+
+	return (*state >> 16) & 0x7FFFU;
+}
+
+static
+int reserve(struct TextBuffer *buf, const size_t size)
+{
+	char *data;
+	size_t capacity;
+
+	if (buf->length + size < buf->capacity)
+		return 0;
+
+	capacity = buf->capacity * 2;
+	while (buf->length + size >= capacity)
+		capacity *= 2;
+
+	data = realloc(buf->data, capacity);
+	if (data == NULL)
+		return -1;
+
+	buf->data = data;
+	buf->capacity = capacity;
+
+	return 0;
+}
+
+static
+int append(struct TextBuffer *buf, const char *str, const size_t len)
+{
+	if (reserve(buf, len) != 0)
+		return -1;
+
+	memcpy(buf->data + buf->length, str, len);
+	buf->length += len;
+	buf->data[buf->length] = '\0';
+
+	return 0;
+}
+
+static
+int append_str(struct TextBuffer *buf, const char *str)
+{
+	return append(buf, str, strlen(str));
+}
+
+/*!
+ * Builds unique name of an item. The index is written in base 36
+ * and padded to the requested length.
+ */
+static
+void make_name(const size_t idx, const size_t length, char *name)
+{
+	static const char DIGITS[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+	size_t value = idx;
+	size_t pos = 0;
+
+	name[pos++] = 's';
+	do {
+		name[pos++] = DIGITS[value % 36];
+		value /= 36;
+	} while (value > 0 && pos < MAX_NAME_LENGTH);
+
+	while (pos < length)
+		name[pos++] = '_';
+	name[pos] = '\0';
+}
+
+/*!
+ * Builds revision of the given version of an item. Revisions
+ * start with a letter and grow with the version number.
+ */
+static
+void make_revision(const size_t ver, char *revision)
+{
+	revision[0] = (char)('a' + (ver % 26));
+	if (ver % 3 == 1) {
+		revision[1] = (char)('0' + (ver % 10));
+		revision[2] = '\0';
+	} else
+		revision[1] = '\0';
+}
+
+char * manifest_generate(const struct ManifestParams *params, size_t *length)
+{
+	struct TextBuffer buf;
+	unsigned int state = params->seed;
+	char *link;
+	size_t idx;
+
+	if (params->name_length < 1 || params->name_length > MAX_NAME_LENGTH)
+		return NULL;
+	if (params->link_length < MIN_LINK_LENGTH || params->num_versions < 1)
+		return NULL;
+
+	link = malloc(params->link_length + 1);
+	if (link == NULL)
+		return NULL;
+	memcpy(link, LINK_PREFIX, sizeof(LINK_PREFIX) - 1);
+
+	buf.capacity = 4096;
+	buf.length = 0;
+	buf.data = malloc(buf.capacity);
+	if (buf.data == NULL)
+		goto err_out;
+
+	if (append_str(&buf, "{\"software\":[") != 0)
+		goto err_out;
+
+	for (idx = 0; idx < params->num_items; idx++) {
+		char name[MAX_NAME_LENGTH + 1];
+		char entry[128];
+		size_t pos;
+		size_t ver;
+
+		make_name(idx, params->name_length, name);
+		for (pos = sizeof(LINK_PREFIX) - 1; pos < params->link_length; pos++)
+			link[pos] = (char)('a' + next_random(&state) % 26);
+		link[params->link_length] = '\0';
+
+		snprintf(entry, sizeof(entry), "%s{\"name\":\"%s\",\"link\":\"", idx > 0 ? "," : "", name);
+		if (append_str(&buf, entry) != 0)
+			goto err_out;
+		if (append(&buf, link, params->link_length) != 0)
+			goto err_out;
+		if (append_str(&buf, "\",\"versions\":[") != 0)
+			goto err_out;
+
+		for (ver = 0; ver < params->num_versions; ver++) {
+			char revision[3];
+
+			make_revision(ver, revision);
+			snprintf(entry, sizeof(entry), "%s{\"major\":%u,\"minor\":%u,\"revision\":\"%s\",\"severity\":%u}",
+				 ver > 0 ? "," : "", (unsigned int)(ver / 10), (unsigned int)(ver % 10), revision,
+				 next_random(&state) % 3);
+			if (append_str(&buf, entry) != 0)
+				goto err_out;
+		}
+
+		if (append_str(&buf, "]}") != 0)
+			goto err_out;
+	}
+
+	if (append_str(&buf, "]}") != 0)
+		goto err_out;
+
+	free(link);
+	*length = buf.length;
+
+	return buf.data;
+
+err_out:
+	free(link);
+	free(buf.data);
+
+	return NULL;
+}
+
+void manifest_software(const struct ManifestParams *params, const size_t idx, struct EUPDInSoftware *sw)
+{
+	char name[MAX_NAME_LENGTH + 1];
+
+	memset(sw, 0, sizeof(struct EUPDInSoftware));
+
+	/* The name in the descriptor does not have to be zero-terminated */
+	make_name(idx, params->name_length, name);
+	memcpy(sw->name, name, strlen(name));
+	sw->version.major = 0;
+	sw->version.minor = 0;
+	sw->version.revision[0] = '\0';
+}
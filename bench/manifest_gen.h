@@ -0,0 +1,39 @@
+#ifndef ECHMET_UPD_BENCH_MANIFEST_GEN_H
+#define ECHMET_UPD_BENCH_MANIFEST_GEN_H
+
+#include <echmetupdatecheck.h>
+#include <stddef.h>
+
+/*!
+ * Shape of a generated list of updates
+ */
+struct ManifestParams {
+	size_t num_items;	/*!< Number of items in the "software" array */
+	size_t num_versions;	/*!< Number of versions of each item */
+	size_t name_length;	/*!< Length of software names, at most 32 */
+	size_t link_length;	/*!< Length of download links */
+	unsigned int seed;	/*!< Seed of the generator, equal seeds produce equal lists */
+};
+
+/*!
+ * Generates a list of updates formatted accordingly to \p format-description.txt
+ *
+ * @param[in] params Shape of the list
+ * @param[out] length Length of the generated text
+ *
+ * @return Zero-terminated JSON text that shall be freed with \p free(),
+ *         <tt>NULL</tt> if the parameters are invalid or there is not enough memory
+ */
+char * manifest_generate(const struct ManifestParams *params, size_t *length);
+
+/*!
+ * Writes the descriptor of software that corresponds to an item of a generated list.
+ * The checked version is older than the newest listed version.
+ *
+ * @param[in] params Shape of the list
+ * @param[in] idx Index of the item
+ * @param[out] sw The descriptor
+ */
+void manifest_software(const struct ManifestParams *params, const size_t idx, struct EUPDInSoftware *sw);
+
+#endif /* ECHMET_UPD_BENCH_MANIFEST_GEN_H */
@@ -0,0 +1,273 @@
+/*
+ * Stress test of concurrent update checks.
+ *
+ * Runs batches of update checks from an increasing number of threads
+ * against a generated list served by the in-tree loopback HTTP server
+ * and reports how the throughput scales with the number of threads.
+ * Each thread checks its own copy of the list so that every check fetches
+ * and parses the list; the test fails if the number of requests the server
+ * received does not grow with the number of threads. With --shared all
+ * threads check one list and concurrent checks share its downloads.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "../bench/loopback_server.h"
+#include "../bench/manifest_gen.h"
+
+#include <echmetupdatecheck.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#define MAX_THREADS 256
+
+struct ThreadCtx {
+	char url[64];
+	const struct ManifestParams *params;
+	size_t first_item;
+	unsigned long num_checks;
+	size_t failed;
+};
+
+static void * worker(void *arg)
+{
+	struct ThreadCtx *ctx = arg;
+	unsigned long idx;
+
+	for (idx = 0; idx < ctx->num_checks; idx++) {
+		struct EUPDInSoftware inSw;
+		struct EUPDResult result;
+		EUPDRetCode ret;
+
+		manifest_software(ctx->params, (ctx->first_item + idx) % ctx->params->num_items, &inSw);
+
+		ret = updater_check(ctx->url, &inSw, &result, 1);
+		if (EUPD_IS_ERROR(ret)) {
+			ctx->failed++;
+			continue;
+		}
+		if (result.status != EUST_UNKNOWN)
+			updater_free_result(&result);
+	}
+
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"Measures how update checks scale with the number of threads.\n"
+		"  --max-threads N    Largest number of threads, the runs double from 1 (default 64)\n"
+		"  --checks N         Checks performed by each thread (default 50)\n"
+		"  --items N          Number of items in the served list (default 1000)\n"
+		"  --latency MS       Delay of each response of the server (default 0)\n"
+		"  --shared           All threads check the same list and share its downloads\n"
+		"  --url URL          Check against URL instead of the loopback server\n",
+		name);
+}
+
+static int parse_ulong(const char *str, unsigned long *value)
+{
+	char *end;
+
+	*value = strtoul(str, &end, 10);
+
+	return (*str == '\0' || *end != '\0') ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	static pthread_t threads[MAX_THREADS];
+	static struct ThreadCtx ctxs[MAX_THREADS];
+	struct ManifestParams params;
+	struct LoopbackRoute route;
+	LoopbackServer *srv = NULL;
+	const char *url = NULL;
+	unsigned long max_threads = 64;
+	unsigned long num_checks = 50;
+	unsigned long num_threads;
+	unsigned long served = 0;
+	unsigned long last_downloads = 0;
+	double base_throughput = 0.0;
+	int shared = 0;
+	int ret = EXIT_SUCCESS;
+	int idx;
+
+	params.num_items = 1000;
+	params.num_versions = 8;
+	params.name_length = 16;
+	params.link_length = 64;
+	params.seed = 1;
+
+	memset(&route, 0, sizeof(struct LoopbackRoute));
+
+	for (idx = 1; idx < argc; idx++) {
+		const char *arg = argv[idx];
+		unsigned long value = 0;
+
+		if (strcmp(arg, "--shared") == 0) {
+			shared = 1;
+			continue;
+		}
+
+		if (idx + 1 >= argc) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		if (strcmp(arg, "--url") == 0) {
+			url = argv[++idx];
+			continue;
+		}
+
+		if (parse_ulong(argv[++idx], &value) != 0) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		if (strcmp(arg, "--max-threads") == 0 && value > 0 && value <= MAX_THREADS)
+			max_threads = value;
+		else if (strcmp(arg, "--checks") == 0 && value > 0)
+			num_checks = value;
+		else if (strcmp(arg, "--items") == 0 && value > 0)
+			params.num_items = value;
+		else if (strcmp(arg, "--latency") == 0)
+			route.latency_ms = value;
+		else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (url == NULL) {
+		char *body = manifest_generate(&params, &route.body_length);
+
+		if (body == NULL) {
+			printf("Failed to generate the list\n");
+			return EXIT_FAILURE;
+		}
+		route.body = body;
+
+		if (loopback_start(&srv, 0) != 0) {
+			printf("Failed to start the loopback server\n");
+			free(body);
+			return EXIT_FAILURE;
+		}
+
+		/* One route per thread keeps checks of different threads from sharing downloads */
+		for (num_threads = 0; num_threads < (shared ? 1 : max_threads); num_threads++) {
+			char path[32];
+
+			snprintf(path, sizeof(path), "/list-%lu.json", num_threads);
+			route.path = path;
+			if (loopback_add_route(srv, &route) != 0) {
+				printf("Failed to start the loopback server\n");
+				loopback_stop(srv);
+				free(body);
+				return EXIT_FAILURE;
+			}
+		}
+		free(body);
+	}
+
+	/* Measure the library itself, not a shared cache */
+	updater_set_cache_daemon(NULL);
+	updater_set_check_server(NULL);
+
+	if (EUPD_IS_ERROR(updater_global_init())) {
+		printf("Failed to initialize the library\n");
+		if (srv != NULL)
+			loopback_stop(srv);
+		return EXIT_FAILURE;
+	}
+
+	if (url != NULL)
+		printf("Checking %s, %lu checks per thread\n", url, num_checks);
+	else
+		printf("Checking %s on 127.0.0.1:%u, %lu checks per thread\n",
+		       shared ? "one list" : "a list per thread", loopback_port(srv), num_checks);
+
+	for (num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+		const size_t total = (size_t)num_threads * num_checks;
+		struct LoopbackCounters counters;
+		size_t failed = 0;
+		double start;
+		double elapsed;
+		double throughput;
+		unsigned long started;
+
+		start = now();
+		for (started = 0; started < num_threads; started++) {
+			if (url != NULL)
+				snprintf(ctxs[started].url, sizeof(ctxs[started].url), "%s", url);
+			else
+				snprintf(ctxs[started].url, sizeof(ctxs[started].url), "http://127.0.0.1:%u/list-%lu.json",
+					 loopback_port(srv), shared ? 0UL : started);
+			ctxs[started].params = &params;
+			ctxs[started].first_item = started * num_checks;
+			ctxs[started].num_checks = num_checks;
+			ctxs[started].failed = 0;
+			if (pthread_create(&threads[started], NULL, worker, &ctxs[started]) != 0) {
+				printf("Failed to start thread\n");
+				break;
+			}
+		}
+
+		for (idx = 0; (unsigned long)idx < started; idx++) {
+			pthread_join(threads[idx], NULL);
+			failed += ctxs[idx].failed;
+		}
+		elapsed = now() - start;
+
+		if (started < num_threads)
+			break;
+
+		throughput = total / elapsed;
+		if (num_threads == 1)
+			base_throughput = throughput;
+
+		printf("Threads: %3lu, checks: %6zu, failed: %zu, time: %.3f s, throughput: %8.1f checks/s, "
+		       "speedup: %5.2fx, efficiency: %3.0f %%, latency: %.3f ms",
+		       num_threads, total, failed, elapsed, throughput,
+		       throughput / base_throughput, 100.0 * throughput / base_throughput / num_threads,
+		       1000.0 * elapsed * num_threads / total);
+
+		if (srv != NULL) {
+			unsigned long downloads;
+
+			loopback_counters(srv, &counters);
+			downloads = counters.requests - served;
+			printf(", downloads: %lu", downloads);
+			served = counters.requests;
+
+			/* Without distinct lists the speedup would come from shared downloads */
+			if (!shared && downloads <= last_downloads) {
+				printf("\nDownloads did not grow with the number of threads\n");
+				ret = EXIT_FAILURE;
+				break;
+			}
+			last_downloads = downloads;
+		}
+		printf("\n");
+	}
+
+	updater_global_cleanup();
+
+	if (srv != NULL)
+		loopback_stop(srv);
+
+	return ret;
+}
@@ -94,6 +94,7 @@ typedef enum _EUPDRetCode {
 	EUPD_E_NO_MEMORY = 0x200,	/*!< Not enough memory to complete operation */
 	EUPD_E_MALFORMED_LIST,		/*!< Downloaded list of updates is malformed and cannot be parsed */
 	EUPD_E_INVALID_ARGUMENT,	/*!< Invalid argument was passed to function */
+	EUPD_E_LIMIT_EXCEEDED,		/*!< Downloaded list of updates exceeds the parse limits */
 	EUPD_E_CURL_SETUP = 0x300,	/*!< Unable to set CURL parameters */
 	EUPD_E_CANNOT_RESOLVE,		/*!< Cannot resolve remote host name */
 	EUPD_E_CONNECTION_FAILED,	/*!< Failed to connect to remote host */
@@ -148,6 +149,373 @@ struct EUPDResult {
 	char *link;			/*!< Download link to the lastest version */
 };
 
+/*!
+ * Result of update check that borrows its download link from a \p EUPDManifest.
+ *
+ * The link remains valid for as long as the caller holds a reference to the
+ * manifest snapshot that produced the result. The struct itself needs not be free'd.
+ */
+struct EUPDResultView {
+	EUPDUpdateStatus status;	/*!< Update status */
+	struct EUPDVersion version;	/*!< Latest available version */
+	const char *link;		/*!< Download link to the latest version. The string is zero-terminated.
+					     <tt>NULL</tt> if the status is \p EUST_UNKNOWN */
+	size_t link_length;		/*!< Length of the download link without the terminating zero */
+};
+
+/*!
+ * Timing and transfer statistics of an update check.
+ *
+ * Transfer times are measured from the start of the transfer
+ * to the completion of the given phase, as reported by libcurl.
+ */
+struct EUPDStats {
+	unsigned long long namelookup_ns;	/*!< Time until the remote host name was resolved */
+	unsigned long long connect_ns;		/*!< Time until the connection to the remote host was established */
+	unsigned long long appconnect_ns;	/*!< Time until the TLS handshake was completed. Zero for plain connections */
+	unsigned long long starttransfer_ns;	/*!< Time until the first byte of the response was received */
+	unsigned long long total_ns;		/*!< Total time of the transfer */
+	unsigned long long bytes_downloaded;	/*!< Number of bytes of the response body */
+	long redirects;				/*!< Number of redirects followed */
+	unsigned long long parse_ns;		/*!< Time spent parsing the list of updates */
+	unsigned long long compare_ns;		/*!< Time spent evaluating the checked software against the list */
+	int shared_fetch;			/*!< Non-zero if the list was fetched and parsed by another concurrent check.
+						     Transfer and parsing statistics are zero in such a case. */
+	unsigned long long transient_peak_bytes;	/*!< Peak of memory held only while the list was fetched and parsed,
+							     such as the download buffer and the JSON document */
+};
+
+/*!
+ * Memory held by a manifest snapshot, broken down by purpose.
+ *
+ * The figures are the sizes requested from the allocator and do not include
+ * the bookkeeping overhead of the allocator itself.
+ */
+struct EUPDMemoryUsage {
+	size_t items;		/*!< Records of software items */
+	size_t versions;	/*!< Records of versions of all items */
+	size_t links;		/*!< Download links including the terminating zeros */
+	size_t index;		/*!< Hash index of software names */
+	size_t metadata;	/*!< The snapshot itself, its URL and the validators of the list */
+	size_t total;		/*!< Sum of all of the above */
+	unsigned long long parse_peak;	/*!< Peak of memory held only while the list was fetched and parsed,
+					     such as the download buffer and the JSON document */
+};
+
+/*!
+ * Limits applied when a list of updates is downloaded and parsed.
+ *
+ * Lists that exceed any of the limits are rejected with \p EUPD_E_LIMIT_EXCEEDED
+ * as soon as the violation is detected. Zero disables the respective limit.
+ */
+struct EUPDParseLimits {
+	size_t max_bytes;		/*!< Maximum size of the list in bytes. The transfer is aborted once exceeded. */
+	size_t max_depth;		/*!< Maximum nesting depth of JSON arrays and objects. A valid list needs a depth of 5. */
+	size_t max_items;		/*!< Maximum number of software items in the list */
+	size_t max_versions;		/*!< Maximum number of versions of a single software item */
+	unsigned long max_parse_ms;	/*!< Maximum time spent parsing the list in milliseconds */
+};
+
+/*!
+ * Phases of an update check reported to the tracing callback.
+ */
+typedef enum _EUPDSpanKind {
+	EUPD_SPAN_FETCH,	/*!< Transfer of the list of updates. A check answered by the eupd_cached daemon
+				     or the eupd_server reports only this span, it covers the whole exchange. */
+	EUPD_SPAN_PARSE,	/*!< Parsing of the downloaded list */
+	EUPD_SPAN_INDEX_BUILD,	/*!< Building of the name index of a parsed list */
+	EUPD_SPAN_COMPARE,	/*!< Evaluation of the checked software against the list */
+	EUPD_SPAN_LINK,		/*!< Assignment of download links to the results */
+	EUPDSK__FORCE_INT32 = 0x7FFFFFF
+} EUPDSpanKind;
+
+/*!
+ * Span event reported to the tracing callback.
+ *
+ * Spans of one thread are strictly nested so that each end event
+ * belongs to the most recent unfinished begin event of the same thread.
+ */
+struct EUPDSpanEvent {
+	EUPDSpanKind kind;			/*!< Phase of the check */
+	int end;				/*!< Zero for the beginning of the span, non-zero for its end */
+	unsigned long long timestamp_ns;	/*!< Monotonic time of the event */
+	const char *url;			/*!< URL of the list of updates, <tt>NULL</tt> if not known in this phase */
+	unsigned long long bytes;		/*!< Size of the list in bytes. Set at the end of fetch and on both events of parse. */
+	size_t items;				/*!< Number of items processed. Set at the end of parse and on both events
+						     of index build, compare and link assignment. */
+	EUPDRetCode result;			/*!< Outcome of the phase, set at the end of the span */
+};
+
+/*!
+ * Tracing callback
+ *
+ * @param[in] event Span event. The event and the strings it points to are valid only during the call.
+ * @param[in] user_data Pointer passed to \p updater_set_trace_callback()
+ */
+typedef void (ECHMET_CC *EUPDTraceCallback)(const struct EUPDSpanEvent *event, void *user_data);
+
+/*!
+ * Allocation function of a custom allocator
+ *
+ * @param[in] size Number of bytes to allocate
+ * @param[in] user_data Pointer passed to \p updater_set_allocator()
+ *
+ * @return Pointer to the allocated memory, <tt>NULL</tt> on failure
+ */
+typedef void * (ECHMET_CC *EUPDMallocFunc)(size_t size, void *user_data);
+
+/*!
+ * Reallocation function of a custom allocator with the semantics of \p realloc()
+ *
+ * @param[in] ptr Memory to resize, may be <tt>NULL</tt>
+ * @param[in] size New size in bytes
+ * @param[in] user_data Pointer passed to \p updater_set_allocator()
+ *
+ * @return Pointer to the resized memory, <tt>NULL</tt> on failure
+ */
+typedef void * (ECHMET_CC *EUPDReallocFunc)(void *ptr, size_t size, void *user_data);
+
+/*!
+ * Deallocation function of a custom allocator
+ *
+ * @param[in] ptr Memory to free, never <tt>NULL</tt>
+ * @param[in] user_data Pointer passed to \p updater_set_allocator()
+ */
+typedef void (ECHMET_CC *EUPDFreeFunc)(void *ptr, void *user_data);
+
+/*!
+ * Receives a piece of the response body from a transport
+ *
+ * @param[in] data The piece of the body
+ * @param[in] length Length of the piece
+ * @param[in] context \p context of the request
+ *
+ * @return Zero to continue, non-zero if the transfer shall be aborted
+ */
+typedef int (ECHMET_CC *EUPDBodySink)(const char *data, size_t length, void *context);
+
+/*!
+ * Receives a header of the final response from a transport
+ *
+ * @param[in] name Zero-terminated name of the header without the colon
+ * @param[in] value Zero-terminated value of the header
+ * @param[in] context \p context of the request
+ */
+typedef void (ECHMET_CC *EUPDHeaderSink)(const char *name, const char *value, void *context);
+
+/*!
+ * Reports completion of an asynchronous transfer
+ *
+ * @param[in] result \p EUPD_OK if a response was received, network error code otherwise
+ * @param[in] status HTTP status code of the response
+ * @param[in] context \p context of the request
+ */
+typedef void (ECHMET_CC *EUPDTransferDone)(EUPDRetCode result, long status, void *context);
+
+/*!
+ * Request passed to a custom transport.
+ *
+ * The request and everything it points to remains valid until the transfer completes.
+ */
+struct EUPDTransportRequest {
+	const char *url;		/*!< URL to fetch */
+	const char *const *headers;	/*!< Request headers as zero-terminated <tt>Name: value</tt> lines */
+	size_t num_headers;		/*!< Number of request headers */
+	int allow_insecure;		/*!< Non-zero if plain HTTP and unverified TLS peers are acceptable */
+	EUPDBodySink body;		/*!< Shall be called with the response body */
+	EUPDHeaderSink header;		/*!< Shall be called with the headers of the final response */
+	EUPDTransferDone done;		/*!< Shall be called once when an asynchronous transfer completes */
+	void *context;			/*!< Passed to \p body, \p header and \p done */
+};
+
+/*!
+ * Custom transport used to fetch lists of updates instead of libcurl.
+ *
+ * At least one of the functions has to be set. Checks call \p fetch if it is set.
+ * Otherwise they start the transfer with \p fetch_async and wait for its completion.
+ * Either function may be called from several threads concurrently and the sinks
+ * may be called from any thread. Redirects shall be followed by the transport.
+ */
+struct EUPDTransport {
+	/*!
+	 * Performs the transfer synchronously
+	 *
+	 * @param[in] request The request
+	 * @param[out] status HTTP status code of the final response
+	 * @param[in] user_data \p user_data of the transport
+	 *
+	 * @return \p EUPD_OK if a response was received, network error code otherwise
+	 */
+	EUPDRetCode (ECHMET_CC *fetch)(const struct EUPDTransportRequest *request, long *status, void *user_data);
+
+	/*!
+	 * Starts the transfer. Completion of a started transfer shall be reported
+	 * through \p done of the request exactly once, possibly before this function returns.
+	 *
+	 * @param[in] request The request
+	 * @param[in] user_data \p user_data of the transport
+	 *
+	 * @return \p EUPD_OK if the transfer has been started, network error code otherwise
+	 */
+	EUPDRetCode (ECHMET_CC *fetch_async)(const struct EUPDTransportRequest *request, void *user_data);
+
+	void *user_data;	/*!< Arbitrary pointer passed to the functions */
+};
+
+/*!
+ * Immutable reference-counted snapshot of a parsed list of updates.
+ */
+typedef struct EUPDManifest EUPDManifest;
+
+/*!
+ * Callback invoked by \p updater_check_each() for each resolved software.
+ *
+ * @param[in] index Index of the software in the input array
+ * @param[in] result Result of the update check. The struct and the download link it
+ *                   refers to are valid only during the callback and shall not be free'd.
+ * @param[in] user_data Pointer passed to \p updater_check_each()
+ *
+ * @return Zero to continue with the next software, non-zero to stop
+ */
+typedef int (ECHMET_CC *EUPDResultCallback)(size_t index, const struct EUPDResult *result, void *user_data);
+
+/*!
+ * \brief Sets allocator used for all memory allocated by the library.
+ *
+ * The allocator is used by the library itself, by the JSON parser and by libcurl.
+ * The functions may be called from multiple threads concurrently.
+ * This function shall be called before any other function of the library.
+ * libcurl is set up with the allocator only if the application
+ * has not initialized libcurl on its own beforehand.
+ *
+ * @param[in] malloc_fn Allocation function
+ * @param[in] realloc_fn Reallocation function
+ * @param[in] free_fn Deallocation function
+ * @param[in] user_data Arbitrary pointer passed to the functions
+ *
+ * @return \p EUPD_OK on success, \p EUPD_E_INVALID_ARGUMENT if any of the functions is <tt>NULL</tt>
+ *         or if the library has already been initialized
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_set_allocator(EUPDMallocFunc malloc_fn, EUPDReallocFunc realloc_fn,
+						       EUPDFreeFunc free_fn, void *user_data);
+
+/*!
+ * \brief Sets transport used to fetch lists of updates.
+ *
+ * The transport replaces libcurl for all subsequent transfers, local files
+ * are still read directly. Responses with HTTP status 400 and above are treated
+ * as \p EUPD_E_HTTP_ERROR.
+ * This function shall not be called while any other function of the library is in progress.
+ *
+ * @param[in] transport The transport, <tt>NULL</tt> to restore the default libcurl transport.
+ *                      The struct is copied.
+ *
+ * @return \p EUPD_OK on success, \p EUPD_E_INVALID_ARGUMENT if neither of the transport functions is set
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_set_transport(const struct EUPDTransport *transport);
+
+/*!
+ * \brief Sets path to the socket of the \p eupd_cached daemon.
+ *
+ * \p updater_check() and \p updater_check_many() send the check to the daemon if
+ * its socket exists and is owned by the user the process runs as or by the superuser.
+ * The daemon keeps the fetched lists of updates for all processes of the host and
+ * revalidates them with the server as needed. If the daemon cannot be reached, the list
+ * is fetched directly. Local files and lists fetched through a custom transport are
+ * never checked by the daemon. The default path is taken from the \p EUPD_CACHED_SOCKET
+ * environment variable, <tt>/tmp/eupd-cached.sock</tt> is used if it is not set.
+ * The daemon is available on POSIX systems only.
+ * This function shall not be called while any other function of the library is in progress.
+ *
+ * @param[in] socket_path Path to the socket, <tt>NULL</tt> or empty string to never use the daemon
+ *
+ * @return \p EUPD_OK on success, \p EUPD_E_INVALID_ARGUMENT if the path is too long
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_set_cache_daemon(const char *socket_path);
+
+/*!
+ * \brief Sets URL of the check endpoint of an \p eupd_server.
+ *
+ * \p updater_check() and \p updater_check_many() post the descriptors of the checked
+ * software to the server which evaluates them against the list of updates it holds
+ * in memory and returns only the results. The list itself is not downloaded.
+ * The server is used only if the \p eupd_cached daemon is not available. If the server
+ * cannot be reached, does not serve the list or returns a malformed answer, the list
+ * is fetched directly. Local files and lists fetched through a custom transport are
+ * never checked by the server. Checks that do not allow insecure transfers use the server
+ * only if its URL is an HTTPS URL. The default URL is taken from the \p EUPD_CHECK_SERVER
+ * environment variable, no server is used if it is not set.
+ * This function shall not be called while any other function of the library is in progress.
+ *
+ * @param[in] server_url URL of the endpoint, e.g. <tt>https://updates.example.com/check</tt>.
+ *                       <tt>NULL</tt> or empty string to never use the server.
+ *
+ * @return \p EUPD_OK on success, \p EUPD_E_INVALID_ARGUMENT if the URL is too long
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_set_check_server(const char *server_url);
+
+/*!
+ * \brief Initializes global resources of the library.
+ *
+ * Calling this function is optional, the library initializes itself
+ * on first use. Applications that want to control when the initialization
+ * takes place may call this function before any other thread is started.
+ * The initialization is performed only once, further calls return the result
+ * of the first initialization.
+ *
+ * All other functions of the library are thread-safe and may be called
+ * concurrently from any number of threads.
+ *
+ * @return \p EUPD_OK on success, \p EUPD_E_CURL_SETUP if libcurl cannot be initialized
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_global_init(void);
+
+/*!
+ * \brief Releases global resources of the library.
+ *
+ * This function shall be called at most once when the library is no longer needed and
+ * no other thread is using it. The background refresher is stopped and all registrations
+ * made with \p updater_watch() are dropped. The library cannot be used after this function
+ * has been called.
+ */
+ECHMET_API void ECHMET_CC updater_global_cleanup(void);
+
+/*!
+ * Handle of software registered with the background refresher.
+ */
+typedef struct EUPDWatch EUPDWatch;
+
+/*!
+ * Queue of non-blocking update checks.
+ */
+typedef struct EUPDQueue EUPDQueue;
+
+/*!
+ * Completed check taken out of a \p EUPDQueue.
+ */
+struct EUPDCompletion {
+	void *user_data;		/*!< Pointer passed to \p updater_queue_submit() */
+	EUPDRetCode ret;		/*!< Result of the check with the same meaning as in \p updater_check_many() */
+	struct EUPDResult *results;	/*!< Results in the order of the submitted softwares, <tt>NULL</tt> on error.
+					     The array shall be free'd using \p updater_free_result_list(). */
+	size_t num_results;		/*!< Number of items in the \p results array */
+};
+
+/*!
+ * Callback invoked by the background refresher when the update status
+ * of a watched software changes.
+ *
+ * The callback is executed on the refresher thread and shall return quickly.
+ *
+ * @param[in] watch Handle of the watched software
+ * @param[in] result Current result of the update check. The struct and the download link it
+ *                   refers to are valid only during the callback and shall not be free'd.
+ *                   If the update status is \p EUST_UNKNOWN, fields \p version and \p link
+ *                   are undefined.
+ * @param[in] user_data Pointer passed to \p updater_watch()
+ */
+typedef void (ECHMET_CC *EUPDWatchCallback)(EUPDWatch *watch, const struct EUPDResult *result, void *user_data);
+
 /*!
  * \brief Checks update status of one software.
  *
@@ -156,6 +524,8 @@ struct EUPDResult {
  * the struct shall not be free'd.
  * If the update status in \p result is \p EUST_UNKNOWN, fields \p version
  * and \p link are undefined. Freeing the struct is possible but unnecessary.
+ * If \p url points to an index of a sharded list, only the shard that
+ * contains the software is fetched.
  *
  * @param[in] url URL of updates list file
  * @param[in] in_software Descriptor of the software to check
@@ -178,6 +548,8 @@ ECHMET_API EUPDRetCode ECHMET_CC updater_check(const char *url, const struct EUP
  * and \p link are undefined for that software.
  * If function at least partially succeeds, \p results shall be free'd using
  * \p updater_free_result_list().
+ * If \p url points to an index of a sharded list, the shards that contain
+ * the softwares are fetched concurrently.
  *
  * @param[in] url URL of updates list file
  * @param[in] in_software_list Array of descriptors of software to check
@@ -196,6 +568,417 @@ ECHMET_API EUPDRetCode ECHMET_CC updater_check_many(const char *url, const struc
 						    const size_t num_software, struct EUPDResult **results, size_t *num_results,
 						    const int allow_insecure);
 
+/*!
+ * \brief Checks update status of one software against a list of updates supplied by the caller.
+ *
+ * Behaves like \p updater_check() but the list is parsed from memory.
+ * Nothing is downloaded and libcurl is not initialized.
+ *
+ * @param[in] data Content of the list of updates. The content does not have to be zero-terminated.
+ * @param[in] length Length of the content in bytes
+ * @param[in] in_software Descriptor of the software to check
+ * @param[out] result Result of update check
+ *
+ * @return \p EUPD_OK if check was performed successfully, appropriate warning or error otherwise
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_check_buffer(const void *data, const size_t length,
+						      const struct EUPDInSoftware *in_software, struct EUPDResult *result);
+
+/*!
+ * \brief Checks update status of multiple softwares against a list of updates supplied by the caller.
+ *
+ * Behaves like \p updater_check_many() but the list is parsed from memory.
+ * Nothing is downloaded and libcurl is not initialized.
+ *
+ * @param[in] data Content of the list of updates. The content does not have to be zero-terminated.
+ * @param[in] length Length of the content in bytes
+ * @param[in] in_software_list Array of descriptors of software to check
+ * @param[in] num_software Length of the in_software_list array
+ * @param[out] results Pointer to the array of results. The array shall be free'd using
+ *                     \p updater_free_result_list(). Value of \p results is defined only if
+ *                     this function does not return an error.
+ * @param[out] num_results Number of items if the \p results array
+ *
+ * @return \p EUPD_OK if check was performed successfully, appropriate warning or error otherwise
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_check_many_buffer(const void *data, const size_t length,
+							   const struct EUPDInSoftware *in_software_list, const size_t num_software,
+							   struct EUPDResult **results, size_t *num_results);
+
+/*!
+ * \brief Checks update status of multiple softwares and returns the results as a single block.
+ *
+ * Behaves like \p updater_check_many() but the array of results and all download links
+ * are laid out in one allocation. Results that refer to the same item of the updates list
+ * share the same link string.
+ * If function at least partially succeeds, \p results shall be free'd using
+ * \p updater_free_result_block(). Neither \p updater_free_result() nor
+ * \p updater_free_result_list() may be used on the block or any of its items.
+ *
+ * Indexes of sharded lists are not supported.
+ *
+ * @param[in] url URL of updates list file
+ * @param[in] in_software_list Array of descriptors of software to check
+ * @param[in] num_software Length of the in_software_list array
+ * @param[out] results Pointer to the block of results. The array will have the same ordering as
+ *                     as \p in_software_list array. Value of \p results is defined only if
+ *                     this function does not return an error.
+ * @param[out] num_results Number of items if the \p results array.
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors. This is dangerous and shall not be used
+ *                           in production.
+ *
+ * @return \p EUPD_OK if check was performed successfully, appropriate warning or error otherwise
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_check_many_block(const char *url, const struct EUPDInSoftware *in_software_list,
+							  const size_t num_software, struct EUPDResult **results, size_t *num_results,
+							  const int allow_insecure);
+
+/*!
+ * \brief Checks update status of multiple softwares and reports the results through a callback.
+ *
+ * The callback is invoked as soon as each software is resolved, in the order given by
+ * \p in_software_list. No result array is allocated.
+ * If the update status of a software is EUST_UNKNOWN, fields \p version
+ * and \p link of the result are undefined.
+ * Indexes of sharded lists are not supported.
+ *
+ * @param[in] url URL of updates list file
+ * @param[in] in_software_list Array of descriptors of software to check
+ * @param[in] num_software Length of the in_software_list array
+ * @param[in] callback Function to call for each result
+ * @param[in] user_data Pointer passed to \p callback
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors. This is dangerous and shall not be used
+ *                           in production.
+ *
+ * @return \p EUPD_OK if check was performed successfully, appropriate warning or error otherwise.
+ *         Stopping the check from the callback is not considered an error.
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_check_each(const char *url, const struct EUPDInSoftware *in_software_list,
+						    const size_t num_software, EUPDResultCallback callback, void *user_data,
+						    const int allow_insecure);
+
+/*!
+ * \brief Fetches and parses list of updates into an immutable snapshot.
+ *
+ * The snapshot can answer any number of queries through \p updater_manifest_check()
+ * without fetching the list again. The caller holds one reference to the snapshot and
+ * shall release it with \p updater_manifest_unref().
+ *
+ * @param[in] url URL of updates list file
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors. This is dangerous and shall not be used
+ *                           in production.
+ * @param[out] manifest Pointer to the snapshot. Value of \p manifest is defined only if this function
+ *                      does not return an error.
+ *
+ * @return \p EUPD_OK if the list was fetched and parsed, \p EUPD_W_LIST_INCOMPLETE if the list
+ *         was parsed only partially, appropriate error otherwise
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_manifest_fetch(const char *url, const int allow_insecure, EUPDManifest **manifest);
+
+/*!
+ * \brief Fetches the current version of a manifest snapshot.
+ *
+ * The list of updates is fetched again from the URL the snapshot was created from.
+ * If the server supports conditional requests and confirms that the list has not changed,
+ * nothing is downloaded nor parsed and \p refreshed is set to a new reference to \p manifest.
+ * Otherwise \p refreshed is set to a new snapshot. In both cases the caller shall
+ * release \p refreshed with \p updater_manifest_unref(). The original snapshot
+ * is not modified and the caller keeps its reference to it.
+ * If the snapshot has an ETag, the server may respond with a patch of the list instead
+ * of the whole list. The patch is applied to a copy of the snapshot without parsing
+ * the unchanged items again. The whole list is fetched if the patch does not match the snapshot.
+ *
+ * @param[in] manifest Snapshot to refresh
+ * @param[out] refreshed Current snapshot of the list. Value of \p refreshed is defined only if
+ *                       this function does not return an error.
+ *
+ * @return \p EUPD_OK if the list was fetched and parsed, \p EUPD_W_LIST_INCOMPLETE if the list
+ *         was parsed only partially, appropriate error otherwise
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_manifest_refresh(EUPDManifest *manifest, EUPDManifest **refreshed);
+
+/*!
+ * \brief Checks update status of multiple softwares against a manifest snapshot.
+ *
+ * No memory is allocated by this function. Download links in \p views point into
+ * the snapshot and stay valid until the reference to the snapshot is released.
+ * Snapshots of indexes of sharded lists shall be checked with \p updater_manifest_check_shards().
+ *
+ * @param[in] manifest Snapshot of the list of updates
+ * @param[in] in_software_list Array of descriptors of software to check
+ * @param[in] num_software Length of the in_software_list array
+ * @param[out] views Caller-allocated array of \p num_software results. The array will have the
+ *                   same ordering as \p in_software_list array.
+ *
+ * @return \p EUPD_OK if check was performed successfully, appropriate warning or error otherwise
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_manifest_check(const EUPDManifest *manifest,
+							const struct EUPDInSoftware *in_software_list,
+							const size_t num_software, struct EUPDResultView *views);
+
+/*!
+ * \brief Checks update status of multiple softwares against the shards of a sharded list.
+ *
+ * Behaves like \p updater_check_many() with the index of the list taken from
+ * the snapshot instead of being fetched again. Only the shards that contain
+ * the softwares are fetched.
+ *
+ * @param[in] index Snapshot of the index of a sharded list
+ * @param[in] in_software_list Array of descriptors of software to check
+ * @param[in] num_software Length of the in_software_list array
+ * @param[out] results Pointer to the array of results. The array shall be free'd using
+ *                     \p updater_free_result_list(). Value of \p results is defined only if
+ *                     this function does not return an error.
+ * @param[out] num_results Number of items if the \p results array
+ *
+ * @return \p EUPD_OK if check was performed successfully, appropriate warning or error otherwise.
+ *         \p EUPD_E_INVALID_ARGUMENT if \p index is not an index of a sharded list.
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_manifest_check_shards(const EUPDManifest *index,
+							       const struct EUPDInSoftware *in_software_list,
+							       const size_t num_software, struct EUPDResult **results,
+							       size_t *num_results);
+
+/*!
+ * Acquires an additional reference to a manifest snapshot.
+ *
+ * @param[in] manifest Snapshot to reference
+ *
+ * @return The same snapshot
+ */
+ECHMET_API EUPDManifest * ECHMET_CC updater_manifest_ref(EUPDManifest *manifest);
+
+/*!
+ * Releases a reference to a manifest snapshot. The snapshot is free'd
+ * when the last reference is released.
+ *
+ * @param[in] manifest Snapshot to release. May be <tt>NULL</tt>.
+ */
+ECHMET_API void ECHMET_CC updater_manifest_unref(EUPDManifest *manifest);
+
+/*!
+ * \brief Reports memory held by a manifest snapshot.
+ *
+ * The report can be used to size caches of snapshots. The memory is
+ * shared by all references to the snapshot.
+ *
+ * @param[in] manifest The snapshot
+ * @param[out] usage Memory held by the snapshot
+ *
+ * @return \p EUPD_OK on success, \p EUPD_E_INVALID_ARGUMENT if any of the arguments is <tt>NULL</tt>
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_manifest_memory(const EUPDManifest *manifest, struct EUPDMemoryUsage *usage);
+
+/*!
+ * \brief Tells whether a manifest snapshot is an index of a sharded list.
+ *
+ * Snapshots of indexes cannot be checked with \p updater_manifest_check(),
+ * they have to be checked with \p updater_manifest_check_shards().
+ *
+ * @param[in] manifest The snapshot
+ *
+ * @return Non-zero if the snapshot is an index of a sharded list, zero if it is not or if \p manifest is <tt>NULL</tt>
+ */
+ECHMET_API int ECHMET_CC updater_manifest_is_index(const EUPDManifest *manifest);
+
+/*!
+ * \brief Registers software whose update status shall be checked periodically.
+ *
+ * All registered software is checked by one background thread that is started
+ * on demand. The list of updates is fetched once for all software registered with the same URL
+ * and conditional requests are used to avoid downloading an unchanged list again.
+ * The callback is invoked when the first check completes and then only when the
+ * update status or the latest available version changes. Failed checks do not invoke the callback.
+ *
+ * @param[in] url URL of updates list file
+ * @param[in] in_software Descriptor of the software to watch
+ * @param[in] interval Refresh interval in seconds. Shall be greater than zero.
+ * @param[in] jitter Maximum random delay in seconds added to each refresh interval
+ * @param[in] callback Function to call when the update status changes
+ * @param[in] user_data Pointer passed to \p callback
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors. This is dangerous and shall not be used
+ *                           in production.
+ * @param[out] watch Handle of the registration. Value of \p watch is defined only if this function
+ *                   does not return an error.
+ *
+ * @return \p EUPD_OK on success, appropriate error otherwise
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_watch(const char *url, const struct EUPDInSoftware *in_software,
+					       const unsigned int interval, const unsigned int jitter,
+					       EUPDWatchCallback callback, void *user_data, const int allow_insecure,
+					       EUPDWatch **watch);
+
+/*!
+ * \brief Returns the most recent snapshot of the list of updates of watched software.
+ *
+ * The snapshot is normally taken without any locking and the function does not wait for
+ * a refresh in progress to download or parse the list. Only when more than 128 threads take
+ * a snapshot at the same moment are the excess ones serialized with a short lock.
+ * A refresh replaces the snapshot atomically; readers that already hold
+ * a snapshot keep a consistent view of the list until they release it.
+ * The snapshot can be queried with \p updater_manifest_check() and shall be released
+ * with \p updater_manifest_unref().
+ *
+ * @param[in] watch Handle of the registration
+ * @param[out] manifest Pointer to the snapshot
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_W_NOT_FOUND No list of updates has been fetched for the watch yet.
+ *                          \p manifest is not set.
+ * @retval EUPD_E_INVALID_ARGUMENT Invalid handle
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_watch_snapshot(EUPDWatch *watch, EUPDManifest **manifest);
+
+/*!
+ * \brief Unregisters software from the background refresher.
+ *
+ * Once this function returns, the callback of the registration will not be invoked again.
+ * The function may be called from within the callback itself.
+ *
+ * @param[in] watch Handle of the registration
+ */
+ECHMET_API void ECHMET_CC updater_unwatch(EUPDWatch *watch);
+
+/*!
+ * \brief Creates a queue of non-blocking update checks.
+ *
+ * Checks submitted to the queue are performed by one thread owned by the queue.
+ * The thread multiplexes all downloads of the queue and never waits for any single one,
+ * so any number of checks can be in flight at once. Checks of the same list submitted while
+ * the list is being downloaded share the download and the parsed list.
+ * Completed checks are taken out with \p updater_queue_collect(). Applications with an event loop
+ * can watch the descriptor returned by \p updater_queue_fd() to learn when to do so.
+ *
+ * Shards of a sharded list and lists fetched by the synchronous function of a custom
+ * transport are downloaded by the thread of the queue one at a time.
+ *
+ * @param[out] queue The queue. Shall be freed with \p updater_queue_free().
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory or the thread cannot be started
+ * @retval EUPD_E_CURL_SETUP libcurl cannot be initialized and no custom transport is set
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_queue_new(EUPDQueue **queue);
+
+/*!
+ * \brief Returns a descriptor that becomes readable when a queue has completed checks.
+ *
+ * The descriptor stays readable until all completed checks are collected. It shall only be
+ * polled for readability and shall not be read from or closed by the application.
+ *
+ * @param[in] queue The queue
+ *
+ * @return The descriptor. -1 on Windows where completed checks have to be collected periodically.
+ */
+ECHMET_API int ECHMET_CC updater_queue_fd(const EUPDQueue *queue);
+
+/*!
+ * \brief Submits a check of multiple softwares to a queue.
+ *
+ * The function does not block. The result of the check is reported as a \p EUPDCompletion
+ * with the same \p user_data. If the function returns an error, no completion is reported.
+ *
+ * @param[in] queue The queue
+ * @param[in] url URL of updates list file
+ * @param[in] in_software_list Array of descriptors of software to check. The array is copied and
+ *                             need not be kept after the function returns.
+ * @param[in] num_software Length of the in_software_list array
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors. This is dangerous and shall not be used
+ *                           in production.
+ * @param[in] user_data Pointer reported with the completion of the check
+ *
+ * @retval EUPD_OK The check was submitted
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to submit the check
+ * @retval EUPD_E_INVALID_ARGUMENT Invalid URL or software descriptor
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_queue_submit(EUPDQueue *queue, const char *url,
+						      const struct EUPDInSoftware *in_software_list,
+						      const size_t num_software, const int allow_insecure,
+						      void *user_data);
+
+/*!
+ * \brief Takes completed checks out of a queue.
+ *
+ * The function does not block. Checks are reported in the order of their completion.
+ *
+ * @param[in] queue The queue
+ * @param[out] completions Caller-allocated array of completions
+ * @param[in] max_completions Length of the \p completions array
+ *
+ * @return Number of completions stored in \p completions
+ */
+ECHMET_API size_t ECHMET_CC updater_queue_collect(EUPDQueue *queue, struct EUPDCompletion *completions,
+						  const size_t max_completions);
+
+/*!
+ * \brief Frees a queue.
+ *
+ * Checks that have not completed are abandoned and completed checks that
+ * have not been collected are discarded. The function waits for transfers
+ * of an asynchronous custom transport to complete as they cannot be cancelled.
+ *
+ * @param[in] queue The queue. May be <tt>NULL</tt>.
+ */
+ECHMET_API void ECHMET_CC updater_queue_free(EUPDQueue *queue);
+
+/*!
+ * \brief Returns statistics of the last check performed by the calling thread.
+ *
+ * Statistics are kept separately for each thread and are reset by every call of
+ * \p updater_check(), \p updater_check_many(), \p updater_check_many_block(),
+ * \p updater_check_each(), \p updater_check_buffer(), \p updater_check_many_buffer(),
+ * \p updater_manifest_fetch(), \p updater_manifest_refresh(), \p updater_manifest_check()
+ * and \p updater_manifest_check_shards(). Phases that were not performed by the last call are zero.
+ *
+ * @param[out] stats Statistics of the last check
+ */
+ECHMET_API void ECHMET_CC updater_last_stats(struct EUPDStats *stats);
+
+/*!
+ * \brief Registers a tracing callback.
+ *
+ * The callback receives begin and end events of spans covering the phases of every check.
+ * It is called synchronously from the thread that performs the check and may be called
+ * from several threads concurrently. Without a registered callback the tracing points
+ * cost one branch each.
+ * The callback may be replaced at any time, including while the background refresher
+ * is running. Spans that are already in progress report their end to the callback they
+ * started with, so the previous callback and its \p user_data shall stay valid until
+ * all checks that were running when it was replaced have finished.
+ *
+ * @param[in] callback The callback, <tt>NULL</tt> to disable tracing
+ * @param[in] user_data Arbitrary pointer passed to the callback
+ */
+ECHMET_API void ECHMET_CC updater_set_trace_callback(EUPDTraceCallback callback, void *user_data);
+
+/*!
+ * \brief Sets limits that protect the library against oversized or pathological lists of updates.
+ *
+ * The limits apply to all subsequent checks. No limits are applied by default.
+ * Only the size limit is enforced when no other limit is set so that parsing
+ * of well-formed lists is not slowed down.
+ * The limits may be replaced at any time. Each transfer and each parse takes a copy
+ * of the limits when it starts and is not affected by later changes.
+ *
+ * @param[in] limits The limits, <tt>NULL</tt> to remove all limits
+ */
+ECHMET_API void ECHMET_CC updater_set_parse_limits(const struct EUPDParseLimits *limits);
+
+/*!
+ * \brief Renders cumulative metrics of the library in Prometheus text exposition format.
+ *
+ * The metrics cover all checks performed by all threads since the library was loaded.
+ * They include the number of checks by return code, number of bytes fetched, lists
+ * served without parsing, conditional requests answered with 304 Not Modified,
+ * histograms of parse and transfer times and memory held by parsed lists.
+ *
+ * @param[out] text Zero-terminated text of the exposition. The text shall be freed
+ *                  with \p updater_free_string().
+ *
+ * @return \p EUPD_OK on success, \p EUPD_E_NO_MEMORY if the text cannot be rendered
+ */
+ECHMET_API EUPDRetCode ECHMET_CC updater_metrics_dump(char **text);
+
 /*!
  * Converts \p EUPDRetCode to string representation.
  *
@@ -220,6 +1003,20 @@ ECHMET_API void ECHMET_CC updater_free_result(struct EUPDResult *result);
  */
 ECHMET_API void ECHMET_CC updater_free_result_list(struct EUPDResult *results, const size_t num_results);
 
+/*!
+ * Frees block of results returned by \p updater_check_many_block().
+ *
+ * @param[in] results Block to free
+ */
+ECHMET_API void ECHMET_CC updater_free_result_block(struct EUPDResult *results);
+
+/*!
+ * Frees a string returned by the library.
+ *
+ * @param[in] str String to free
+ */
+ECHMET_API void ECHMET_CC updater_free_string(char *str);
+
 /*!
  * Converts \p EUPDUpdateStatus to string representation.
  *
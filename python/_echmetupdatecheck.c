@@ -0,0 +1,326 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <echmetupdatecheck.h>
+
+#include <limits.h>
+#include <string.h>
+
+/*!
+ * Reads an integer that may be stored either as a Python integer
+ * or as a ctypes integer that carries its value in the \p value attribute
+ *
+ * @param[in] obj Object with the integer attribute
+ * @param[in] attr Name of the attribute
+ * @param[out] value The integer
+ *
+ * @return Zero on success, -1 with a Python exception set otherwise
+ */
+static
+int get_int(PyObject *obj, const char *attr, int *value)
+{
+	PyObject *item;
+	long l;
+
+	item = PyObject_GetAttrString(obj, attr);
+	if (item == NULL)
+		return -1;
+
+	if (!PyLong_Check(item)) {
+		PyObject *inner = PyObject_GetAttrString(item, "value");
+		Py_DECREF(item);
+		if (inner == NULL)
+			return -1;
+		item = inner;
+	}
+
+	l = PyLong_AsLong(item);
+	Py_DECREF(item);
+	if (l == -1 && PyErr_Occurred())
+		return -1;
+	if (l < INT_MIN || l > INT_MAX) {
+		PyErr_SetString(PyExc_OverflowError, "Version number does not fit into int");
+		return -1;
+	}
+
+	*value = (int)l;
+
+	return 0;
+}
+
+/*!
+ * Copies a bytes attribute into a fixed-size buffer that needs not be zero-terminated
+ *
+ * @param[in] obj Object with the attribute
+ * @param[in] attr Name of the attribute
+ * @param[out] dst The buffer. It is expected to be zeroed.
+ * @param[in] dst_size Size of the buffer
+ *
+ * @return Zero on success, -1 with a Python exception set otherwise
+ */
+static
+int get_bytes(PyObject *obj, const char *attr, char *dst, const size_t dst_size)
+{
+	PyObject *item;
+	char *data;
+	Py_ssize_t length;
+
+	item = PyObject_GetAttrString(obj, attr);
+	if (item == NULL)
+		return -1;
+
+	if (PyBytes_AsStringAndSize(item, &data, &length) != 0) {
+		Py_DECREF(item);
+		return -1;
+	}
+	if ((size_t)length > dst_size) {
+		Py_DECREF(item);
+		PyErr_Format(PyExc_ValueError, "Attribute '%s' is too long", attr);
+		return -1;
+	}
+
+	memcpy(dst, data, (size_t)length);
+	Py_DECREF(item);
+
+	return 0;
+}
+
+/*!
+ * Fills a software descriptor from a <tt>ECHMETUpdateCheck.Software</tt> object
+ *
+ * @param[in] software The Python object
+ * @param[out] in_sw The descriptor. It is expected to be zeroed.
+ *
+ * @return Zero on success, -1 with a Python exception set otherwise
+ */
+static
+int to_insoftware(PyObject *software, struct EUPDInSoftware *in_sw)
+{
+	PyObject *version;
+	int ret;
+
+	if (get_bytes(software, "name", in_sw->name, sizeof(in_sw->name)) != 0)
+		return -1;
+
+	version = PyObject_GetAttrString(software, "version");
+	if (version == NULL)
+		return -1;
+
+	ret = -1;
+	if (get_int(version, "major", &in_sw->version.major) != 0)
+		goto out;
+	if (get_int(version, "minor", &in_sw->version.minor) != 0)
+		goto out;
+	if (get_bytes(version, "revision", in_sw->version.revision, sizeof(in_sw->version.revision)) != 0)
+		goto out;
+
+	ret = 0;
+
+out:
+	Py_DECREF(version);
+
+	return ret;
+}
+
+/*!
+ * Converts a result of update check to a Python tuple
+ *
+ * @param[in] result The result
+ *
+ * @return <tt>(status, major, minor, revision, link)</tt> tuple, <tt>None</tt> if the status
+ *         is unknown or <tt>NULL</tt> with a Python exception set
+ */
+static
+PyObject * from_result(const struct EUPDResult *result)
+{
+	if (result->status == EUST_UNKNOWN)
+		Py_RETURN_NONE;
+
+	return Py_BuildValue("(iiiy#s)",
+			     (int)result->status,
+			     result->version.major,
+			     result->version.minor,
+			     result->version.revision, (Py_ssize_t)strnlen(result->version.revision, sizeof(result->version.revision)),
+			     result->link != NULL ? result->link : "");
+}
+
+PyDoc_STRVAR(check_doc,
+"check(url, software, allow_insecure) -> (ret, result)\n\n"
+"Checks update status of one software. result is None on error or if the status\n"
+"is unknown, (status, major, minor, revision, link) tuple otherwise.");
+
+static
+PyObject * native_check(PyObject *self, PyObject *args)
+{
+	const char *url;
+	PyObject *software;
+	int allow_insecure;
+	struct EUPDInSoftware in_sw;
+	struct EUPDResult result;
+	EUPDRetCode tRet;
+	PyObject *py_result;
+
+	(void)self;
+
+	if (!PyArg_ParseTuple(args, "sOp", &url, &software, &allow_insecure))
+		return NULL;
+
+	memset(&in_sw, 0, sizeof(struct EUPDInSoftware));
+	if (to_insoftware(software, &in_sw) != 0)
+		return NULL;
+
+	/* Fetching and parsing may take seconds, let other Python threads run */
+	Py_BEGIN_ALLOW_THREADS
+	tRet = updater_check(url, &in_sw, &result, allow_insecure);
+	Py_END_ALLOW_THREADS
+
+	if (EUPD_IS_ERROR(tRet))
+		return Py_BuildValue("(iO)", (int)tRet, Py_None);
+
+	py_result = from_result(&result);
+	updater_free_result(&result);
+	if (py_result == NULL)
+		return NULL;
+
+	return Py_BuildValue("(iN)", (int)tRet, py_result);
+}
+
+PyDoc_STRVAR(check_many_doc,
+"check_many(url, software_list, allow_insecure) -> (ret, results)\n\n"
+"Checks update status of multiple softwares. results is None on error, list with\n"
+"one item per checked software otherwise. Items are None if the status is unknown,\n"
+"(status, major, minor, revision, link) tuples otherwise.");
+
+static
+PyObject * native_check_many(PyObject *self, PyObject *args)
+{
+	const char *url;
+	PyObject *software_list;
+	PyObject *seq;
+	int allow_insecure;
+	struct EUPDInSoftware *in_list;
+	struct EUPDResult *results;
+	size_t num_results;
+	Py_ssize_t num_software;
+	Py_ssize_t idx;
+	EUPDRetCode tRet;
+	PyObject *py_results = NULL;
+
+	(void)self;
+
+	if (!PyArg_ParseTuple(args, "sOp", &url, &software_list, &allow_insecure))
+		return NULL;
+
+	seq = PySequence_Fast(software_list, "software_list must be a sequence");
+	if (seq == NULL)
+		return NULL;
+
+	num_software = PySequence_Fast_GET_SIZE(seq);
+	in_list = PyMem_Calloc(num_software > 0 ? (size_t)num_software : 1, sizeof(struct EUPDInSoftware));
+	if (in_list == NULL) {
+		Py_DECREF(seq);
+		return PyErr_NoMemory();
+	}
+
+	for (idx = 0; idx < num_software; idx++) {
+		if (to_insoftware(PySequence_Fast_GET_ITEM(seq, idx), &in_list[idx]) != 0)
+			goto out;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	tRet = updater_check_many(url, in_list, (size_t)num_software, &results, &num_results, allow_insecure);
+	Py_END_ALLOW_THREADS
+
+	if (EUPD_IS_ERROR(tRet)) {
+		py_results = Py_BuildValue("(iO)", (int)tRet, Py_None);
+		goto out;
+	}
+
+	{
+		PyObject *list = PyList_New((Py_ssize_t)num_results);
+		size_t rdx;
+
+		if (list == NULL) {
+			updater_free_result_list(results, num_results);
+			goto out;
+		}
+
+		for (rdx = 0; rdx < num_results; rdx++) {
+			PyObject *item = from_result(&results[rdx]);
+			if (item == NULL) {
+				Py_DECREF(list);
+				updater_free_result_list(results, num_results);
+				goto out;
+			}
+			PyList_SET_ITEM(list, (Py_ssize_t)rdx, item);
+		}
+		updater_free_result_list(results, num_results);
+
+		py_results = Py_BuildValue("(iN)", (int)tRet, list);
+	}
+
+out:
+	PyMem_Free(in_list);
+	Py_DECREF(seq);
+
+	return py_results;
+}
+
+PyDoc_STRVAR(error_to_str_doc,
+"error_to_str(err) -> str\n\n"
+"Translates return code to string representation.");
+
+static
+PyObject * native_error_to_str(PyObject *self, PyObject *args)
+{
+	int err;
+
+	(void)self;
+
+	if (!PyArg_ParseTuple(args, "i", &err))
+		return NULL;
+
+	return PyUnicode_FromString(updater_error_to_str((EUPDRetCode)err));
+}
+
+PyDoc_STRVAR(status_to_str_doc,
+"status_to_str(stat) -> str\n\n"
+"Translates update status to string representation.");
+
+static
+PyObject * native_status_to_str(PyObject *self, PyObject *args)
+{
+	int stat;
+
+	(void)self;
+
+	if (!PyArg_ParseTuple(args, "i", &stat))
+		return NULL;
+
+	return PyUnicode_FromString(updater_status_to_str((EUPDUpdateStatus)stat));
+}
+
+static PyMethodDef native_methods[] = {
+	{ "check", native_check, METH_VARARGS, check_doc },
+	{ "check_many", native_check_many, METH_VARARGS, check_many_doc },
+	{ "error_to_str", native_error_to_str, METH_VARARGS, error_to_str_doc },
+	{ "status_to_str", native_status_to_str, METH_VARARGS, status_to_str_doc },
+	{ NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef native_module = {
+	PyModuleDef_HEAD_INIT,
+	"_echmetupdatecheck",
+	"Native fast path of the echmetupdatecheck module",
+	-1,
+	native_methods,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+PyMODINIT_FUNC PyInit__echmetupdatecheck(void)
+{
+	return PyModule_Create(&native_module);
+}
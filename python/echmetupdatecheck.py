@@ -1,6 +1,13 @@
-from ctypes import byref, c_int, c_char, c_char_p, Structure, CDLL, POINTER
+from ctypes import byref, c_int, c_char, c_char_p, c_size_t, c_void_p, \
+                   Structure, CDLL, POINTER
+import asyncio
 import enum
 
+try:
+    import _echmetupdatecheck
+except ImportError:
+    _echmetupdatecheck = None
+
 
 LIB_EUPD_OK = 0
 LIB_EUPD_W_LIST_INCOMPLETE = 0x100
@@ -41,6 +48,13 @@ class LIB_RESULT(Structure):
                 ('link', c_char_p)]
 
 
+class LIB_COMPLETION(Structure):
+    _fields_ = [('user_data', c_void_p),
+                ('ret', c_int),
+                ('results', POINTER(LIB_RESULT)),
+                ('num_results', c_size_t)]
+
+
 class ECHMETUpdateCheck:
     """Wrapper around `libECHMETUpdateCheck` library
     """
@@ -103,6 +117,24 @@ class ECHMETUpdateCheck:
                                                           'too long')
             self.revision = asc
 
+        @classmethod
+        def from_native(cls, major, minor, revision):
+            """Creates :obj:Version from values reported by the library
+            without validating them again.
+
+            Args:
+                major (int): Major version number.
+                minor (int): Minor version number.
+                revision (bytes): Revision string.
+            """
+
+            ver = cls.__new__(cls)
+            ver.major = c_int(major)
+            ver.minor = c_int(minor)
+            ver.revision = revision
+
+            return ver
+
         def __str__(self):
             return 'Major: {0}, Minor: {1}, Revision: {2}'.format(
                     self.major.value,
@@ -160,16 +192,27 @@ class ECHMETUpdateCheck:
                     'Download link: {2}').format(
                         self.status, self.version, self.link)
 
-    def __init__(self, path):
+    def __init__(self, path, native=True):
         """:obj:ECHMETUpdateCheck constructor.
 
+        If the compiled `_echmetupdatecheck` extension module is available,
+        checks are performed through it and `path` is not loaded. The extension
+        is linked against the library it was built with. Otherwise the library
+        is loaded from `path` through ctypes.
+
         Args:
             path (str): Path to the `libECHMETUpdateCheck` library.
+            native (bool): Use the compiled extension module if it is available.
 
         Raises:
             AttributeError: Required symbol was not found in the library.
         """
 
+        self.native = _echmetupdatecheck if native else None
+        if self.native is not None:
+            self.lib_obj = None
+            return
+
         self.lib_obj = CDLL(path)
 
         self.lib_obj.updater_error_to_str.restype = c_char_p
@@ -262,6 +305,25 @@ class ECHMETUpdateCheck:
         raise ECHMETUpdateCheck.InvalidOutputError('Unknown value of '
                                                    'update status')
 
+    def native_to_usr_result(self, res):
+        """Converts a result reported by the extension module to :obj:Result.
+
+        Args:
+            res: ``None`` if the status is unknown, tuple of status, major,
+                 minor, revision and link otherwise.
+
+        Returns:
+            :obj:Result of the update check.
+        """
+
+        if res is None:
+            return self.Result(self.UpdateState.UNKNOWN, None, '')
+
+        status, major, minor, revision, link = res
+        return self.Result(self.lib_to_usr_status(status),
+                           self.Version.from_native(major, minor, revision),
+                           link)
+
     def check(self, url, software, allow_insecure):
         """Checks if there is an update available for given software.
 
@@ -280,6 +342,13 @@ class ECHMETUpdateCheck:
                 the value is set to ``None``
         """
 
+        if self.native is not None:
+            ret, res = self.native.check(url, software, allow_insecure)
+            if self.internal_is_error(ret):
+                return (False, ret, None)
+
+            return (True, ret, self.native_to_usr_result(res))
+
         in_sw = LIB_INSOFTWARE()
         in_sw.name = software.name
         in_sw.version.major = software.version.major
@@ -328,18 +397,25 @@ class ECHMETUpdateCheck:
 
         """
 
+        if self.native is not None:
+            ret, raw_results = self.native.check_many(url, software_list,
+                                                      allow_insecure)
+            if self.internal_is_error(ret):
+                return (False, ret, None)
+
+            results_out = []
+            for idx, raw_res in enumerate(raw_results):
+                res = self.native_to_usr_result(raw_res)
+                if raw_res is not None:
+                    res = (software_list[idx].name.decode('ASCII'), res)
+                results_out.append(res)
+
+            return (True, ret, results_out)
+
         num_software = len(software_list)
 
-        INSWLIST_TYPE = LIB_INSOFTWARE * num_software
         RESULTS_TYPE = POINTER(LIB_RESULT)
-        in_sw_list = INSWLIST_TYPE()
-
-        for idx in range(0, num_software):
-            in_sw = in_sw_list[idx]
-            in_sw.name = software_list[idx].name
-            in_sw.version.major = software_list[idx].version.major
-            in_sw.version.minor = software_list[idx].version.minor
-            in_sw.version.revision = software_list[idx].version.revision
+        in_sw_list = self.make_lib_software_list(software_list)
 
         results = RESULTS_TYPE()
         num_results = c_int(0)
@@ -354,8 +430,53 @@ class ECHMETUpdateCheck:
         if self.internal_is_error(ret):
             return (False, ret, None)
 
+        results_out = self.lib_to_usr_results(results, num_results.value,
+                                              software_list)
+
+        self.lib_obj.updater_free_result_list(results, num_results)
+
+        return (True, ret, results_out)
+
+    @staticmethod
+    def make_lib_software_list(software_list):
+        """Converts softwares to an array that can be passed to the library.
+
+        Args:
+            software_list (:obj:Software): Array of softwares.
+
+        Returns:
+            ctypes array of `LIB_INSOFTWARE`.
+        """
+
+        num_software = len(software_list)
+
+        INSWLIST_TYPE = LIB_INSOFTWARE * num_software
+        in_sw_list = INSWLIST_TYPE()
+
+        for idx in range(0, num_software):
+            in_sw = in_sw_list[idx]
+            in_sw.name = software_list[idx].name
+            in_sw.version.major = software_list[idx].version.major
+            in_sw.version.minor = software_list[idx].version.minor
+            in_sw.version.revision = software_list[idx].version.revision
+
+        return in_sw_list
+
+    def lib_to_usr_results(self, results, num_results, software_list):
+        """Converts results reported by the library to the output
+        of :obj:check_many.
+
+        Args:
+            results: Pointer to the array of `LIB_RESULT`.
+            num_results (int): Number of items in the array.
+            software_list (:obj:Software): Array of checked softwares.
+
+        Returns:
+            Array of results as returned by :obj:check_many.
+        """
+
         results_out = []
-        for idx in range(0, num_results.value):
+        for idx in range(0, num_results):
             raw_res = results[idx]
             res = None
 
@@ -372,9 +493,7 @@ class ECHMETUpdateCheck:
                        )
             results_out.append(res)
 
-        self.lib_obj.updater_free_result_list(results, num_results)
-
-        return (True, ret, results_out)
+        return results_out
 
     def error_to_str(self, err):
         """Translates ECHMETUpdateCheck return code to string representation.
@@ -386,6 +505,9 @@ class ECHMETUpdateCheck:
             String representation of the return code
         """
 
+        if self.native is not None:
+            return self.native.error_to_str(err)
+
         return self.lib_obj.updater_error_to_str(err).decode('ASCII')
 
     def status_to_str(self, stat):
@@ -398,4 +520,195 @@ class ECHMETUpdateCheck:
             String representation of the update status
         """
 
+        if self.native is not None:
+            return self.native.status_to_str(stat)
+
         return self.lib_obj.updater_status_to_str(stat).decode('ASCII')
+
+
+class ECHMETUpdateCheckAsync:
+    """asyncio interface to `libECHMETUpdateCheck` library.
+
+    Checks are submitted to a queue of the library that performs all
+    downloads on one thread of its own without blocking the event loop.
+    The loop is notified of completed checks through a file descriptor.
+    Results have the same form as those of :obj:ECHMETUpdateCheck.
+    """
+
+    # Number of completions taken out of the queue at once
+    COLLECT_BATCH = 64
+
+    # Interval of collecting completions on platforms without a pollable descriptor
+    POLL_INTERVAL = 0.05
+
+    def __init__(self, path):
+        """:obj:ECHMETUpdateCheckAsync constructor.
+
+        Args:
+            path (str): Path to the `libECHMETUpdateCheck` library.
+
+        Raises:
+            AttributeError: Required symbol was not found in the library.
+            RuntimeError: The queue of checks cannot be created.
+        """
+
+        self.updater = ECHMETUpdateCheck(path, native=False)
+        self.lib_obj = self.updater.lib_obj
+
+        for sym in ('updater_queue_new', 'updater_queue_fd',
+                    'updater_queue_submit', 'updater_queue_collect',
+                    'updater_queue_free'):
+            if not hasattr(self.lib_obj, sym):
+                raise AttributeError('undefined symbol: ' + sym)
+
+        self.lib_obj.updater_queue_fd.restype = c_int
+        self.lib_obj.updater_queue_submit.argtypes = [c_void_p, c_char_p,
+                                                      POINTER(LIB_INSOFTWARE),
+                                                      c_size_t, c_int, c_void_p]
+        self.lib_obj.updater_queue_collect.restype = c_size_t
+        self.lib_obj.updater_queue_collect.argtypes = [c_void_p,
+                                                       POINTER(LIB_COMPLETION),
+                                                       c_size_t]
+        self.lib_obj.updater_queue_free.argtypes = [c_void_p]
+
+        self.queue = c_void_p()
+        ret = self.lib_obj.updater_queue_new(byref(self.queue))
+        if ECHMETUpdateCheck.internal_is_error(ret):
+            raise RuntimeError('Cannot create queue of checks: ' +
+                               self.updater.error_to_str(ret))
+
+        self.fd = self.lib_obj.updater_queue_fd(self.queue)
+        self.completions = (LIB_COMPLETION * self.COLLECT_BATCH)()
+        self.pending = {}
+        self.next_token = 1
+        self.loop = None
+        self.poll_handle = None
+
+    def close(self):
+        """Frees the queue of checks. Checks that have not completed yet
+        are cancelled.
+        """
+
+        if self.queue is None:
+            return
+
+        if self.loop is not None and self.fd >= 0:
+            self.loop.remove_reader(self.fd)
+        if self.poll_handle is not None:
+            self.poll_handle.cancel()
+
+        self.lib_obj.updater_queue_free(self.queue)
+        self.queue = None
+
+        for fut, _ in self.pending.values():
+            if not fut.done():
+                fut.cancel()
+        self.pending.clear()
+
+    def internal_attach(self):
+        """Registers the queue with the running event loop.
+        """
+
+        loop = asyncio.get_running_loop()
+        if self.loop is loop:
+            return
+        if self.loop is not None:
+            raise RuntimeError('Checks of one queue cannot be awaited '
+                               'from multiple event loops')
+
+        self.loop = loop
+        if self.fd >= 0:
+            loop.add_reader(self.fd, self.internal_collect)
+
+    def internal_schedule_poll(self):
+        if self.fd < 0 and self.poll_handle is None and self.pending:
+            self.poll_handle = self.loop.call_later(self.POLL_INTERVAL,
+                                                    self.internal_poll)
+
+    def internal_poll(self):
+        self.poll_handle = None
+        self.internal_collect()
+        self.internal_schedule_poll()
+
+    def internal_collect(self):
+        """Resolves futures of all completed checks.
+        """
+
+        while self.queue is not None:
+            num = self.lib_obj.updater_queue_collect(self.queue,
+                                                     self.completions,
+                                                     self.COLLECT_BATCH)
+            for idx in range(0, num):
+                compl = self.completions[idx]
+                fut, software_list = self.pending.pop(compl.user_data)
+
+                if ECHMETUpdateCheck.internal_is_error(compl.ret):
+                    out = (False, compl.ret, None)
+                else:
+                    out = (True, compl.ret,
+                           self.updater.lib_to_usr_results(compl.results,
+                                                           compl.num_results,
+                                                           software_list))
+                    self.lib_obj.updater_free_result_list(
+                        compl.results, c_size_t(compl.num_results))
+
+                if not fut.done():
+                    fut.set_result(out)
+
+            if num < self.COLLECT_BATCH:
+                break
+
+    async def check_many(self, url, software_list, allow_insecure):
+        """Checks if there are updates available for multiple softwares.
+
+        Args and return value are the same as of
+        :obj:ECHMETUpdateCheck.check_many.
+        """
+
+        if self.queue is None:
+            raise RuntimeError('The queue of checks has been closed')
+
+        self.internal_attach()
+
+        token = self.next_token
+        self.next_token += 1
+
+        in_sw_list = ECHMETUpdateCheck.make_lib_software_list(software_list)
+        ret = self.lib_obj.updater_queue_submit(self.queue,
+                                                url.encode('ASCII'),
+                                                in_sw_list,
+                                                len(software_list),
+                                                c_int(allow_insecure),
+                                                c_void_p(token))
+        if ECHMETUpdateCheck.internal_is_error(ret):
+            return (False, ret, None)
+
+        fut = self.loop.create_future()
+        self.pending[token] = (fut, software_list)
+        self.internal_schedule_poll()
+
+        return await fut
+
+    async def check(self, url, software, allow_insecure):
+        """Checks if there is an update available for given software.
+
+        Args and return value are the same as of
+        :obj:ECHMETUpdateCheck.check.
+        """
+
+        ok, ret, results = await self.check_many(url, [software],
+                                                 allow_insecure)
+        if not ok:
+            return (False, ret, None)
+
+        res = results[0]
+        if isinstance(res, tuple):
+            res = res[1]
+
+        return (True, ret, res)
+
+    def error_to_str(self, err):
+        """Translates ECHMETUpdateCheck return code to string representation.
+        """
+
+        return self.updater.error_to_str(err)
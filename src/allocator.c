@@ -0,0 +1,101 @@
+#include "allocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static
+void * ECHMET_CC std_malloc(size_t size, void *user_data)
+{
+	(void)user_data;
+
+	return malloc(size);
+}
+
+static
+void * ECHMET_CC std_realloc(void *ptr, size_t size, void *user_data)
+{
+	(void)user_data;
+
+	return realloc(ptr, size);
+}
+
+static
+void ECHMET_CC std_free(void *ptr, void *user_data)
+{
+	(void)user_data;
+
+	free(ptr);
+}
+
+static EUPDMallocFunc malloc_hook = std_malloc;
+static EUPDReallocFunc realloc_hook = std_realloc;
+static EUPDFreeFunc free_hook = std_free;
+static void *hook_data = NULL;
+static int frozen = 0;
+
+void * mem_calloc(size_t num, size_t size)
+{
+	void *ptr;
+
+	if (size != 0 && num > ((size_t)-1) / size)
+		return NULL;
+
+	ptr = malloc_hook(num * size, hook_data);
+	if (ptr != NULL)
+		memset(ptr, 0, num * size);
+
+	return ptr;
+}
+
+void mem_freeze(void)
+{
+	frozen = 1;
+}
+
+void mem_free(void *ptr)
+{
+	if (ptr != NULL)
+		free_hook(ptr, hook_data);
+}
+
+int mem_is_custom(void)
+{
+	return malloc_hook != std_malloc;
+}
+
+void * mem_malloc(size_t size)
+{
+	return malloc_hook(size, hook_data);
+}
+
+void * mem_realloc(void *ptr, size_t size)
+{
+	return realloc_hook(ptr, size, hook_data);
+}
+
+EUPDRetCode mem_set_allocator(EUPDMallocFunc malloc_fn, EUPDReallocFunc realloc_fn, EUPDFreeFunc free_fn,
+			      void *user_data)
+{
+	if (frozen)
+		return EUPD_E_INVALID_ARGUMENT;
+	if (malloc_fn == NULL || realloc_fn == NULL || free_fn == NULL)
+		return EUPD_E_INVALID_ARGUMENT;
+
+	malloc_hook = malloc_fn;
+	realloc_hook = realloc_fn;
+	free_hook = free_fn;
+	hook_data = user_data;
+
+	return EUPD_OK;
+}
+
+char * mem_strdup(const char *str)
+{
+	const size_t len = strlen(str);
+	char *copy = mem_malloc(len + 1);
+
+	if (copy != NULL)
+		memcpy(copy, str, len + 1);
+
+	return copy;
+}
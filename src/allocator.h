@@ -0,0 +1,93 @@
+#ifndef ECHMET_UPD_ALLOCATOR_H
+#define ECHMET_UPD_ALLOCATOR_H
+
+#include <echmetupdatecheck.h>
+#include <stddef.h>
+
+/*
+ * All memory used by the library is allocated through these functions
+ * so that the application may substitute its own allocator.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Allocates zero-initialized array
+ *
+ * @param[in] num Number of elements
+ * @param[in] size Size of one element
+ *
+ * @return Pointer to the memory or <tt>NULL</tt> on failure
+ */
+void * mem_calloc(size_t num, size_t size);
+
+/*!
+ * Prevents any further changes of the allocator. Shall be called once
+ * the first allocation that may outlive the call is about to be made.
+ */
+void mem_freeze(void);
+
+/*!
+ * Frees memory
+ *
+ * @param[in] ptr Memory to free, may be <tt>NULL</tt>
+ */
+void mem_free(void *ptr);
+
+/*!
+ * Checks whether the application has set its own allocator
+ *
+ * @retval 1 Custom allocator is set
+ * @retval 0 Standard C library allocator is used
+ */
+int mem_is_custom(void);
+
+/*!
+ * Allocates memory
+ *
+ * @param[in] size Number of bytes
+ *
+ * @return Pointer to the memory or <tt>NULL</tt> on failure
+ */
+void * mem_malloc(size_t size);
+
+/*!
+ * Resizes memory
+ *
+ * @param[in] ptr Memory to resize, may be <tt>NULL</tt>
+ * @param[in] size New size in bytes
+ *
+ * @return Pointer to the resized memory or <tt>NULL</tt> on failure
+ */
+void * mem_realloc(void *ptr, size_t size);
+
+/*!
+ * Sets the allocator
+ *
+ * @param[in] malloc_fn Allocation function
+ * @param[in] realloc_fn Reallocation function
+ * @param[in] free_fn Deallocation function
+ * @param[in] user_data Pointer passed to the functions
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_INVALID_ARGUMENT A function is missing or the allocator has been frozen
+ */
+EUPDRetCode mem_set_allocator(EUPDMallocFunc malloc_fn, EUPDReallocFunc realloc_fn, EUPDFreeFunc free_fn,
+			      void *user_data);
+
+/*!
+ * Duplicates a string
+ *
+ * @param[in] str String to duplicate
+ *
+ * @return The copy or <tt>NULL</tt> on failure
+ */
+char * mem_strdup(const char *str);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_ALLOCATOR_H */
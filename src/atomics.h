@@ -0,0 +1,152 @@
+#ifndef ECHMET_UPD_ATOMICS_H
+#define ECHMET_UPD_ATOMICS_H
+
+#include "echmetupdatecheck_p.h"
+
+#if defined ECHMET_COMPILER_GCC_LIKE || defined ECHMET_COMPILER_MINGW || defined ECHMET_COMPILER_MSYS
+	#define ATOMIC_GCC_BUILTINS
+#elif defined ECHMET_COMPILER_MSVC
+	#include <intrin.h>
+#else
+	#error "Unsupported or misdetected compiler"
+#endif /* ECHMET_COMPILER_* */
+
+/*!
+ * Atomically increments a reference counter.
+ *
+ * @param[in,out] cnt Counter to increment
+ */
+static inline
+void atomic_ref_inc(volatile long *cnt)
+{
+#ifdef ATOMIC_GCC_BUILTINS
+	__atomic_add_fetch(cnt, 1, __ATOMIC_RELAXED);
+#else
+	_InterlockedIncrement(cnt);
+#endif /* ATOMIC_GCC_BUILTINS */
+}
+
+/*!
+ * Atomically decrements a reference counter.
+ *
+ * @param[in,out] cnt Counter to decrement
+ *
+ * @return Value of the counter after the decrement
+ */
+static inline
+long atomic_ref_dec(volatile long *cnt)
+{
+#ifdef ATOMIC_GCC_BUILTINS
+	return __atomic_sub_fetch(cnt, 1, __ATOMIC_ACQ_REL);
+#else
+	return _InterlockedDecrement(cnt);
+#endif /* ATOMIC_GCC_BUILTINS */
+}
+
+/*!
+ * Atomically adds to a statistical counter. Relaxed, the counter
+ * does not order any other memory access.
+ *
+ * @param[in,out] cnt Counter to modify
+ * @param[in] value Value to add
+ */
+static inline
+void atomic_counter_add(volatile long long *cnt, const long long value)
+{
+#ifdef ATOMIC_GCC_BUILTINS
+	__atomic_add_fetch(cnt, value, __ATOMIC_RELAXED);
+#else
+	InterlockedExchangeAdd64(cnt, value);
+#endif /* ATOMIC_GCC_BUILTINS */
+}
+
+/*!
+ * Atomically reads a statistical counter. Relaxed.
+ *
+ * @param[in] cnt Counter to read
+ *
+ * @return Value of the counter
+ */
+static inline
+long long atomic_counter_load(volatile long long *cnt)
+{
+#ifdef ATOMIC_GCC_BUILTINS
+	return __atomic_load_n(cnt, __ATOMIC_RELAXED);
+#else
+	return InterlockedCompareExchange64(cnt, 0, 0);
+#endif /* ATOMIC_GCC_BUILTINS */
+}
+
+/*!
+ * Atomically compares a pointer with an expected value and replaces it
+ * if they are equal. Sequentially consistent.
+ *
+ * @param[in,out] ptr Pointer to modify
+ * @param[in] expected Expected current value
+ * @param[in] desired New value
+ *
+ * @retval 1 Pointer was replaced
+ * @retval 0 Pointer did not have the expected value
+ */
+static inline
+int atomic_ptr_cas(void * volatile *ptr, void *expected, void *desired)
+{
+#ifdef ATOMIC_GCC_BUILTINS
+	return __atomic_compare_exchange_n(ptr, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#else
+	return _InterlockedCompareExchangePointer(ptr, desired, expected) == expected;
+#endif /* ATOMIC_GCC_BUILTINS */
+}
+
+/*!
+ * Atomically replaces a pointer. Sequentially consistent.
+ *
+ * @param[in,out] ptr Pointer to modify
+ * @param[in] desired New value
+ *
+ * @return Previous value of the pointer
+ */
+static inline
+void * atomic_ptr_exchange(void * volatile *ptr, void *desired)
+{
+#ifdef ATOMIC_GCC_BUILTINS
+	return __atomic_exchange_n(ptr, desired, __ATOMIC_SEQ_CST);
+#else
+	return _InterlockedExchangePointer(ptr, desired);
+#endif /* ATOMIC_GCC_BUILTINS */
+}
+
+/*!
+ * Atomically loads a pointer. Sequentially consistent.
+ *
+ * @param[in] ptr Pointer to load
+ *
+ * @return Value of the pointer
+ */
+static inline
+void * atomic_ptr_load(void * volatile *ptr)
+{
+#ifdef ATOMIC_GCC_BUILTINS
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+#else
+	return _InterlockedCompareExchangePointer(ptr, NULL, NULL);
+#endif /* ATOMIC_GCC_BUILTINS */
+}
+
+/*!
+ * Atomically stores a pointer. Sequentially consistent.
+ *
+ * @param[out] ptr Pointer to store to
+ * @param[in] value Value to store
+ */
+static inline
+void atomic_ptr_store(void * volatile *ptr, void *value)
+{
+#ifdef ATOMIC_GCC_BUILTINS
+	__atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+#else
+	_InterlockedExchangePointer(ptr, value);
+#endif /* ATOMIC_GCC_BUILTINS */
+}
+
+#endif /* ECHMET_UPD_ATOMICS_H */
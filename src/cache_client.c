@@ -0,0 +1,337 @@
+#ifndef _WIN32
+	#define _POSIX_C_SOURCE 200809L
+#endif /* _WIN32 */
+
+#include "cache_client.h"
+#include "allocator.h"
+#include "check_protocol.h"
+#include "threading.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ECHMET_PLATFORM_UNIX
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <stdint.h>
+	#include <sys/socket.h>
+	#include <sys/stat.h>
+	#include <sys/time.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+
+	#ifdef MSG_NOSIGNAL
+		#define SEND_FLAGS MSG_NOSIGNAL
+	#else
+		#define SEND_FLAGS 0
+	#endif /* MSG_NOSIGNAL */
+
+	#define MAX_SOCKET_PATH STRUCT_MEM_SZ(struct sockaddr_un, sun_path)
+#else
+	#define MAX_SOCKET_PATH 108
+#endif /* ECHMET_PLATFORM_UNIX */
+
+/* The daemon may need to fetch the list, allow for the timeouts of the transfer */
+#define CACHE_CLIENT_TIMEOUT_S 30
+
+static OnceFlag init_flag = ONCE_FLAG_INIT;
+static char socket_path[MAX_SOCKET_PATH];
+
+static
+void init_socket_path(void)
+{
+	const char *path = getenv(CACHE_SOCKET_ENV);
+
+	if (path == NULL)
+		path = CACHE_DEFAULT_SOCKET;
+	if (strlen(path) < MAX_SOCKET_PATH)
+		strcpy(socket_path, path);
+}
+
+EUPDRetCode cache_client_set_socket(const char *path)
+{
+	thread_once(&init_flag, init_socket_path);
+
+	if (path == NULL) {
+		socket_path[0] = '\0';
+		return EUPD_OK;
+	}
+
+	if (strlen(path) >= MAX_SOCKET_PATH)
+		return EUPD_E_INVALID_ARGUMENT;
+
+	strcpy(socket_path, path);
+
+	return EUPD_OK;
+}
+
+#ifdef ECHMET_PLATFORM_UNIX
+
+static OnceFlag key_flag = ONCE_FLAG_INIT;
+static ThreadKey connection_key;
+static int key_ok;
+
+/* Each thread keeps its connection to the daemon open between checks.
+ * The descriptor is stored incremented by one so that zero means no connection. */
+static THREAD_LOCAL int connection;
+static THREAD_LOCAL pid_t connection_pid;
+
+static
+void THREAD_KEY_CC close_connection(void *value)
+{
+	close((int)(intptr_t)value - 1);
+}
+
+static
+void init_key(void)
+{
+	key_ok = thread_key_create(&connection_key, close_connection) == 0;
+}
+
+static
+void drop_connection(void)
+{
+	close(connection - 1);
+	connection = 0;
+	thread_key_set(connection_key, NULL);
+}
+
+/*!
+ * Checks that the socket of the daemon exists and that it has been
+ * created by a user whose answers can be trusted
+ *
+ * @return Non-zero if the socket can be used
+ */
+static
+int socket_trusted(void)
+{
+	struct stat st;
+
+	if (lstat(socket_path, &st) != 0)
+		return 0;
+
+	return S_ISSOCK(st.st_mode) && (st.st_uid == geteuid() || st.st_uid == 0);
+}
+
+/*!
+ * Returns connection of the calling thread to the daemon, connecting if necessary
+ *
+ * @param[out] reused Set to non-zero if the connection has been used before
+ *
+ * @return The descriptor, -1 if the daemon is not available
+ */
+static
+int get_connection(int *reused)
+{
+	struct sockaddr_un addr;
+	struct timeval tv;
+	int fd;
+
+	*reused = 0;
+
+	if (connection != 0) {
+		if (connection_pid == getpid()) {
+			*reused = 1;
+			return connection - 1;
+		}
+
+		/* The connection has been inherited from the parent process */
+		close(connection - 1);
+		connection = 0;
+	}
+
+	thread_once(&key_flag, init_key);
+	if (!key_ok || !socket_trusted())
+		return -1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+#ifdef SO_NOSIGPIPE
+	{
+		const int on = 1;
+		setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+	}
+#endif /* SO_NOSIGPIPE */
+
+	tv.tv_sec = CACHE_CLIENT_TIMEOUT_S;
+	tv.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	memset(&addr, 0, sizeof(struct sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socket_path);
+
+	if (connect(fd, (const struct sockaddr *)&addr, sizeof(struct sockaddr_un)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	if (thread_key_set(connection_key, (void *)(intptr_t)(fd + 1)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	connection = fd + 1;
+	connection_pid = getpid();
+
+	return fd;
+}
+
+static
+int write_all(const int fd, const char *data, size_t length)
+{
+	while (length > 0) {
+		const ssize_t sent = send(fd, data, length, SEND_FLAGS);
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		data += sent;
+		length -= (size_t)sent;
+	}
+
+	return 0;
+}
+
+/*!
+ * Reads exactly \p length bytes
+ *
+ * @return Zero on success, -1 on error or premature end of the stream
+ */
+static
+int read_all(const int fd, char *data, size_t length)
+{
+	while (length > 0) {
+		const ssize_t got = recv(fd, data, length, 0);
+		if (got < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		} else if (got == 0)
+			return -1;
+
+		data += got;
+		length -= (size_t)got;
+	}
+
+	return 0;
+}
+
+/*!
+ * Sends a request over an established connection and reads the response
+ *
+ * @return Zero if the response has been received, -1 on failure of the connection
+ *         or malformed response
+ */
+static
+int exchange(const int fd, const char *req, const size_t req_length, const size_t num_software,
+	     struct EUPDResult **results, EUPDRetCode *tRet, uint32_t *outcome)
+{
+	char hdr_data[PROTOCOL_RESPONSE_HEADER_SIZE];
+	struct ProtocolResponse hdr;
+	char *payload;
+	int ret;
+
+	if (write_all(fd, req, req_length) != 0)
+		return -1;
+	if (read_all(fd, hdr_data, PROTOCOL_RESPONSE_HEADER_SIZE) != 0)
+		return -1;
+
+	if (protocol_decode_response(hdr_data, &hdr) != 0)
+		return -1;
+	if (EUPD_IS_ERROR(hdr.ret)) {
+		*tRet = hdr.ret;
+		*outcome = hdr.outcome;
+		return 0;
+	}
+	if (hdr.num_results != num_software)
+		return -1;
+
+	payload = mem_malloc(hdr.payload_length > 0 ? hdr.payload_length : 1);
+	if (payload == NULL)
+		return -1;
+
+	ret = -1;
+	if (read_all(fd, payload, hdr.payload_length) != 0)
+		goto out;
+	if (protocol_decode_results(payload, hdr.payload_length, num_software, results) != 0)
+		goto out;
+
+	*tRet = hdr.ret;
+	*outcome = hdr.outcome;
+	ret = 0;
+
+out:
+	mem_free(payload);
+
+	return ret;
+}
+
+int cache_client_check(const char *url, const struct EUPDInSoftware *in_software_list, const size_t num_software,
+		       const int allow_insecure, struct EUPDResult **results, EUPDRetCode *tRet, uint32_t *outcome)
+{
+	const size_t url_length = strlen(url);
+	char *req;
+	size_t req_length;
+	int reused;
+	int fd;
+	int ret;
+
+	thread_once(&init_flag, init_socket_path);
+
+	if (socket_path[0] == '\0' || url_length > PROTOCOL_MAX_URL_LENGTH ||
+	    num_software > PROTOCOL_MAX_SOFTWARE)
+		return 0;
+
+	fd = get_connection(&reused);
+	if (fd < 0)
+		return 0;
+
+	req = protocol_encode_request(url, url_length, in_software_list, num_software, allow_insecure, &req_length);
+	if (req == NULL)
+		return 0;
+
+	ret = exchange(fd, req, req_length, num_software, results, tRet, outcome);
+	if (ret != 0) {
+		drop_connection();
+
+		/* The daemon closes idle connections and may have been restarted, try once more */
+		if (reused) {
+			fd = get_connection(&reused);
+			if (fd >= 0) {
+				ret = exchange(fd, req, req_length, num_software, results, tRet, outcome);
+				if (ret != 0)
+					drop_connection();
+			}
+		}
+	}
+
+	mem_free(req);
+
+	return ret == 0;
+}
+
+#elif defined ECHMET_PLATFORM_WIN32
+
+int cache_client_check(const char *url, const struct EUPDInSoftware *in_software_list, const size_t num_software,
+		       const int allow_insecure, struct EUPDResult **results, EUPDRetCode *tRet, uint32_t *outcome)
+{
+	(void)url;
+	(void)in_software_list;
+	(void)num_software;
+	(void)allow_insecure;
+	(void)results;
+	(void)tRet;
+	(void)outcome;
+
+	/* The daemon is available on POSIX systems only */
+	return 0;
+}
+
+#endif /* ECHMET_PLATFORM */
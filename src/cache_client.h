@@ -0,0 +1,52 @@
+#ifndef ECHMET_UPD_CACHE_CLIENT_H
+#define ECHMET_UPD_CACHE_CLIENT_H
+
+#include "echmetupdatecheck_p.h"
+
+#include <echmetupdatecheck.h>
+#include <stdint.h>
+
+#define CACHE_SOCKET_ENV "EUPD_CACHED_SOCKET"
+#define CACHE_DEFAULT_SOCKET "/tmp/eupd-cached.sock"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Checks update status of multiple softwares through the eupd_cached daemon.
+ *
+ * The daemon is used only if its socket exists and is owned either by the user
+ * the process runs as or by the superuser. Any failure to talk to the daemon
+ * makes the caller fall back to checking on its own.
+ *
+ * @param[in] url URL of the list of updates
+ * @param[in] in_software_list Array of validated descriptors of software to check
+ * @param[in] num_software Length of the in_software_list array
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[out] results Array of results allocated with \p mem_calloc(). Set only if the daemon
+ *                     answered and \p tRet is not an error.
+ * @param[out] tRet Result of the check performed by the daemon
+ * @param[out] outcome How the daemon obtained the list, one of \p PROTOCOL_OUTCOME_ values
+ *
+ * @return Non-zero if the daemon answered, zero if the check shall be performed directly
+ */
+int cache_client_check(const char *url, const struct EUPDInSoftware *in_software_list, const size_t num_software,
+		       const int allow_insecure, struct EUPDResult **results, EUPDRetCode *tRet, uint32_t *outcome);
+
+/*!
+ * Sets path to the socket of the eupd_cached daemon. The default path is taken from
+ * the \p EUPD_CACHED_SOCKET environment variable if it is set.
+ *
+ * @param[in] path The path, <tt>NULL</tt> or empty string to stop using the daemon
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_INVALID_ARGUMENT The path is too long to be used as an address of a socket
+ */
+EUPDRetCode cache_client_set_socket(const char *path);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_CACHE_CLIENT_H */
@@ -0,0 +1,240 @@
+#include "check_protocol.h"
+#include "allocator.h"
+
+#include <string.h>
+
+static
+void put_u16(char *p, const uint16_t v)
+{
+	p[0] = (char)(v & 0xFF);
+	p[1] = (char)(v >> 8);
+}
+
+static
+void put_u32(char *p, const uint32_t v)
+{
+	p[0] = (char)(v & 0xFF);
+	p[1] = (char)((v >> 8) & 0xFF);
+	p[2] = (char)((v >> 16) & 0xFF);
+	p[3] = (char)(v >> 24);
+}
+
+static
+uint16_t get_u16(const char *p)
+{
+	const unsigned char *u = (const unsigned char *)p;
+
+	return (uint16_t)(u[0] | (u[1] << 8));
+}
+
+static
+uint32_t get_u32(const char *p)
+{
+	const unsigned char *u = (const unsigned char *)p;
+
+	return (uint32_t)u[0] | ((uint32_t)u[1] << 8) | ((uint32_t)u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+static
+int32_t get_i32(const char *p)
+{
+	const uint32_t v = get_u32(p);
+
+	/* Avoids implementation-defined conversion of values above INT32_MAX */
+	return v <= 0x7FFFFFFFU ? (int32_t)v : -(int32_t)(~v) - 1;
+}
+
+int protocol_decode_request(const char *data, struct ProtocolRequest *req)
+{
+	if (get_u32(data) != PROTOCOL_MAGIC || get_u16(data + 4) != PROTOCOL_VERSION)
+		return -1;
+
+	req->flags = get_u16(data + 6);
+	req->url_length = get_u32(data + 8);
+	req->num_software = get_u32(data + 12);
+
+	if (req->url_length == 0 || req->url_length > PROTOCOL_MAX_URL_LENGTH ||
+	    req->num_software > PROTOCOL_MAX_SOFTWARE)
+		return -1;
+
+	return 0;
+}
+
+int protocol_decode_response(const char *data, struct ProtocolResponse *resp)
+{
+	if (get_u32(data) != PROTOCOL_MAGIC)
+		return -1;
+
+	resp->ret = (EUPDRetCode)get_i32(data + 4);
+	resp->outcome = get_u32(data + 8);
+	resp->num_results = get_u32(data + 12);
+	resp->payload_length = get_u32(data + 16);
+
+	if (resp->outcome > PROTOCOL_OUTCOME_STALE || resp->payload_length > PROTOCOL_MAX_PAYLOAD)
+		return -1;
+	if (EUPD_IS_ERROR(resp->ret) && (resp->num_results != 0 || resp->payload_length != 0))
+		return -1;
+
+	return 0;
+}
+
+int protocol_decode_results(const char *data, const size_t length, const size_t num_results,
+			    struct EUPDResult **results)
+{
+	const char *p = data;
+	const char *end = data + length;
+	struct EUPDResult *res;
+	size_t idx;
+
+	res = mem_calloc(num_results > 0 ? num_results : 1, sizeof(struct EUPDResult));
+	if (res == NULL)
+		return -1;
+
+	for (idx = 0; idx < num_results; idx++) {
+		int32_t status;
+		uint32_t link_length;
+
+		if ((size_t)(end - p) < PROTOCOL_RESULT_SIZE)
+			goto err_out;
+
+		status = get_i32(p);
+		link_length = get_u32(p + 16);
+		if (status < EUST_UNKNOWN || status > EUST_UPDATE_REQUIRED ||
+		    (size_t)(end - p) - PROTOCOL_RESULT_SIZE < link_length)
+			goto err_out;
+
+		res[idx].status = (EUPDUpdateStatus)status;
+		res[idx].version.major = get_i32(p + 4);
+		res[idx].version.minor = get_i32(p + 8);
+		memcpy(res[idx].version.revision, p + 12, sizeof(res[idx].version.revision));
+		p += PROTOCOL_RESULT_SIZE;
+
+		if (res[idx].status != EUST_UNKNOWN) {
+			res[idx].link = mem_malloc(link_length + 1);
+			if (res[idx].link == NULL)
+				goto err_out;
+			memcpy(res[idx].link, p, link_length);
+			res[idx].link[link_length] = '\0';
+		}
+		p += link_length;
+	}
+
+	if (p != end)
+		goto err_out;
+
+	*results = res;
+
+	return 0;
+
+err_out:
+	/* Results that have not been decoded yet are zeroed */
+	for (idx = 0; idx < num_results; idx++)
+		mem_free(res[idx].link);
+	mem_free(res);
+
+	return -1;
+}
+
+void protocol_decode_software(const char *data, const size_t num_software, struct EUPDInSoftware *in_software_list)
+{
+	size_t idx;
+
+	for (idx = 0; idx < num_software; idx++) {
+		struct EUPDInSoftware *in_sw = &in_software_list[idx];
+
+		memcpy(in_sw->name, data, sizeof(in_sw->name));
+		in_sw->version.major = get_i32(data + 32);
+		in_sw->version.minor = get_i32(data + 36);
+		memcpy(in_sw->version.revision, data + 40, sizeof(in_sw->version.revision));
+
+		data += PROTOCOL_SOFTWARE_SIZE;
+	}
+}
+
+char * protocol_encode_request(const char *url, const size_t url_length, const struct EUPDInSoftware *in_software_list,
+			       const size_t num_software, const int allow_insecure, size_t *length)
+{
+	char *req;
+	char *p;
+	size_t idx;
+
+	*length = PROTOCOL_REQUEST_HEADER_SIZE + url_length + num_software * PROTOCOL_SOFTWARE_SIZE;
+	req = mem_malloc(*length);
+	if (req == NULL)
+		return NULL;
+
+	put_u32(req, PROTOCOL_MAGIC);
+	put_u16(req + 4, PROTOCOL_VERSION);
+	put_u16(req + 6, allow_insecure ? PROTOCOL_FLAG_ALLOW_INSECURE : 0);
+	put_u32(req + 8, (uint32_t)url_length);
+	put_u32(req + 12, (uint32_t)num_software);
+
+	p = req + PROTOCOL_REQUEST_HEADER_SIZE;
+	memcpy(p, url, url_length);
+	p += url_length;
+
+	for (idx = 0; idx < num_software; idx++) {
+		const struct EUPDInSoftware *in_sw = &in_software_list[idx];
+
+		memcpy(p, in_sw->name, sizeof(in_sw->name));
+		put_u32(p + 32, (uint32_t)in_sw->version.major);
+		put_u32(p + 36, (uint32_t)in_sw->version.minor);
+		memcpy(p + 40, in_sw->version.revision, sizeof(in_sw->version.revision));
+
+		p += PROTOCOL_SOFTWARE_SIZE;
+	}
+
+	return req;
+}
+
+char * protocol_encode_response(const EUPDRetCode tRet, const uint32_t outcome, const struct EUPDResultView *views,
+				const size_t num_views, size_t *length)
+{
+	const size_t num_results = EUPD_IS_ERROR(tRet) ? 0 : num_views;
+	size_t payload_length = 0;
+	char *resp;
+	char *p;
+	size_t idx;
+
+	for (idx = 0; idx < num_results; idx++) {
+		payload_length += PROTOCOL_RESULT_SIZE;
+		if (views[idx].status != EUST_UNKNOWN)
+			payload_length += views[idx].link_length;
+	}
+	if (payload_length > PROTOCOL_MAX_PAYLOAD)
+		return NULL;
+
+	*length = PROTOCOL_RESPONSE_HEADER_SIZE + payload_length;
+	resp = mem_malloc(*length);
+	if (resp == NULL)
+		return NULL;
+
+	put_u32(resp, PROTOCOL_MAGIC);
+	put_u32(resp + 4, (uint32_t)tRet);
+	put_u32(resp + 8, outcome);
+	put_u32(resp + 12, (uint32_t)num_results);
+	put_u32(resp + 16, (uint32_t)payload_length);
+
+	p = resp + PROTOCOL_RESPONSE_HEADER_SIZE;
+	for (idx = 0; idx < num_results; idx++) {
+		const struct EUPDResultView *v = &views[idx];
+		const uint32_t link_length = v->status != EUST_UNKNOWN ? (uint32_t)v->link_length : 0;
+
+		put_u32(p, (uint32_t)v->status);
+		put_u32(p + 4, (uint32_t)v->version.major);
+		put_u32(p + 8, (uint32_t)v->version.minor);
+		memcpy(p + 12, v->version.revision, sizeof(v->version.revision));
+		put_u32(p + 16, link_length);
+		p += PROTOCOL_RESULT_SIZE;
+
+		memcpy(p, v->link, link_length);
+		p += link_length;
+	}
+
+	return resp;
+}
+
+int protocol_is_http_url(const char *url)
+{
+	return STRNICMP(url, "http://", 7) == 0 || STRNICMP(url, "https://", 8) == 0;
+}
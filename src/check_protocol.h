@@ -0,0 +1,156 @@
+#ifndef ECHMET_UPD_CHECK_PROTOCOL_H
+#define ECHMET_UPD_CHECK_PROTOCOL_H
+
+#include "echmetupdatecheck_p.h"
+
+#include <echmetupdatecheck.h>
+#include <stdint.h>
+
+/*
+ * Protocol of checks performed on behalf of the library by the eupd_cached daemon
+ * and by the eupd_server.
+ *
+ * A request consists of a header followed by the URL of the list of updates
+ * (without the terminating zero) and by \p num_software software records.
+ * A response consists of a header followed by \p payload_length bytes that hold
+ * \p num_results result records, each followed by its download link (without
+ * the terminating zero). All integers are little-endian.
+ *
+ * Request header:  magic (u32), version (u16), flags (u16), url_length (u32), num_software (u32)
+ * Software record: name (32 bytes), major (i32), minor (i32), revision (4 bytes)
+ * Response header: magic (u32), ret (i32), outcome (u32), num_results (u32), payload_length (u32)
+ * Result record:   status (i32), major (i32), minor (i32), revision (4 bytes), link_length (u32)
+ */
+
+#define PROTOCOL_MAGIC 0x44505545U	/* "EUPD" */
+/* Version 1 used the byte order of the host, version 2 is little-endian,
+ * version 3 reports the outcome of the check */
+#define PROTOCOL_VERSION 3
+
+#define PROTOCOL_FLAG_ALLOW_INSECURE 0x1
+
+/* How the list that answered a check has been obtained */
+#define PROTOCOL_OUTCOME_CACHED 0	/* Snapshot used without contacting the server of the list */
+#define PROTOCOL_OUTCOME_REVALIDATED 1	/* Snapshot confirmed to be current by the server of the list */
+#define PROTOCOL_OUTCOME_FETCHED 2	/* List fetched and parsed for the check */
+#define PROTOCOL_OUTCOME_STALE 3	/* Snapshot used because the server of the list could not be reached */
+
+#define PROTOCOL_REQUEST_HEADER_SIZE 16
+#define PROTOCOL_RESPONSE_HEADER_SIZE 20
+#define PROTOCOL_SOFTWARE_SIZE 44
+#define PROTOCOL_RESULT_SIZE 20
+
+#define PROTOCOL_MAX_URL_LENGTH 8192
+#define PROTOCOL_MAX_SOFTWARE 65536
+#define PROTOCOL_MAX_PAYLOAD (64UL * 1024UL * 1024UL)
+
+/*!
+ * Decoded request header
+ */
+struct ProtocolRequest {
+	uint16_t flags;
+	uint32_t url_length;
+	uint32_t num_software;
+};
+
+/*!
+ * Decoded response header
+ */
+struct ProtocolResponse {
+	EUPDRetCode ret;
+	uint32_t outcome;		/*!< One of \p PROTOCOL_OUTCOME_ values */
+	uint32_t num_results;		/*!< Zero if \p ret is an error */
+	uint32_t payload_length;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Decodes and validates a request header
+ *
+ * @param[in] data \p PROTOCOL_REQUEST_HEADER_SIZE bytes of the header
+ * @param[out] req The header
+ *
+ * @return Zero on success, -1 if the header is not valid
+ */
+int protocol_decode_request(const char *data, struct ProtocolRequest *req);
+
+/*!
+ * Decodes and validates a response header
+ *
+ * @param[in] data \p PROTOCOL_RESPONSE_HEADER_SIZE bytes of the header
+ * @param[out] resp The header
+ *
+ * @return Zero on success, -1 if the header is not valid
+ */
+int protocol_decode_response(const char *data, struct ProtocolResponse *resp);
+
+/*!
+ * Decodes result records
+ *
+ * @param[in] data The payload of a response
+ * @param[in] length Length of the payload
+ * @param[in] num_results Number of results the payload shall contain
+ * @param[out] results Array of results. Shall be freed with \p updater_free_result_list().
+ *
+ * @return Zero on success, -1 if the payload is malformed or there is not enough memory
+ */
+int protocol_decode_results(const char *data, const size_t length, const size_t num_results,
+			    struct EUPDResult **results);
+
+/*!
+ * Decodes software records
+ *
+ * @param[in] data \p num_software records
+ * @param[in] num_software Number of records
+ * @param[out] in_software_list Array of \p num_software descriptors
+ */
+void protocol_decode_software(const char *data, const size_t num_software, struct EUPDInSoftware *in_software_list);
+
+/*!
+ * Encodes a complete request
+ *
+ * @param[in] url URL of the list of updates
+ * @param[in] url_length Length of the URL
+ * @param[in] in_software_list Array of descriptors of software to check
+ * @param[in] num_software Length of the in_software_list array
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[out] length Length of the request
+ *
+ * @return The request allocated with \p mem_malloc(), <tt>NULL</tt> if there is not enough memory
+ */
+char * protocol_encode_request(const char *url, const size_t url_length, const struct EUPDInSoftware *in_software_list,
+			       const size_t num_software, const int allow_insecure, size_t *length);
+
+/*!
+ * Encodes a complete response
+ *
+ * @param[in] tRet Result of the check
+ * @param[in] outcome How the list has been obtained, one of \p PROTOCOL_OUTCOME_ values
+ * @param[in] views Results of the individual softwares. Ignored if \p tRet is an error.
+ * @param[in] num_views Length of the views array
+ * @param[out] length Length of the response
+ *
+ * @return The response allocated with \p mem_malloc(), <tt>NULL</tt> if there is not enough memory
+ *         or if the response would exceed \p PROTOCOL_MAX_PAYLOAD
+ */
+char * protocol_encode_response(const EUPDRetCode tRet, const uint32_t outcome, const struct EUPDResultView *views,
+				const size_t num_views, size_t *length);
+
+/*!
+ * Checks whether a list may be checked on behalf of a client. Only lists
+ * fetched over HTTP or HTTPS are, local files are never read for a client.
+ *
+ * @param[in] url URL of the list of updates
+ *
+ * @return Non-zero if the URL is an HTTP or HTTPS URL, zero otherwise
+ */
+int protocol_is_http_url(const char *url);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_CHECK_PROTOCOL_H */
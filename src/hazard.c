@@ -0,0 +1,105 @@
+#ifndef _WIN32
+	#define _POSIX_C_SOURCE 200809L
+#endif /* _WIN32 */
+
+#include "hazard.h"
+#include "atomics.h"
+#include "threading.h"
+
+#ifndef ECHMET_PLATFORM_WIN32
+	#include <sched.h>
+#endif /* ECHMET_PLATFORM_WIN32 */
+
+#define NUM_SLOTS 128
+#define OVERFLOW_SLOT NUM_SLOTS
+
+static void * volatile slots[NUM_SLOTS];
+
+/* Marks a slot as taken by a reader that has not loaded the pointer yet */
+static char claimed;
+
+/* Readers that find all slots taken hold this lock instead of a slot */
+static OnceFlag overflow_flag = ONCE_FLAG_INIT;
+static Mutex overflow_lock;
+static int overflow_ready;
+
+static
+void init_overflow_lock(void)
+{
+	overflow_ready = mutex_init(&overflow_lock) == 0;
+}
+
+/*!
+ * Yields the processor to other threads
+ */
+static
+void relax(void)
+{
+#ifdef ECHMET_PLATFORM_WIN32
+	SwitchToThread();
+#else
+	sched_yield();
+#endif /* ECHMET_PLATFORM_WIN32 */
+}
+
+void * hazard_acquire(void * volatile *ptr, size_t *slot)
+{
+	size_t idx = 0;
+	void *p;
+
+	while (!atomic_ptr_cas(&slots[idx], NULL, &claimed)) {
+		if (++idx < NUM_SLOTS)
+			continue;
+
+		/* More readers than slots, serialize the excess ones
+		 * with the writers instead of spinning until a slot frees up */
+		thread_once(&overflow_flag, init_overflow_lock);
+		if (overflow_ready) {
+			mutex_lock(&overflow_lock);
+			*slot = OVERFLOW_SLOT;
+
+			return atomic_ptr_load(ptr);
+		}
+
+		relax();
+		idx = 0;
+	}
+
+	do {
+		p = atomic_ptr_load(ptr);
+		atomic_ptr_store(&slots[idx], (p != NULL) ? p : &claimed);
+	} while (atomic_ptr_load(ptr) != p);
+
+	*slot = idx;
+
+	return p;
+}
+
+void hazard_release(const size_t slot)
+{
+	if (slot == OVERFLOW_SLOT)
+		mutex_unlock(&overflow_lock);
+	else
+		atomic_ptr_store(&slots[slot], NULL);
+}
+
+void hazard_synchronize(const void *obj)
+{
+	size_t idx;
+
+	if (obj == NULL)
+		return;
+
+	for (idx = 0; idx < NUM_SLOTS; idx++) {
+		while (atomic_ptr_load(&slots[idx]) == obj)
+			relax();
+	}
+
+	/* A reader holding the overflow lock may have loaded the object
+	 * before it was unpublished, wait until it is done with it */
+	thread_once(&overflow_flag, init_overflow_lock);
+	if (overflow_ready) {
+		mutex_lock(&overflow_lock);
+		mutex_unlock(&overflow_lock);
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef ECHMET_UPD_HAZARD_H
+#define ECHMET_UPD_HAZARD_H
+
+#include <stddef.h>
+
+/*
+ * Hazard pointers protect objects published through an atomic pointer
+ * from being reclaimed while a reader is about to acquire a reference to them.
+ * Readers do not block as long as a free hazard slot exists. Readers that find
+ * all slots taken fall back to a lock shared with the writers. A writer that
+ * replaced the published pointer waits only until no reader is in the short
+ * window between loading the pointer and acquiring its reference.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Loads a published pointer and protects it from reclamation.
+ * The protection shall be dropped with \p hazard_release() as soon
+ * as the caller has acquired its own reference to the object.
+ *
+ * @param[in] ptr Published pointer
+ * @param[out] slot Hazard slot that protects the pointer
+ *
+ * @return Value of the published pointer
+ */
+void * hazard_acquire(void * volatile *ptr, size_t *slot);
+
+/*!
+ * Drops the protection acquired by \p hazard_acquire().
+ *
+ * @param[in] slot Hazard slot to release
+ */
+void hazard_release(const size_t slot);
+
+/*!
+ * Waits until no reader protects the given object. Shall be called
+ * after the object has been unpublished and before it is reclaimed.
+ *
+ * @param[in] obj Unpublished object
+ */
+void hazard_synchronize(const void *obj);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_HAZARD_H */
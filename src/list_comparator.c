@@ -80,56 +80,57 @@ VersionDiff compare_version(const struct EUPDVersion *first, const struct EUPDVe
 }
 
 EUPDRetCode comparator_compare(const struct SoftwareList *sw_list, const struct EUPDInSoftware *checked_sw,
-			       EUPDUpdateStatus *status, struct EUPDVersion *new_version)
+			       EUPDUpdateStatus *status, struct EUPDVersion *new_version,
+			       const struct Software **match)
 {
-	size_t idx;
-	for (idx = 0; idx < sw_list->length; idx++) {
-		const struct Software *sw = &sw_list->items[idx];
-
-		if (!STRNICMP(sw->name, checked_sw->name, STRUCT_MEM_SZ(struct Software, name))) {
-			size_t jdx;
-			Severity severity = SEV_FEATURE;
-			int update_available = 0;
-
-			copy_version(new_version, &checked_sw->version);
-
-			for (jdx = 0; jdx < sw->num_versions; jdx++) {
-				const struct ListVersion *lv = &sw->versions[jdx];
-
-				VersionDiff diff = compare_version(&lv->version, new_version);
-				if (diff == VER_NEWER) {
-					update_available = 1;
-					copy_version(new_version, &lv->version);
-				}
-
-				diff = compare_version(&lv->version, &checked_sw->version);
-				if (diff == VER_NEWER) {
-					if (lv->severity > severity)
-						severity = lv->severity;
-				}
-			}
-
-			if (update_available) {
-				switch (severity) {
-				case SEV_FEATURE:
-					*status = EUST_UPDATE_AVAILABLE;
-					break;
-				case SEV_BUGFIX:
-					*status = EUST_UPDATE_RECOMMENDED;
-					break;
-				case SEV_CRITICAL:
-					*status = EUST_UPDATE_REQUIRED;
-					break;
-				default:
-					abort();
-				}
-			} else {
-				*status = EUST_UP_TO_DATE;
-			}
-			return EUPD_OK;
+	size_t jdx;
+	Severity severity = SEV_FEATURE;
+	int update_available = 0;
+	const struct Software *sw = parser_find(sw_list, checked_sw->name);
+
+	if (match != NULL)
+		*match = sw;
+
+	if (sw == NULL) {
+		*status = EUST_UNKNOWN;
+		return EUPD_W_NOT_FOUND;
+	}
+
+	copy_version(new_version, &checked_sw->version);
+
+	for (jdx = 0; jdx < sw->num_versions; jdx++) {
+		const struct ListVersion *lv = &sw->versions[jdx];
+
+		VersionDiff diff = compare_version(&lv->version, new_version);
+		if (diff == VER_NEWER) {
+			update_available = 1;
+			copy_version(new_version, &lv->version);
+		}
+
+		diff = compare_version(&lv->version, &checked_sw->version);
+		if (diff == VER_NEWER) {
+			if (lv->severity > severity)
+				severity = lv->severity;
+		}
+	}
+
+	if (update_available) {
+		switch (severity) {
+		case SEV_FEATURE:
+			*status = EUST_UPDATE_AVAILABLE;
+			break;
+		case SEV_BUGFIX:
+			*status = EUST_UPDATE_RECOMMENDED;
+			break;
+		case SEV_CRITICAL:
+			*status = EUST_UPDATE_REQUIRED;
+			break;
+		default:
+			abort();
 		}
+	} else {
+		*status = EUST_UP_TO_DATE;
 	}
 
-	*status = EUST_UNKNOWN;
-	return EUPD_W_NOT_FOUND;
+	return EUPD_OK;
 }
@@ -17,12 +17,16 @@ extern "C" {
  * @param[in] checked_sw Software to check for update
  * @param[out] status Update status of the given software
  * @param[out] new_version Latest available version of the given software
+ * @param[out] match Item of the list that matched the given software. May be <tt>NULL</tt>
+ *                   if the caller does not need it. Set to <tt>NULL</tt> if the software
+ *                   was not found.
  *
  * @retval EUPD_OK Check completed successfully
  * @retval EUPD_W_NOT_FOUND Given software was not found in the list
  */
 EUPDRetCode comparator_compare(const struct SoftwareList *sw_list, const struct EUPDInSoftware *checked_sw,
-			       EUPDUpdateStatus *status, struct EUPDVersion *new_version);
+			       EUPDUpdateStatus *status, struct EUPDVersion *new_version,
+			       const struct Software **match);
 
 #ifdef __cplusplus
 }
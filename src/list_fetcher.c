@@ -1,35 +1,358 @@
 #include "list_fetcher.h"
+#include "allocator.h"
+#include "list_parser.h"
+#include "metrics.h"
+#include "stats.h"
+#include "threading.h"
+#include "timing.h"
 
 #include <curl/curl.h>
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define HTTP_IM_USED 226L
+#define HTTP_NOT_MODIFIED 304L
+#define HTTP_FIRST_ERROR 400L
+
+#define MAX_REQUEST_HEADERS 4
+
+/* Instance manipulation that denotes a patch of a list of updates, see RFC 3229 */
+#define DELTA_IM "eupd-delta"
+
+/* Longest wait of a multiplexer that cannot be woken up */
+#define MULTI_POLL_INTERVAL_MS 50
+
+#if LIBCURL_VERSION_NUM >= 0x073D00
+	#define HAVE_CURLINFO_TIME_T
+#endif /* LIBCURL_VERSION_NUM */
+
+#if LIBCURL_VERSION_NUM >= 0x074400
+	#define HAVE_CURL_MULTI_WAKEUP
+#endif /* LIBCURL_VERSION_NUM */
+
+static OnceFlag init_flag = ONCE_FLAG_INIT;
+static CURLcode init_ret = CURLE_FAILED_INIT;
+
+/* Custom transport, libcurl is used if neither of the functions is set */
+static struct EUPDTransport transport;
+
 struct Buffer {
 	char *data;
 	size_t length;
 	size_t allocated;
+	size_t limit;		/*!< Maximum length of the data, zero if unlimited */
+	int limit_exceeded;	/*!< Set when the transfer was aborted because of the limit */
 };
 
 struct Session {
 	CURL *connection;
 	char *error_string;
 	struct Buffer data_buffer;
+	struct curl_slist *headers;
+	char *etag;
+	char *last_modified;
+};
+
+struct MultiTransfer;
+
+/*!
+ * State of a transfer performed by a custom transport
+ */
+struct TransportCall {
+	struct EUPDTransportRequest request;
+	char *headers[MAX_REQUEST_HEADERS];
+	struct Buffer data_buffer;
+	char *etag;
+	char *last_modified;
+	uint64_t start;		/*!< Time the transfer was started */
+	Mutex lock;		/*!< Guards the completion of an asynchronous transfer */
+	CondVar completed;
+	int done;
+	EUPDRetCode result;
+	long status;
+	struct MultiTransfer *transfer;	/*!< Multiplexed transfer the call belongs to,
+					     <tt>NULL</tt> if the caller waits for the completion */
+};
+
+/*!
+ * Transfer performed by a multiplexer
+ */
+struct MultiTransfer {
+	FetcherMulti *multi;
+	struct Session session;		/*!< Session of a libcurl transfer */
+	struct TransportCall call;	/*!< State of a transfer performed by the custom transport */
+	int finished;			/*!< Non-zero once \p ret and \p list are set */
+	EUPDRetCode ret;
+	struct DownloadedList list;
+	FetchDoneFunc done;
+	void *ctx;
+	struct MultiTransfer *prev;
+	struct MultiTransfer *next;
 };
 
+struct FetcherMulti {
+	CURLM *handle;			/*!< libcurl multiplexer, <tt>NULL</tt> if libcurl is not available */
+	struct MultiTransfer *active;	/*!< Transfers performed by libcurl */
+	Mutex lock;			/*!< Guards the fields below */
+	CondVar wakeup;			/*!< Signalled on wakeups and on completions of transfers outside of libcurl */
+	int woken;
+	struct MultiTransfer *ready;	/*!< Transfers completed outside of libcurl in reverse order */
+	size_t pending_calls;		/*!< Asynchronous transfers of the custom transport that have not completed yet */
+};
+
+/*!
+ * Makes a zero-terminated copy of a string
+ *
+ * @param[in] str String to copy
+ * @param[in] len Length of the string
+ *
+ * @retval Pointer to the copy on success
+ * @retval <tt>NULL</tt> on failure
+ */
 static
-int writer(char *data, size_t size, size_t nmemb, void *raw)
+char * copy_string(const char *str, const size_t len)
 {
-	struct Buffer *buf = (struct Buffer *)raw;
-	const size_t payload_size = size * nmemb;
+	char *copy = (char *)mem_malloc(len + 1);
+	if (!copy)
+		return NULL;
 
-	if (!buf)
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+
+	return copy;
+}
+
+/*!
+ * Checks whether a header line starts with a given header name
+ * and extracts the trimmed header value
+ *
+ * @param[in] line Header line
+ * @param[in] len Length of the header line
+ * @param[in] name Name of the header including the colon
+ * @param[out] value Pointer to the copy of the value. Any previous value is free'd.
+ *
+ * @retval 1 The line contained the header
+ * @retval 0 The line did not contain the header
+ */
+static
+int grab_header(const char *line, size_t len, const char *name, char **value)
+{
+	const size_t name_len = strlen(name);
+	size_t start;
+
+	if (len < name_len)
 		return 0;
+	if (STRNICMP(line, name, name_len))
+		return 0;
+
+	start = name_len;
+	while (start < len && isspace((unsigned char)line[start]))
+		start++;
+	while (len > start && isspace((unsigned char)line[len - 1]))
+		len--;
+
+	mem_free(*value);
+	*value = copy_string(line + start, len - start);
+
+	return 1;
+}
+
+/*!
+ * Returns the maximum size of a list allowed by the parse limits
+ *
+ * @return The size, zero if the size is not limited
+ */
+static
+size_t max_list_size(void)
+{
+	struct EUPDParseLimits limits;
+
+	parser_limits(&limits);
+
+	return limits.max_bytes;
+}
+
+/*!
+ * Checks whether a string is an absolute path of a local file
+ *
+ * @param[in] str The string
+ *
+ * @retval 1 The string is an absolute path
+ * @retval 0 The string is not an absolute path
+ */
+static
+int is_absolute_path(const char *str)
+{
+#ifdef ECHMET_PLATFORM_WIN32
+	if (isalpha((unsigned char)str[0]) && str[1] == ':' && (str[2] == '\\' || str[2] == '/'))
+		return 1;
+	return str[0] == '\\' && str[1] == '\\';
+#else
+	return str[0] == '/';
+#endif /* ECHMET_PLATFORM_WIN32 */
+}
+
+/*!
+ * Converts a hexadecimal digit to its value
+ *
+ * @param[in] c The digit
+ *
+ * @return Value of the digit, -1 if \p c is not a hexadecimal digit
+ */
+static
+int hex_value(const char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/*!
+ * Extracts path of a local file from a URL. Absolute paths
+ * and <tt>file://</tt> URLs with no host or with <tt>localhost</tt>
+ * refer to local files.
+ *
+ * @param[in] url The URL
+ * @param[out] path Zero-terminated path or <tt>NULL</tt> if the URL does not
+ *                  refer to a local file. Shall be freed with \p mem_free().
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to store the path
+ */
+static
+EUPDRetCode local_path(const char *url, char **path)
+{
+	static const char FILE_SCHEME[] = "file://";
+	static const char LOCALHOST[] = "localhost";
+	const char *src;
+	char *dst;
+
+	*path = NULL;
+
+	if (is_absolute_path(url)) {
+		*path = copy_string(url, strlen(url));
+		return *path != NULL ? EUPD_OK : EUPD_E_NO_MEMORY;
+	}
+
+	if (STRNICMP(url, FILE_SCHEME, sizeof(FILE_SCHEME) - 1))
+		return EUPD_OK;
+
+	src = url + sizeof(FILE_SCHEME) - 1;
+	if (!STRNICMP(src, LOCALHOST, sizeof(LOCALHOST) - 1))
+		src += sizeof(LOCALHOST) - 1;
+	/* Files on remote hosts are left to libcurl */
+	if (*src != '/')
+		return EUPD_OK;
+#ifdef ECHMET_PLATFORM_WIN32
+	/* file:///C:/dir/list.json refers to C:/dir/list.json */
+	if (isalpha((unsigned char)src[1]) && src[2] == ':')
+		src++;
+#endif /* ECHMET_PLATFORM_WIN32 */
+
+	*path = (char *)mem_malloc(strlen(src) + 1);
+	if (*path == NULL)
+		return EUPD_E_NO_MEMORY;
+
+	for (dst = *path; *src != '\0'; src++) {
+		if (*src == '%' && hex_value(src[1]) >= 0 && hex_value(src[2]) >= 0 &&
+		    (src[1] != '0' || src[2] != '0')) {
+			*dst++ = (char)(hex_value(src[1]) * 16 + hex_value(src[2]));
+			src += 2;
+		} else
+			*dst++ = *src;
+	}
+	*dst = '\0';
+
+	return EUPD_OK;
+}
+
+/*!
+ * Maps a local file as the downloaded list
+ *
+ * @param[out] list Result of the operation
+ * @param[in] path Path to the file
+ * @param[in] etag Validator of the previously fetched file, <tt>NULL</tt> if not known
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to map the file
+ * @retval EUPD_E_TRANSFER_ERROR The file cannot be read
+ * @retval EUPD_E_LIMIT_EXCEEDED The file is larger than the parse limits allow
+ */
+static
+EUPDRetCode fetch_local(struct DownloadedList *list, const char *path, const char *etag)
+{
+	struct EUPDStats *stats = stats_current();
+	const size_t max_bytes = max_list_size();
+	const uint64_t start = timing_now_ns();
+	EUPDRetCode tRet;
+
+	tRet = mapped_file_open(&list->mapping, path, etag, &list->etag, &list->not_modified);
+	stats->total_ns = timing_now_ns() - start;
+	if (tRet != EUPD_OK)
+		return tRet;
+
+	if (max_bytes > 0 && list->mapping.length > max_bytes) {
+		mapped_file_close(&list->mapping);
+		return EUPD_E_LIMIT_EXCEEDED;
+	}
+
+	if (!list->not_modified) {
+		list->list = list->mapping.data;
+		list->length = list->mapping.length;
+	}
+
+	stats->bytes_downloaded = list->length;
+	metrics_fetched(stats->bytes_downloaded, stats->total_ns);
+
+	return EUPD_OK;
+}
+
+static
+size_t header_writer(char *data, size_t size, size_t nmemb, void *raw)
+{
+	struct Session *s = (struct Session *)raw;
+	const size_t len = size * nmemb;
+
+	/* Drop validators of any previous response in the chain of redirects */
+	if (len >= 5 && !strncmp(data, "HTTP/", 5)) {
+		mem_free(s->etag);
+		mem_free(s->last_modified);
+		s->etag = NULL;
+		s->last_modified = NULL;
+	} else if (!grab_header(data, len, "ETag:", &s->etag))
+		grab_header(data, len, "Last-Modified:", &s->last_modified);
+
+	return len;
+}
+
+/*!
+ * Appends a piece of the response body to the buffer
+ *
+ * @param[in,out] buf The buffer
+ * @param[in] data The piece of the body
+ * @param[in] payload_size Length of the piece
+ *
+ * @retval 0 Success
+ * @retval -1 Insufficient memory or the body exceeds the size limit
+ */
+static
+int buffer_append(struct Buffer *buf, const char *data, const size_t payload_size)
+{
+	if (buf->limit > 0 && buf->length + payload_size > buf->limit) {
+		buf->limit_exceeded = 1;
+		return -1;
+	}
 
 	if (buf->length + payload_size > buf->allocated) {
 		const size_t size_new = buf->allocated + payload_size;
-		char *data_new = (char *)realloc(buf->data, size_new);
+		char *data_new = (char *)mem_realloc(buf->data, size_new);
 		if (!data_new)
-			return 0;
+			return -1;
 		buf->data = data_new;
 		buf->allocated = size_new;
 	}
@@ -37,6 +360,42 @@ int writer(char *data, size_t size, size_t nmemb, void *raw)
 	memcpy(buf->data + buf->length, data, payload_size);
 	buf->length += payload_size;
 
+	return 0;
+}
+
+/*!
+ * Hands the response body over to the downloaded list so that
+ * the list is parsed straight from the transfer buffer
+ *
+ * @param[out] list The downloaded list
+ * @param[in,out] buf The buffer. It is left empty.
+ */
+static
+void take_buffer(struct DownloadedList *list, struct Buffer *buf)
+{
+	list->buffer = buf->data;
+	list->buffer_size = buf->allocated;
+	list->list = list->buffer != NULL ? list->buffer : "";
+	list->length = buf->length;
+	buf->data = NULL;
+	buf->allocated = 0;
+}
+
+static
+int writer(char *data, size_t size, size_t nmemb, void *raw)
+{
+	struct Buffer *buf = (struct Buffer *)raw;
+	const size_t payload_size = size * nmemb;
+	size_t allocated;
+
+	if (!buf)
+		return 0;
+
+	allocated = buf->allocated;
+	if (buffer_append(buf, data, payload_size) != 0)
+		return 0;
+	stats_transient_alloc(buf->allocated - allocated);
+
 	return payload_size;
 }
 
@@ -48,7 +407,7 @@ EUPDRetCode init_session(struct Session *s)
 
 	memset(s, 0, sizeof(struct Session));
 
-	s->error_string = (char *)malloc(CURL_ERROR_SIZE);
+	s->error_string = (char *)mem_malloc(CURL_ERROR_SIZE);
 	if (!s->error_string) {
 		ret = EUPD_E_NO_MEMORY;
 		goto err_out;
@@ -83,6 +442,25 @@ EUPDRetCode init_session(struct Session *s)
 		goto err_out_3;
 	}
 
+	curl_ret = curl_easy_setopt(s->connection, CURLOPT_HEADERFUNCTION, header_writer);
+	if (curl_ret != CURLE_OK) {
+		ret = EUPD_E_CURL_SETUP;
+		goto err_out_3;
+	}
+
+	curl_ret = curl_easy_setopt(s->connection, CURLOPT_HEADERDATA, s);
+	if (curl_ret != CURLE_OK) {
+		ret = EUPD_E_CURL_SETUP;
+		goto err_out_3;
+	}
+
+	/* Signals cannot be used to implement timeouts in multithreaded programs */
+	curl_ret = curl_easy_setopt(s->connection, CURLOPT_NOSIGNAL, 1L);
+	if (curl_ret != CURLE_OK) {
+		ret = EUPD_E_CURL_SETUP;
+		goto err_out_3;
+	}
+
 	curl_ret = curl_easy_setopt(s->connection, CURLOPT_FOLLOWLOCATION, 1L);
 	if (curl_ret != CURLE_OK) {
 		ret = EUPD_E_CURL_SETUP;
@@ -112,9 +490,9 @@ EUPDRetCode init_session(struct Session *s)
 err_out_3:
 	curl_easy_cleanup(s->connection);
 err_out_2:
-	free(s->data_buffer.data);
+	mem_free(s->data_buffer.data);
 err_out:
-	free(s->error_string);
+	mem_free(s->error_string);
 
 	return ret;
 }
@@ -123,113 +501,1006 @@ static
 void destroy_session(struct Session *s)
 {
 	curl_easy_cleanup(s->connection);
+	curl_slist_free_all(s->headers);
 
-	free(s->data_buffer.data);
-	free(s->error_string);
+	stats_transient_free(s->data_buffer.allocated);
+	mem_free(s->data_buffer.data);
+	mem_free(s->error_string);
+	mem_free(s->etag);
+	mem_free(s->last_modified);
 }
 
-void fetcher_cleanup(void)
+#ifdef HAVE_CURLINFO_TIME_T
+static
+unsigned long long get_time(CURL *connection, const CURLINFO info)
 {
-	curl_global_cleanup();
+	curl_off_t us = 0;
+
+	curl_easy_getinfo(connection, info, &us);
+
+	return (unsigned long long)us * 1000ULL;
 }
 
-EUPDRetCode fetcher_fetch(struct DownloadedList *list, const char *url, const int allow_insecure,
-			  const char *user_agent)
+	#define GET_TIME(connection, info) get_time(connection, info##_T)
+#else
+static
+unsigned long long get_time(CURL *connection, const CURLINFO info)
+{
+	double secs = 0.0;
+
+	curl_easy_getinfo(connection, info, &secs);
+
+	return (unsigned long long)(secs * 1.0e9);
+}
+
+	#define GET_TIME(connection, info) get_time(connection, info)
+#endif /* HAVE_CURLINFO_TIME_T */
+
+/*!
+ * Records timing and transfer statistics of a finished transfer
+ *
+ * @param[in] s The session
+ */
+static
+void collect_stats(struct Session *s)
+{
+	struct EUPDStats *stats = stats_current();
+	long redirects = 0;
+
+	stats->namelookup_ns = GET_TIME(s->connection, CURLINFO_NAMELOOKUP_TIME);
+	stats->connect_ns = GET_TIME(s->connection, CURLINFO_CONNECT_TIME);
+	stats->appconnect_ns = GET_TIME(s->connection, CURLINFO_APPCONNECT_TIME);
+	stats->starttransfer_ns = GET_TIME(s->connection, CURLINFO_STARTTRANSFER_TIME);
+	stats->total_ns = GET_TIME(s->connection, CURLINFO_TOTAL_TIME);
+
+	curl_easy_getinfo(s->connection, CURLINFO_REDIRECT_COUNT, &redirects);
+	stats->redirects = redirects;
+	stats->bytes_downloaded = s->data_buffer.length;
+
+	metrics_fetched(stats->bytes_downloaded, stats->total_ns);
+}
+
+/*!
+ * Formats a request header line
+ *
+ * @param[in] name Name of the header including the colon
+ * @param[in] value Value of the header
+ *
+ * @return Zero-terminated line or <tt>NULL</tt> if there is not enough memory
+ */
+static
+char * header_line(const char *name, const char *value)
+{
+	const size_t len = strlen(name) + strlen(value) + 2;
+	char *line = (char *)mem_malloc(len);
+	if (!line)
+		return NULL;
+
+	strcpy(line, name);
+	strcat(line, " ");
+	strcat(line, value);
+
+	return line;
+}
+
+/*!
+ * Adds a request header to the session
+ *
+ * @param[in] s The session
+ * @param[in] name Name of the header including the colon
+ * @param[in] value Value of the header
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to add the header
+ */
+static
+EUPDRetCode add_header(struct Session *s, const char *name, const char *value)
+{
+	struct curl_slist *headers;
+	char *line = header_line(name, value);
+	if (!line)
+		return EUPD_E_NO_MEMORY;
+
+	headers = curl_slist_append(s->headers, line);
+	mem_free(line);
+	if (!headers)
+		return EUPD_E_NO_MEMORY;
+
+	s->headers = headers;
+
+	return EUPD_OK;
+}
+
+/*!
+ * Sets up a libcurl session to download list of updates
+ *
+ * @param[in] s Initialized session
+ * @param[in] url URL of the file to download
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[in] user_agent User agent string, may be <tt>NULL</tt>
+ * @param[in] etag ETag of the previously fetched file, may be <tt>NULL</tt>
+ * @param[in] last_modified Last-Modified date of the previously fetched file, may be <tt>NULL</tt>
+ * @param[in] accept_delta Allow the server to respond with a patch of the previously fetched file
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to set up the request
+ * @retval EUPD_E_CURL_SETUP Unable to set libcurl parameters
+ */
+static
+EUPDRetCode setup_request(struct Session *s, const char *url, const int allow_insecure,
+			  const char *user_agent, const char *etag, const char *last_modified,
+			  const int accept_delta)
 {
 	EUPDRetCode ret;
 	CURLcode curl_ret;
-	struct Session s;
-	size_t len;
 
-	memset(list, 0, sizeof(struct DownloadedList));
+	curl_ret = curl_easy_setopt(s->connection, CURLOPT_URL, url);
+	if (curl_ret != CURLE_OK)
+		return EUPD_E_CURL_SETUP;
 
-	ret = init_session(&s);
-	if (ret != EUPD_OK)
-		return ret;
+	if (allow_insecure > 0) {
+		curl_ret = curl_easy_setopt(s->connection, CURLOPT_SSL_VERIFYPEER, 0L);
+		if (curl_ret != CURLE_OK)
+			return EUPD_E_CURL_SETUP;
 
-	curl_ret = curl_easy_setopt(s.connection, CURLOPT_URL, url);
-	if (curl_ret != CURLE_OK) {
-		ret = EUPD_E_CURL_SETUP;
-		goto err_out;
+		curl_ret = curl_easy_setopt(s->connection, CURLOPT_SSL_VERIFYHOST, 0L);
+		if (curl_ret != CURLE_OK)
+			return EUPD_E_CURL_SETUP;
 	}
 
-	if (allow_insecure > 0) {
-		curl_ret = curl_easy_setopt(s.connection, CURLOPT_SSL_VERIFYPEER, 0L);
-		if (curl_ret != CURLE_OK) {
-			ret = EUPD_E_CURL_SETUP;
-			goto err_out;
-		}
+	if (user_agent != NULL)
+		curl_easy_setopt(s->connection, CURLOPT_USERAGENT, user_agent);
 
-		curl_ret = curl_easy_setopt(s.connection, CURLOPT_SSL_VERIFYHOST, 0L);
-		if (curl_ret != CURLE_OK) {
-			ret = EUPD_E_CURL_SETUP;
-			goto err_out;
-		}
+	if (etag != NULL) {
+		ret = add_header(s, "If-None-Match:", etag);
+		if (ret != EUPD_OK)
+			return ret;
+	}
+	if (last_modified != NULL) {
+		ret = add_header(s, "If-Modified-Since:", last_modified);
+		if (ret != EUPD_OK)
+			return ret;
+	}
+	if (accept_delta) {
+		ret = add_header(s, "A-IM:", DELTA_IM);
+		if (ret != EUPD_OK)
+			return ret;
+	}
+	if (s->headers != NULL) {
+		curl_ret = curl_easy_setopt(s->connection, CURLOPT_HTTPHEADER, s->headers);
+		if (curl_ret != CURLE_OK)
+			return EUPD_E_CURL_SETUP;
 	}
 
-	if (user_agent != NULL)
-		curl_easy_setopt(s.connection, CURLOPT_USERAGENT, user_agent);
+	s->data_buffer.limit = max_list_size();
+	if (s->data_buffer.limit > 0) {
+		/* Rejects oversized responses that announce their length right away */
+		curl_ret = curl_easy_setopt(s->connection, CURLOPT_MAXFILESIZE_LARGE, (curl_off_t)s->data_buffer.limit);
+		if (curl_ret != CURLE_OK)
+			return EUPD_E_CURL_SETUP;
+	}
+
+	return EUPD_OK;
+}
+
+/*!
+ * Evaluates a finished libcurl transfer
+ *
+ * @param[in] s The session
+ * @param[in] curl_ret Result of the transfer
+ * @param[out] list Result of the operation
+ * @param[in] etag ETag sent with the request, may be <tt>NULL</tt>
+ * @param[in] last_modified Last-Modified date sent with the request, may be <tt>NULL</tt>
+ * @param[in] accept_delta Non-zero if the server was allowed to respond with a patch
+ *
+ * @return EUPD_OK on success, appropriate error code otherwise
+ */
+static
+EUPDRetCode finish_request(struct Session *s, const CURLcode curl_ret, struct DownloadedList *list,
+			   const char *etag, const char *last_modified, const int accept_delta)
+{
+	EUPDRetCode ret;
+	long http_code = 0;
 
-	curl_ret = curl_easy_perform(s.connection);
 	switch (curl_ret) {
 	case CURLE_OK:
 		break;
 	case CURLE_COULDNT_RESOLVE_HOST:
 		ret = EUPD_E_CANNOT_RESOLVE;
-		goto err_out_2;
+		goto err_out;
 	case CURLE_COULDNT_CONNECT:
 		ret = EUPD_E_CONNECTION_FAILED;
-		goto err_out_2;
+		goto err_out;
 	case CURLE_HTTP_RETURNED_ERROR:
 		ret = EUPD_E_HTTP_ERROR;
-		goto err_out_2;
+		goto err_out;
 	case CURLE_WRITE_ERROR:
-		ret = EUPD_E_TRANSFER_ERROR;
-		goto err_out_2;
+		ret = s->data_buffer.limit_exceeded ? EUPD_E_LIMIT_EXCEEDED : EUPD_E_TRANSFER_ERROR;
+		goto err_out;
+	case CURLE_FILESIZE_EXCEEDED:
+		ret = EUPD_E_LIMIT_EXCEEDED;
+		goto err_out;
 	case CURLE_OPERATION_TIMEDOUT:
 		ret = EUPD_E_TIMEOUT;
-		goto err_out_2;
+		goto err_out;
 	case CURLE_SSL_CONNECT_ERROR:
 		ret = EUPD_E_SSL;
-		goto err_out_2;
+		goto err_out;
 	default:
 		ret = EUPD_E_UNKW_NETWORK;
-		goto err_out_2;
+		goto err_out;
 	}
 
-	len = s.data_buffer.length;
-	list->list = (char *)malloc(len + 1);
-	if (!list->list) {
-		ret = EUPD_E_NO_MEMORY;
-		goto err_out;
+	list->etag = s->etag;
+	list->last_modified = s->last_modified;
+	s->etag = NULL;
+	s->last_modified = NULL;
+
+	curl_easy_getinfo(s->connection, CURLINFO_RESPONSE_CODE, &http_code);
+	if (http_code == HTTP_NOT_MODIFIED && (etag != NULL || last_modified != NULL)) {
+		list->not_modified = 1;
+		return EUPD_OK;
+	}
+
+	list->delta = http_code == HTTP_IM_USED && accept_delta;
+	take_buffer(list, &s->data_buffer);
+
+	return EUPD_OK;
+
+err_out:
+	list->error_string = copy_string(s->error_string, strlen(s->error_string));
+	if (!list->error_string)
+		return EUPD_E_NO_MEMORY;
+
+	return ret;
+}
+
+/*!
+ * Receives a piece of the response body from a custom transport
+ *
+ * @param[in] data The piece of the body
+ * @param[in] length Length of the piece
+ * @param[in] context The call the response belongs to
+ *
+ * @retval 0 Transport shall continue
+ * @retval 1 Transport shall abort the transfer, the body exceeds the size limit or memory ran out
+ */
+static
+int ECHMET_CC transport_body(const char *data, size_t length, void *context)
+{
+	struct TransportCall *call = (struct TransportCall *)context;
+
+	return buffer_append(&call->data_buffer, data, length) == 0 ? 0 : 1;
+}
+
+/*!
+ * Receives a response header from a custom transport and keeps the validators
+ *
+ * @param[in] name Name of the header without the colon
+ * @param[in] value Value of the header
+ * @param[in] context The call the response belongs to
+ */
+static
+void ECHMET_CC transport_header(const char *name, const char *value, void *context)
+{
+	struct TransportCall *call = (struct TransportCall *)context;
+	char **validator;
+
+	if (!STRNICMP(name, "ETag", sizeof("ETag")))
+		validator = &call->etag;
+	else if (!STRNICMP(name, "Last-Modified", sizeof("Last-Modified")))
+		validator = &call->last_modified;
+	else
+		return;
+
+	/* Validators are optional, failure to store one only disables revalidation */
+	mem_free(*validator);
+	*validator = mem_strdup(value);
+}
+
+/*!
+ * Wakes up the thread that waits in \p fetcher_multi_wait()
+ *
+ * @param[in] multi The multiplexer. Its lock shall be held by the caller.
+ */
+static
+void multi_wake(FetcherMulti *multi)
+{
+	multi->woken = 1;
+	cond_broadcast(&multi->wakeup);
+#ifdef HAVE_CURL_MULTI_WAKEUP
+	if (multi->handle != NULL)
+		curl_multi_wakeup(multi->handle);
+#endif /* HAVE_CURL_MULTI_WAKEUP */
+}
+
+/*!
+ * Completes a call made through a custom transport
+ *
+ * @param[in] result Outcome of the transfer
+ * @param[in] status HTTP status code of the response
+ * @param[in] context The call that has been completed
+ */
+static
+void ECHMET_CC transport_done(EUPDRetCode result, long status, void *context)
+{
+	struct TransportCall *call = (struct TransportCall *)context;
+
+	if (call->transfer != NULL) {
+		struct MultiTransfer *t = call->transfer;
+		FetcherMulti *multi = t->multi;
+
+		/* The transfer is evaluated by the thread that drives the multiplexer */
+		mutex_lock(&multi->lock);
+		call->result = result;
+		call->status = status;
+		t->next = multi->ready;
+		multi->ready = t;
+		multi->pending_calls--;
+		multi_wake(multi);
+		mutex_unlock(&multi->lock);
+
+		return;
+	}
+
+	mutex_lock(&call->lock);
+	call->result = result;
+	call->status = status;
+	call->done = 1;
+	cond_signal(&call->completed);
+	mutex_unlock(&call->lock);
+}
+
+/*!
+ * Prepares a request for the custom transport
+ *
+ * @param[out] call State of the transfer
+ * @param[in] url URL of the file to download. It shall remain valid until the transfer completes.
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[in] user_agent User agent string, may be <tt>NULL</tt>
+ * @param[in] etag ETag of the previously fetched file, may be <tt>NULL</tt>
+ * @param[in] last_modified Last-Modified date of the previously fetched file, may be <tt>NULL</tt>
+ * @param[in] accept_delta Allow the server to respond with a patch of the previously fetched file
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to prepare the request.
+ *                          The call shall be released with \p transport_release().
+ */
+static
+EUPDRetCode transport_prepare(struct TransportCall *call, const char *url, const int allow_insecure,
+			      const char *user_agent, const char *etag, const char *last_modified,
+			      const int accept_delta)
+{
+	size_t num_headers = 0;
+
+	memset(call, 0, sizeof(struct TransportCall));
+	call->data_buffer.limit = max_list_size();
+
+	if (user_agent != NULL) {
+		call->headers[num_headers] = header_line("User-Agent:", user_agent);
+		if (call->headers[num_headers++] == NULL)
+			return EUPD_E_NO_MEMORY;
+	}
+	if (etag != NULL) {
+		call->headers[num_headers] = header_line("If-None-Match:", etag);
+		if (call->headers[num_headers++] == NULL)
+			return EUPD_E_NO_MEMORY;
+	}
+	if (last_modified != NULL) {
+		call->headers[num_headers] = header_line("If-Modified-Since:", last_modified);
+		if (call->headers[num_headers++] == NULL)
+			return EUPD_E_NO_MEMORY;
+	}
+	if (accept_delta) {
+		call->headers[num_headers] = header_line("A-IM:", DELTA_IM);
+		if (call->headers[num_headers++] == NULL)
+			return EUPD_E_NO_MEMORY;
+	}
+
+	call->request.url = url;
+	call->request.headers = (const char *const *)call->headers;
+	call->request.num_headers = num_headers;
+	call->request.allow_insecure = allow_insecure;
+	call->request.body = transport_body;
+	call->request.header = transport_header;
+	call->request.done = transport_done;
+	call->request.context = call;
+
+	call->start = timing_now_ns();
+
+	return EUPD_OK;
+}
+
+/*!
+ * Frees resources held by a transfer of the custom transport
+ *
+ * @param[in] call State of the transfer
+ */
+static
+void transport_release(struct TransportCall *call)
+{
+	size_t idx;
+
+	for (idx = 0; idx < MAX_REQUEST_HEADERS; idx++)
+		mem_free(call->headers[idx]);
+
+	stats_transient_free(call->data_buffer.allocated);
+	mem_free(call->data_buffer.data);
+	mem_free(call->etag);
+	mem_free(call->last_modified);
+}
+
+/*!
+ * Evaluates a finished transfer of the custom transport and releases the call
+ *
+ * @param[in] call State of the transfer
+ * @param[in] ret Result reported by the transport
+ * @param[in] status HTTP status code reported by the transport
+ * @param[out] list Result of the operation
+ * @param[in] etag ETag sent with the request, may be <tt>NULL</tt>
+ * @param[in] last_modified Last-Modified date sent with the request, may be <tt>NULL</tt>
+ * @param[in] accept_delta Non-zero if the server was allowed to respond with a patch
+ *
+ * @return EUPD_OK on success, appropriate error code otherwise
+ */
+static
+EUPDRetCode transport_finish(struct TransportCall *call, EUPDRetCode ret, const long status,
+			     struct DownloadedList *list, const char *etag, const char *last_modified,
+			     const int accept_delta)
+{
+	struct EUPDStats *stats = stats_current();
+
+	/* The sinks may have been called from another thread, the buffer
+	 * is accounted to the calling thread only once the transfer is over */
+	stats_transient_alloc(call->data_buffer.allocated);
+	stats->total_ns = timing_now_ns() - call->start;
+	stats->bytes_downloaded = call->data_buffer.length;
+	metrics_fetched(stats->bytes_downloaded, stats->total_ns);
+
+	if (call->data_buffer.limit_exceeded)
+		ret = EUPD_E_LIMIT_EXCEEDED;
+	else if (ret == EUPD_OK && status >= HTTP_FIRST_ERROR)
+		ret = EUPD_E_HTTP_ERROR;
+	if (ret != EUPD_OK)
+		goto out;
+
+	list->etag = call->etag;
+	list->last_modified = call->last_modified;
+	call->etag = NULL;
+	call->last_modified = NULL;
+
+	if (status == HTTP_NOT_MODIFIED && (etag != NULL || last_modified != NULL))
+		list->not_modified = 1;
+	else {
+		list->delta = status == HTTP_IM_USED && accept_delta;
+		take_buffer(list, &call->data_buffer);
+	}
+
+out:
+	transport_release(call);
+
+	return ret;
+}
+
+/*!
+ * Performs a transfer with the asynchronous function of the custom transport
+ * and waits for its completion
+ *
+ * @param[in,out] call Prepared state of the transfer
+ * @param[out] status HTTP status code of the response
+ *
+ * @return Result of the transfer
+ */
+static
+EUPDRetCode fetch_async_blocking(struct TransportCall *call, long *status)
+{
+	EUPDRetCode ret;
+
+	if (mutex_init(&call->lock) != 0)
+		return EUPD_E_NO_MEMORY;
+	if (cond_init(&call->completed) != 0) {
+		mutex_destroy(&call->lock);
+		return EUPD_E_NO_MEMORY;
+	}
+
+	ret = transport.fetch_async(&call->request, transport.user_data);
+	if (ret == EUPD_OK) {
+		mutex_lock(&call->lock);
+		while (!call->done)
+			cond_wait(&call->completed, &call->lock);
+		mutex_unlock(&call->lock);
+
+		ret = call->result;
+		*status = call->status;
+	}
+
+	cond_destroy(&call->completed);
+	mutex_destroy(&call->lock);
+
+	return ret;
+}
+
+/*!
+ * Downloads list of updates with the custom transport
+ *
+ * @param[out] list Result of the operation
+ * @param[in] url URL of the file to download
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[in] user_agent User agent string, may be <tt>NULL</tt>
+ * @param[in] etag ETag of the previously fetched file, may be <tt>NULL</tt>
+ * @param[in] last_modified Last-Modified date of the previously fetched file, may be <tt>NULL</tt>
+ * @param[in] accept_delta Allow the server to respond with a patch of the previously fetched file
+ *
+ * @return EUPD_OK on success, appropriate error code otherwise
+ */
+static
+EUPDRetCode fetch_transport(struct DownloadedList *list, const char *url, const int allow_insecure,
+			    const char *user_agent, const char *etag, const char *last_modified,
+			    const int accept_delta)
+{
+	struct TransportCall call;
+	long status = 0;
+	EUPDRetCode ret;
+
+	ret = transport_prepare(&call, url, allow_insecure, user_agent, etag, last_modified, accept_delta);
+	if (ret != EUPD_OK) {
+		transport_release(&call);
+		return ret;
+	}
+
+	if (transport.fetch != NULL)
+		ret = transport.fetch(&call.request, &status, transport.user_data);
+	else
+		ret = fetch_async_blocking(&call, &status);
+
+	return transport_finish(&call, ret, status, list, etag, last_modified, accept_delta);
+}
+
+void fetcher_cleanup(void)
+{
+	curl_global_cleanup();
+}
+
+EUPDRetCode fetcher_fetch(struct DownloadedList *list, const char *url, const int allow_insecure,
+			  const char *user_agent, const char *etag, const char *last_modified,
+			  const int accept_delta)
+{
+	EUPDRetCode ret;
+	CURLcode curl_ret;
+	struct Session s;
+	char *path;
+
+	memset(list, 0, sizeof(struct DownloadedList));
+
+	ret = local_path(url, &path);
+	if (ret != EUPD_OK)
+		return ret;
+	if (path != NULL) {
+		ret = fetch_local(list, path, etag);
+		mem_free(path);
+
+		return ret;
+	}
+
+	if (transport.fetch != NULL || transport.fetch_async != NULL)
+		return fetch_transport(list, url, allow_insecure, user_agent, etag, last_modified, accept_delta);
+	if (init_ret != CURLE_OK)
+		return EUPD_E_CURL_SETUP;
+
+	ret = init_session(&s);
+	if (ret != EUPD_OK)
+		return ret;
+
+	ret = setup_request(&s, url, allow_insecure, user_agent, etag, last_modified, accept_delta);
+	if (ret != EUPD_OK)
+		goto out;
+
+	curl_ret = curl_easy_perform(s.connection);
+	collect_stats(&s);
+
+	ret = finish_request(&s, curl_ret, list, etag, last_modified, accept_delta);
+
+out:
+	destroy_session(&s);
+
+	return ret;
+}
+
+EUPDRetCode fetcher_post(struct DownloadedList *list, const char *url, const int allow_insecure,
+			 const char *user_agent, const char *content_type, const char *body, const size_t length)
+{
+	EUPDRetCode ret;
+	CURLcode curl_ret;
+	struct Session s;
+
+	memset(list, 0, sizeof(struct DownloadedList));
+
+	if (init_ret != CURLE_OK)
+		return EUPD_E_CURL_SETUP;
+
+	ret = init_session(&s);
+	if (ret != EUPD_OK)
+		return ret;
+
+	ret = add_header(&s, "Content-Type:", content_type);
+	if (ret != EUPD_OK)
+		goto out;
+
+	ret = setup_request(&s, url, allow_insecure, user_agent, NULL, NULL, 0);
+	if (ret != EUPD_OK)
+		goto out;
+
+	if (curl_easy_setopt(s.connection, CURLOPT_POSTFIELDS, body) != CURLE_OK ||
+	    curl_easy_setopt(s.connection, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)length) != CURLE_OK) {
+		ret = EUPD_E_CURL_SETUP;
+		goto out;
 	}
-	memcpy(list->list, s.data_buffer.data, len);
-	list->list[len] = '\0';
 
+	curl_ret = curl_easy_perform(s.connection);
+	collect_stats(&s);
+
+	ret = finish_request(&s, curl_ret, list, NULL, NULL, 0);
+
+out:
 	destroy_session(&s);
 
+	return ret;
+}
+
+/*!
+ * Hands a transfer that completed outside of libcurl over to \p fetcher_multi_perform()
+ *
+ * @param[in] t The transfer. Its result shall be set.
+ */
+static
+void multi_ready(struct MultiTransfer *t)
+{
+	FetcherMulti *multi = t->multi;
+
+	t->finished = 1;
+
+	mutex_lock(&multi->lock);
+	t->next = multi->ready;
+	multi->ready = t;
+	multi_wake(multi);
+	mutex_unlock(&multi->lock);
+}
+
+/*!
+ * Reports a finished transfer to its owner and frees it
+ *
+ * @param[in] t The transfer
+ */
+static
+void multi_complete(struct MultiTransfer *t)
+{
+	t->done(t->ret, &t->list, t->ctx);
+	mem_free(t);
+}
+
+EUPDRetCode fetcher_multi_add(FetcherMulti *multi, const char *url, const int allow_insecure,
+			      const char *user_agent, FetchDoneFunc done, void *ctx)
+{
+	struct MultiTransfer *t;
+	EUPDRetCode ret;
+	char *path;
+
+	t = (struct MultiTransfer *)mem_calloc(1, sizeof(struct MultiTransfer));
+	if (t == NULL)
+		return EUPD_E_NO_MEMORY;
+	t->multi = multi;
+	t->done = done;
+	t->ctx = ctx;
+
+	ret = local_path(url, &path);
+	if (ret != EUPD_OK)
+		goto err_out;
+	if (path != NULL) {
+		/* Mapping a file does not wait for the network */
+		t->ret = fetch_local(&t->list, path, NULL);
+		mem_free(path);
+		multi_ready(t);
+
+		return EUPD_OK;
+	}
+
+	if (transport.fetch != NULL) {
+		/* A synchronous transport cannot be multiplexed */
+		t->ret = fetch_transport(&t->list, url, allow_insecure, user_agent, NULL, NULL, 0);
+		multi_ready(t);
+
+		return EUPD_OK;
+	}
+
+	if (transport.fetch_async != NULL) {
+		ret = transport_prepare(&t->call, url, allow_insecure, user_agent, NULL, NULL, 0);
+		if (ret != EUPD_OK) {
+			transport_release(&t->call);
+			goto err_out;
+		}
+		t->call.transfer = t;
+
+		mutex_lock(&multi->lock);
+		multi->pending_calls++;
+		mutex_unlock(&multi->lock);
+
+		ret = transport.fetch_async(&t->call.request, transport.user_data);
+		if (ret != EUPD_OK) {
+			mutex_lock(&multi->lock);
+			multi->pending_calls--;
+			mutex_unlock(&multi->lock);
+
+			t->ret = transport_finish(&t->call, ret, 0, &t->list, NULL, NULL, 0);
+			multi_ready(t);
+		}
+
+		return EUPD_OK;
+	}
+
+	if (multi->handle == NULL) {
+		ret = EUPD_E_CURL_SETUP;
+		goto err_out;
+	}
+
+	ret = init_session(&t->session);
+	if (ret != EUPD_OK)
+		goto err_out;
+
+	ret = setup_request(&t->session, url, allow_insecure, user_agent, NULL, NULL, 0);
+	if (ret != EUPD_OK)
+		goto err_out_2;
+
+	if (curl_easy_setopt(t->session.connection, CURLOPT_PRIVATE, t) != CURLE_OK ||
+	    curl_multi_add_handle(multi->handle, t->session.connection) != CURLM_OK) {
+		ret = EUPD_E_CURL_SETUP;
+		goto err_out_2;
+	}
+
+	t->next = multi->active;
+	if (multi->active != NULL)
+		multi->active->prev = t;
+	multi->active = t;
+
 	return EUPD_OK;
 
 err_out_2:
-	len = strlen(s.error_string);
-	list->error_string = (char *)malloc(len + 1);
-	if (!list->error_string) {
-		ret = EUPD_E_NO_MEMORY;
+	destroy_session(&t->session);
+err_out:
+	mem_free(t);
+
+	return ret;
+}
+
+void fetcher_multi_free(FetcherMulti *multi)
+{
+	struct MultiTransfer *t;
+
+	if (multi == NULL)
+		return;
+
+	while (multi->active != NULL) {
+		t = multi->active;
+		multi->active = t->next;
+
+		curl_multi_remove_handle(multi->handle, t->session.connection);
+		destroy_session(&t->session);
+		mem_free(t);
+	}
+
+	/* Transfers of the custom transport cannot be cancelled, their completion has to be awaited */
+	mutex_lock(&multi->lock);
+	while (multi->pending_calls > 0)
+		cond_wait(&multi->wakeup, &multi->lock);
+	mutex_unlock(&multi->lock);
+
+	while (multi->ready != NULL) {
+		t = multi->ready;
+		multi->ready = t->next;
+
+		if (!t->finished)
+			t->ret = transport_finish(&t->call, t->call.result, t->call.status, &t->list, NULL, NULL, 0);
+		fetcher_list_cleanup(&t->list);
+		mem_free(t);
+	}
+
+	if (multi->handle != NULL)
+		curl_multi_cleanup(multi->handle);
+	cond_destroy(&multi->wakeup);
+	mutex_destroy(&multi->lock);
+	mem_free(multi);
+}
+
+EUPDRetCode fetcher_multi_new(FetcherMulti **multi)
+{
+	FetcherMulti *m;
+
+	m = (FetcherMulti *)mem_calloc(1, sizeof(FetcherMulti));
+	if (m == NULL)
+		return EUPD_E_NO_MEMORY;
+
+	if (mutex_init(&m->lock) != 0)
 		goto err_out;
+	if (cond_init(&m->wakeup) != 0)
+		goto err_out_2;
+
+	/* libcurl is optional if the application supplies its own transport */
+	if (init_ret == CURLE_OK) {
+		m->handle = curl_multi_init();
+		if (m->handle == NULL)
+			goto err_out_3;
 	}
-	strcpy(list->error_string, s.error_string);
+
+	*multi = m;
+
+	return EUPD_OK;
+
+err_out_3:
+	cond_destroy(&m->wakeup);
+err_out_2:
+	mutex_destroy(&m->lock);
 err_out:
-	destroy_session(&s);
-	return ret;
+	mem_free(m);
+
+	return EUPD_E_NO_MEMORY;
+}
+
+void fetcher_multi_perform(FetcherMulti *multi)
+{
+	struct MultiTransfer *ready;
+	struct MultiTransfer *reversed = NULL;
+
+	if (multi->handle != NULL) {
+		CURLMsg *msg;
+		int running;
+		int queued;
+
+		curl_multi_perform(multi->handle, &running);
+
+		while ((msg = curl_multi_info_read(multi->handle, &queued)) != NULL) {
+			struct MultiTransfer *t;
+			CURLcode curl_ret;
+			char *priv;
+
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+
+			curl_ret = msg->data.result;
+
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+			t = (struct MultiTransfer *)priv;
+
+			if (t->prev != NULL)
+				t->prev->next = t->next;
+			else
+				multi->active = t->next;
+			if (t->next != NULL)
+				t->next->prev = t->prev;
+
+			/* The message is invalidated by the removal */
+			curl_multi_remove_handle(multi->handle, msg->easy_handle);
+			collect_stats(&t->session);
+			t->ret = finish_request(&t->session, curl_ret, &t->list, NULL, NULL, 0);
+			destroy_session(&t->session);
+
+			multi_complete(t);
+		}
+	}
+
+	mutex_lock(&multi->lock);
+	ready = multi->ready;
+	multi->ready = NULL;
+	mutex_unlock(&multi->lock);
+
+	/* Report the transfers in the order of their completion */
+	while (ready != NULL) {
+		struct MultiTransfer *next = ready->next;
+		ready->next = reversed;
+		reversed = ready;
+		ready = next;
+	}
+
+	while (reversed != NULL) {
+		struct MultiTransfer *t = reversed;
+		reversed = t->next;
+
+		if (!t->finished)
+			t->ret = transport_finish(&t->call, t->call.result, t->call.status, &t->list, NULL, NULL, 0);
+		multi_complete(t);
+	}
+}
+
+void fetcher_multi_wait(FetcherMulti *multi, const unsigned long timeout_ms)
+{
+	int skip;
+
+	mutex_lock(&multi->lock);
+	skip = multi->ready != NULL || multi->woken;
+	multi->woken = 0;
+	if (!skip && multi->handle == NULL) {
+		cond_wait_timed(&multi->wakeup, &multi->lock, timeout_ms);
+		multi->woken = 0;
+	}
+	mutex_unlock(&multi->lock);
+
+	if (skip || multi->handle == NULL)
+		return;
+
+#ifdef HAVE_CURL_MULTI_WAKEUP
+	curl_multi_poll(multi->handle, NULL, 0, (int)timeout_ms, NULL);
+#else
+	/* Without a wakeup, new transfers are noticed after a short wait at the latest */
+	curl_multi_wait(multi->handle, NULL, 0, timeout_ms < MULTI_POLL_INTERVAL_MS ? (int)timeout_ms : MULTI_POLL_INTERVAL_MS, NULL);
+#endif /* HAVE_CURL_MULTI_WAKEUP */
 }
 
-void fetcher_init(void)
+void fetcher_multi_wakeup(FetcherMulti *multi)
 {
-	curl_global_init(CURL_GLOBAL_DEFAULT);
+	mutex_lock(&multi->lock);
+	multi_wake(multi);
+	mutex_unlock(&multi->lock);
+}
+
+static
+void global_init(void)
+{
+	mem_freeze();
+
+	if (mem_is_custom())
+		init_ret = curl_global_init_mem(CURL_GLOBAL_DEFAULT, mem_malloc, mem_free, mem_realloc, mem_strdup, mem_calloc);
+	else
+		init_ret = curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+EUPDRetCode fetcher_init(void)
+{
+	thread_once(&init_flag, global_init);
+
+	/* libcurl is not needed if the application supplies its own transport */
+	if (transport.fetch != NULL || transport.fetch_async != NULL)
+		return EUPD_OK;
+
+	return (init_ret == CURLE_OK) ? EUPD_OK : EUPD_E_CURL_SETUP;
+}
+
+EUPDRetCode fetcher_set_transport(const struct EUPDTransport *custom)
+{
+	if (custom == NULL) {
+		memset(&transport, 0, sizeof(struct EUPDTransport));
+		return EUPD_OK;
+	}
+
+	if (custom->fetch == NULL && custom->fetch_async == NULL)
+		return EUPD_E_INVALID_ARGUMENT;
+
+	transport = *custom;
+
+	return EUPD_OK;
+}
+
+int fetcher_is_curl_transfer(const char *url)
+{
+	char *path;
+
+	if (transport.fetch != NULL || transport.fetch_async != NULL)
+		return 0;
+
+	if (local_path(url, &path) != EUPD_OK)
+		return 0;
+	if (path != NULL) {
+		mem_free(path);
+		return 0;
+	}
+
+	return 1;
 }
 
 void fetcher_list_cleanup(struct DownloadedList *list)
 {
-	free(list->list);
-	free(list->error_string);
+	stats_transient_free(list->buffer_size);
+
+	mem_free(list->buffer);
+	mapped_file_close(&list->mapping);
+	mem_free(list->error_string);
+	mem_free(list->etag);
+	mem_free(list->last_modified);
 }
@@ -1,37 +1,180 @@
 #ifndef ECHMET_UPD_LIST_FETCHER_H
 #define ECHMET_UPD_LIST_FETCHER_H
 
-#include "echmetupdatecheck.h"
+#include "echmetupdatecheck_p.h"
+#include "mapped_file.h"
+
+#include <echmetupdatecheck.h>
 
 /*!
  * Downloaded list object
  */
 struct DownloadedList {
-	char *list;		/*!< Downloaded file as string */
+	const char *list;	/*!< Content of the downloaded file, not zero-terminated.
+				     <tt>NULL</tt> if the file was not modified */
+	size_t length;		/*!< Length of the downloaded file */
+	char *buffer;		/*!< Heap buffer holding the content of a transferred file */
+	size_t buffer_size;	/*!< Allocated size of \p buffer */
+	struct MappedFile mapping;	/*!< Mapping holding the content of a local file */
 	char *error_string;	/*!< CURL return code in case the retrieval failed */
+	char *etag;		/*!< Value of the ETag header of the response, <tt>NULL</tt> if not present */
+	char *last_modified;	/*!< Value of the Last-Modified header of the response, <tt>NULL</tt> if not present */
+	int not_modified;	/*!< Non-zero if the server confirmed that the previously fetched file is still current */
+	int delta;		/*!< Non-zero if the content is a patch of the previously fetched file */
 };
 
 /*!
- * Frees fetcher's internal resources
+ * Multiplexer of concurrent non-blocking transfers
+ */
+typedef struct FetcherMulti FetcherMulti;
+
+/*!
+ * Receives the result of a multiplexed transfer
+ *
+ * @param[in] ret \p EUPD_OK if the list was downloaded, appropriate error code otherwise
+ * @param[in] list The downloaded list. The callee takes over its content and shall free it
+ *                 with \p fetcher_list_cleanup().
+ * @param[in] ctx Context passed to \p fetcher_multi_add()
+ */
+typedef void (*FetchDoneFunc)(EUPDRetCode ret, struct DownloadedList *list, void *ctx);
+
+/*!
+ * Frees fetcher's internal resources. The fetcher cannot be
+ * initialized again once this function has been called.
  */
 void fetcher_cleanup(void);
 
 /*!
  * Downloads list of updates from a given URL.
  *
+ * Absolute paths and <tt>file://</tt> URLs of local files are not transferred,
+ * the file is mapped into memory instead. Validator of a local file is reported
+ * as its ETag.
+ *
  * @param[out] list Result of the operation.
  * @param[in] URL of the file to download.
  * @param[in] allow_insecure Allow HTTP and ignore TLS errors
  * @param[in] user_agent String to use as user agent. If <tt>NULL</tt>, no user agent
  *                       string is set.
+ * @param[in] etag ETag of the previously fetched file. If not <tt>NULL</tt>, the request is
+ *                 made conditional.
+ * @param[in] last_modified Last-Modified date of the previously fetched file. If not <tt>NULL</tt>,
+ *                          the request is made conditional.
+ * @param[in] accept_delta If non-zero, the server is allowed to respond with a patch
+ *                         of the file identified by \p etag.
  */
 EUPDRetCode fetcher_fetch(struct DownloadedList *list, const char *url, const int allow_insecure,
-			  const char *user_agent);
+			  const char *user_agent, const char *etag, const char *last_modified,
+			  const int accept_delta);
+
+/*!
+ * Sends data with a POST request and downloads the response. The custom transport
+ * is not used, the request is always performed by libcurl.
+ *
+ * @param[out] list The response
+ * @param[in] url URL to send the data to
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[in] user_agent String to use as user agent, may be <tt>NULL</tt>
+ * @param[in] content_type Content type of the data
+ * @param[in] body The data
+ * @param[in] length Length of the data
+ */
+EUPDRetCode fetcher_post(struct DownloadedList *list, const char *url, const int allow_insecure,
+			 const char *user_agent, const char *content_type, const char *body, const size_t length);
 
 /*!
- * Initializes fetcher's internal resources
+ * Starts a multiplexed download of list of updates from a given URL.
+ *
+ * Transfers performed by libcurl or by the asynchronous function of the custom transport
+ * do not block the caller. Local files and transfers of the synchronous function of the
+ * custom transport are completed before this function returns.
+ *
+ * @param[in] multi The multiplexer
+ * @param[in] url URL of the file to download. It shall remain valid until \p done is called.
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[in] user_agent String to use as user agent, may be <tt>NULL</tt>
+ * @param[in] done Function called from \p fetcher_multi_perform() once the transfer completes
+ * @param[in] ctx Context passed to \p done
+ *
+ * @retval EUPD_OK Transfer started, \p done will be called
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to start the transfer
+ * @retval EUPD_E_CURL_SETUP The transfer cannot be set up
+ */
+EUPDRetCode fetcher_multi_add(FetcherMulti *multi, const char *url, const int allow_insecure,
+			      const char *user_agent, FetchDoneFunc done, void *ctx);
+
+/*!
+ * Aborts all transfers of a multiplexer and frees it. Completion callbacks of the
+ * aborted transfers are not called. Transfers of the custom transport cannot be aborted,
+ * this function waits until they complete.
+ *
+ * @param[in] multi The multiplexer. May be <tt>NULL</tt>.
+ */
+void fetcher_multi_free(FetcherMulti *multi);
+
+/*!
+ * Creates a multiplexer of transfers. The fetcher has to be initialized.
+ *
+ * @param[out] multi The multiplexer
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to create the multiplexer
+ */
+EUPDRetCode fetcher_multi_new(FetcherMulti **multi);
+
+/*!
+ * Advances the transfers without blocking and calls the completion
+ * callbacks of the finished ones. The function shall be called
+ * from a single thread only.
+ *
+ * @param[in] multi The multiplexer
+ */
+void fetcher_multi_perform(FetcherMulti *multi);
+
+/*!
+ * Waits until any of the transfers of a multiplexer can be advanced,
+ * \p fetcher_multi_wakeup() is called or the timeout expires.
+ *
+ * @param[in] multi The multiplexer
+ * @param[in] timeout_ms Maximum time to wait in milliseconds
+ */
+void fetcher_multi_wait(FetcherMulti *multi, const unsigned long timeout_ms);
+
+/*!
+ * Interrupts \p fetcher_multi_wait(). May be called from any thread.
+ *
+ * @param[in] multi The multiplexer
+ */
+void fetcher_multi_wakeup(FetcherMulti *multi);
+
+/*!
+ * Initializes fetcher's internal resources. The initialization is performed only once,
+ * subsequent calls return the result of the first initialization. This function
+ * may be called concurrently from multiple threads.
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_CURL_SETUP CURL could not have been initialized
+ */
+EUPDRetCode fetcher_init(void);
+
+/*!
+ * Sets custom transport used instead of libcurl.
+ *
+ * @param[in] custom The transport, <tt>NULL</tt> to use libcurl
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_INVALID_ARGUMENT Neither of the transport functions is set
+ */
+EUPDRetCode fetcher_set_transport(const struct EUPDTransport *custom);
+
+/*!
+ * Checks whether a list of updates would be transferred by libcurl
+ *
+ * @param[in] url URL of the list
+ *
+ * @return Non-zero if the URL does not refer to a local file and no custom transport is set
  */
-void fetcher_init(void);
+int fetcher_is_curl_transfer(const char *url);
 
 /*!
  * Frees downloaded list.
@@ -1,39 +1,265 @@
 #include "list_parser.h"
+#include "allocator.h"
 #include "json.hpp"
 #include "list_comparator.h"
+#include "stats.h"
+#include "threading.h"
+#include "timing.h"
 
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <echmetupdatecheck.h>
+#include <new>
 
 #ifdef EUPD_ENABLE_DIAGNOSTICS
 #include <iostream>
 #endif // EUPD_ENABLE_DIAGNOSTICS
 
-typedef nlohmann::json json_t;
-typedef nlohmann::json::parse_error parse_error_t;
+#define NO_ITEM ((size_t)-1)
 
-static const std::string LINK("link");
-static const std::string MAJOR("major");
-static const std::string MINOR("minor");
-static const std::string NAME("name");
-static const std::string REVISION("revision");
-static const std::string SEVERITY("severity");
-static const std::string SOFTWARE("software");
-static const std::string VERSIONS("versions");
+/* Numbers of containers enclosing software items and their versions */
+#define ITEM_DEPTH 2
+#define VERSION_DEPTH 4
+
+/* Number of parser events between two checks of the deadline */
+#define DEADLINE_CHECK_MASK 0x3FF
+
+/*!
+ * Standard allocator interface over the library allocator so that
+ * the JSON document is allocated the same way as everything else.
+ * The document lives only during the parse, its memory is accounted as transient.
+ */
+template <typename T>
+class LibAllocator {
+public:
+	typedef T value_type;
+
+	LibAllocator() noexcept = default;
+	template <typename U>
+	LibAllocator(const LibAllocator<U> &) noexcept {}
+
+	T * allocate(const size_t n)
+	{
+		if (n > static_cast<size_t>(-1) / sizeof(T))
+			throw std::bad_alloc();
+
+		auto p = static_cast<T *>(mem_malloc(n * sizeof(T)));
+		if (p == nullptr)
+			throw std::bad_alloc();
+		stats_transient_alloc(n * sizeof(T));
+		return p;
+	}
+
+	void deallocate(T *p, const size_t n) noexcept
+	{
+		stats_transient_free(n * sizeof(T));
+		mem_free(p);
+	}
+};
+
+template <typename T, typename U>
+bool operator==(const LibAllocator<T> &, const LibAllocator<U> &) noexcept
+{
+	return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const LibAllocator<T> &, const LibAllocator<U> &) noexcept
+{
+	return false;
+}
+
+typedef std::basic_string<char, std::char_traits<char>, LibAllocator<char>> string_t;
+typedef nlohmann::basic_json<std::map, std::vector, string_t, bool, std::int64_t, std::uint64_t, double, LibAllocator> json_t;
+typedef json_t::parse_error parse_error_t;
+
+/* Plain arrays, keys must not be allocated before the application sets its allocator */
+static const char ADDED[] = "added";
+static const char BASE[] = "base";
+static const char CHANGED[] = "changed";
+static const char LINK[] = "link";
+static const char MAJOR[] = "major";
+static const char MINOR[] = "minor";
+static const char NAME[] = "name";
+static const char NAMES[] = "names";
+static const char REMOVED[] = "removed";
+static const char REVISION[] = "revision";
+static const char SEVERITY[] = "severity";
+static const char SHARDS[] = "shards";
+static const char SOFTWARE[] = "software";
+static const char VERSIONS[] = "versions";
+
+static const size_t NAME_LEN = STRUCT_MEM_SZ(struct Software, name);
+
+/* Limits are replaced as a whole under the lock, each parse works with its own copy */
+static OnceFlag limits_flag = ONCE_FLAG_INIT;
+static Mutex limits_lock;
+static struct EUPDParseLimits parse_limits;
 
 class InvalidItemError : public std::runtime_error {
 public:
 	using std::runtime_error::runtime_error;
 };
 
+class LimitExceededError : public std::runtime_error {
+public:
+	using std::runtime_error::runtime_error;
+};
+
+/*!
+ * Builds the JSON document like the default parser does and enforces
+ * parse limits on the way so that a pathological list is rejected
+ * before it is fully parsed.
+ */
+class LimitedDomParser : public nlohmann::detail::json_sax_dom_parser<json_t> {
+public:
+	typedef nlohmann::detail::json_sax_dom_parser<json_t> Base;
+
+	LimitedDomParser(json_t &root, const struct EUPDParseLimits &limits) :
+		Base(root),
+		m_limits(limits),
+		m_deadline(limits.max_parse_ms > 0 ? timing_now_ns() + limits.max_parse_ms * UINT64_C(1000000) : 0),
+		m_depth(0),
+		m_events(0),
+		m_items(0),
+		m_versions(0),
+		m_in_software(false),
+		m_in_versions(false)
+	{}
+
+	void check_deadline() const
+	{
+		if (m_deadline > 0 && timing_now_ns() > m_deadline)
+			throw LimitExceededError("Parsing takes too long");
+	}
+
+	bool null() override
+	{
+		count_element();
+		return Base::null();
+	}
+
+	bool boolean(bool val) override
+	{
+		count_element();
+		return Base::boolean(val);
+	}
+
+	bool number_integer(number_integer_t val) override
+	{
+		count_element();
+		return Base::number_integer(val);
+	}
+
+	bool number_unsigned(number_unsigned_t val) override
+	{
+		count_element();
+		return Base::number_unsigned(val);
+	}
+
+	bool number_float(number_float_t val, const string_t &str) override
+	{
+		count_element();
+		return Base::number_float(val, str);
+	}
+
+	bool string(string_t &val) override
+	{
+		count_element();
+		return Base::string(val);
+	}
+
+	bool start_object(std::size_t len) override
+	{
+		enter_container();
+		return Base::start_object(len);
+	}
+
+	bool key(string_t &val) override
+	{
+		if (m_depth == ITEM_DEPTH - 1)
+			m_in_software = val == SOFTWARE;
+		else if (m_depth == VERSION_DEPTH - 1)
+			m_in_versions = val == VERSIONS;
+
+		return Base::key(val);
+	}
+
+	bool end_object() override
+	{
+		m_depth--;
+		return Base::end_object();
+	}
+
+	bool start_array(std::size_t len) override
+	{
+		enter_container();
+		return Base::start_array(len);
+	}
+
+	bool end_array() override
+	{
+		m_depth--;
+		return Base::end_array();
+	}
+
+private:
+	void count_element()
+	{
+		if ((++m_events & DEADLINE_CHECK_MASK) == 0)
+			check_deadline();
+
+		if (m_depth == ITEM_DEPTH && m_in_software) {
+			if (m_limits.max_items > 0 && ++m_items > m_limits.max_items)
+				throw LimitExceededError("List has too many items");
+			m_versions = 0;
+			m_in_versions = false;
+		} else if (m_depth == VERSION_DEPTH && m_in_software && m_in_versions) {
+			if (m_limits.max_versions > 0 && ++m_versions > m_limits.max_versions)
+				throw LimitExceededError("Item has too many versions");
+		}
+	}
+
+	void enter_container()
+	{
+		if (m_limits.max_depth > 0 && m_depth >= m_limits.max_depth)
+			throw LimitExceededError("List is nested too deep");
+
+		count_element();
+		m_depth++;
+	}
+
+	const struct EUPDParseLimits m_limits;
+	const uint64_t m_deadline;
+	size_t m_depth;		/*!< Number of arrays and objects currently open */
+	size_t m_events;
+	size_t m_items;
+	size_t m_versions;	/*!< Number of versions of the current item */
+	bool m_in_software;
+	bool m_in_versions;
+};
+
+/*!
+ * Checks whether any limit other than the size limit is set.
+ * The parser needs to observe the parsing only in such a case.
+ */
+static
+bool has_structural_limits(const struct EUPDParseLimits &limits)
+{
+	return limits.max_depth > 0 || limits.max_items > 0 ||
+	       limits.max_versions > 0 || limits.max_parse_ms > 0;
+}
+
 static
-bool has_entry(const json_t &o, const std::string &key)
+bool has_entry(const json_t &o, const char *key)
 {
 	return o.find(key) != o.end();
 }
 
 static
-bool is_json_revision_valid(const std::string &rev)
+bool is_json_revision_valid(const string_t &rev)
 {
 	return is_revision_valid(rev.c_str(), rev.length());
 }
@@ -44,7 +270,7 @@ bool is_json_software_valid(const json_t &sw)
 	if (!sw.is_string())
 		return false;
 
-	const auto &name = sw.get<std::string>();
+	const auto &name = sw.get_ref<const string_t &>();
 	if (name.length() > STRUCT_MEM_SZ(struct Software, name))
 		return false;
 	return is_software_name_valid(name.length());
@@ -69,7 +295,7 @@ bool is_version_item(const json_t &o)
 	const auto &rev = o[REVISION];
 	if (!rev.is_string())
 		return false;
-	if (!is_json_revision_valid(rev.get<std::string>()))
+	if (!is_json_revision_valid(rev.get_ref<const string_t &>()))
 		return false;
 
 	if (!has_entry(o, SEVERITY))
@@ -94,7 +320,7 @@ void check_item(const json_t &item)
 	const auto &link = item[LINK];
 	if (!link.is_string())
 		throw InvalidItemError("Field \"link\" is not a string");
-	if (link.get<std::string>().length() < 1)
+	if (link.get_ref<const string_t &>().length() < 1)
 		throw InvalidItemError("Field \"link\" is an empty string\"");
 
 	if (!has_entry(item, VERSIONS))
@@ -114,7 +340,7 @@ void parse_version(const json_t &v, struct ListVersion *lv)
 
 	const auto major = v[MAJOR].get<int>();
 	const auto minor = v[MINOR].get<int>();
-	const auto &rev = v[REVISION].get<std::string>();
+	const auto &rev = v[REVISION].get_ref<const string_t &>();
 	const auto sev = v[SEVERITY].get<int>();
 
 	lv->version.major = major;
@@ -139,28 +365,29 @@ void parse_item(const json_t &item, struct Software *sw)
 {
 	check_item(item);
 
-	const auto &name = item[NAME].get<std::string>();
-	const auto &link = item[LINK].get<std::string>();
+	const auto &name = item[NAME].get_ref<const string_t &>();
+	const auto &link = item[LINK].get_ref<const string_t &>();
 	const auto &vers = item[VERSIONS];
 
 	std::memset(sw, 0, sizeof(struct Software));
 
 	const size_t vers_sz = sizeof(struct ListVersion) * vers.size();
-	sw->versions = static_cast<ListVersion *>(malloc(vers_sz));
+	sw->versions = static_cast<ListVersion *>(mem_malloc(vers_sz));
 	if (sw->versions == nullptr)
 		throw std::bad_alloc();
 	std::memset(sw->versions, 0, vers_sz);
 
 	const size_t link_len = link.length();
-	sw->link = static_cast<char *>(malloc(link_len + 1));
+	sw->link = static_cast<char *>(mem_malloc(link_len + 1));
 	if (sw->link == nullptr) {
-		free(sw->versions);
+		mem_free(sw->versions);
 
 		throw std::bad_alloc();
 	}
 
 	std::strncpy(sw->name, name.c_str(), STRUCT_MEM_SZ(struct Software, name));
 	std::strncpy(sw->link, link.c_str(), link_len + 1);
+	sw->link_len = link_len;
 
 	size_t idx;
 	for (idx = 0; idx < vers.size(); idx++) {
@@ -170,8 +397,8 @@ void parse_item(const json_t &item, struct Software *sw)
 		try {
 			parse_version(v, lv);
 		} catch (const InvalidItemError &) {
-			free(sw->link);
-			free(sw->versions);
+			mem_free(sw->link);
+			mem_free(sw->versions);
 
 			sw->num_versions = idx;
 
@@ -181,21 +408,38 @@ void parse_item(const json_t &item, struct Software *sw)
 	sw->num_versions = idx;
 }
 
+/*!
+ * Calculates case-insensitive hash of a software name
+ *
+ * @param[in] name Name of the software
+ *
+ * @return Hash value
+ */
 static
-EUPDRetCode walk_list(const json_t &root, struct SoftwareList *sw_list)
+size_t hash_name(const char *name)
 {
-	EUPDRetCode tRet;
+	uint32_t h = 2166136261U;
 
-	if (!root.is_object())
-		return EUPD_E_MALFORMED_LIST;
-	if (!has_entry(root, SOFTWARE))
-		return EUPD_E_MALFORMED_LIST;
+	for (size_t idx = 0; idx < NAME_LEN && name[idx] != '\0'; idx++) {
+		h ^= static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(name[idx])));
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+/*!
+ * Reads array of software items
+ */
+static
+EUPDRetCode walk_items(const json_t &software, struct SoftwareList *sw_list)
+{
+	EUPDRetCode tRet;
 
-	const auto &software = root[SOFTWARE];
 	if (!software.is_array())
 		return EUPD_E_MALFORMED_LIST;
 
-	sw_list->items = static_cast<struct Software *>(calloc(software.size(), sizeof(struct Software)));
+	sw_list->items = static_cast<struct Software *>(mem_calloc(software.size() > 0 ? software.size() : 1, sizeof(struct Software)));
 	if (sw_list->items == nullptr)
 		return EUPD_E_NO_MEMORY;
 
@@ -226,50 +470,534 @@ out:
 	return tRet;
 }
 
-extern "C" {
+/*!
+ * Copies case-folded software name
+ *
+ * @param[out] dst Buffer of \p NAME_LEN characters
+ * @param[in] name Name of the software
+ */
+static
+void fold_name(char *dst, const char *name)
+{
+	size_t idx;
 
-void parser_free_list(struct SoftwareList *sw_list)
+	for (idx = 0; idx < NAME_LEN && name[idx] != '\0'; idx++)
+		dst[idx] = static_cast<char>(std::tolower(static_cast<unsigned char>(name[idx])));
+	for (; idx < NAME_LEN; idx++)
+		dst[idx] = '\0';
+}
+
+static
+int compare_shard_names(const void *a, const void *b)
+{
+	return std::strncmp(static_cast<const struct ShardName *>(a)->name,
+			    static_cast<const struct ShardName *>(b)->name,
+			    NAME_LEN);
+}
+
+static
+void free_shard_index(struct ShardIndex *shards)
+{
+	if (shards == nullptr)
+		return;
+
+	for (size_t idx = 0; idx < shards->num_urls; idx++)
+		mem_free(shards->urls[idx]);
+
+	mem_free(shards->urls);
+	mem_free(shards->names);
+	mem_free(shards);
+}
+
+/*!
+ * Reads index of a sharded list. Unlike items of an ordinary list,
+ * any invalid entry makes the whole index unusable.
+ */
+static
+EUPDRetCode walk_index(const json_t &root, struct SoftwareList *sw_list)
+{
+	const auto &urls = root[SHARDS];
+	if (!urls.is_array() || urls.size() < 1)
+		return EUPD_E_MALFORMED_LIST;
+
+	const json_t *names = nullptr;
+	if (has_entry(root, NAMES)) {
+		names = &root[NAMES];
+		if (!names->is_object())
+			return EUPD_E_MALFORMED_LIST;
+	}
+
+	auto shards = static_cast<struct ShardIndex *>(mem_calloc(1, sizeof(struct ShardIndex)));
+	if (shards == nullptr)
+		return EUPD_E_NO_MEMORY;
+
+	shards->urls = static_cast<char **>(mem_calloc(urls.size(), sizeof(char *)));
+	if (shards->urls == nullptr)
+		goto no_memory;
+	shards->memory = sizeof(struct ShardIndex) + sizeof(char *) * urls.size();
+
+	for (const auto &u : urls) {
+		if (!u.is_string())
+			goto malformed;
+
+		const auto &s = u.get_ref<const string_t &>();
+		if (s.length() < 1)
+			goto malformed;
+
+		char *url = static_cast<char *>(mem_malloc(s.length() + 1));
+		if (url == nullptr)
+			goto no_memory;
+		std::memcpy(url, s.c_str(), s.length() + 1);
+
+		shards->urls[shards->num_urls++] = url;
+		shards->memory += s.length() + 1;
+	}
+
+	/* An empty map means that no software is in any shard, unlike a missing one */
+	if (names != nullptr) {
+		const size_t capacity = names->size() > 0 ? names->size() : 1;
+
+		shards->names = static_cast<struct ShardName *>(mem_calloc(capacity, sizeof(struct ShardName)));
+		if (shards->names == nullptr)
+			goto no_memory;
+		shards->memory += sizeof(struct ShardName) * capacity;
+
+		for (auto it = names->begin(); it != names->end(); ++it) {
+			const auto &name = it.key();
+			const auto &shard = it.value();
+
+			if (name.length() > NAME_LEN || !is_software_name_valid(name.length()))
+				goto malformed;
+			if (!shard.is_number_unsigned() || shard.get<std::uint64_t>() >= shards->num_urls)
+				goto malformed;
+
+			auto sn = &shards->names[shards->num_names++];
+			fold_name(sn->name, name.c_str());
+			sn->shard = shard.get<size_t>();
+		}
+
+		std::qsort(shards->names, shards->num_names, sizeof(struct ShardName), compare_shard_names);
+	}
+
+	sw_list->shards = shards;
+
+	return EUPD_OK;
+
+malformed:
+	free_shard_index(shards);
+	return EUPD_E_MALFORMED_LIST;
+
+no_memory:
+	free_shard_index(shards);
+	return EUPD_E_NO_MEMORY;
+}
+
+static
+EUPDRetCode walk_list(const json_t &root, struct SoftwareList *sw_list)
+{
+	if (!root.is_object())
+		return EUPD_E_MALFORMED_LIST;
+	if (!has_entry(root, SOFTWARE) && has_entry(root, SHARDS))
+		return walk_index(root, sw_list);
+	if (!has_entry(root, SOFTWARE))
+		return EUPD_E_MALFORMED_LIST;
+
+	return walk_items(root[SOFTWARE], sw_list);
+}
+
+/*!
+ * Copies parsed item
+ *
+ * @param[in] src The item
+ * @param[out] dst The copy
+ *
+ * @return <tt>true</tt> on success, <tt>false</tt> if there is not enough memory
+ */
+static
+bool copy_item(const struct Software *src, struct Software *dst)
+{
+	const size_t vers_sz = sizeof(struct ListVersion) * src->num_versions;
+
+	*dst = *src;
+
+	dst->link = static_cast<char *>(mem_malloc(src->link_len + 1));
+	if (dst->link == nullptr)
+		return false;
+	std::memcpy(dst->link, src->link, src->link_len + 1);
+
+	dst->versions = static_cast<struct ListVersion *>(mem_malloc(vers_sz > 0 ? vers_sz : 1));
+	if (dst->versions == nullptr) {
+		mem_free(dst->link);
+		return false;
+	}
+	std::memcpy(dst->versions, src->versions, vers_sz);
+
+	return true;
+}
+
+/*!
+ * Reads array of names of removed items
+ */
+static
+EUPDRetCode walk_names(const json_t &names, struct SoftwareList *sw_list)
+{
+	if (!names.is_array())
+		return EUPD_E_MALFORMED_LIST;
+
+	sw_list->items = static_cast<struct Software *>(mem_calloc(names.size() > 0 ? names.size() : 1, sizeof(struct Software)));
+	if (sw_list->items == nullptr)
+		return EUPD_E_NO_MEMORY;
+
+	for (const auto &name : names) {
+		if (!is_json_software_valid(name))
+			return EUPD_E_MALFORMED_LIST;
+
+		const auto &n = name.get_ref<const string_t &>();
+		std::memcpy(sw_list->items[sw_list->length++].name, n.c_str(), n.length());
+	}
+
+	return EUPD_OK;
+}
+
+/*!
+ * Reads patch of a list. Sections that are not present are left empty.
+ */
+static
+EUPDRetCode walk_patch(const json_t &root, struct ListPatch *patch)
+{
+	EUPDRetCode tRet;
+
+	if (!root.is_object())
+		return EUPD_E_MALFORMED_LIST;
+	if (!has_entry(root, BASE) || !root[BASE].is_string())
+		return EUPD_E_MALFORMED_LIST;
+
+	const auto &base = root[BASE].get_ref<const string_t &>();
+	patch->base = static_cast<char *>(mem_malloc(base.length() + 1));
+	if (patch->base == nullptr)
+		return EUPD_E_NO_MEMORY;
+	std::memcpy(patch->base, base.c_str(), base.length() + 1);
+
+	if (has_entry(root, ADDED)) {
+		tRet = walk_items(root[ADDED], &patch->added);
+		if (tRet != EUPD_OK)
+			return EUPD_IS_ERROR(tRet) ? tRet : EUPD_E_MALFORMED_LIST;
+	}
+	if (has_entry(root, CHANGED)) {
+		tRet = walk_items(root[CHANGED], &patch->changed);
+		if (tRet != EUPD_OK)
+			return EUPD_IS_ERROR(tRet) ? tRet : EUPD_E_MALFORMED_LIST;
+	}
+	if (has_entry(root, REMOVED))
+		return walk_names(root[REMOVED], &patch->removed);
+
+	return EUPD_OK;
+}
+
+static
+void init_limits_lock(void)
+{
+	mutex_init(&limits_lock);
+}
+
+/*!
+ * Returns a copy of the current parse limits
+ *
+ * @return The limits
+ */
+static
+struct EUPDParseLimits current_limits(void)
+{
+	struct EUPDParseLimits limits;
+
+	thread_once(&limits_flag, init_limits_lock);
+
+	mutex_lock(&limits_lock);
+	limits = parse_limits;
+	mutex_unlock(&limits_lock);
+
+	return limits;
+}
+
+/*!
+ * Checks whether a list contains the same name more than once.
+ * Lookups find the first occurence of a name, any other occurence is a duplicate.
+ *
+ * @param[in] sw_list The list
+ *
+ * @return True if some name is listed more than once
+ */
+static
+bool has_duplicates(const struct SoftwareList *sw_list)
 {
 	for (size_t idx = 0; idx < sw_list->length; idx++) {
-		const auto sw = &sw_list->items[idx];
-		free(sw->link);
-		free(sw->versions);
+		if (parser_find(sw_list, sw_list->items[idx].name) != &sw_list->items[idx])
+			return true;
 	}
 
-	free(sw_list->items);
+	return false;
 }
 
-EUPDRetCode parser_parse(const char *list_string, struct SoftwareList *sw_list)
+/*!
+ * Parses JSON document, enforcing the parse limits
+ *
+ * @param[in] data The document. The string does not have to be zero-terminated.
+ * @param[in] length Length of the document
+ * @param[out] j Parsed document
+ *
+ * @return EUPD_OK on success, appropriate error code otherwise
+ */
+static
+EUPDRetCode parse_document(const char *data, const size_t length, json_t &j)
 {
-	json_t j;
+	const auto limits = current_limits();
+
+	if (limits.max_bytes > 0 && length > limits.max_bytes)
+		return EUPD_E_LIMIT_EXCEEDED;
 
 	try {
-		j = json_t::parse(list_string);
+		if (has_structural_limits(limits)) {
+			LimitedDomParser sax(j, limits);
+
+			json_t::sax_parse(nlohmann::detail::input_adapter(data, length), &sax);
+			sax.check_deadline();
+		} else
+			j = json_t::parse(nlohmann::detail::input_adapter(data, length));
 	} catch (const parse_error_t &) {
 		return EUPD_E_MALFORMED_LIST;
+	} catch (const LimitExceededError &ex) {
+	#ifdef EUPD_ENABLE_DIAGNOSTICS
+		std::cerr << "List rejected: " << ex.what() << std::endl;
+	#else
+		(void)ex;
+	#endif // EUPD_ENABLE_DIAGNOSTICS
+		return EUPD_E_LIMIT_EXCEEDED;
+	} catch (const std::bad_alloc &) {
+		return EUPD_E_NO_MEMORY;
 	}
 
-	return walk_list(j, sw_list);
+	return EUPD_OK;
 }
 
-EUPDRetCode parser_set_link(const struct SoftwareList *sw_list, const char *name, struct EUPDResult *result)
+extern "C" {
+
+EUPDRetCode parser_apply_patch(const struct SoftwareList *base, struct ListPatch *patch, struct SoftwareList *patched)
+{
+	std::memset(patched, 0, sizeof(struct SoftwareList));
+
+	/* Indices only speed up the lookups, the patch is usable without them */
+	parser_build_index(&patch->added);
+	parser_build_index(&patch->changed);
+	parser_build_index(&patch->removed);
+
+	/* A name listed twice would make the patched list ambiguous */
+	if (has_duplicates(&patch->added) || has_duplicates(&patch->changed) || has_duplicates(&patch->removed))
+		return EUPD_E_MALFORMED_LIST;
+
+	for (size_t idx = 0; idx < patch->removed.length; idx++) {
+		if (parser_find(base, patch->removed.items[idx].name) == nullptr)
+			return EUPD_E_MALFORMED_LIST;
+	}
+	for (size_t idx = 0; idx < patch->changed.length; idx++) {
+		const char *name = patch->changed.items[idx].name;
+
+		if (parser_find(base, name) == nullptr || parser_find(&patch->removed, name) != nullptr)
+			return EUPD_E_MALFORMED_LIST;
+	}
+	for (size_t idx = 0; idx < patch->added.length; idx++) {
+		if (parser_find(base, patch->added.items[idx].name) != nullptr)
+			return EUPD_E_MALFORMED_LIST;
+	}
+
+	const size_t capacity = base->length + patch->added.length;
+	const auto max_items = current_limits().max_items;
+	if (max_items > 0 && capacity - patch->removed.length > max_items)
+		return EUPD_E_LIMIT_EXCEEDED;
+
+	patched->items = static_cast<struct Software *>(mem_calloc(capacity > 0 ? capacity : 1, sizeof(struct Software)));
+	if (patched->items == nullptr)
+		return EUPD_E_NO_MEMORY;
+
+	/* Unchanged items are copied as they are, the order of the base list is kept */
+	for (size_t idx = 0; idx < base->length; idx++) {
+		const auto sw = &base->items[idx];
+
+		if (parser_find(&patch->removed, sw->name) != nullptr)
+			continue;
+
+		const auto changed = parser_find(&patch->changed, sw->name);
+		if (!copy_item(changed != nullptr ? changed : sw, &patched->items[patched->length]))
+			goto no_memory;
+		patched->length++;
+	}
+	for (size_t idx = 0; idx < patch->added.length; idx++) {
+		if (!copy_item(&patch->added.items[idx], &patched->items[patched->length]))
+			goto no_memory;
+		patched->length++;
+	}
+
+	return EUPD_OK;
+
+no_memory:
+	parser_free_list(patched);
+	std::memset(patched, 0, sizeof(struct SoftwareList));
+
+	return EUPD_E_NO_MEMORY;
+}
+
+void parser_free_list(struct SoftwareList *sw_list)
+{
+	for (size_t idx = 0; idx < sw_list->length; idx++) {
+		const auto sw = &sw_list->items[idx];
+		mem_free(sw->link);
+		mem_free(sw->versions);
+	}
+
+	mem_free(sw_list->items);
+	mem_free(sw_list->index);
+	free_shard_index(sw_list->shards);
+}
+
+void parser_free_patch(struct ListPatch *patch)
+{
+	mem_free(patch->base);
+	parser_free_list(&patch->added);
+	parser_free_list(&patch->changed);
+	parser_free_list(&patch->removed);
+}
+
+EUPDRetCode parser_build_index(struct SoftwareList *sw_list)
 {
-	static const size_t name_len = STRUCT_MEM_SZ(struct Software, name);
+	size_t size = 8;
+
+	while (size < sw_list->length * 2)
+		size <<= 1;
+
+	size_t *index = static_cast<size_t *>(mem_malloc(sizeof(size_t) * size));
+	if (index == nullptr)
+		return EUPD_E_NO_MEMORY;
+
+	for (size_t idx = 0; idx < size; idx++)
+		index[idx] = NO_ITEM;
 
 	for (size_t idx = 0; idx < sw_list->length; idx++) {
 		const auto sw = &sw_list->items[idx];
+		size_t bucket = hash_name(sw->name) & (size - 1);
+
+		while (index[bucket] != NO_ITEM) {
+			/* Keep the first occurence of a duplicate name so that
+			 * lookups match the behavior of walking the list */
+			if (!STRNICMP(sw->name, sw_list->items[index[bucket]].name, NAME_LEN))
+				goto next;
+			bucket = (bucket + 1) & (size - 1);
+		}
+		index[bucket] = idx;
+next:
+		;
+	}
 
-		if (!STRNICMP(name, sw->name, name_len)) {
-			result->link = static_cast<char *>(malloc(strlen(sw->link) + 1));
-			if (result->link == nullptr)
-				return EUPD_E_NO_MEMORY;
-			std::strcpy(result->link, sw->link);
+	mem_free(sw_list->index);
+	sw_list->index = index;
+	sw_list->index_size = size;
+
+	return EUPD_OK;
+}
 
-			return EUPD_OK;
+const struct Software * parser_find(const struct SoftwareList *sw_list, const char *name)
+{
+	if (sw_list->index != nullptr) {
+		const size_t mask = sw_list->index_size - 1;
+		size_t bucket = hash_name(name) & mask;
+
+		while (sw_list->index[bucket] != NO_ITEM) {
+			const auto sw = &sw_list->items[sw_list->index[bucket]];
+			if (!STRNICMP(name, sw->name, NAME_LEN))
+				return sw;
+			bucket = (bucket + 1) & mask;
 		}
+
+		return nullptr;
+	}
+
+	for (size_t idx = 0; idx < sw_list->length; idx++) {
+		const auto sw = &sw_list->items[idx];
+
+		if (!STRNICMP(name, sw->name, NAME_LEN))
+			return sw;
 	}
 
-	abort(); /* This cannot happen */
+	return nullptr;
+}
+
+size_t parser_find_shard(const struct ShardIndex *shards, const char *name)
+{
+	if (shards->names == nullptr)
+		return hash_name(name) % shards->num_urls;
+
+	struct ShardName key;
+	fold_name(key.name, name);
+
+	const auto sn = static_cast<const struct ShardName *>(std::bsearch(&key, shards->names, shards->num_names,
+									   sizeof(struct ShardName), compare_shard_names));
+
+	return sn != nullptr ? sn->shard : NO_SHARD;
+}
+
+void parser_limits(struct EUPDParseLimits *limits)
+{
+	*limits = current_limits();
+}
+
+EUPDRetCode parser_parse(const char *list_string, const size_t length, struct SoftwareList *sw_list)
+{
+	json_t j;
+
+	std::memset(sw_list, 0, sizeof(struct SoftwareList));
+
+	const auto tRet = parse_document(list_string, length, j);
+	if (tRet != EUPD_OK)
+		return tRet;
+
+	return walk_list(j, sw_list);
+}
+
+EUPDRetCode parser_parse_patch(const char *patch_string, const size_t length, struct ListPatch *patch)
+{
+	json_t j;
+
+	std::memset(patch, 0, sizeof(struct ListPatch));
+
+	const auto tRet = parse_document(patch_string, length, j);
+	if (tRet != EUPD_OK)
+		return tRet;
+
+	return walk_patch(j, patch);
+}
+
+EUPDRetCode parser_set_link(const struct SoftwareList *sw_list, const char *name, struct EUPDResult *result)
+{
+	const auto sw = parser_find(sw_list, name);
+	if (sw == nullptr)
+		abort(); /* This cannot happen */
+
+	result->link = static_cast<char *>(mem_malloc(sw->link_len + 1));
+	if (result->link == nullptr)
+		return EUPD_E_NO_MEMORY;
+	std::memcpy(result->link, sw->link, sw->link_len + 1);
+
+	return EUPD_OK;
+}
+
+void parser_set_limits(const struct EUPDParseLimits *limits)
+{
+	thread_once(&limits_flag, init_limits_lock);
+
+	mutex_lock(&limits_lock);
+	if (limits == nullptr)
+		std::memset(&parse_limits, 0, sizeof(struct EUPDParseLimits));
+	else
+		parse_limits = *limits;
+	mutex_unlock(&limits_lock);
 }
 
 }
@@ -6,6 +6,9 @@
 #include <echmetupdatecheck.h>
 #include <stddef.h>
 
+/* Shard number of software that is not in any shard */
+#define NO_SHARD ((size_t)-1)
+
 struct ListVersion {
 	struct EUPDVersion version;
 	Severity severity;
@@ -14,19 +17,99 @@ struct ListVersion {
 struct Software {
 	char name[32];
 	char *link;
+	size_t link_len;
 	struct ListVersion *versions;
 	size_t num_versions;
 };
 
+/*!
+ * Explicit assignment of software to a shard
+ */
+struct ShardName {
+	char name[32];		/*!< Case-folded name of the software */
+	size_t shard;		/*!< Number of the shard */
+};
+
+/*!
+ * Index of a list of updates that is split into shards
+ */
+struct ShardIndex {
+	char **urls;			/*!< URLs of the shards as given in the index */
+	size_t num_urls;		/*!< Number of shards */
+	struct ShardName *names;	/*!< Names sorted by the case-folded name, <tt>NULL</tt> if shards are selected by hash.
+					     Not <tt>NULL</tt> even if the index maps no names. */
+	size_t num_names;		/*!< Number of names */
+	size_t memory;			/*!< Number of bytes allocated for the index */
+};
+
 struct SoftwareList {
 	struct Software *items;
 	size_t length;
+	size_t *index;		/*!< Optional hash index of case-folded names, <tt>NULL</tt> if not built */
+	size_t index_size;	/*!< Number of buckets in the index, always a power of two */
+	struct ShardIndex *shards;	/*!< Index of shards if the list is sharded, <tt>NULL</tt> otherwise */
+};
+
+/*!
+ * Changes of a list of updates relative to a previous revision of the list
+ */
+struct ListPatch {
+	char *base;			/*!< ETag of the revision the patch applies to */
+	struct SoftwareList added;	/*!< Items that are not in the base revision */
+	struct SoftwareList changed;	/*!< Items that replace items of the same name in the base revision */
+	struct SoftwareList removed;	/*!< Items removed from the base revision, only names are set */
 };
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/*!
+ * Applies patch to a parsed list. The base list is not modified.
+ *
+ * @param[in] base List the patch applies to
+ * @param[in,out] patch The patch. Items of the patch are indexed for faster lookups.
+ * @param[out] patched The patched list
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_MALFORMED_LIST The patch does not match the base list or lists a name twice
+ * @retval EUPD_E_LIMIT_EXCEEDED The patched list exceeds the parse limits
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to complete operation
+ */
+EUPDRetCode parser_apply_patch(const struct SoftwareList *base, struct ListPatch *patch, struct SoftwareList *patched);
+
+/*!
+ * Builds hash index of software names. Lookups in an indexed list
+ * do not have to walk the whole list.
+ *
+ * @param[in,out] sw_list List to index
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to build the index. The list remains usable.
+ */
+EUPDRetCode parser_build_index(struct SoftwareList *sw_list);
+
+/*!
+ * Finds software in the parsed list by name.
+ *
+ * @param[in] sw_list Parsed software list
+ * @param[in] name Name of the software. The name does not have to be zero-terminated if
+ *                 it is exactly as long as the name field.
+ *
+ * @return Pointer to the matching item or <tt>NULL</tt> if there is no such item
+ */
+const struct Software * parser_find(const struct SoftwareList *sw_list, const char *name);
+
+/*!
+ * Finds the shard that contains given software.
+ *
+ * @param[in] shards Index of shards
+ * @param[in] name Name of the software
+ *
+ * @return Number of the shard or \p NO_SHARD if no shard contains the software
+ */
+size_t parser_find_shard(const struct ShardIndex *shards, const char *name);
+
 /*!
  * Frees parsed software list.
  *
@@ -34,16 +117,49 @@ extern "C" {
  */
 void parser_free_list(struct SoftwareList *sw_list);
 
+/*!
+ * Frees parsed patch.
+ *
+ * @param[in] patch Patch to free
+ */
+void parser_free_patch(struct ListPatch *patch);
+
 /*!
  * Parses downloaded software list.
  *
- * @param[in] list_string Software list as string.
+ * @param[in] list_string Software list as string. The string does not have to be zero-terminated.
+ * @param[in] length Length of the string
  * @param[out] sw_list Parsed list
  *
+ * If the list is an index of a sharded list, \p shards member of \p sw_list
+ * is set and the list has no items.
+ *
  * @return EUPD_OK on success, appropriate warning if the list was only partially parsed
- *         or error if the list is completely unparsable.
+ *         or error if the list is completely unparsable. \p EUPD_E_LIMIT_EXCEEDED if the
+ *         list exceeds the parse limits.
  */
-EUPDRetCode parser_parse(const char *list_string, struct SoftwareList *sw_list);
+EUPDRetCode parser_parse(const char *list_string, const size_t length, struct SoftwareList *sw_list);
+
+/*!
+ * Parses downloaded patch of a software list. Unlike a list, the patch
+ * is rejected as a whole if any of its items is invalid.
+ *
+ * @param[in] patch_string Patch as string. The string does not have to be zero-terminated.
+ * @param[in] length Length of the string
+ * @param[out] patch Parsed patch
+ *
+ * @return EUPD_OK on success, \p EUPD_E_MALFORMED_LIST if the patch is not valid,
+ *         \p EUPD_E_LIMIT_EXCEEDED if the patch exceeds the parse limits.
+ */
+EUPDRetCode parser_parse_patch(const char *patch_string, const size_t length, struct ListPatch *patch);
+
+/*!
+ * Returns limits applied to downloaded lists.
+ * The limits may be replaced at any time, the caller gets a consistent copy.
+ *
+ * @param[out] limits The current limits
+ */
+void parser_limits(struct EUPDParseLimits *limits);
 
 /*!
  * Assingns a download link to \p Results struct.
@@ -57,6 +173,13 @@ EUPDRetCode parser_parse(const char *list_string, struct SoftwareList *sw_list);
  */
 EUPDRetCode parser_set_link(const struct SoftwareList *sw_list, const char *name, struct EUPDResult *result);
 
+/*!
+ * Sets limits applied to downloaded lists.
+ *
+ * @param[in] limits The limits, <tt>NULL</tt> to remove all limits
+ */
+void parser_set_limits(const struct EUPDParseLimits *limits);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
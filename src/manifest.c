@@ -0,0 +1,176 @@
+#include "manifest.h"
+#include "allocator.h"
+#include "atomics.h"
+#include "list_comparator.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+ * Computes the number of bytes allocated for the parts of a parsed list
+ *
+ * @param[in] sw_list The list
+ * @param[out] usage Memory of items, versions, links and the index. Other fields are not touched.
+ */
+static
+void list_usage(const struct SoftwareList *sw_list, struct EUPDMemoryUsage *usage)
+{
+	size_t idx;
+
+	usage->items = sizeof(struct Software) * sw_list->length;
+	usage->versions = 0;
+	usage->links = 0;
+	usage->index = sizeof(size_t) * sw_list->index_size;
+	if (sw_list->shards != NULL)
+		usage->index += sw_list->shards->memory;
+
+	for (idx = 0; idx < sw_list->length; idx++) {
+		const struct Software *sw = &sw_list->items[idx];
+
+		usage->links += sw->link_len + 1;
+		usage->versions += sizeof(struct ListVersion) * sw->num_versions;
+	}
+}
+
+/*!
+ * Computes the number of bytes allocated for a parsed list
+ *
+ * @param[in] sw_list The list
+ *
+ * @return Number of bytes
+ */
+static
+size_t list_memory(const struct SoftwareList *sw_list)
+{
+	struct EUPDMemoryUsage usage;
+
+	list_usage(sw_list, &usage);
+
+	return usage.items + usage.versions + usage.links + usage.index;
+}
+
+/*!
+ * Returns the number of bytes allocated for a string
+ *
+ * @param[in] str The string, may be <tt>NULL</tt>
+ *
+ * @return Number of bytes
+ */
+static
+size_t string_memory(const char *str)
+{
+	return str != NULL ? strlen(str) + 1 : 0;
+}
+
+EUPDRetCode manifest_check(const struct EUPDManifest *manifest, const struct EUPDInSoftware *in_software_list,
+			   const size_t num_software, struct EUPDResultView *views)
+{
+	EUPDRetCode tRet = manifest->parse_ret;
+	size_t idx;
+
+	for (idx = 0; idx < num_software; idx++) {
+		struct EUPDResultView *v = &views[idx];
+		const struct Software *match;
+		EUPDRetCode cRet;
+
+		cRet = comparator_compare(&manifest->sw_list, &in_software_list[idx], &v->status, &v->version, &match);
+		if (!EUPD_IS_WARNING(tRet))
+			tRet = cRet;
+
+		if (match != NULL) {
+			v->link = match->link;
+			v->link_length = match->link_len;
+		} else {
+			v->link = NULL;
+			v->link_length = 0;
+		}
+	}
+
+	return tRet;
+}
+
+void manifest_memory(const struct EUPDManifest *manifest, struct EUPDMemoryUsage *usage)
+{
+	list_usage(&manifest->sw_list, usage);
+
+	usage->metadata = manifest->memory - (usage->items + usage->versions + usage->links + usage->index);
+	usage->total = manifest->memory;
+	usage->parse_peak = manifest->parse_peak;
+}
+
+struct EUPDManifest * manifest_new(struct SoftwareList *sw_list, const EUPDRetCode parse_ret)
+{
+	struct EUPDManifest *manifest = mem_malloc(sizeof(struct EUPDManifest));
+	EUPDRetCode tRet;
+	TraceSpan span;
+
+	if (manifest == NULL) {
+		parser_free_list(sw_list);
+		return NULL;
+	}
+
+	/* Snapshot is expected to answer many queries, failure to index it
+	 * only makes the lookups slower */
+	TRACE_BEGIN(span, EUPD_SPAN_INDEX_BUILD, NULL, 0, sw_list->length);
+	tRet = parser_build_index(sw_list);
+	TRACE_END(span, EUPD_SPAN_INDEX_BUILD, NULL, 0, sw_list->length, tRet);
+
+	manifest->refcount = 1;
+	manifest->sw_list = *sw_list;
+	manifest->parse_ret = parse_ret;
+	manifest->url = NULL;
+	manifest->allow_insecure = 0;
+	manifest->etag = NULL;
+	manifest->last_modified = NULL;
+	manifest->memory = sizeof(struct EUPDManifest) + list_memory(&manifest->sw_list);
+	manifest->parse_peak = 0;
+
+	metrics_manifest_memory((long long)manifest->memory);
+
+	return manifest;
+}
+
+EUPDRetCode manifest_set_origin(struct EUPDManifest *manifest, const char *url, const int allow_insecure,
+				struct DownloadedList *dl_list)
+{
+	const size_t len = strlen(url);
+	size_t origin_memory;
+
+	manifest->url = mem_malloc(len + 1);
+	if (manifest->url == NULL)
+		return EUPD_E_NO_MEMORY;
+	memcpy(manifest->url, url, len + 1);
+
+	manifest->allow_insecure = allow_insecure;
+	manifest->etag = dl_list->etag;
+	manifest->last_modified = dl_list->last_modified;
+	dl_list->etag = NULL;
+	dl_list->last_modified = NULL;
+
+	origin_memory = len + 1 + string_memory(manifest->etag) + string_memory(manifest->last_modified);
+	manifest->memory += origin_memory;
+	metrics_manifest_memory((long long)origin_memory);
+
+	return EUPD_OK;
+}
+
+void manifest_ref(struct EUPDManifest *manifest)
+{
+	atomic_ref_inc(&manifest->refcount);
+}
+
+void manifest_unref(struct EUPDManifest *manifest)
+{
+	if (atomic_ref_dec(&manifest->refcount) > 0)
+		return;
+
+	metrics_manifest_memory(-(long long)manifest->memory);
+
+	parser_free_list(&manifest->sw_list);
+	mem_free(manifest->url);
+	mem_free(manifest->etag);
+	mem_free(manifest->last_modified);
+	mem_free(manifest);
+}
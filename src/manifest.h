@@ -0,0 +1,94 @@
+#ifndef ECHMET_UPD_MANIFEST_H
+#define ECHMET_UPD_MANIFEST_H
+
+#include "list_fetcher.h"
+#include "list_parser.h"
+
+#include <echmetupdatecheck.h>
+
+/*!
+ * Immutable snapshot of a parsed list of updates
+ */
+struct EUPDManifest {
+	volatile long refcount;		/*!< Number of references held to the snapshot */
+	struct SoftwareList sw_list;	/*!< Parsed list of updates */
+	EUPDRetCode parse_ret;		/*!< Warning state of the list parsing */
+	char *url;			/*!< URL the list was fetched from */
+	int allow_insecure;		/*!< Whether the list was fetched with insecure transfer allowed */
+	char *etag;			/*!< ETag of the fetched list, <tt>NULL</tt> if unknown */
+	char *last_modified;		/*!< Last-Modified date of the fetched list, <tt>NULL</tt> if unknown */
+	size_t memory;			/*!< Number of bytes allocated for the snapshot */
+	unsigned long long parse_peak;	/*!< Peak of transient memory used to fetch and parse the list */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Checks update status of given softwares against the snapshot.
+ *
+ * @param[in] manifest Snapshot to check against
+ * @param[in] in_software_list Array of descriptors of software to check
+ * @param[in] num_software Length of the \p in_software_list array
+ * @param[out] views Array of \p num_software results
+ *
+ * @return EUPD_OK or warning code on success, appropriate error code otherwise
+ */
+EUPDRetCode manifest_check(const struct EUPDManifest *manifest, const struct EUPDInSoftware *in_software_list,
+			   const size_t num_software, struct EUPDResultView *views);
+
+/*!
+ * Reports memory held by the snapshot.
+ *
+ * @param[in] manifest The snapshot
+ * @param[out] usage Memory held by the snapshot
+ */
+void manifest_memory(const struct EUPDManifest *manifest, struct EUPDMemoryUsage *usage);
+
+/*!
+ * Creates a new snapshot from parsed list of updates.
+ * The snapshot takes ownership of the list. If the function fails, the list is free'd.
+ *
+ * @param[in] sw_list Parsed list of updates
+ * @param[in] parse_ret Return code of the list parsing
+ *
+ * @return Pointer to the new snapshot with one reference held, <tt>NULL</tt> on failure
+ */
+struct EUPDManifest * manifest_new(struct SoftwareList *sw_list, const EUPDRetCode parse_ret);
+
+/*!
+ * Records where the snapshot came from so that it can be revalidated later.
+ * Validators of the downloaded list are moved into the snapshot.
+ *
+ * @param[in] manifest The snapshot
+ * @param[in] url URL the list was fetched from
+ * @param[in] allow_insecure Whether insecure transfer was allowed
+ * @param[in,out] dl_list Downloaded list whose validators are taken over
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to complete operation
+ */
+EUPDRetCode manifest_set_origin(struct EUPDManifest *manifest, const char *url, const int allow_insecure,
+				struct DownloadedList *dl_list);
+
+/*!
+ * Acquires a reference to the snapshot.
+ *
+ * @param[in] manifest Snapshot to reference
+ */
+void manifest_ref(struct EUPDManifest *manifest);
+
+/*!
+ * Releases a reference to the snapshot. The snapshot is destroyed when the last
+ * reference is released.
+ *
+ * @param[in] manifest Snapshot to release
+ */
+void manifest_unref(struct EUPDManifest *manifest);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_MANIFEST_H */
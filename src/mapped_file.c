@@ -0,0 +1,273 @@
+#ifndef _WIN32
+	#define _POSIX_C_SOURCE 200809L
+#endif /* _WIN32 */
+
+#include "mapped_file.h"
+#include "allocator.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ECHMET_PLATFORM_UNIX
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif /* ECHMET_PLATFORM_UNIX */
+
+#define MAX_VALIDATOR_LENGTH 80
+
+/* Files up to this size are copied, mapping them is not worth
+ * the risk of SIGBUS should the file be truncated while mapped */
+#define MAX_COPIED_LENGTH (1024 * 1024)
+
+/* Empty files cannot be mapped, they are represented by an empty string instead */
+static const char EMPTY[] = "";
+
+/*!
+ * Creates a validator of a file in the form of a strong ETag
+ *
+ * @param[in] volume Identifier of the volume the file resides on
+ * @param[in] id Identifier of the file on the volume
+ * @param[in] size Size of the file
+ * @param[in] mtime Modification time of the file
+ *
+ * @return Zero-terminated validator or <tt>NULL</tt> if there is not enough memory
+ */
+static
+char * make_validator(const unsigned long long volume, const unsigned long long id,
+		      const unsigned long long size, const unsigned long long mtime)
+{
+	char validator[MAX_VALIDATOR_LENGTH];
+
+	snprintf(validator, MAX_VALIDATOR_LENGTH, "\"%llx-%llx-%llx-%llx\"", volume, id, size, mtime);
+
+	return mem_strdup(validator);
+}
+
+#ifdef ECHMET_PLATFORM_UNIX
+
+/*!
+ * Reads the whole content of a file into memory
+ *
+ * @param[out] mf The file
+ * @param[in] fd Descriptor of the file
+ * @param[in] length Size of the file
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to hold the content
+ * @retval EUPD_E_TRANSFER_ERROR The file cannot be read or it has been truncated
+ */
+static
+EUPDRetCode copy_file(struct MappedFile *mf, const int fd, const size_t length)
+{
+	char *data = mem_malloc(length);
+	size_t offset = 0;
+
+	if (data == NULL)
+		return EUPD_E_NO_MEMORY;
+
+	while (offset < length) {
+		const ssize_t r = read(fd, data + offset, length - offset);
+
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			mem_free(data);
+			return EUPD_E_TRANSFER_ERROR;
+		}
+		offset += (size_t)r;
+	}
+
+	mf->data = data;
+	mf->length = length;
+	mf->copied = 1;
+
+	return EUPD_OK;
+}
+
+void mapped_file_close(struct MappedFile *mf)
+{
+	if (mf->copied)
+		mem_free((void *)mf->data);
+	else if (mf->length > 0)
+		munmap((void *)mf->data, mf->length);
+
+	mf->data = NULL;
+	mf->length = 0;
+	mf->copied = 0;
+}
+
+EUPDRetCode mapped_file_open(struct MappedFile *mf, const char *path, const char *etag, char **new_etag,
+			     int *not_modified)
+{
+	EUPDRetCode tRet;
+	struct stat st;
+	void *data;
+	int fd;
+
+	memset(mf, 0, sizeof(struct MappedFile));
+	*new_etag = NULL;
+	*not_modified = 0;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return errno == ENOMEM ? EUPD_E_NO_MEMORY : EUPD_E_TRANSFER_ERROR;
+
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		tRet = EUPD_E_TRANSFER_ERROR;
+		goto out;
+	}
+
+	/* Files are usually replaced by renaming a new file over the old one
+	 * which changes the identity even if the size and time stay the same */
+	*new_etag = make_validator((unsigned long long)st.st_dev, (unsigned long long)st.st_ino,
+				   (unsigned long long)st.st_size, (unsigned long long)st.st_mtime);
+	if (*new_etag == NULL) {
+		tRet = EUPD_E_NO_MEMORY;
+		goto out;
+	}
+
+	if (etag != NULL && strcmp(etag, *new_etag) == 0) {
+		*not_modified = 1;
+		tRet = EUPD_OK;
+		goto out;
+	}
+
+	if ((unsigned long long)st.st_size > (size_t)-1) {
+		tRet = EUPD_E_NO_MEMORY;
+		goto out;
+	}
+
+	if (st.st_size == 0) {
+		mf->data = EMPTY;
+		tRet = EUPD_OK;
+		goto out;
+	}
+
+	if (st.st_size <= MAX_COPIED_LENGTH) {
+		tRet = copy_file(mf, fd, (size_t)st.st_size);
+		goto out;
+	}
+
+	/* Truncating the file while it is mapped raises SIGBUS,
+	 * large lists have to be replaced by renaming */
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		tRet = errno == ENOMEM ? EUPD_E_NO_MEMORY : EUPD_E_TRANSFER_ERROR;
+		goto out;
+	}
+
+	/* The list is read front to back exactly once */
+	posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+	mf->data = data;
+	mf->length = (size_t)st.st_size;
+	tRet = EUPD_OK;
+
+out:
+	close(fd);
+
+	if (tRet != EUPD_OK) {
+		mem_free(*new_etag);
+		*new_etag = NULL;
+	}
+
+	return tRet;
+}
+
+#elif defined ECHMET_PLATFORM_WIN32
+
+void mapped_file_close(struct MappedFile *mf)
+{
+	if (mf->length > 0)
+		UnmapViewOfFile(mf->data);
+
+	mf->data = NULL;
+	mf->length = 0;
+}
+
+EUPDRetCode mapped_file_open(struct MappedFile *mf, const char *path, const char *etag, char **new_etag,
+			     int *not_modified)
+{
+	EUPDRetCode tRet;
+	BY_HANDLE_FILE_INFORMATION info;
+	HANDLE file;
+	HANDLE mapping;
+	void *data;
+	unsigned long long size;
+
+	memset(mf, 0, sizeof(struct MappedFile));
+	*new_etag = NULL;
+	*not_modified = 0;
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+			   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return EUPD_E_TRANSFER_ERROR;
+
+	if (!GetFileInformationByHandle(file, &info) || (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+		tRet = EUPD_E_TRANSFER_ERROR;
+		goto out;
+	}
+
+	size = ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	*new_etag = make_validator(info.dwVolumeSerialNumber,
+				   ((unsigned long long)info.nFileIndexHigh << 32) | info.nFileIndexLow,
+				   size,
+				   ((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime);
+	if (*new_etag == NULL) {
+		tRet = EUPD_E_NO_MEMORY;
+		goto out;
+	}
+
+	if (etag != NULL && strcmp(etag, *new_etag) == 0) {
+		*not_modified = 1;
+		tRet = EUPD_OK;
+		goto out;
+	}
+
+	if (size > (size_t)-1) {
+		tRet = EUPD_E_NO_MEMORY;
+		goto out;
+	}
+
+	if (size == 0) {
+		mf->data = EMPTY;
+		tRet = EUPD_OK;
+		goto out;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		tRet = EUPD_E_TRANSFER_ERROR;
+		goto out;
+	}
+
+	/* The view keeps the mapping alive once it has been created */
+	data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (data == NULL) {
+		tRet = EUPD_E_NO_MEMORY;
+		goto out;
+	}
+
+	mf->data = data;
+	mf->length = (size_t)size;
+	tRet = EUPD_OK;
+
+out:
+	CloseHandle(file);
+
+	if (tRet != EUPD_OK) {
+		mem_free(*new_etag);
+		*new_etag = NULL;
+	}
+
+	return tRet;
+}
+
+#else
+	#error "Unsupported or misdetected platform"
+#endif /* ECHMET_PLATFORM_UNIX */
@@ -0,0 +1,55 @@
+#ifndef ECHMET_UPD_MAPPED_FILE_H
+#define ECHMET_UPD_MAPPED_FILE_H
+
+#include "echmetupdatecheck_p.h"
+
+#include <echmetupdatecheck.h>
+
+/*!
+ * Read-only view of a local file mapped into memory
+ */
+struct MappedFile {
+	const char *data;	/*!< Content of the file, not zero-terminated */
+	size_t length;		/*!< Length of the file */
+	int copied;		/*!< Non-zero if the content was read into memory instead of being mapped */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Unmaps a mapped file. Calling the function on a zeroed struct is a no-op.
+ *
+ * @param[in] mf The mapped file
+ */
+void mapped_file_close(struct MappedFile *mf);
+
+/*!
+ * Maps a local file into memory.
+ *
+ * Validator of the file is derived from its identity, size and modification time.
+ * If it matches \p etag, the file is not mapped.
+ *
+ * On POSIX systems small files are read into memory rather than mapped. Larger files
+ * are mapped and shall be replaced by renaming a new file over them, truncating a file
+ * while it is mapped makes access to the lost pages raise \p SIGBUS.
+ *
+ * @param[out] mf The mapped file
+ * @param[in] path Path to the file
+ * @param[in] etag Validator of the previously mapped content, <tt>NULL</tt> if not known
+ * @param[out] new_etag Validator of the file. Shall be freed with \p mem_free().
+ * @param[out] not_modified Set to non-zero if the file matches \p etag
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to map the file
+ * @retval EUPD_E_TRANSFER_ERROR The file cannot be opened or read
+ */
+EUPDRetCode mapped_file_open(struct MappedFile *mf, const char *path, const char *etag, char **new_etag,
+			     int *not_modified);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_MAPPED_FILE_H */
@@ -0,0 +1,409 @@
+#include "metrics.h"
+#include "allocator.h"
+#include "atomics.h"
+#include "threading.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_BUCKETS 12
+
+struct Bucket {
+	const char *le;		/*!< Upper bound as rendered in the exposition */
+	long long bound_ns;	/*!< Upper bound in nanoseconds */
+};
+
+static const struct Bucket PARSE_BUCKETS[] = {
+	{ "0.0001", 100000LL },
+	{ "0.0005", 500000LL },
+	{ "0.001", 1000000LL },
+	{ "0.005", 5000000LL },
+	{ "0.01", 10000000LL },
+	{ "0.05", 50000000LL },
+	{ "0.1", 100000000LL },
+	{ "0.5", 500000000LL },
+	{ "1", 1000000000LL },
+	{ "5", 5000000000LL }
+};
+
+static const struct Bucket FETCH_BUCKETS[] = {
+	{ "0.005", 5000000LL },
+	{ "0.01", 10000000LL },
+	{ "0.025", 25000000LL },
+	{ "0.05", 50000000LL },
+	{ "0.1", 100000000LL },
+	{ "0.25", 250000000LL },
+	{ "0.5", 500000000LL },
+	{ "1", 1000000000LL },
+	{ "2.5", 2500000000LL },
+	{ "5", 5000000000LL },
+	{ "10", 10000000000LL }
+};
+
+#define NUM_PARSE_BUCKETS (sizeof(PARSE_BUCKETS) / sizeof(PARSE_BUCKETS[0]))
+#define NUM_FETCH_BUCKETS (sizeof(FETCH_BUCKETS) / sizeof(FETCH_BUCKETS[0]))
+
+static const EUPDRetCode RET_CODES[] = {
+	EUPD_OK,
+	EUPD_W_LIST_INCOMPLETE,
+	EUPD_W_NOT_FOUND,
+	EUPD_E_NO_MEMORY,
+	EUPD_E_MALFORMED_LIST,
+	EUPD_E_INVALID_ARGUMENT,
+	EUPD_E_LIMIT_EXCEEDED,
+	EUPD_E_CURL_SETUP,
+	EUPD_E_CANNOT_RESOLVE,
+	EUPD_E_CONNECTION_FAILED,
+	EUPD_E_HTTP_ERROR,
+	EUPD_E_TRANSFER_ERROR,
+	EUPD_E_TIMEOUT,
+	EUPD_E_SSL,
+	EUPD_E_UNKW_NETWORK
+};
+
+#define NUM_RET_CODES (sizeof(RET_CODES) / sizeof(RET_CODES[0]))
+
+struct Histogram {
+	volatile long long buckets[MAX_BUCKETS];	/*!< Non-cumulative counts, the last used bucket is +Inf */
+	volatile long long sum_ns;
+	volatile long long count;
+};
+
+struct MetricsBlock {
+	struct MetricsBlock *next;
+	int owned;					/*!< Block is assigned to a running thread. Guarded by \p blocks_lock */
+	volatile long long checks[NUM_RET_CODES + 1];	/*!< The last counter collects unknown codes */
+	volatile long long bytes_fetched;
+	volatile long long cache_hits;
+	volatile long long cache_misses;
+	volatile long long revalidations;
+	volatile long long deltas_applied;
+	volatile long long delta_fallbacks;
+	volatile long long manifest_memory;
+	struct Histogram parse;
+	struct Histogram fetch;
+};
+
+struct TextBuffer {
+	char *data;
+	size_t length;
+	size_t capacity;
+	int failed;
+};
+
+static OnceFlag init_flag = ONCE_FLAG_INIT;
+static Mutex blocks_lock;
+static ThreadKey block_key;
+static int key_ok;
+
+/* Blocks are never freed. A block of an exited thread keeps its counts
+ * and is handed over to the next thread that needs one. */
+static struct MetricsBlock *blocks;
+static THREAD_LOCAL struct MetricsBlock *local_block;
+
+static
+void THREAD_KEY_CC release_block(void *value)
+{
+	struct MetricsBlock *block = value;
+
+	mutex_lock(&blocks_lock);
+	block->owned = 0;
+	mutex_unlock(&blocks_lock);
+}
+
+static
+void init_once(void)
+{
+	mem_freeze();
+
+	mutex_init(&blocks_lock);
+	key_ok = thread_key_create(&block_key, release_block) == 0;
+}
+
+/*!
+ * Returns counters of the calling thread, assigning them on the first use
+ *
+ * @return Pointer to the counters, <tt>NULL</tt> if no counters could be assigned
+ */
+static
+struct MetricsBlock * get_block(void)
+{
+	struct MetricsBlock *block;
+
+	if (local_block != NULL)
+		return local_block;
+
+	thread_once(&init_flag, init_once);
+	if (!key_ok)
+		return NULL;
+
+	mutex_lock(&blocks_lock);
+	for (block = blocks; block != NULL; block = block->next) {
+		if (!block->owned)
+			break;
+	}
+
+	if (block == NULL) {
+		block = mem_calloc(1, sizeof(struct MetricsBlock));
+		if (block == NULL) {
+			mutex_unlock(&blocks_lock);
+			return NULL;
+		}
+
+		block->next = blocks;
+		blocks = block;
+	}
+	block->owned = 1;
+	mutex_unlock(&blocks_lock);
+
+	if (thread_key_set(block_key, block) != 0) {
+		release_block(block);
+		return NULL;
+	}
+
+	local_block = block;
+
+	return block;
+}
+
+static
+void observe(struct Histogram *h, const struct Bucket *buckets, const size_t num_buckets, const uint64_t duration_ns)
+{
+	size_t idx;
+
+	for (idx = 0; idx < num_buckets; idx++) {
+		if ((long long)duration_ns <= buckets[idx].bound_ns)
+			break;
+	}
+
+	atomic_counter_add(&h->buckets[idx], 1);
+	atomic_counter_add(&h->sum_ns, (long long)duration_ns);
+	atomic_counter_add(&h->count, 1);
+}
+
+static
+void sum_histogram(struct Histogram *total, struct Histogram *h, const size_t num_buckets)
+{
+	size_t idx;
+
+	for (idx = 0; idx <= num_buckets; idx++)
+		total->buckets[idx] += atomic_counter_load(&h->buckets[idx]);
+	total->sum_ns += atomic_counter_load(&h->sum_ns);
+	total->count += atomic_counter_load(&h->count);
+}
+
+static
+void append(struct TextBuffer *buf, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	if (buf->failed)
+		return;
+
+	va_start(args, fmt);
+	len = vsnprintf(buf->data + buf->length, buf->capacity - buf->length, fmt, args);
+	va_end(args);
+
+	if (len < 0) {
+		buf->failed = 1;
+		return;
+	}
+
+	if ((size_t)len >= buf->capacity - buf->length) {
+		size_t capacity = buf->capacity * 2;
+		char *data;
+
+		while (capacity - buf->length <= (size_t)len)
+			capacity *= 2;
+
+		data = mem_realloc(buf->data, capacity);
+		if (data == NULL) {
+			buf->failed = 1;
+			return;
+		}
+		buf->data = data;
+		buf->capacity = capacity;
+
+		va_start(args, fmt);
+		vsnprintf(buf->data + buf->length, buf->capacity - buf->length, fmt, args);
+		va_end(args);
+	}
+
+	buf->length += (size_t)len;
+}
+
+static
+void append_counter(struct TextBuffer *buf, const char *name, const char *help, const long long value)
+{
+	append(buf, "# HELP %s %s\n# TYPE %s counter\n%s %lld\n", name, help, name, name, value);
+}
+
+static
+void append_histogram(struct TextBuffer *buf, const char *name, const char *help,
+		      const struct Histogram *h, const struct Bucket *buckets, const size_t num_buckets)
+{
+	long long cumulative = 0;
+	size_t idx;
+
+	append(buf, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+	for (idx = 0; idx < num_buckets; idx++) {
+		cumulative += h->buckets[idx];
+		append(buf, "%s_bucket{le=\"%s\"} %lld\n", name, buckets[idx].le, cumulative);
+	}
+	cumulative += h->buckets[num_buckets];
+	append(buf, "%s_bucket{le=\"+Inf\"} %lld\n", name, cumulative);
+	append(buf, "%s_sum %lld.%09lld\n", name, h->sum_ns / 1000000000LL, h->sum_ns % 1000000000LL);
+	append(buf, "%s_count %lld\n", name, h->count);
+}
+
+void metrics_cache_hit(void)
+{
+	struct MetricsBlock *block = get_block();
+
+	if (block != NULL)
+		atomic_counter_add(&block->cache_hits, 1);
+}
+
+void metrics_cache_miss(void)
+{
+	struct MetricsBlock *block = get_block();
+
+	if (block != NULL)
+		atomic_counter_add(&block->cache_misses, 1);
+}
+
+EUPDRetCode metrics_check_done(const EUPDRetCode tRet)
+{
+	struct MetricsBlock *block = get_block();
+	size_t idx;
+
+	if (block == NULL)
+		return tRet;
+
+	for (idx = 0; idx < NUM_RET_CODES; idx++) {
+		if (RET_CODES[idx] == tRet)
+			break;
+	}
+	atomic_counter_add(&block->checks[idx], 1);
+
+	return tRet;
+}
+
+void metrics_delta(const int applied)
+{
+	struct MetricsBlock *block = get_block();
+
+	if (block == NULL)
+		return;
+
+	if (applied)
+		atomic_counter_add(&block->deltas_applied, 1);
+	else
+		atomic_counter_add(&block->delta_fallbacks, 1);
+}
+
+EUPDRetCode metrics_dump(char **text)
+{
+	struct MetricsBlock total;
+	struct MetricsBlock *block;
+	struct TextBuffer buf;
+	size_t idx;
+
+	memset(&total, 0, sizeof(struct MetricsBlock));
+
+	thread_once(&init_flag, init_once);
+
+	mutex_lock(&blocks_lock);
+	for (block = blocks; block != NULL; block = block->next) {
+		for (idx = 0; idx <= NUM_RET_CODES; idx++)
+			total.checks[idx] += atomic_counter_load(&block->checks[idx]);
+		total.bytes_fetched += atomic_counter_load(&block->bytes_fetched);
+		total.cache_hits += atomic_counter_load(&block->cache_hits);
+		total.cache_misses += atomic_counter_load(&block->cache_misses);
+		total.revalidations += atomic_counter_load(&block->revalidations);
+		total.deltas_applied += atomic_counter_load(&block->deltas_applied);
+		total.delta_fallbacks += atomic_counter_load(&block->delta_fallbacks);
+		total.manifest_memory += atomic_counter_load(&block->manifest_memory);
+		sum_histogram(&total.parse, &block->parse, NUM_PARSE_BUCKETS);
+		sum_histogram(&total.fetch, &block->fetch, NUM_FETCH_BUCKETS);
+	}
+	mutex_unlock(&blocks_lock);
+
+	buf.capacity = 4096;
+	buf.length = 0;
+	buf.failed = 0;
+	buf.data = mem_malloc(buf.capacity);
+	if (buf.data == NULL)
+		return EUPD_E_NO_MEMORY;
+
+	append(&buf, "# HELP eupd_checks_total Update checks by return code.\n# TYPE eupd_checks_total counter\n");
+	for (idx = 0; idx < NUM_RET_CODES; idx++)
+		append(&buf, "eupd_checks_total{code=\"%s\"} %lld\n", updater_error_to_str(RET_CODES[idx]), total.checks[idx]);
+	if (total.checks[NUM_RET_CODES] > 0)
+		append(&buf, "eupd_checks_total{code=\"unknown\"} %lld\n", total.checks[NUM_RET_CODES]);
+
+	append_counter(&buf, "eupd_fetched_bytes_total", "Bytes of lists of updates received.", total.bytes_fetched);
+	append_counter(&buf, "eupd_cache_hits_total", "Lists served without parsing, shared with a concurrent check or unchanged on the server.",
+		       total.cache_hits);
+	append_counter(&buf, "eupd_cache_misses_total", "Lists that had to be parsed.", total.cache_misses);
+	append_counter(&buf, "eupd_revalidations_total", "Conditional requests answered with 304 Not Modified.", total.revalidations);
+	append_counter(&buf, "eupd_deltas_applied_total", "Patches of cached lists applied instead of fetching the whole list.",
+		       total.deltas_applied);
+	append_counter(&buf, "eupd_delta_fallbacks_total", "Patches that did not match the cached list and were replaced by a full fetch.",
+		       total.delta_fallbacks);
+
+	append_histogram(&buf, "eupd_parse_duration_seconds", "Time spent parsing lists of updates.",
+			 &total.parse, PARSE_BUCKETS, NUM_PARSE_BUCKETS);
+	append_histogram(&buf, "eupd_fetch_duration_seconds", "Total time of transfers of lists of updates.",
+			 &total.fetch, FETCH_BUCKETS, NUM_FETCH_BUCKETS);
+
+	append(&buf, "# HELP eupd_manifest_memory_bytes Memory held by parsed lists of updates.\n"
+		     "# TYPE eupd_manifest_memory_bytes gauge\neupd_manifest_memory_bytes %lld\n", total.manifest_memory);
+
+	if (buf.failed) {
+		mem_free(buf.data);
+		return EUPD_E_NO_MEMORY;
+	}
+
+	*text = buf.data;
+
+	return EUPD_OK;
+}
+
+void metrics_fetched(const unsigned long long bytes, const uint64_t duration_ns)
+{
+	struct MetricsBlock *block = get_block();
+
+	if (block == NULL)
+		return;
+
+	atomic_counter_add(&block->bytes_fetched, (long long)bytes);
+	observe(&block->fetch, FETCH_BUCKETS, NUM_FETCH_BUCKETS, duration_ns);
+}
+
+void metrics_manifest_memory(const long long delta)
+{
+	struct MetricsBlock *block = get_block();
+
+	if (block != NULL)
+		atomic_counter_add(&block->manifest_memory, delta);
+}
+
+void metrics_parsed(const uint64_t duration_ns)
+{
+	struct MetricsBlock *block = get_block();
+
+	if (block != NULL)
+		observe(&block->parse, PARSE_BUCKETS, NUM_PARSE_BUCKETS, duration_ns);
+}
+
+void metrics_revalidated(void)
+{
+	struct MetricsBlock *block = get_block();
+
+	if (block != NULL)
+		atomic_counter_add(&block->revalidations, 1);
+}
@@ -0,0 +1,86 @@
+#ifndef ECHMET_UPD_METRICS_H
+#define ECHMET_UPD_METRICS_H
+
+#include <echmetupdatecheck.h>
+#include <stdint.h>
+
+/*
+ * Cumulative library-wide metrics. Every thread updates its own block
+ * of counters so that recording a value never contends with other threads.
+ * The blocks are summed up only when the metrics are read.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Records a list served without parsing it, either shared with a concurrent
+ * check or confirmed by the server as unchanged
+ */
+void metrics_cache_hit(void);
+
+/*!
+ * Records a list that had to be parsed
+ */
+void metrics_cache_miss(void);
+
+/*!
+ * Records the outcome of an update check
+ *
+ * @param[in] tRet Return code of the check
+ *
+ * @return \p tRet
+ */
+EUPDRetCode metrics_check_done(const EUPDRetCode tRet);
+
+/*!
+ * Records a patch of a list received in response to a revalidation
+ *
+ * @param[in] applied Non-zero if the patch was applied, zero if it did not match
+ *                    the cached list and the whole list had to be fetched
+ */
+void metrics_delta(const int applied);
+
+/*!
+ * Renders all metrics in Prometheus text exposition format
+ *
+ * @param[out] text Zero-terminated text. Shall be freed with \p mem_free().
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to render the text
+ */
+EUPDRetCode metrics_dump(char **text);
+
+/*!
+ * Records a finished transfer
+ *
+ * @param[in] bytes Size of the response body
+ * @param[in] duration_ns Total time of the transfer
+ */
+void metrics_fetched(const unsigned long long bytes, const uint64_t duration_ns);
+
+/*!
+ * Adjusts the amount of memory held by parsed lists
+ *
+ * @param[in] delta Number of bytes allocated, negative if released
+ */
+void metrics_manifest_memory(const long long delta);
+
+/*!
+ * Records time spent parsing a list
+ *
+ * @param[in] duration_ns Time spent parsing
+ */
+void metrics_parsed(const uint64_t duration_ns);
+
+/*!
+ * Records a conditional request answered by 304 Not Modified
+ */
+void metrics_revalidated(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_METRICS_H */
@@ -0,0 +1,487 @@
+#ifndef _WIN32
+	#define _POSIX_C_SOURCE 200809L
+#endif /* _WIN32 */
+
+#include "queue.h"
+#include "allocator.h"
+#include "manifest.h"
+#include "threading.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ECHMET_PLATFORM_UNIX
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif /* ECHMET_PLATFORM_UNIX */
+
+/* Longest sleep of an idle queue, submissions wake the queue up earlier */
+#define IDLE_WAIT_MS 1000
+
+/*!
+ * Check submitted to a queue
+ */
+struct Submission {
+	char *url;				/*!< URL of the list of updates */
+	int allow_insecure;
+	struct EUPDInSoftware *software;	/*!< Copy of the checked softwares */
+	size_t num_software;
+	void *user_data;
+	EUPDRetCode ret;			/*!< Result of the check, set on completion */
+	struct EUPDResult *results;
+	size_t num_results;
+	struct Submission *next;
+};
+
+/*!
+ * Download of a list of updates shared by all checks of the same list
+ * submitted while the download is in progress
+ */
+struct Flight {
+	char *url;
+	int allow_insecure;
+	struct Submission *waiters;	/*!< Checks waiting for the list in the order of submission */
+	struct Submission *last_waiter;
+	EUPDQueue *queue;
+	struct Flight *next;
+};
+
+struct EUPDQueue {
+	QueueParseFunc parse;
+	QueueCheckFunc check;
+	FetcherMulti *multi;
+	struct Flight *flights;			/*!< Downloads in progress, accessed only by the thread of the queue */
+	Thread thread;
+	Mutex lock;				/*!< Guards the fields below */
+	int stop;
+	struct Submission *incoming;		/*!< Checks not yet seen by the thread of the queue */
+	struct Submission *last_incoming;
+	struct Submission *completed;		/*!< Checks ready to be collected in the order of completion */
+	struct Submission *last_completed;
+#ifdef ECHMET_PLATFORM_UNIX
+	int notify_fds[2];			/*!< Pipe that holds one byte while there are completed checks */
+#endif /* ECHMET_PLATFORM_UNIX */
+};
+
+static
+void free_submission(struct Submission *s)
+{
+	if (s->results != NULL)
+		updater_free_result_list(s->results, s->num_results);
+	mem_free(s->software);
+	mem_free(s->url);
+	mem_free(s);
+}
+
+static
+void free_submissions(struct Submission *s)
+{
+	while (s != NULL) {
+		struct Submission *next = s->next;
+		free_submission(s);
+		s = next;
+	}
+}
+
+#ifdef ECHMET_PLATFORM_UNIX
+
+static
+int notify_open(EUPDQueue *queue)
+{
+	int idx;
+
+	if (pipe(queue->notify_fds) != 0)
+		return -1;
+
+	for (idx = 0; idx < 2; idx++) {
+		const int fd = queue->notify_fds[idx];
+
+		fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	}
+
+	return 0;
+}
+
+static
+void notify_close(EUPDQueue *queue)
+{
+	close(queue->notify_fds[0]);
+	close(queue->notify_fds[1]);
+}
+
+static
+void notify_set(EUPDQueue *queue)
+{
+	const char byte = 0;
+	ssize_t ret;
+
+	do {
+		ret = write(queue->notify_fds[1], &byte, 1);
+	} while (ret < 0 && errno == EINTR);
+}
+
+static
+void notify_clear(EUPDQueue *queue)
+{
+	char buf[16];
+	ssize_t ret;
+
+	do {
+		ret = read(queue->notify_fds[0], buf, sizeof(buf));
+	} while (ret > 0 || (ret < 0 && errno == EINTR));
+}
+
+int queue_fd(const EUPDQueue *queue)
+{
+	return queue->notify_fds[0];
+}
+
+#elif defined ECHMET_PLATFORM_WIN32
+
+static
+int notify_open(EUPDQueue *queue)
+{
+	(void)queue;
+
+	return 0;
+}
+
+static
+void notify_close(EUPDQueue *queue)
+{
+	(void)queue;
+}
+
+static
+void notify_set(EUPDQueue *queue)
+{
+	(void)queue;
+}
+
+static
+void notify_clear(EUPDQueue *queue)
+{
+	(void)queue;
+}
+
+int queue_fd(const EUPDQueue *queue)
+{
+	(void)queue;
+
+	return -1;
+}
+
+#else
+	#error "Unsupported or misdetected platform"
+#endif /* ECHMET_PLATFORM_UNIX */
+
+/*!
+ * Makes a finished check available for collection
+ *
+ * @param[in] queue The queue
+ * @param[in] s The check
+ */
+static
+void complete(EUPDQueue *queue, struct Submission *s)
+{
+	s->next = NULL;
+
+	mutex_lock(&queue->lock);
+	if (queue->completed == NULL) {
+		queue->completed = s;
+		notify_set(queue);
+	} else
+		queue->last_completed->next = s;
+	queue->last_completed = s;
+	mutex_unlock(&queue->lock);
+}
+
+static
+void unlink_flight(EUPDQueue *queue, struct Flight *f)
+{
+	struct Flight **pp;
+
+	for (pp = &queue->flights; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == f) {
+			*pp = f->next;
+			return;
+		}
+	}
+}
+
+/*!
+ * Evaluates all checks waiting for a list of updates and releases the download
+ *
+ * @param[in] ret Result of the download
+ * @param[in] dl_list The downloaded list
+ * @param[in] ctx The \p Flight
+ */
+static
+void flight_done(EUPDRetCode ret, struct DownloadedList *dl_list, void *ctx)
+{
+	struct Flight *f = (struct Flight *)ctx;
+	EUPDQueue *queue = f->queue;
+	EUPDManifest *manifest = NULL;
+	struct Submission *s;
+
+	/* The list is parsed once for all waiting checks */
+	if (!EUPD_IS_ERROR(ret))
+		ret = queue->parse(&manifest, dl_list, f->url, f->allow_insecure);
+	fetcher_list_cleanup(dl_list);
+
+	s = f->waiters;
+	while (s != NULL) {
+		struct Submission *next = s->next;
+
+		/* The check releases the snapshot when it is done */
+		if (manifest != NULL)
+			manifest_ref(manifest);
+		s->ret = queue->check(manifest, ret, f->url, s->software, s->num_software,
+				      &s->results, &s->num_results);
+		complete(queue, s);
+
+		s = next;
+	}
+
+	if (manifest != NULL)
+		manifest_unref(manifest);
+
+	unlink_flight(queue, f);
+	mem_free(f->url);
+	mem_free(f);
+}
+
+/*!
+ * Attaches a submitted check to the download of its list of updates.
+ * The download is started if it is not in progress already.
+ *
+ * @param[in] queue The queue
+ * @param[in] s The check
+ */
+static
+void dispatch(EUPDQueue *queue, struct Submission *s)
+{
+	struct Flight *f;
+	EUPDRetCode ret;
+
+	s->next = NULL;
+
+	for (f = queue->flights; f != NULL; f = f->next) {
+		if (f->allow_insecure == s->allow_insecure && !strcmp(f->url, s->url)) {
+			f->last_waiter->next = s;
+			f->last_waiter = s;
+			return;
+		}
+	}
+
+	f = (struct Flight *)mem_calloc(1, sizeof(struct Flight));
+	if (f == NULL) {
+		ret = EUPD_E_NO_MEMORY;
+		goto err_out;
+	}
+
+	f->url = mem_strdup(s->url);
+	if (f->url == NULL) {
+		ret = EUPD_E_NO_MEMORY;
+		goto err_out_2;
+	}
+	f->allow_insecure = s->allow_insecure;
+	f->queue = queue;
+	f->waiters = s;
+	f->last_waiter = s;
+
+	ret = fetcher_multi_add(queue->multi, f->url, f->allow_insecure, NULL, flight_done, f);
+	if (ret != EUPD_OK)
+		goto err_out_3;
+
+	f->next = queue->flights;
+	queue->flights = f;
+
+	return;
+
+err_out_3:
+	mem_free(f->url);
+err_out_2:
+	mem_free(f);
+err_out:
+	s->ret = queue->check(NULL, ret, s->url, s->software, s->num_software, &s->results, &s->num_results);
+	complete(queue, s);
+}
+
+static
+void queue_thread(void *arg)
+{
+	EUPDQueue *queue = (EUPDQueue *)arg;
+
+	for (;;) {
+		struct Submission *incoming;
+
+		mutex_lock(&queue->lock);
+		if (queue->stop) {
+			mutex_unlock(&queue->lock);
+			break;
+		}
+		incoming = queue->incoming;
+		queue->incoming = NULL;
+		queue->last_incoming = NULL;
+		mutex_unlock(&queue->lock);
+
+		while (incoming != NULL) {
+			struct Submission *next = incoming->next;
+			dispatch(queue, incoming);
+			incoming = next;
+		}
+
+		fetcher_multi_perform(queue->multi);
+		fetcher_multi_wait(queue->multi, IDLE_WAIT_MS);
+	}
+}
+
+size_t queue_collect(EUPDQueue *queue, struct EUPDCompletion *completions, const size_t max_completions)
+{
+	struct Submission *taken = NULL;
+	size_t num = 0;
+
+	mutex_lock(&queue->lock);
+	while (num < max_completions && queue->completed != NULL) {
+		struct Submission *s = queue->completed;
+		queue->completed = s->next;
+
+		completions[num].user_data = s->user_data;
+		completions[num].ret = s->ret;
+		completions[num].results = s->results;
+		completions[num].num_results = s->num_results;
+		num++;
+
+		/* The results now belong to the caller */
+		s->results = NULL;
+		s->next = taken;
+		taken = s;
+	}
+	if (queue->completed == NULL) {
+		queue->last_completed = NULL;
+		notify_clear(queue);
+	}
+	mutex_unlock(&queue->lock);
+
+	free_submissions(taken);
+
+	return num;
+}
+
+void queue_free(EUPDQueue *queue)
+{
+	struct Flight *f;
+
+	if (queue == NULL)
+		return;
+
+	mutex_lock(&queue->lock);
+	queue->stop = 1;
+	mutex_unlock(&queue->lock);
+
+	fetcher_multi_wakeup(queue->multi);
+	thread_join(&queue->thread);
+
+	fetcher_multi_free(queue->multi);
+
+	f = queue->flights;
+	while (f != NULL) {
+		struct Flight *next = f->next;
+
+		free_submissions(f->waiters);
+		mem_free(f->url);
+		mem_free(f);
+
+		f = next;
+	}
+
+	free_submissions(queue->incoming);
+	free_submissions(queue->completed);
+
+	notify_close(queue);
+	mutex_destroy(&queue->lock);
+	mem_free(queue);
+}
+
+EUPDRetCode queue_new(EUPDQueue **queue, QueueParseFunc parse, QueueCheckFunc check)
+{
+	EUPDQueue *q;
+	EUPDRetCode tRet;
+
+	q = (EUPDQueue *)mem_calloc(1, sizeof(EUPDQueue));
+	if (q == NULL)
+		return EUPD_E_NO_MEMORY;
+	q->parse = parse;
+	q->check = check;
+
+	tRet = fetcher_multi_new(&q->multi);
+	if (tRet != EUPD_OK)
+		goto err_out;
+
+	if (mutex_init(&q->lock) != 0) {
+		tRet = EUPD_E_NO_MEMORY;
+		goto err_out_2;
+	}
+
+	if (notify_open(q) != 0) {
+		tRet = EUPD_E_NO_MEMORY;
+		goto err_out_3;
+	}
+
+	if (thread_create(&q->thread, queue_thread, q) != 0) {
+		tRet = EUPD_E_NO_MEMORY;
+		goto err_out_4;
+	}
+
+	*queue = q;
+
+	return EUPD_OK;
+
+err_out_4:
+	notify_close(q);
+err_out_3:
+	mutex_destroy(&q->lock);
+err_out_2:
+	fetcher_multi_free(q->multi);
+err_out:
+	mem_free(q);
+
+	return tRet;
+}
+
+EUPDRetCode queue_submit(EUPDQueue *queue, const char *url, const struct EUPDInSoftware *in_software_list,
+			 const size_t num_software, const int allow_insecure, void *user_data)
+{
+	struct Submission *s;
+
+	s = (struct Submission *)mem_calloc(1, sizeof(struct Submission));
+	if (s == NULL)
+		return EUPD_E_NO_MEMORY;
+
+	s->url = mem_strdup(url);
+	s->software = (struct EUPDInSoftware *)mem_calloc(num_software > 0 ? num_software : 1, sizeof(struct EUPDInSoftware));
+	if (s->url == NULL || s->software == NULL) {
+		free_submission(s);
+		return EUPD_E_NO_MEMORY;
+	}
+	if (num_software > 0)
+		memcpy(s->software, in_software_list, num_software * sizeof(struct EUPDInSoftware));
+	s->num_software = num_software;
+	s->allow_insecure = allow_insecure;
+	s->user_data = user_data;
+
+	mutex_lock(&queue->lock);
+	if (queue->incoming == NULL)
+		queue->incoming = s;
+	else
+		queue->last_incoming->next = s;
+	queue->last_incoming = s;
+	mutex_unlock(&queue->lock);
+
+	fetcher_multi_wakeup(queue->multi);
+
+	return EUPD_OK;
+}
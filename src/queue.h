@@ -0,0 +1,102 @@
+#ifndef ECHMET_UPD_QUEUE_H
+#define ECHMET_UPD_QUEUE_H
+
+#include "list_fetcher.h"
+
+#include <echmetupdatecheck.h>
+
+/*!
+ * Function that parses a downloaded list of updates into a snapshot
+ *
+ * @param[out] manifest The snapshot. Set only on success.
+ * @param[in] dl_list The downloaded list
+ * @param[in] url URL the list was downloaded from
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ *
+ * @return EUPD_OK or warning on success, appropriate error code otherwise
+ */
+typedef EUPDRetCode (*QueueParseFunc)(EUPDManifest **manifest, struct DownloadedList *dl_list, const char *url,
+				      const int allow_insecure);
+
+/*!
+ * Function that checks update status of softwares against a snapshot and releases the snapshot
+ *
+ * @param[in] manifest The snapshot, <tt>NULL</tt> if it could not be obtained
+ * @param[in] list_ret Return code of obtaining the snapshot
+ * @param[in] url URL of the list of updates
+ * @param[in] in_software_list Array of descriptors of software to check
+ * @param[in] num_software Length of the in_software_list array
+ * @param[out] results Pointer to the array of results
+ * @param[out] num_results Number of items in the results array
+ *
+ * @return EUPD_OK or warning on success, appropriate error code otherwise
+ */
+typedef EUPDRetCode (*QueueCheckFunc)(EUPDManifest *manifest, const EUPDRetCode list_ret, const char *url,
+				      const struct EUPDInSoftware *in_software_list, const size_t num_software,
+				      struct EUPDResult **results, size_t *num_results);
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Takes completed checks out of a queue. This function never blocks.
+ *
+ * @param[in] queue The queue
+ * @param[out] completions Caller-allocated array of completions
+ * @param[in] max_completions Length of the \p completions array
+ *
+ * @return Number of completions stored in \p completions
+ */
+size_t queue_collect(EUPDQueue *queue, struct EUPDCompletion *completions, const size_t max_completions);
+
+/*!
+ * Returns file descriptor that is readable while a queue has completed checks
+ *
+ * @param[in] queue The queue
+ *
+ * @return The file descriptor, -1 on platforms without pollable descriptors
+ */
+int queue_fd(const EUPDQueue *queue);
+
+/*!
+ * Stops the thread of a queue, abandons the unfinished checks and frees the queue
+ *
+ * @param[in] queue The queue. May be <tt>NULL</tt>.
+ */
+void queue_free(EUPDQueue *queue);
+
+/*!
+ * Creates a queue of non-blocking update checks and starts its thread.
+ * The fetcher has to be initialized.
+ *
+ * @param[out] queue The queue
+ * @param[in] parse Function that parses the downloaded lists
+ * @param[in] check Function that evaluates the checks against the parsed lists
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory or the thread cannot be started
+ */
+EUPDRetCode queue_new(EUPDQueue **queue, QueueParseFunc parse, QueueCheckFunc check);
+
+/*!
+ * Submits a check of multiple softwares to a queue. This function never blocks.
+ *
+ * @param[in] queue The queue
+ * @param[in] url URL of updates list file
+ * @param[in] in_software_list Array of descriptors of software to check. The array is copied.
+ * @param[in] num_software Length of the in_software_list array
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[in] user_data Pointer reported with the completion of the check
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to submit the check
+ */
+EUPDRetCode queue_submit(EUPDQueue *queue, const char *url, const struct EUPDInSoftware *in_software_list,
+			 const size_t num_software, const int allow_insecure, void *user_data);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_QUEUE_H */
@@ -0,0 +1,105 @@
+#include "server_client.h"
+#include "allocator.h"
+#include "check_protocol.h"
+#include "list_fetcher.h"
+#include "threading.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SERVER_URL 2048
+
+static OnceFlag init_flag = ONCE_FLAG_INIT;
+static char server_url[MAX_SERVER_URL];
+
+static
+void init_server_url(void)
+{
+	const char *url = getenv(SERVER_URL_ENV);
+
+	if (url != NULL && strlen(url) < MAX_SERVER_URL)
+		strcpy(server_url, url);
+}
+
+EUPDRetCode server_client_set_url(const char *url)
+{
+	thread_once(&init_flag, init_server_url);
+
+	if (url == NULL) {
+		server_url[0] = '\0';
+		return EUPD_OK;
+	}
+
+	if (strlen(url) >= MAX_SERVER_URL)
+		return EUPD_E_INVALID_ARGUMENT;
+
+	strcpy(server_url, url);
+
+	return EUPD_OK;
+}
+
+int server_client_enabled(void)
+{
+	thread_once(&init_flag, init_server_url);
+
+	return server_url[0] != '\0';
+}
+
+int server_client_check(const char *url, const struct EUPDInSoftware *in_software_list, const size_t num_software,
+			const int allow_insecure, const char *user_agent, struct EUPDResult **results, EUPDRetCode *tRet,
+			uint32_t *outcome)
+{
+	const size_t url_length = strlen(url);
+	struct DownloadedList resp;
+	struct ProtocolResponse hdr;
+	char *req;
+	size_t req_length;
+	int ret = 0;
+
+	thread_once(&init_flag, init_server_url);
+
+	if (server_url[0] == '\0' || url_length > PROTOCOL_MAX_URL_LENGTH || num_software > PROTOCOL_MAX_SOFTWARE)
+		return 0;
+
+	/* The inventory and the answer shall not travel in plain text unless the caller allows it */
+	if (!allow_insecure && STRNICMP(server_url, "https://", 8) != 0)
+		return 0;
+
+	if (fetcher_init() != EUPD_OK)
+		return 0;
+
+	req = protocol_encode_request(url, url_length, in_software_list, num_software, allow_insecure, &req_length);
+	if (req == NULL)
+		return 0;
+
+	if (fetcher_post(&resp, server_url, allow_insecure, user_agent, SERVER_CONTENT_TYPE, req, req_length) != EUPD_OK)
+		goto out;
+
+	if (resp.list == NULL || resp.length < PROTOCOL_RESPONSE_HEADER_SIZE)
+		goto out;
+	if (protocol_decode_response(resp.list, &hdr) != 0 ||
+	    hdr.payload_length != resp.length - PROTOCOL_RESPONSE_HEADER_SIZE)
+		goto out;
+
+	if (EUPD_IS_ERROR(hdr.ret)) {
+		*tRet = hdr.ret;
+		*outcome = hdr.outcome;
+		ret = 1;
+		goto out;
+	}
+
+	if (hdr.num_results != num_software)
+		goto out;
+	if (protocol_decode_results(resp.list + PROTOCOL_RESPONSE_HEADER_SIZE, hdr.payload_length, num_software, results) != 0)
+		goto out;
+
+	*tRet = hdr.ret;
+	*outcome = hdr.outcome;
+	ret = 1;
+
+out:
+	fetcher_list_cleanup(&resp);
+	mem_free(req);
+
+	return ret;
+}
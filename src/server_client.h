@@ -0,0 +1,63 @@
+#ifndef ECHMET_UPD_SERVER_CLIENT_H
+#define ECHMET_UPD_SERVER_CLIENT_H
+
+#include "echmetupdatecheck_p.h"
+
+#include <echmetupdatecheck.h>
+#include <stdint.h>
+
+#define SERVER_URL_ENV "EUPD_CHECK_SERVER"
+#define SERVER_CONTENT_TYPE "application/x-eupd-check"
+#define SERVER_RESULT_CONTENT_TYPE "application/x-eupd-result"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Checks update status of multiple softwares through the eupd_server.
+ *
+ * The inventory is posted to the server which evaluates it against the list
+ * it holds in memory. Any failure to reach the server or a malformed answer
+ * makes the caller fall back to fetching the list on its own. Unless \p allow_insecure
+ * is set, the server is used only if its URL is an HTTPS URL.
+ *
+ * @param[in] url URL of the list of updates
+ * @param[in] in_software_list Array of validated descriptors of software to check
+ * @param[in] num_software Length of the in_software_list array
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[in] user_agent String to use as user agent, may be <tt>NULL</tt>
+ * @param[out] results Array of results allocated with \p mem_calloc(). Set only if the server
+ *                     answered and \p tRet is not an error.
+ * @param[out] tRet Result of the check performed by the server
+ * @param[out] outcome How the server obtained the list, one of \p PROTOCOL_OUTCOME_ values
+ *
+ * @return Non-zero if the server answered, zero if the check shall be performed directly
+ */
+int server_client_check(const char *url, const struct EUPDInSoftware *in_software_list, const size_t num_software,
+			const int allow_insecure, const char *user_agent, struct EUPDResult **results, EUPDRetCode *tRet,
+			uint32_t *outcome);
+
+/*!
+ * Checks whether a server has been configured
+ *
+ * @return Non-zero if checks shall be posted to the server
+ */
+int server_client_enabled(void);
+
+/*!
+ * Sets URL of the endpoint of the eupd_server. The default URL is taken from
+ * the \p EUPD_CHECK_SERVER environment variable if it is set.
+ *
+ * @param[in] url The URL, <tt>NULL</tt> or empty string to stop using the server
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_INVALID_ARGUMENT The URL is too long
+ */
+EUPDRetCode server_client_set_url(const char *url);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_SERVER_CLIENT_H */
@@ -0,0 +1,355 @@
+#include "shards.h"
+#include "allocator.h"
+#include "manifest.h"
+#include "stats.h"
+#include "threading.h"
+#include "trace.h"
+
+#include <string.h>
+
+/* Maximum number of shards fetched at the same time */
+#define MAX_CONCURRENT_FETCHES 8
+
+/*!
+ * Tracing events of a fetch performed by a group of threads
+ */
+struct ShardTrace {
+	struct TraceRecorder recorder;
+	size_t num_replayed;		/*!< Number of events already reported */
+};
+
+/*!
+ * Shards waiting to be fetched by a group of threads
+ */
+struct ShardQueue {
+	Mutex lock;
+	struct ShardFetch *fetches;
+	struct ShardTrace *traces;	/*!< Events of each fetch, <tt>NULL</tt> if not traced */
+	size_t num_fetches;
+	size_t next;			/*!< Position of the next shard to fetch */
+	int allow_insecure;
+	ShardFetchFunc func;
+};
+
+/*!
+ * Joins parts of a URL
+ *
+ * @param[in] head First part, only its first \p head_len characters are used
+ * @param[in] head_len Number of characters of \p head to use
+ * @param[in] sep Separator placed between the parts
+ * @param[in] tail Second part
+ *
+ * @return Zero-terminated string or <tt>NULL</tt> if there is not enough memory
+ */
+static
+char * join_url(const char *head, const size_t head_len, const char *sep, const char *tail)
+{
+	const size_t sep_len = strlen(sep);
+	const size_t tail_len = strlen(tail);
+	char *str = mem_malloc(head_len + sep_len + tail_len + 1);
+
+	if (str == NULL)
+		return NULL;
+
+	memcpy(str, head, head_len);
+	memcpy(str + head_len, sep, sep_len);
+	memcpy(str + head_len + sep_len, tail, tail_len + 1);
+
+	return str;
+}
+
+/*!
+ * Returns length of the scheme of a URL
+ *
+ * @param[in] url The URL
+ *
+ * @return Length of the scheme without the <tt>://</tt> separator, zero if the URL has no scheme
+ */
+static
+size_t scheme_length(const char *url)
+{
+	const size_t len = strcspn(url, ":/\\?#");
+
+	return (len > 0 && strncmp(url + len, "://", 3) == 0) ? len : 0;
+}
+
+/*!
+ * Checks whether an index may refer to a shard given by an absolute URL.
+ * The shard has to use the same scheme as the index, an index fetched
+ * from a server thus cannot make the client read local files.
+ *
+ * @param[in] base URL of the index
+ * @param[in] ref Absolute URL of the shard
+ *
+ * @retval 1 The shard may be fetched
+ * @retval 0 The shard shall be rejected
+ */
+static
+int is_same_scheme(const char *base, const char *ref)
+{
+	const size_t base_len = scheme_length(base);
+	const size_t ref_len = scheme_length(ref);
+
+	/* Index given by a path is a local file */
+	if (base_len == 0)
+		return ref_len == 4 && STRNICMP(ref, "file", 4) == 0;
+
+	return ref_len == base_len && STRNICMP(ref, base, base_len) == 0;
+}
+
+/*!
+ * Resolves URL of a shard against the URL of the index
+ *
+ * @param[in] base URL of the index, may be <tt>NULL</tt>
+ * @param[in] ref URL of the shard as given in the index
+ *
+ * @return Zero-terminated URL or <tt>NULL</tt> if there is not enough memory
+ */
+static
+char * resolve_url(const char *base, const char *ref)
+{
+	const char *scheme_end;
+	const char *path;
+	size_t end;
+	size_t idx;
+
+	if (base == NULL || scheme_length(ref) > 0)
+		return mem_strdup(ref);
+
+	/* Query and fragment of the index URL do not take part in the resolution */
+	end = strcspn(base, "?#");
+	scheme_end = strstr(base, "://");
+	if (scheme_end == NULL || (size_t)(scheme_end - base) > end) {
+		/* Index is a local file */
+		if (ref[0] == '/' || ref[0] == '\\')
+			return mem_strdup(ref);
+
+		for (idx = end; idx > 0; idx--) {
+			if (base[idx - 1] == '/' || base[idx - 1] == '\\')
+				return join_url(base, idx, "", ref);
+		}
+
+		return mem_strdup(ref);
+	}
+
+	path = strchr(scheme_end + 3, '/');
+	if (path == NULL || (size_t)(path - base) > end)
+		return join_url(base, end, ref[0] == '/' ? "" : "/", ref);
+
+	if (ref[0] == '/')
+		return join_url(base, (size_t)(path - base), "", ref);
+
+	for (idx = end; base[idx - 1] != '/'; idx--)
+		;
+
+	return join_url(base, idx, "", ref);
+}
+
+/*!
+ * Fetches one shard
+ *
+ * @param[in,out] f The shard
+ * @param[in] trace Where to record tracing events of the fetch, <tt>NULL</tt> to report them right away
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[in] func Function that obtains snapshot of the shard
+ */
+static
+void fetch_one(struct ShardFetch *f, struct ShardTrace *trace, const int allow_insecure, ShardFetchFunc func)
+{
+	stats_reset();
+	trace_record(trace != NULL ? &trace->recorder : NULL);
+
+	f->ret = func(&f->manifest, f->url, allow_insecure);
+	if (EUPD_IS_ERROR(f->ret))
+		f->manifest = NULL;
+
+	trace_record(NULL);
+	f->stats = *stats_current();
+}
+
+/*!
+ * Reports tracing events recorded by a group of threads in the order they occurred
+ *
+ * @param[in,out] traces Events of each fetch
+ * @param[in] num_fetches Number of fetches
+ */
+static
+void replay_traces(struct ShardTrace *traces, const size_t num_fetches)
+{
+	for (;;) {
+		const struct TraceRecord *first = NULL;
+		struct ShardTrace *from = NULL;
+		size_t idx;
+
+		for (idx = 0; idx < num_fetches; idx++) {
+			struct ShardTrace *t = &traces[idx];
+			const struct TraceRecord *r;
+
+			if (t->num_replayed == t->recorder.num_records)
+				continue;
+
+			r = &t->recorder.records[t->num_replayed];
+			if (first == NULL || r->event.timestamp_ns < first->event.timestamp_ns) {
+				first = r;
+				from = t;
+			}
+		}
+
+		if (first == NULL)
+			return;
+
+		trace_replay(first);
+		from->num_replayed++;
+	}
+}
+
+static
+void fetch_worker(void *arg)
+{
+	struct ShardQueue *queue = arg;
+
+	for (;;) {
+		size_t idx;
+
+		mutex_lock(&queue->lock);
+		idx = queue->next++;
+		mutex_unlock(&queue->lock);
+
+		if (idx >= queue->num_fetches)
+			return;
+
+		fetch_one(&queue->fetches[idx], (queue->traces != NULL) ? &queue->traces[idx] : NULL,
+			  queue->allow_insecure, queue->func);
+	}
+}
+
+void shards_fetch(struct ShardFetch *fetches, const size_t num_fetches, const int allow_insecure,
+		  ShardFetchFunc func)
+{
+	/* Each fetch starts with clean statistics, those of the check are restored afterwards */
+	const struct EUPDStats check_stats = *stats_current();
+	struct ShardQueue queue;
+	Thread threads[MAX_CONCURRENT_FETCHES - 1];
+	size_t num_threads;
+	size_t idx;
+
+	if (num_fetches < 2 || mutex_init(&queue.lock)) {
+		for (idx = 0; idx < num_fetches; idx++)
+			fetch_one(&fetches[idx], NULL, allow_insecure, func);
+		goto out;
+	}
+
+	/* Events of the helper threads are recorded and reported by the calling thread.
+	 * If there is no memory to record them, they are reported by the helpers. */
+	queue.traces = (trace_sink() != NULL) ? mem_calloc(num_fetches, sizeof(struct ShardTrace)) : NULL;
+	queue.fetches = fetches;
+	queue.num_fetches = num_fetches;
+	queue.next = 0;
+	queue.allow_insecure = allow_insecure;
+	queue.func = func;
+
+	/* The calling thread fetches too, threads that cannot be started
+	 * only make the fetching less concurrent */
+	for (num_threads = 0; num_threads < MAX_CONCURRENT_FETCHES - 1 && num_threads + 1 < num_fetches; num_threads++) {
+		if (thread_create(&threads[num_threads], fetch_worker, &queue))
+			break;
+	}
+
+	fetch_worker(&queue);
+
+	while (num_threads > 0)
+		thread_join(&threads[--num_threads]);
+
+	mutex_destroy(&queue.lock);
+
+	if (queue.traces != NULL) {
+		replay_traces(queue.traces, num_fetches);
+		mem_free(queue.traces);
+	}
+
+out:
+	*stats_current() = check_stats;
+	for (idx = 0; idx < num_fetches; idx++)
+		stats_merge(&fetches[idx].stats);
+}
+
+EUPDRetCode shards_plan(const struct ShardIndex *shards, const char *index_url,
+			const struct EUPDInSoftware *in_software_list, const size_t num_software,
+			struct ShardFetch **fetches, size_t *num_fetches, size_t *assignment)
+{
+	struct ShardFetch *list;
+	size_t *slots;
+	size_t count = 0;
+	size_t idx;
+
+	*fetches = NULL;
+	*num_fetches = 0;
+
+	/* Position of each shard in the list of fetches */
+	slots = mem_malloc(sizeof(size_t) * shards->num_urls);
+	if (slots == NULL)
+		return EUPD_E_NO_MEMORY;
+	for (idx = 0; idx < shards->num_urls; idx++)
+		slots[idx] = NO_SHARD;
+
+	list = mem_calloc(num_software > 0 ? num_software : 1, sizeof(struct ShardFetch));
+	if (list == NULL) {
+		mem_free(slots);
+		return EUPD_E_NO_MEMORY;
+	}
+
+	for (idx = 0; idx < num_software; idx++) {
+		const size_t shard = parser_find_shard(shards, in_software_list[idx].name);
+
+		if (shard == NO_SHARD) {
+			assignment[idx] = NO_SHARD;
+			continue;
+		}
+
+		if (slots[shard] == NO_SHARD) {
+			struct ShardFetch *f = &list[count];
+
+			if (index_url != NULL && scheme_length(shards->urls[shard]) > 0 &&
+			    !is_same_scheme(index_url, shards->urls[shard])) {
+				shards_release(list, count);
+				mem_free(slots);
+				return EUPD_E_MALFORMED_LIST;
+			}
+
+			f->shard = shard;
+			f->url = resolve_url(index_url, shards->urls[shard]);
+			if (f->url == NULL) {
+				shards_release(list, count);
+				mem_free(slots);
+				return EUPD_E_NO_MEMORY;
+			}
+
+			slots[shard] = count++;
+		}
+
+		assignment[idx] = slots[shard];
+	}
+
+	mem_free(slots);
+
+	*fetches = list;
+	*num_fetches = count;
+
+	return EUPD_OK;
+}
+
+void shards_release(struct ShardFetch *fetches, const size_t num_fetches)
+{
+	size_t idx;
+
+	if (fetches == NULL)
+		return;
+
+	for (idx = 0; idx < num_fetches; idx++) {
+		if (fetches[idx].manifest != NULL)
+			manifest_unref(fetches[idx].manifest);
+		mem_free(fetches[idx].url);
+	}
+
+	mem_free(fetches);
+}
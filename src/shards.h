@@ -0,0 +1,80 @@
+#ifndef ECHMET_UPD_SHARDS_H
+#define ECHMET_UPD_SHARDS_H
+
+#include "list_parser.h"
+
+#include <echmetupdatecheck.h>
+
+/*!
+ * Function that obtains snapshot of one shard
+ *
+ * @param[out] manifest Snapshot of the shard
+ * @param[in] url URL of the shard
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ *
+ * @return EUPD_OK or warning on success, appropriate error code otherwise
+ */
+typedef EUPDRetCode (*ShardFetchFunc)(EUPDManifest **manifest, const char *url, const int allow_insecure);
+
+/*!
+ * Fetch of one shard needed by an update check
+ */
+struct ShardFetch {
+	size_t shard;			/*!< Number of the shard in the index */
+	char *url;			/*!< Resolved URL of the shard */
+	EUPDManifest *manifest;		/*!< Snapshot of the shard, <tt>NULL</tt> if it could not be obtained */
+	EUPDRetCode ret;		/*!< Result of the fetch */
+	struct EUPDStats stats;		/*!< Statistics of the fetch */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Fetches shards concurrently. Each fetch is performed even if another one fails.
+ * Statistics of all fetches are added to the statistics of the calling thread
+ * and tracing events of the fetches are reported from the calling thread.
+ *
+ * @param[in,out] fetches Shards to fetch
+ * @param[in] num_fetches Number of shards to fetch
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[in] func Function that obtains snapshot of a shard
+ */
+void shards_fetch(struct ShardFetch *fetches, const size_t num_fetches, const int allow_insecure,
+		  ShardFetchFunc func);
+
+/*!
+ * Determines which shards are needed to check given softwares.
+ *
+ * @param[in] shards Index of shards
+ * @param[in] index_url URL of the index that relative shard URLs are resolved against.
+ *                      May be <tt>NULL</tt>.
+ * @param[in] in_software_list Array of descriptors of software to check
+ * @param[in] num_software Length of the \p in_software_list array
+ * @param[out] fetches Shards to fetch. Shall be released with \p shards_release().
+ * @param[out] num_fetches Number of shards to fetch
+ * @param[out] assignment Array of \p num_software items set to the position of each software's shard
+ *                        in \p fetches or to \p NO_SHARD if no shard contains the software.
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_MALFORMED_LIST A needed shard uses a different scheme than the index
+ * @retval EUPD_E_NO_MEMORY Insufficient memory to complete operation
+ */
+EUPDRetCode shards_plan(const struct ShardIndex *shards, const char *index_url,
+			const struct EUPDInSoftware *in_software_list, const size_t num_software,
+			struct ShardFetch **fetches, size_t *num_fetches, size_t *assignment);
+
+/*!
+ * Releases shards obtained by \p shards_plan() and \p shards_fetch().
+ *
+ * @param[in] fetches The shards, may be <tt>NULL</tt>
+ * @param[in] num_fetches Number of shards
+ */
+void shards_release(struct ShardFetch *fetches, const size_t num_fetches);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_SHARDS_H */
@@ -0,0 +1,165 @@
+#include "singleflight.h"
+#include "allocator.h"
+#include "manifest.h"
+#include "threading.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+ * Fetch of a list of updates that is in progress
+ */
+struct Flight {
+	const char *url;		/*!< URL of the list, owned by the leading caller */
+	int allow_insecure;
+	int done;			/*!< Non-zero once the leading caller has finished */
+	EUPDRetCode ret;		/*!< Result of the fetch */
+	EUPDManifest *manifest;		/*!< Fetched snapshot, the flight holds one reference to it */
+	size_t waiters;			/*!< Number of callers waiting for the result */
+	struct Flight *next;
+};
+
+static Mutex lock;
+static CondVar cond;
+static struct Flight *flights = NULL;
+
+static OnceFlag init_flag = ONCE_FLAG_INIT;
+static int init_ok = 0;
+
+static
+void init_singleflight(void)
+{
+	if (mutex_init(&lock))
+		return;
+	if (cond_init(&cond)) {
+		mutex_destroy(&lock);
+		return;
+	}
+
+	init_ok = 1;
+}
+
+static
+void unlink_flight(struct Flight *f)
+{
+	struct Flight **pp;
+
+	for (pp = &flights; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == f) {
+			*pp = f->next;
+			return;
+		}
+	}
+}
+
+/*!
+ * Releases a flight once all of its callers have taken its result.
+ * Shall be called with the lock held.
+ *
+ * @param[in] f The flight
+ */
+static
+void drop_flight(struct Flight *f)
+{
+	if (f->waiters > 0)
+		return;
+
+	if (f->manifest != NULL)
+		manifest_unref(f->manifest);
+	mem_free(f);
+}
+
+/*!
+ * Waits for the result of a flight led by another thread
+ * Shall be called with the lock held.
+ *
+ * @param[out] manifest Snapshot of the list
+ * @param[in] f The flight
+ *
+ * @return Return code of the flight
+ */
+static
+EUPDRetCode join_flight(EUPDManifest **manifest, struct Flight *f)
+{
+	EUPDRetCode tRet;
+
+	f->waiters++;
+	while (!f->done)
+		cond_wait(&cond, &lock);
+	f->waiters--;
+
+	tRet = f->ret;
+	if (f->manifest != NULL) {
+		manifest_ref(f->manifest);
+		*manifest = f->manifest;
+	}
+
+	drop_flight(f);
+
+	return tRet;
+}
+
+EUPDRetCode singleflight_do(EUPDManifest **manifest, const char *url, const int allow_insecure,
+			    FlightFunc func, const void *ctx, int *shared)
+{
+	struct Flight *f;
+	EUPDManifest *m = NULL;
+	EUPDRetCode tRet;
+
+	if (shared != NULL)
+		*shared = 0;
+
+	thread_once(&init_flag, init_singleflight);
+	if (!init_ok)
+		return func(manifest, url, allow_insecure, ctx);
+
+	mutex_lock(&lock);
+
+	for (f = flights; f != NULL; f = f->next) {
+		if (f->allow_insecure == allow_insecure && !strcmp(f->url, url)) {
+			tRet = join_flight(manifest, f);
+			mutex_unlock(&lock);
+
+			if (shared != NULL)
+				*shared = 1;
+
+			return tRet;
+		}
+	}
+
+	f = mem_malloc(sizeof(struct Flight));
+	if (f == NULL) {
+		mutex_unlock(&lock);
+		return func(manifest, url, allow_insecure, ctx);
+	}
+
+	memset(f, 0, sizeof(struct Flight));
+	f->url = url;
+	f->allow_insecure = allow_insecure;
+	f->next = flights;
+	flights = f;
+
+	mutex_unlock(&lock);
+
+	tRet = func(&m, url, allow_insecure, ctx);
+
+	mutex_lock(&lock);
+
+	/* Callers that arrive from now on start a new flight */
+	unlink_flight(f);
+	f->url = NULL;
+	f->done = 1;
+	f->ret = tRet;
+	if (!EUPD_IS_ERROR(tRet)) {
+		manifest_ref(m);
+		f->manifest = m;
+		*manifest = m;
+	}
+
+	cond_broadcast(&cond);
+	drop_flight(f);
+
+	mutex_unlock(&lock);
+
+	return tRet;
+}
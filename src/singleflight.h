@@ -0,0 +1,45 @@
+#ifndef ECHMET_UPD_SINGLEFLIGHT_H
+#define ECHMET_UPD_SINGLEFLIGHT_H
+
+#include <echmetupdatecheck.h>
+
+/*!
+ * Function that fetches and parses list of updates on behalf of all coalesced callers
+ *
+ * @param[out] manifest Snapshot of the list
+ * @param[in] url URL of the list
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[in] ctx Context passed to \p singleflight_do()
+ *
+ * @return EUPD_OK or warning on success, appropriate error code otherwise
+ */
+typedef EUPDRetCode (*FlightFunc)(EUPDManifest **manifest, const char *url, const int allow_insecure,
+				  const void *ctx);
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Obtains snapshot of a list of updates. If another thread is already obtaining
+ * the same list, the caller waits for it and shares its result instead of
+ * fetching the list again.
+ *
+ * @param[out] manifest Snapshot of the list. Set only on success.
+ * @param[in] url URL of the list
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[in] func Function that obtains the list if no other thread is doing it
+ * @param[in] ctx Context passed to \p func
+ * @param[out] shared Set to non-zero if the result was obtained by another thread.
+ *                    May be <tt>NULL</tt>.
+ *
+ * @return Return code of \p func
+ */
+EUPDRetCode singleflight_do(EUPDManifest **manifest, const char *url, const int allow_insecure,
+			    FlightFunc func, const void *ctx, int *shared);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_SINGLEFLIGHT_H */
@@ -0,0 +1,51 @@
+#include "stats.h"
+#include "threading.h"
+
+#include <string.h>
+
+static THREAD_LOCAL struct EUPDStats current;
+static THREAD_LOCAL size_t transient;
+
+struct EUPDStats * stats_current(void)
+{
+	return &current;
+}
+
+void stats_reset(void)
+{
+	memset(&current, 0, sizeof(struct EUPDStats));
+}
+
+#define MERGE_MAX(field) \
+	do { \
+		if (stats->field > current.field) \
+			current.field = stats->field; \
+	} while (0)
+
+void stats_merge(const struct EUPDStats *stats)
+{
+	MERGE_MAX(namelookup_ns);
+	MERGE_MAX(connect_ns);
+	MERGE_MAX(appconnect_ns);
+	MERGE_MAX(starttransfer_ns);
+	MERGE_MAX(total_ns);
+	MERGE_MAX(transient_peak_bytes);
+
+	current.bytes_downloaded += stats->bytes_downloaded;
+	current.redirects += stats->redirects;
+	current.parse_ns += stats->parse_ns;
+	current.compare_ns += stats->compare_ns;
+	current.shared_fetch = current.shared_fetch && stats->shared_fetch;
+}
+
+void stats_transient_alloc(const size_t bytes)
+{
+	transient += bytes;
+	if (transient > current.transient_peak_bytes)
+		current.transient_peak_bytes = transient;
+}
+
+void stats_transient_free(const size_t bytes)
+{
+	transient = transient > bytes ? transient - bytes : 0;
+}
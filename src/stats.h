@@ -0,0 +1,52 @@
+#ifndef ECHMET_UPD_STATS_H
+#define ECHMET_UPD_STATS_H
+
+#include <echmetupdatecheck.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Returns statistics of the check being performed by the calling thread
+ *
+ * @return Pointer to thread-local statistics
+ */
+struct EUPDStats * stats_current(void);
+
+/*!
+ * Clears statistics of the calling thread. Shall be called when a new check begins.
+ */
+void stats_reset(void);
+
+/*!
+ * Adds statistics of a fetch performed for the check of the calling thread,
+ * possibly by another thread, to the statistics of the calling thread.
+ * Sizes, counts and parse times are summed. Transfer times and the memory peak
+ * take the larger value as the fetches may have run concurrently.
+ *
+ * @param[in] stats Statistics of the fetch
+ */
+void stats_merge(const struct EUPDStats *stats);
+
+/*!
+ * Records memory allocated by the calling thread only for the duration
+ * of a fetch or a parse. Updates the peak of such memory in the statistics.
+ *
+ * @param[in] bytes Number of bytes allocated
+ */
+void stats_transient_alloc(const size_t bytes);
+
+/*!
+ * Records release of memory previously recorded with \p stats_transient_alloc()
+ *
+ * @param[in] bytes Number of bytes released
+ */
+void stats_transient_free(const size_t bytes);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_STATS_H */
@@ -0,0 +1,256 @@
+#ifndef _WIN32
+	#define _POSIX_C_SOURCE 200809L
+#endif /* _WIN32 */
+
+#include "threading.h"
+#include "allocator.h"
+
+#include <stdlib.h>
+
+struct ThreadStart {
+	ThreadFunc func;
+	void *arg;
+};
+
+#ifdef ECHMET_PLATFORM_UNIX
+
+#include <time.h>
+
+static
+void * thread_trampoline(void *raw)
+{
+	struct ThreadStart start = *(struct ThreadStart *)raw;
+
+	mem_free(raw);
+	start.func(start.arg);
+
+	return NULL;
+}
+
+void cond_destroy(CondVar *cv)
+{
+	pthread_cond_destroy(cv);
+}
+
+int cond_init(CondVar *cv)
+{
+	return pthread_cond_init(cv, NULL) == 0 ? 0 : -1;
+}
+
+void cond_broadcast(CondVar *cv)
+{
+	pthread_cond_broadcast(cv);
+}
+
+void cond_signal(CondVar *cv)
+{
+	pthread_cond_signal(cv);
+}
+
+void cond_wait(CondVar *cv, Mutex *mtx)
+{
+	pthread_cond_wait(cv, mtx);
+}
+
+void cond_wait_timed(CondVar *cv, Mutex *mtx, const unsigned long timeout_ms)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	pthread_cond_timedwait(cv, mtx, &ts);
+}
+
+void mutex_destroy(Mutex *mtx)
+{
+	pthread_mutex_destroy(mtx);
+}
+
+int mutex_init(Mutex *mtx)
+{
+	return pthread_mutex_init(mtx, NULL) == 0 ? 0 : -1;
+}
+
+void mutex_lock(Mutex *mtx)
+{
+	pthread_mutex_lock(mtx);
+}
+
+void mutex_unlock(Mutex *mtx)
+{
+	pthread_mutex_unlock(mtx);
+}
+
+int thread_create(Thread *thr, ThreadFunc func, void *arg)
+{
+	struct ThreadStart *start = mem_malloc(sizeof(struct ThreadStart));
+	if (start == NULL)
+		return -1;
+
+	start->func = func;
+	start->arg = arg;
+
+	if (pthread_create(thr, NULL, thread_trampoline, start) != 0) {
+		mem_free(start);
+		return -1;
+	}
+
+	return 0;
+}
+
+int thread_is_current(const Thread *thr)
+{
+	return pthread_equal(*thr, pthread_self());
+}
+
+void thread_join(Thread *thr)
+{
+	pthread_join(*thr, NULL);
+}
+
+int thread_key_create(ThreadKey *key, ThreadKeyDestructor dtor)
+{
+	return pthread_key_create(key, dtor) == 0 ? 0 : -1;
+}
+
+int thread_key_set(ThreadKey key, void *value)
+{
+	return pthread_setspecific(key, value) == 0 ? 0 : -1;
+}
+
+void thread_once(OnceFlag *flag, void (*func)(void))
+{
+	pthread_once(flag, func);
+}
+
+#elif defined ECHMET_PLATFORM_WIN32
+
+static
+DWORD WINAPI thread_trampoline(LPVOID raw)
+{
+	struct ThreadStart start = *(struct ThreadStart *)raw;
+
+	mem_free(raw);
+	start.func(start.arg);
+
+	return 0;
+}
+
+void cond_destroy(CondVar *cv)
+{
+	(void)cv;
+}
+
+int cond_init(CondVar *cv)
+{
+	InitializeConditionVariable(cv);
+	return 0;
+}
+
+void cond_broadcast(CondVar *cv)
+{
+	WakeAllConditionVariable(cv);
+}
+
+void cond_signal(CondVar *cv)
+{
+	WakeConditionVariable(cv);
+}
+
+void cond_wait(CondVar *cv, Mutex *mtx)
+{
+	SleepConditionVariableCS(cv, mtx, INFINITE);
+}
+
+void cond_wait_timed(CondVar *cv, Mutex *mtx, const unsigned long timeout_ms)
+{
+	SleepConditionVariableCS(cv, mtx, timeout_ms);
+}
+
+void mutex_destroy(Mutex *mtx)
+{
+	DeleteCriticalSection(mtx);
+}
+
+int mutex_init(Mutex *mtx)
+{
+	InitializeCriticalSection(mtx);
+	return 0;
+}
+
+void mutex_lock(Mutex *mtx)
+{
+	EnterCriticalSection(mtx);
+}
+
+void mutex_unlock(Mutex *mtx)
+{
+	LeaveCriticalSection(mtx);
+}
+
+int thread_create(Thread *thr, ThreadFunc func, void *arg)
+{
+	struct ThreadStart *start = mem_malloc(sizeof(struct ThreadStart));
+	if (start == NULL)
+		return -1;
+
+	start->func = func;
+	start->arg = arg;
+
+	thr->handle = CreateThread(NULL, 0, thread_trampoline, start, 0, &thr->id);
+	if (thr->handle == NULL) {
+		mem_free(start);
+		return -1;
+	}
+
+	return 0;
+}
+
+int thread_is_current(const Thread *thr)
+{
+	return thr->id == GetCurrentThreadId();
+}
+
+void thread_join(Thread *thr)
+{
+	WaitForSingleObject(thr->handle, INFINITE);
+	CloseHandle(thr->handle);
+}
+
+/* Fiber-local storage is used because plain TLS has no destructors.
+ * Fibers are not used by the library so the two are equivalent. */
+int thread_key_create(ThreadKey *key, ThreadKeyDestructor dtor)
+{
+	*key = FlsAlloc(dtor);
+	return *key == FLS_OUT_OF_INDEXES ? -1 : 0;
+}
+
+int thread_key_set(ThreadKey key, void *value)
+{
+	return FlsSetValue(key, value) ? 0 : -1;
+}
+
+/* InitOnceExecuteOnce() is not available on Windows XP */
+void thread_once(OnceFlag *flag, void (*func)(void))
+{
+	switch (InterlockedCompareExchange(flag, 1, 0)) {
+	case 0:
+		func();
+		InterlockedExchange(flag, 2);
+		return;
+	case 1:
+		while (InterlockedCompareExchange(flag, 2, 2) != 2)
+			Sleep(0);
+		return;
+	default:
+		return;
+	}
+}
+
+#endif /* ECHMET_PLATFORM */
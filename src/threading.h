@@ -0,0 +1,195 @@
+#ifndef ECHMET_UPD_THREADING_H
+#define ECHMET_UPD_THREADING_H
+
+#include "echmetupdatecheck_p.h"
+
+#ifdef ECHMET_PLATFORM_UNIX
+	#include <pthread.h>
+
+	typedef pthread_once_t OnceFlag;
+	typedef pthread_mutex_t Mutex;
+	typedef pthread_cond_t CondVar;
+	typedef pthread_t Thread;
+	typedef pthread_key_t ThreadKey;
+	#define ONCE_FLAG_INIT PTHREAD_ONCE_INIT
+	#define THREAD_KEY_CC
+#elif defined ECHMET_PLATFORM_WIN32
+	typedef volatile LONG OnceFlag;
+	typedef CRITICAL_SECTION Mutex;
+	typedef CONDITION_VARIABLE CondVar;
+	typedef struct _Thread {
+		HANDLE handle;
+		DWORD id;
+	} Thread;
+	typedef DWORD ThreadKey;
+	#define ONCE_FLAG_INIT 0
+	#define THREAD_KEY_CC WINAPI
+#else
+	#error "Unsupported or misdetected platform"
+#endif /* ECHMET_PLATFORM */
+
+#ifdef ECHMET_COMPILER_MSVC
+	#define THREAD_LOCAL __declspec(thread)
+#else
+	#define THREAD_LOCAL __thread
+#endif /* ECHMET_COMPILER_MSVC */
+
+/*!
+ * Entry point of a thread
+ */
+typedef void (*ThreadFunc)(void *arg);
+
+/*!
+ * Destructor of a thread-specific value, called when the owning thread exits
+ */
+typedef void (THREAD_KEY_CC *ThreadKeyDestructor)(void *value);
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Destroys condition variable
+ *
+ * @param[in] cv Condition variable to destroy
+ */
+void cond_destroy(CondVar *cv);
+
+/*!
+ * Initializes condition variable
+ *
+ * @param[out] cv Condition variable to initialize
+ *
+ * @retval 0 Success
+ * @retval -1 Failure
+ */
+int cond_init(CondVar *cv);
+
+/*!
+ * Wakes up all threads waiting on a condition variable
+ *
+ * @param[in] cv The condition variable
+ */
+void cond_broadcast(CondVar *cv);
+
+/*!
+ * Wakes up one thread waiting on a condition variable
+ *
+ * @param[in] cv The condition variable
+ */
+void cond_signal(CondVar *cv);
+
+/*!
+ * Waits on a condition variable
+ *
+ * @param[in] cv The condition variable
+ * @param[in] mtx Locked mutex associated with the condition variable
+ */
+void cond_wait(CondVar *cv, Mutex *mtx);
+
+/*!
+ * Waits on a condition variable for a limited amount of time
+ *
+ * @param[in] cv The condition variable
+ * @param[in] mtx Locked mutex associated with the condition variable
+ * @param[in] timeout_ms Maximum time to wait in milliseconds
+ */
+void cond_wait_timed(CondVar *cv, Mutex *mtx, const unsigned long timeout_ms);
+
+/*!
+ * Destroys mutex
+ *
+ * @param[in] mtx Mutex to destroy
+ */
+void mutex_destroy(Mutex *mtx);
+
+/*!
+ * Initializes mutex
+ *
+ * @param[out] mtx Mutex to initialize
+ *
+ * @retval 0 Success
+ * @retval -1 Failure
+ */
+int mutex_init(Mutex *mtx);
+
+/*!
+ * Locks mutex
+ *
+ * @param[in] mtx Mutex to lock
+ */
+void mutex_lock(Mutex *mtx);
+
+/*!
+ * Unlocks mutex
+ *
+ * @param[in] mtx Mutex to unlock
+ */
+void mutex_unlock(Mutex *mtx);
+
+/*!
+ * Starts a new thread
+ *
+ * @param[out] thr Handle of the new thread
+ * @param[in] func Entry point of the thread
+ * @param[in] arg Argument passed to the entry point
+ *
+ * @retval 0 Success
+ * @retval -1 Failure
+ */
+int thread_create(Thread *thr, ThreadFunc func, void *arg);
+
+/*!
+ * Checks whether the calling thread is the given thread
+ *
+ * @param[in] thr Handle of the thread
+ *
+ * @retval 1 Calling thread is \p thr
+ * @retval 0 Calling thread is some other thread
+ */
+int thread_is_current(const Thread *thr);
+
+/*!
+ * Waits for a thread to finish and releases its handle
+ *
+ * @param[in] thr Handle of the thread
+ */
+void thread_join(Thread *thr);
+
+/*!
+ * Creates a key for thread-specific values
+ *
+ * @param[out] key The key
+ * @param[in] dtor Function called with the non-<tt>NULL</tt> value of the key when a thread exits
+ *
+ * @retval 0 Success
+ * @retval -1 Failure
+ */
+int thread_key_create(ThreadKey *key, ThreadKeyDestructor dtor);
+
+/*!
+ * Sets value of a thread-specific key for the calling thread
+ *
+ * @param[in] key The key
+ * @param[in] value The value
+ *
+ * @retval 0 Success
+ * @retval -1 Failure
+ */
+int thread_key_set(ThreadKey key, void *value);
+
+/*!
+ * Calls a function exactly once regardless of how many threads
+ * try to call it concurrently. All callers return only after
+ * the function has finished.
+ *
+ * @param[in,out] flag Flag guarding the call, initialized to \p ONCE_FLAG_INIT
+ * @param[in] func Function to call
+ */
+void thread_once(OnceFlag *flag, void (*func)(void));
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_THREADING_H */
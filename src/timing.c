@@ -0,0 +1,36 @@
+#ifndef _WIN32
+	#define _POSIX_C_SOURCE 200809L
+#endif /* _WIN32 */
+
+#include "timing.h"
+#include "echmetupdatecheck_p.h"
+
+#ifdef ECHMET_PLATFORM_UNIX
+
+#include <time.h>
+
+uint64_t timing_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#elif defined ECHMET_PLATFORM_WIN32
+
+uint64_t timing_now_ns(void)
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+
+	return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000ULL +
+	       (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000ULL / (uint64_t)freq.QuadPart;
+}
+
+#endif /* ECHMET_PLATFORM */
@@ -0,0 +1,21 @@
+#ifndef ECHMET_UPD_TIMING_H
+#define ECHMET_UPD_TIMING_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Returns current value of a monotonic clock
+ *
+ * @return Time in nanoseconds since an unspecified point in the past
+ */
+uint64_t timing_now_ns(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_TIMING_H */
@@ -0,0 +1,100 @@
+#include "trace.h"
+#include "allocator.h"
+#include "atomics.h"
+#include "threading.h"
+#include "timing.h"
+
+/* Replaced callbacks may still be in use by spans in progress.
+ * They are kept until the library is cleaned up, registering
+ * a callback is expected to be rare. */
+static void * volatile current_sink = NULL;
+static void * volatile retired_sinks = NULL;
+
+static THREAD_LOCAL struct TraceRecorder *recorder = NULL;
+
+/*!
+ * Keeps a replaced callback until the library is cleaned up
+ *
+ * @param[in] sink The replaced callback
+ */
+static
+void retire(struct TraceSink *sink)
+{
+	do {
+		sink->next_retired = atomic_ptr_load(&retired_sinks);
+	} while (!atomic_ptr_cas(&retired_sinks, sink->next_retired, sink));
+}
+
+void trace_emit(TraceSpan span, const EUPDSpanKind kind, const int end, const char *url,
+		const unsigned long long bytes, const size_t items, const EUPDRetCode result)
+{
+	struct EUPDSpanEvent event;
+
+	event.kind = kind;
+	event.end = end;
+	event.timestamp_ns = timing_now_ns();
+	event.url = url;
+	event.bytes = bytes;
+	event.items = items;
+	event.result = result;
+
+	if (recorder != NULL) {
+		if (recorder->num_records < TRACE_MAX_RECORDS) {
+			struct TraceRecord *r = &recorder->records[recorder->num_records++];
+
+			r->span = span;
+			r->event = event;
+		}
+		return;
+	}
+
+	span->callback(&event, span->user_data);
+}
+
+void trace_cleanup(void)
+{
+	struct TraceSink *sink = atomic_ptr_exchange(&retired_sinks, NULL);
+
+	while (sink != NULL) {
+		struct TraceSink *next = sink->next_retired;
+
+		mem_free(sink);
+		sink = next;
+	}
+}
+
+void trace_record(struct TraceRecorder *new_recorder)
+{
+	recorder = new_recorder;
+}
+
+void trace_replay(const struct TraceRecord *record)
+{
+	record->span->callback(&record->event, record->span->user_data);
+}
+
+void trace_set_callback(EUPDTraceCallback callback, void *user_data)
+{
+	struct TraceSink *sink = NULL;
+	struct TraceSink *old;
+
+	if (callback != NULL) {
+		sink = mem_malloc(sizeof(struct TraceSink));
+		/* Keep the previous callback rather than silently disabling tracing */
+		if (sink == NULL)
+			return;
+
+		sink->callback = callback;
+		sink->user_data = user_data;
+		sink->next_retired = NULL;
+	}
+
+	old = atomic_ptr_exchange(&current_sink, sink);
+	if (old != NULL)
+		retire(old);
+}
+
+TraceSpan trace_sink(void)
+{
+	return atomic_ptr_load(&current_sink);
+}
@@ -0,0 +1,115 @@
+#ifndef ECHMET_UPD_TRACE_H
+#define ECHMET_UPD_TRACE_H
+
+#include <echmetupdatecheck.h>
+
+/*
+ * Tracing points are macros so that the arguments of an event are
+ * not even evaluated unless a tracing callback is registered.
+ * The registered callback is loaded once at the beginning of a span
+ * and both events of the span are reported to it even if another
+ * callback is registered in the meantime.
+ */
+
+#define TRACE_BEGIN(span, kind, url, bytes, items) \
+	do { \
+		(span) = trace_sink(); \
+		if ((span) != NULL) \
+			trace_emit(span, kind, 0, url, bytes, items, EUPD_OK); \
+	} while (0)
+
+#define TRACE_END(span, kind, url, bytes, items, result) \
+	do { \
+		if ((span) != NULL) \
+			trace_emit(span, kind, 1, url, bytes, items, result); \
+	} while (0)
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Registered callback along with its user data. Never modified once published.
+ */
+struct TraceSink {
+	EUPDTraceCallback callback;
+	void *user_data;
+	struct TraceSink *next_retired;
+};
+
+typedef const struct TraceSink * TraceSpan;
+
+/* Events of one fetch of a shard, fetching and parsing a shard produces six */
+#define TRACE_MAX_RECORDS 16
+
+/*!
+ * Event recorded on a helper thread to be reported later by the thread
+ * that performs the check
+ */
+struct TraceRecord {
+	TraceSpan span;
+	struct EUPDSpanEvent event;
+};
+
+/*!
+ * Events recorded instead of being reported. Events that do not fit are dropped.
+ */
+struct TraceRecorder {
+	struct TraceRecord records[TRACE_MAX_RECORDS];
+	size_t num_records;
+};
+
+/*!
+ * Reports a span event to the callback the span was started with
+ *
+ * @param[in] span Callback that was registered at the beginning of the span
+ * @param[in] kind Phase of the check
+ * @param[in] end Zero for the beginning of the span, non-zero for its end
+ * @param[in] url URL of the list, may be <tt>NULL</tt>
+ * @param[in] bytes Size of the list
+ * @param[in] items Number of processed items
+ * @param[in] result Outcome of the phase
+ */
+void trace_emit(TraceSpan span, const EUPDSpanKind kind, const int end, const char *url,
+		const unsigned long long bytes, const size_t items, const EUPDRetCode result);
+
+/*!
+ * Makes the calling thread record its events instead of reporting them.
+ *
+ * @param[in] recorder Where to record the events, <tt>NULL</tt> to report them again
+ */
+void trace_record(struct TraceRecorder *recorder);
+
+/*!
+ * Reports a recorded event to the callback it was recorded for
+ *
+ * @param[in] record The event
+ */
+void trace_replay(const struct TraceRecord *record);
+
+/*!
+ * Releases callbacks that have been replaced by another one.
+ * Shall be called only when no check is in progress.
+ */
+void trace_cleanup(void);
+
+/*!
+ * Registers the tracing callback
+ *
+ * @param[in] callback The callback, may be <tt>NULL</tt>
+ * @param[in] user_data Pointer passed to the callback
+ */
+void trace_set_callback(EUPDTraceCallback callback, void *user_data);
+
+/*!
+ * Returns the registered callback
+ *
+ * @return The callback with its user data, <tt>NULL</tt> if tracing is disabled
+ */
+TraceSpan trace_sink(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_TRACE_H */
@@ -1,12 +1,37 @@
+#include "allocator.h"
+#include "cache_client.h"
+#include "check_protocol.h"
 #include "list_fetcher.h"
 #include "list_parser.h"
 #include "list_comparator.h"
+#include "manifest.h"
+#include "metrics.h"
+#include "queue.h"
+#include "server_client.h"
+#include "shards.h"
+#include "singleflight.h"
+#include "stats.h"
+#include "timing.h"
+#include "trace.h"
+#include "watcher.h"
 
 #include <ctype.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+#define NO_MATCH ((size_t)-1)
+
+/*!
+ * Outcome of the comparison of one software in the block mode
+ */
+struct BlockMatch {
+	size_t item;			/*!< Index of the matching list item, \p NO_MATCH if there is none */
+	EUPDUpdateStatus status;
+	struct EUPDVersion version;
+};
+
 #define _STRINGIFY(input) #input
 #define ERROR_CODE_CASE(erCase) case erCase: return _STRINGIFY(erCase)
 
@@ -31,6 +56,42 @@ size_t get_software_name_length(const char *str)
 	return idx;
 }
 
+/*!
+ * Adds two sizes
+ *
+ * @param[out] sum The sum
+ *
+ * @return Zero on success, -1 if the sum does not fit into \p size_t
+ */
+static
+int size_add(size_t *sum, const size_t a, const size_t b)
+{
+	if (a > SIZE_MAX - b)
+		return -1;
+
+	*sum = a + b;
+
+	return 0;
+}
+
+/*!
+ * Multiplies two sizes
+ *
+ * @param[out] product The product
+ *
+ * @return Zero on success, -1 if the product does not fit into \p size_t
+ */
+static
+int size_mul(size_t *product, const size_t a, const size_t b)
+{
+	if (b != 0 && a > SIZE_MAX / b)
+		return -1;
+
+	*product = a * b;
+
+	return 0;
+}
+
 /*!
  * \brief Checks if the content of \p InSoftware is valid
  *
@@ -70,7 +131,7 @@ char * make_user_agent_str(const struct EUPDInSoftware *in_software)
 	static const char *PREFIX = "ECHMETUpdateCheck";
 	const size_t MAX_SIZE = 64;
 
-	char *user_agent = malloc(MAX_SIZE);
+	char *user_agent = mem_malloc(MAX_SIZE);
 	if (user_agent == NULL)
 		return NULL;
 
@@ -104,64 +165,367 @@ char * make_user_agent_str(const struct EUPDInSoftware *in_software)
  * @param[in] allow_insecure Allow HTTP and ignore TLS errors
  * @param[in] in_software ID of software requesting update check. This may be <tt>NULL</tt>
  *                        if no such information is available.
+ * @param[in] cached Previously fetched snapshot of the list to revalidate. This may be <tt>NULL</tt>
+ *                   if the list shall be fetched unconditionally.
  *
  * @return EUPD_OK on success, appropriate error code oterwise
  */
 static
 EUPDRetCode fetch(struct DownloadedList *dl_list, const char *url, const int allow_insecure,
-		  const struct EUPDInSoftware *in_software)
+		  const struct EUPDInSoftware *in_software, const EUPDManifest *cached)
 {
 	EUPDRetCode tRet;
+	char *user_agent;
+	TraceSpan span;
 
-	char *user_agent = make_user_agent_str(in_software);
+	memset(dl_list, 0, sizeof(struct DownloadedList));
 
-	fetcher_init();
+	tRet = fetcher_init();
+	if (tRet != EUPD_OK)
+		return tRet;
 
-	tRet = fetcher_fetch(dl_list, url, allow_insecure, user_agent);
-	free(user_agent);
+	user_agent = make_user_agent_str(in_software);
 
-	fetcher_cleanup();
+	TRACE_BEGIN(span, EUPD_SPAN_FETCH, url, 0, 0);
+	if (cached != NULL) {
+		/* A patch can only be applied to a completely parsed list identified by its ETag */
+		const int accept_delta = cached->etag != NULL && cached->parse_ret == EUPD_OK &&
+					 cached->sw_list.shards == NULL;
+
+		tRet = fetcher_fetch(dl_list, url, allow_insecure, user_agent, cached->etag, cached->last_modified,
+				     accept_delta);
+	} else
+		tRet = fetcher_fetch(dl_list, url, allow_insecure, user_agent, NULL, NULL, 0);
+	TRACE_END(span, EUPD_SPAN_FETCH, url, stats_current()->bytes_downloaded, 0, tRet);
+	mem_free(user_agent);
 
 	return tRet;
 }
 
 /*!
- * Downloads list of updates form a given URL and parses the list
+ * Parses list of updates into a new snapshot
+ *
+ * @param[out] manifest The snapshot
+ * @param[in] data Content of the list, does not have to be zero-terminated
+ * @param[in] length Length of the list
+ * @param[in] url URL the list was fetched from, <tt>NULL</tt> if the list was supplied by the caller
+ *
+ * @retval EUPD_OK List successfully parsed
+ * @retval EUPD_W_LIST_INCOMPLETE List contains invalid items and was not fully parsed
+ * @return Appropriate error code if the list cannot be processed at all
+ */
+static
+EUPDRetCode parse_manifest(EUPDManifest **manifest, const char *data, const size_t length, const char *url)
+{
+	struct SoftwareList sw_list;
+	EUPDRetCode tRet;
+	uint64_t start;
+	TraceSpan span;
+
+	memset(&sw_list, 0, sizeof(struct SoftwareList));
+
+	TRACE_BEGIN(span, EUPD_SPAN_PARSE, url, length, 0);
+	start = timing_now_ns();
+	tRet = parser_parse(data, length, &sw_list);
+	stats_current()->parse_ns = timing_now_ns() - start;
+	TRACE_END(span, EUPD_SPAN_PARSE, url, length, sw_list.length, tRet);
+	metrics_parsed(stats_current()->parse_ns);
+	metrics_cache_miss();
+	if (EUPD_IS_ERROR(tRet)) {
+		parser_free_list(&sw_list);
+		return tRet;
+	}
+
+	*manifest = manifest_new(&sw_list, tRet);
+	if (*manifest == NULL)
+		return EUPD_E_NO_MEMORY;
+	(*manifest)->parse_peak = stats_current()->transient_peak_bytes;
+
+	return tRet;
+}
+
+/*!
+ * Applies downloaded patch to a snapshot and creates a new snapshot from the result
+ *
+ * @param[out] manifest The new snapshot
+ * @param[in] base Snapshot the patch applies to
+ * @param[in] dl_list Downloaded patch
+ * @param[in] url URL the patch was fetched from
+ *
+ * @retval EUPD_OK Patch successfully applied
+ * @retval EUPD_E_MALFORMED_LIST Patch is not valid or does not match the snapshot
+ * @return Appropriate error code if the patch cannot be applied for other reasons
+ */
+static
+EUPDRetCode patch_manifest(EUPDManifest **manifest, const EUPDManifest *base, const struct DownloadedList *dl_list,
+			   const char *url)
+{
+	struct ListPatch patch;
+	struct SoftwareList sw_list;
+	EUPDRetCode tRet;
+	uint64_t start;
+	TraceSpan span;
+
+	memset(&sw_list, 0, sizeof(struct SoftwareList));
+
+	TRACE_BEGIN(span, EUPD_SPAN_PARSE, url, dl_list->length, 0);
+	start = timing_now_ns();
+	tRet = parser_parse_patch(dl_list->list, dl_list->length, &patch);
+	if (tRet == EUPD_OK) {
+		/* The new revision has to be identifiable so that the next patch can be applied to it */
+		if (dl_list->etag == NULL || strcmp(patch.base, base->etag))
+			tRet = EUPD_E_MALFORMED_LIST;
+		else
+			tRet = parser_apply_patch(&base->sw_list, &patch, &sw_list);
+	}
+	parser_free_patch(&patch);
+	stats_current()->parse_ns = timing_now_ns() - start;
+	TRACE_END(span, EUPD_SPAN_PARSE, url, dl_list->length, sw_list.length, tRet);
+	metrics_parsed(stats_current()->parse_ns);
+	if (tRet != EUPD_OK)
+		return tRet;
+
+	*manifest = manifest_new(&sw_list, EUPD_OK);
+	if (*manifest == NULL)
+		return EUPD_E_NO_MEMORY;
+	(*manifest)->parse_peak = stats_current()->transient_peak_bytes;
+
+	return EUPD_OK;
+}
+
+/*!
+ * Downloads list of updates from a given URL and parses it into a snapshot
  *
- * @param[out] sw_list Initialized \p SoftwareList struct
+ * @param[out] manifest The snapshot
  * @param[in] url URL of the file to download.
  * @param[in] allow_insecure Allow HTTP and ignore TLS errors
  * @param[in] in_software ID of software requesting update check. This may be <tt>NULL</tt>
  *                        if no such information is available.
+ * @param[in] cached Previously fetched snapshot of the list. If the server confirms that the list
+ *                   has not changed, a new reference to this snapshot is returned.
+ *                   This may be <tt>NULL</tt>.
  *
  * @retval EUPD_OK List successfully parsed
  * @retval EUPD_W_LIST_INCOMPLETE List contains invalid items and was not fully parsed
  * @return Appropriate error code if the list cannot be processed at all
  */
 static
-EUPDRetCode make_list(struct SoftwareList *sw_list, const char *url, const int allow_insecure,
-		      const struct EUPDInSoftware *in_software)
+EUPDRetCode make_manifest(EUPDManifest **manifest, const char *url, const int allow_insecure,
+			  const struct EUPDInSoftware *in_software, EUPDManifest *cached)
 {
 	struct DownloadedList dl_list;
 	EUPDRetCode tRet;
+	EUPDRetCode tRetTwo;
+	EUPDManifest *m;
 
-	tRet = fetch(&dl_list, url, allow_insecure, in_software);
-	if (EUPD_IS_ERROR(tRet)) {
-		fetcher_list_cleanup(&dl_list);
+	tRet = fetch(&dl_list, url, allow_insecure, in_software, cached);
+	if (EUPD_IS_ERROR(tRet))
+		goto out;
 
-		return tRet;
+	if (dl_list.not_modified) {
+		metrics_revalidated();
+		metrics_cache_hit();
+
+		manifest_ref(cached);
+		*manifest = cached;
+
+		tRet = cached->parse_ret;
+		goto out;
+	}
+
+	if (dl_list.delta) {
+		tRet = patch_manifest(&m, cached, &dl_list, url);
+		if (tRet == EUPD_E_MALFORMED_LIST) {
+			/* Patch does not fit the snapshot, fetch the whole list instead */
+			metrics_delta(0);
+			fetcher_list_cleanup(&dl_list);
+			return make_manifest(manifest, url, allow_insecure, in_software, NULL);
+		} else if (tRet == EUPD_OK)
+			metrics_delta(1);
+	} else
+		tRet = parse_manifest(&m, dl_list.list, dl_list.length, url);
+	if (EUPD_IS_ERROR(tRet))
+		goto out;
+
+	tRetTwo = manifest_set_origin(m, url, allow_insecure, &dl_list);
+	if (tRetTwo != EUPD_OK) {
+		manifest_unref(m);
+		tRet = tRetTwo;
+		goto out;
 	}
 
-	tRet = parser_parse(dl_list.list, sw_list);
+	*manifest = m;
+
+out:
 	fetcher_list_cleanup(&dl_list);
 
 	return tRet;
 }
 
+/*!
+ * Parses list of updates downloaded by a queue into a snapshot
+ *
+ * @param[out] manifest The snapshot
+ * @param[in] dl_list The downloaded list
+ * @param[in] url URL the list was downloaded from
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ *
+ * @retval EUPD_OK List successfully parsed
+ * @retval EUPD_W_LIST_INCOMPLETE List contains invalid items and was not fully parsed
+ * @return Appropriate error code if the list cannot be processed at all
+ */
+static
+EUPDRetCode queue_manifest(EUPDManifest **manifest, struct DownloadedList *dl_list, const char *url,
+			   const int allow_insecure)
+{
+	EUPDRetCode tRet;
+	EUPDRetCode tRetTwo;
+	EUPDManifest *m;
+
+	stats_reset();
+
+	tRet = parse_manifest(&m, dl_list->list, dl_list->length, url);
+	if (EUPD_IS_ERROR(tRet))
+		return tRet;
+
+	tRetTwo = manifest_set_origin(m, url, allow_insecure, dl_list);
+	if (tRetTwo != EUPD_OK) {
+		manifest_unref(m);
+		return tRetTwo;
+	}
+
+	*manifest = m;
+
+	return tRet;
+}
+
+static
+EUPDRetCode make_manifest_flight(EUPDManifest **manifest, const char *url, const int allow_insecure,
+				 const void *ctx)
+{
+	return make_manifest(manifest, url, allow_insecure, (const struct EUPDInSoftware *)ctx, NULL);
+}
+
+/*!
+ * Obtains parsed list of updates from a given URL. Concurrent requests for the same
+ * URL are coalesced so that the list is fetched and parsed only once.
+ *
+ * @param[out] manifest Snapshot of the list
+ * @param[in] url URL of the file to download.
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[in] in_software ID of software requesting update check. This may be <tt>NULL</tt>
+ *                        if no such information is available.
+ *
+ * @retval EUPD_OK List successfully parsed
+ * @retval EUPD_W_LIST_INCOMPLETE List contains invalid items and was not fully parsed
+ * @return Appropriate error code if the list cannot be processed at all
+ */
+static
+EUPDRetCode make_list(EUPDManifest **manifest, const char *url, const int allow_insecure,
+		      const struct EUPDInSoftware *in_software)
+{
+	EUPDRetCode tRet;
+	int shared;
+
+	*manifest = NULL;
+
+	tRet = singleflight_do(manifest, url, allow_insecure, make_manifest_flight, in_software, &shared);
+	stats_current()->shared_fetch = shared;
+	if (shared && !EUPD_IS_ERROR(tRet))
+		metrics_cache_hit();
+
+	return tRet;
+}
+
+/*!
+ * Checks update status of multiple softwares through the eupd_cached daemon
+ * or the eupd_server if either is available and the list would be fetched by libcurl.
+ *
+ * The list is fetched and compared remotely. A check answered this way reports
+ * a single fetch span that covers the whole exchange.
+ *
+ * @param[in] url URL of the list of updates
+ * @param[in] in_software_list Array of descriptors of software to check
+ * @param[in] num_software Length of the in_software_list array
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[out] results Array of results. Set only if the check has been performed successfully.
+ * @param[out] tRet Result of the check
+ *
+ * @return Non-zero if the check has been performed, zero if it shall be performed directly
+ */
+static
+int check_cached(const char *url, const struct EUPDInSoftware *in_software_list, const size_t num_software,
+		 const int allow_insecure, struct EUPDResult **results, EUPDRetCode *tRet)
+{
+	struct TraceRecorder recorder;
+	TraceSpan span;
+	uint32_t outcome = PROTOCOL_OUTCOME_FETCHED;
+	int answered;
+	size_t idx;
+
+	/* The daemon and the server check only lists fetched over HTTP(S) */
+	if (url == NULL || !fetcher_is_curl_transfer(url) || !protocol_is_http_url(url))
+		return 0;
+
+	/* Invalid input is reported by the direct check */
+	for (idx = 0; idx < num_software; idx++) {
+		if (!check_input(&in_software_list[idx]))
+			return 0;
+	}
+
+	/* Events of an attempt that does not answer the check are dropped,
+	 * the direct check reports its own */
+	recorder.num_records = 0;
+	trace_record(&recorder);
+	TRACE_BEGIN(span, EUPD_SPAN_FETCH, url, 0, 0);
+
+	answered = cache_client_check(url, in_software_list, num_software, allow_insecure, results, tRet, &outcome);
+	if (!answered && server_client_enabled()) {
+		char *user_agent = make_user_agent_str(num_software == 1 ? in_software_list : NULL);
+
+		answered = server_client_check(url, in_software_list, num_software, allow_insecure, user_agent,
+					       results, tRet, &outcome);
+		mem_free(user_agent);
+	}
+
+	TRACE_END(span, EUPD_SPAN_FETCH, url, 0, 0, answered ? *tRet : EUPD_OK);
+	trace_record(NULL);
+
+	if (!answered)
+		return 0;
+
+	for (idx = 0; idx < recorder.num_records; idx++)
+		trace_replay(&recorder.records[idx]);
+
+	if (!EUPD_IS_ERROR(*tRet)) {
+		/* A snapshot held remotely is shared with other checks unless it had to be fetched for this one */
+		if (outcome == PROTOCOL_OUTCOME_FETCHED)
+			metrics_cache_miss();
+		else
+			metrics_cache_hit();
+		stats_current()->shared_fetch = outcome == PROTOCOL_OUTCOME_CACHED || outcome == PROTOCOL_OUTCOME_STALE;
+	}
+
+	return 1;
+}
+
+/*!
+ * Releases snapshot obtained by \p make_list()
+ *
+ * @param[in] manifest The snapshot. May be <tt>NULL</tt>.
+ */
+static
+void release_list(EUPDManifest *manifest)
+{
+	if (manifest != NULL)
+		manifest_unref(manifest);
+}
+
 /*!
  * Processes one item from list of updates
  *
  * @param[in] sw_list List of updates
+ * @param[in] url URL of the list of updates
  * @param[in] in_software Software whose update status is to be checked
  * @param[out] result Result of the update check
  * @param[in] in_ret Value of return code before this function was called.
@@ -170,19 +534,26 @@ EUPDRetCode make_list(struct SoftwareList *sw_list, const char *url, const int a
  * @return EUPD_OK or previous warning code on success, appropriate error code otherwise
  */
 static
-EUPDRetCode process_item(const struct SoftwareList *sw_list, const struct EUPDInSoftware *in_software,
+EUPDRetCode process_item(const struct SoftwareList *sw_list, const char *url, const struct EUPDInSoftware *in_software,
 			 struct EUPDResult *result, const EUPDRetCode in_ret)
 {
 	EUPDRetCode tRet;
+	TraceSpan span;
 
-	tRet = comparator_compare(sw_list, in_software, &result->status, &result->version);
+	TRACE_BEGIN(span, EUPD_SPAN_COMPARE, url, 0, 1);
+	tRet = comparator_compare(sw_list, in_software, &result->status, &result->version, NULL);
+	TRACE_END(span, EUPD_SPAN_COMPARE, url, 0, 1, tRet);
 	if (EUPD_IS_ERROR(tRet))
 		return tRet;
 	else if (EUPD_IS_WARNING(in_ret))
 		tRet = in_ret;
 
 	if (result->status != EUST_UNKNOWN) {
-		EUPDRetCode tRetTwo = parser_set_link(sw_list, in_software->name, result);
+		EUPDRetCode tRetTwo;
+
+		TRACE_BEGIN(span, EUPD_SPAN_LINK, url, 0, 1);
+		tRetTwo = parser_set_link(sw_list, in_software->name, result);
+		TRACE_END(span, EUPD_SPAN_LINK, url, 0, 1, tRetTwo);
 		if (EUPD_IS_ERROR(tRetTwo))
 			tRet = tRetTwo;
 		else if (!EUPD_IS_WARNING(tRet))
@@ -192,6 +563,215 @@ EUPDRetCode process_item(const struct SoftwareList *sw_list, const struct EUPDIn
 	return tRet;
 }
 
+/*!
+ * Obtains snapshot of one shard of a sharded list
+ *
+ * @param[out] manifest Snapshot of the shard
+ * @param[in] url URL of the shard
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ *
+ * @return EUPD_OK or warning on success, appropriate error code otherwise
+ */
+static
+EUPDRetCode make_shard(EUPDManifest **manifest, const char *url, const int allow_insecure)
+{
+	EUPDRetCode tRet = make_list(manifest, url, allow_insecure, NULL);
+
+	/* Shards shall contain the software, not point to other shards */
+	if (!EUPD_IS_ERROR(tRet) && (*manifest)->sw_list.shards != NULL) {
+		manifest_unref(*manifest);
+		*manifest = NULL;
+		return EUPD_E_MALFORMED_LIST;
+	}
+
+	return tRet;
+}
+
+/*!
+ * Checks update status of softwares against the shards of a sharded list.
+ * Only the shards that contain the softwares are fetched.
+ *
+ * @param[in] index Snapshot of the index of the list
+ * @param[in] in_software_list Array of descriptors of software to check
+ * @param[in] num_software Length of the in_software_list array
+ * @param[out] results Array of \p num_software results
+ * @param[out] num_checked Number of results that have been filled in
+ *
+ * @return EUPD_OK or warning code on success, appropriate error code otherwise
+ */
+static
+EUPDRetCode check_sharded(const EUPDManifest *index, const struct EUPDInSoftware *in_software_list,
+			  const size_t num_software, struct EUPDResult *results, size_t *num_checked)
+{
+	static const struct SoftwareList EMPTY_LIST;
+
+	struct ShardFetch *fetches;
+	size_t num_fetches;
+	size_t *assignment;
+	EUPDRetCode tRet;
+	size_t idx;
+	uint64_t start;
+
+	*num_checked = 0;
+
+	for (idx = 0; idx < num_software; idx++) {
+		if (!check_input(&in_software_list[idx]))
+			return EUPD_E_INVALID_ARGUMENT;
+	}
+
+	assignment = mem_malloc(sizeof(size_t) * (num_software > 0 ? num_software : 1));
+	if (assignment == NULL)
+		return EUPD_E_NO_MEMORY;
+
+	tRet = shards_plan(index->sw_list.shards, index->url, in_software_list, num_software,
+			   &fetches, &num_fetches, assignment);
+	if (EUPD_IS_ERROR(tRet))
+		goto out;
+
+	shards_fetch(fetches, num_fetches, index->allow_insecure, make_shard);
+
+	tRet = index->parse_ret;
+	start = timing_now_ns();
+	for (idx = 0; idx < num_software; idx++) {
+		const struct ShardFetch *f = (assignment[idx] != NO_SHARD) ? &fetches[assignment[idx]] : NULL;
+
+		if (f == NULL) {
+			/* Software that is in no shard is not in the list at all */
+			tRet = process_item(&EMPTY_LIST, index->url, &in_software_list[idx], &results[idx], tRet);
+		} else {
+			if (EUPD_IS_ERROR(f->ret)) {
+				tRet = f->ret;
+				break;
+			}
+
+			tRet = process_item(&f->manifest->sw_list, f->url, &in_software_list[idx], &results[idx],
+					    EUPD_IS_WARNING(f->ret) ? f->ret : tRet);
+		}
+		if (EUPD_IS_ERROR(tRet))
+			break;
+
+		(*num_checked)++;
+	}
+	stats_current()->compare_ns = timing_now_ns() - start;
+
+	shards_release(fetches, num_fetches);
+
+out:
+	mem_free(assignment);
+
+	return tRet;
+}
+
+/*!
+ * Checks update status of one software against a snapshot and releases the snapshot
+ *
+ * @param[in] manifest The snapshot, <tt>NULL</tt> if it could not be obtained
+ * @param[in] list_ret Return code of obtaining the snapshot
+ * @param[in] url URL of the list of updates, may be <tt>NULL</tt>
+ * @param[in] in_software Software whose update status is to be checked
+ * @param[out] result Result of the update check
+ *
+ * @return EUPD_OK or warning code on success, appropriate error code otherwise
+ */
+static
+EUPDRetCode check_one(EUPDManifest *manifest, const EUPDRetCode list_ret, const char *url,
+		      const struct EUPDInSoftware *in_software, struct EUPDResult *result)
+{
+	EUPDRetCode tRet = list_ret;
+	uint64_t start;
+
+	if (EUPD_IS_ERROR(tRet))
+		goto out;
+
+	if (manifest->sw_list.shards != NULL) {
+		size_t num_checked;
+
+		tRet = check_sharded(manifest, in_software, 1, result, &num_checked);
+		goto out;
+	}
+
+	start = timing_now_ns();
+	tRet = process_item(&manifest->sw_list, url, in_software, result, tRet);
+	stats_current()->compare_ns = timing_now_ns() - start;
+
+out:
+	release_list(manifest);
+
+	return metrics_check_done(tRet);
+}
+
+/*!
+ * Checks update status of multiple softwares against a snapshot and releases the snapshot
+ *
+ * @param[in] manifest The snapshot, <tt>NULL</tt> if it could not be obtained
+ * @param[in] list_ret Return code of obtaining the snapshot
+ * @param[in] url URL of the list of updates, may be <tt>NULL</tt>
+ * @param[in] in_software_list Array of descriptors of software to check
+ * @param[in] num_software Length of the in_software_list array
+ * @param[out] out_results Pointer to the array of results
+ * @param[out] num_results Number of items if the results array
+ *
+ * @return EUPD_OK or warning code on success, appropriate error code otherwise
+ */
+static
+EUPDRetCode check_many(EUPDManifest *manifest, const EUPDRetCode list_ret, const char *url,
+		       const struct EUPDInSoftware *in_software_list, const size_t num_software,
+		       struct EUPDResult **out_results, size_t *num_results)
+{
+	const struct SoftwareList *sw_list;
+	EUPDRetCode tRet = list_ret;
+	struct EUPDResult *results = NULL;
+	uint64_t start;
+
+	*num_results = 0;
+
+	if (EUPD_IS_ERROR(tRet))
+		goto err_out;
+	sw_list = &manifest->sw_list;
+
+	results = mem_calloc(sizeof(struct EUPDResult), num_software);
+	if (results == NULL) {
+		tRet = EUPD_E_NO_MEMORY;
+		goto err_out;
+	}
+
+	if (sw_list->shards != NULL) {
+		tRet = check_sharded(manifest, in_software_list, num_software, results, num_results);
+		if (EUPD_IS_ERROR(tRet))
+			goto err_out;
+		goto done;
+	}
+
+	start = timing_now_ns();
+	for (*num_results = 0; *num_results < num_software; (*num_results)++) {
+		const struct EUPDInSoftware *in_sw = &in_software_list[*num_results];
+		if (!check_input(in_sw)) {
+			tRet = EUPD_E_INVALID_ARGUMENT;
+			goto err_out;
+		}
+
+		tRet = process_item(sw_list, url, in_sw,
+				    &results[*num_results], tRet);
+		if (EUPD_IS_ERROR(tRet))
+			goto err_out;
+	}
+	stats_current()->compare_ns = timing_now_ns() - start;
+
+done:
+	release_list(manifest);
+
+	*out_results = results;
+
+	return metrics_check_done(tRet);
+
+err_out:
+	release_list(manifest);
+	if (results != NULL)
+		updater_free_result_list(results, *num_results);
+
+	return metrics_check_done(tRet);
+}
+
 int is_revision_valid(const char *rev, const size_t len)
 {
 	size_t idx;
@@ -219,78 +799,519 @@ int is_software_name_valid(const size_t len)
 	return (len > 0 && len <= STRUCT_MEM_SZ(struct EUPDInSoftware, name));
 }
 
+EUPDRetCode ECHMET_CC updater_set_allocator(EUPDMallocFunc malloc_fn, EUPDReallocFunc realloc_fn,
+					    EUPDFreeFunc free_fn, void *user_data)
+{
+	return mem_set_allocator(malloc_fn, realloc_fn, free_fn, user_data);
+}
+
+EUPDRetCode ECHMET_CC updater_global_init(void)
+{
+	return fetcher_init();
+}
+
+void ECHMET_CC updater_global_cleanup(void)
+{
+	watcher_shutdown();
+	fetcher_cleanup();
+	trace_cleanup();
+}
+
 EUPDRetCode ECHMET_CC updater_check(const char *url, const struct EUPDInSoftware *in_software,
 				    struct EUPDResult *result, const int allow_insecure)
 {
-	struct SoftwareList sw_list;
+	EUPDManifest *manifest;
+	struct EUPDResult *results;
 	EUPDRetCode tRet;
 
+	stats_reset();
+
 	if (!check_input(in_software))
-		return EUPD_E_INVALID_ARGUMENT;
+		return metrics_check_done(EUPD_E_INVALID_ARGUMENT);
 
-	memset(&sw_list, 0, sizeof(struct SoftwareList));
 	memset(result, 0, sizeof(struct EUPDResult));
 
-	tRet = make_list(&sw_list, url, allow_insecure, in_software);
-	if (EUPD_IS_ERROR(tRet))
-		goto out;
+	if (check_cached(url, in_software, 1, allow_insecure, &results, &tRet)) {
+		if (!EUPD_IS_ERROR(tRet)) {
+			*result = results[0];
+			mem_free(results);
+		}
+		return metrics_check_done(tRet);
+	}
 
-	tRet = process_item(&sw_list, in_software, result, tRet);
+	tRet = make_list(&manifest, url, allow_insecure, in_software);
 
-out:
-	parser_free_list(&sw_list);
+	return check_one(manifest, tRet, url, in_software, result);
+}
 
-	return tRet;
+EUPDRetCode ECHMET_CC updater_check_buffer(const void *data, const size_t length, const struct EUPDInSoftware *in_software,
+					   struct EUPDResult *result)
+{
+	EUPDManifest *manifest = NULL;
+	EUPDRetCode tRet;
+
+	stats_reset();
+
+	if (data == NULL || !check_input(in_software))
+		return metrics_check_done(EUPD_E_INVALID_ARGUMENT);
+
+	memset(result, 0, sizeof(struct EUPDResult));
+
+	tRet = parse_manifest(&manifest, (const char *)data, length, NULL);
+
+	return check_one(manifest, tRet, NULL, in_software, result);
 }
 
 EUPDRetCode ECHMET_CC updater_check_many(const char *url, const struct EUPDInSoftware *in_software_list, const size_t num_software,
 					 struct EUPDResult **out_results, size_t *num_results, const int allow_insecure)
 {
-	struct SoftwareList sw_list;
+	EUPDManifest *manifest;
+	EUPDRetCode tRet;
+
+	stats_reset();
+
+	if (check_cached(url, in_software_list, num_software, allow_insecure, out_results, &tRet)) {
+		*num_results = EUPD_IS_ERROR(tRet) ? 0 : num_software;
+		return metrics_check_done(tRet);
+	}
+
+	tRet = make_list(&manifest, url, allow_insecure, NULL);
+
+	return check_many(manifest, tRet, url, in_software_list, num_software, out_results, num_results);
+}
+
+EUPDRetCode ECHMET_CC updater_check_many_buffer(const void *data, const size_t length,
+						const struct EUPDInSoftware *in_software_list, const size_t num_software,
+						struct EUPDResult **out_results, size_t *num_results)
+{
+	EUPDManifest *manifest = NULL;
+	EUPDRetCode tRet;
+
+	stats_reset();
+
+	if (data == NULL) {
+		*num_results = 0;
+		return metrics_check_done(EUPD_E_INVALID_ARGUMENT);
+	}
+
+	tRet = parse_manifest(&manifest, (const char *)data, length, NULL);
+
+	return check_many(manifest, tRet, NULL, in_software_list, num_software, out_results, num_results);
+}
+
+EUPDRetCode ECHMET_CC updater_check_many_block(const char *url, const struct EUPDInSoftware *in_software_list, const size_t num_software,
+					       struct EUPDResult **out_results, size_t *num_results, const int allow_insecure)
+{
+	EUPDManifest *manifest;
+	const struct SoftwareList *sw_list;
 	EUPDRetCode tRet;
 	struct EUPDResult *results;
+	struct BlockMatch *matches;
+	size_t *link_offsets;
+	size_t scratch_size;
+	size_t offsets_size;
+	size_t links_size;
+	size_t results_size;
+	size_t block_size;
+	size_t idx;
+	uint64_t start;
+	TraceSpan span;
 
-	results = calloc(sizeof(struct EUPDResult), num_software);
-	if (results == NULL)
-		return EUPD_E_NO_MEMORY;
+	stats_reset();
 
-	memset(results, 0, sizeof(struct EUPDResult) * num_software);
-	memset(&sw_list, 0, sizeof(struct SoftwareList));
 	*num_results = 0;
 
-	tRet = make_list(&sw_list, url, allow_insecure, NULL);
+	tRet = make_list(&manifest, url, allow_insecure, NULL);
 	if (EUPD_IS_ERROR(tRet))
 		goto err_out;
+	sw_list = &manifest->sw_list;
+	if (sw_list->shards != NULL) {
+		tRet = EUPD_E_INVALID_ARGUMENT;
+		goto err_out;
+	}
+
+	if (size_mul(&scratch_size, num_software, sizeof(struct BlockMatch)) != 0 ||
+	    size_mul(&offsets_size, sw_list->length, sizeof(size_t)) != 0 ||
+	    size_add(&scratch_size, scratch_size, offsets_size) != 0 ||
+	    size_add(&scratch_size, scratch_size, 1) != 0 ||
+	    size_mul(&results_size, num_software, sizeof(struct EUPDResult)) != 0) {
+		tRet = EUPD_E_NO_MEMORY;
+		goto err_out;
+	}
+
+	/* Scratch space holding the outcome of the comparison for each result
+	 * and the offset of each list item's link in the final block */
+	matches = mem_malloc(scratch_size);
+	if (matches == NULL) {
+		tRet = EUPD_E_NO_MEMORY;
+		goto err_out;
+	}
+	link_offsets = (size_t *)(matches + num_software);
+
+	/* First pass - compare everything and figure out how much space the links need */
+	TRACE_BEGIN(span, EUPD_SPAN_COMPARE, url, 0, num_software);
+	start = timing_now_ns();
+	for (idx = 0; idx < num_software; idx++) {
+		const struct EUPDInSoftware *in_sw = &in_software_list[idx];
+		const struct Software *match;
+		EUPDRetCode cRet;
 
-	for (*num_results = 0; *num_results < num_software; (*num_results)++) {
-		const struct EUPDInSoftware *in_sw = &in_software_list[*num_results];
 		if (!check_input(in_sw)) {
 			tRet = EUPD_E_INVALID_ARGUMENT;
-			goto err_out;
+			TRACE_END(span, EUPD_SPAN_COMPARE, url, 0, idx, tRet);
+			goto err_out_2;
 		}
 
-		tRet = process_item(&sw_list, in_sw,
-				    &results[*num_results], tRet);
-		if (EUPD_IS_ERROR(tRet))
-			goto err_out;
+		memset(&matches[idx], 0, sizeof(struct BlockMatch));
+		cRet = comparator_compare(sw_list, in_sw, &matches[idx].status, &matches[idx].version, &match);
+		if (!EUPD_IS_WARNING(tRet))
+			tRet = cRet;
+
+		matches[idx].item = (match != NULL) ? (size_t)(match - sw_list->items) : NO_MATCH;
 	}
+	TRACE_END(span, EUPD_SPAN_COMPARE, url, 0, num_software, tRet);
+
+	TRACE_BEGIN(span, EUPD_SPAN_LINK, url, 0, num_software);
+
+	for (idx = 0; idx < sw_list->length; idx++)
+		link_offsets[idx] = NO_MATCH;
 
-	parser_free_list(&sw_list);
+	links_size = 0;
+	for (idx = 0; idx < num_software; idx++) {
+		const size_t m = matches[idx].item;
+
+		if (m == NO_MATCH || link_offsets[m] != NO_MATCH)
+			continue;
+
+		link_offsets[m] = links_size;
+		if (size_add(&links_size, links_size, sw_list->items[m].link_len + 1) != 0) {
+			tRet = EUPD_E_NO_MEMORY;
+			TRACE_END(span, EUPD_SPAN_LINK, url, 0, num_software, tRet);
+			goto err_out_2;
+		}
+	}
+
+	/* Second pass - fill the block that holds the results and the links */
+	if (size_add(&block_size, results_size, links_size) != 0 || size_add(&block_size, block_size, 1) != 0) {
+		tRet = EUPD_E_NO_MEMORY;
+		TRACE_END(span, EUPD_SPAN_LINK, url, 0, num_software, tRet);
+		goto err_out_2;
+	}
+
+	results = mem_malloc(block_size);
+	if (results == NULL) {
+		tRet = EUPD_E_NO_MEMORY;
+		TRACE_END(span, EUPD_SPAN_LINK, url, 0, num_software, tRet);
+		goto err_out_2;
+	}
+	memset(results, 0, results_size);
+
+	for (idx = 0; idx < sw_list->length; idx++) {
+		const struct Software *sw = &sw_list->items[idx];
+
+		if (link_offsets[idx] != NO_MATCH)
+			memcpy((char *)results + results_size + link_offsets[idx], sw->link, sw->link_len + 1);
+	}
+
+	for (idx = 0; idx < num_software; idx++) {
+		const size_t m = matches[idx].item;
+
+		results[idx].status = matches[idx].status;
+		results[idx].version = matches[idx].version;
+		if (m != NO_MATCH)
+			results[idx].link = (char *)results + results_size + link_offsets[m];
+	}
+	TRACE_END(span, EUPD_SPAN_LINK, url, 0, num_software, EUPD_OK);
+	stats_current()->compare_ns = timing_now_ns() - start;
+
+	mem_free(matches);
+	release_list(manifest);
 
 	*out_results = results;
+	*num_results = num_software;
 
-	return tRet;
+	return metrics_check_done(tRet);
 
+err_out_2:
+	mem_free(matches);
 err_out:
-	parser_free_list(&sw_list);
-	updater_free_result_list(results, *num_results);
+	release_list(manifest);
 
-	return tRet;
+	return metrics_check_done(tRet);
+}
+
+EUPDRetCode ECHMET_CC updater_check_each(const char *url, const struct EUPDInSoftware *in_software_list, const size_t num_software,
+					 EUPDResultCallback callback, void *user_data, const int allow_insecure)
+{
+	EUPDManifest *manifest;
+	const struct SoftwareList *sw_list;
+	EUPDRetCode tRet;
+	size_t idx;
+	struct EUPDStats *stats;
+
+	stats_reset();
+	stats = stats_current();
+
+	if (callback == NULL)
+		return metrics_check_done(EUPD_E_INVALID_ARGUMENT);
+
+	tRet = make_list(&manifest, url, allow_insecure, NULL);
+	if (EUPD_IS_ERROR(tRet))
+		goto out;
+	sw_list = &manifest->sw_list;
+	if (sw_list->shards != NULL) {
+		tRet = EUPD_E_INVALID_ARGUMENT;
+		goto out;
+	}
+
+	for (idx = 0; idx < num_software; idx++) {
+		const struct EUPDInSoftware *in_sw = &in_software_list[idx];
+		const struct Software *match;
+		struct EUPDResult result;
+		EUPDRetCode cRet;
+		uint64_t start;
+		TraceSpan span;
+
+		if (!check_input(in_sw)) {
+			tRet = EUPD_E_INVALID_ARGUMENT;
+			goto out;
+		}
+
+		TRACE_BEGIN(span, EUPD_SPAN_COMPARE, url, 0, 1);
+		start = timing_now_ns();
+		cRet = comparator_compare(sw_list, in_sw, &result.status, &result.version, &match);
+		stats->compare_ns += timing_now_ns() - start;
+		TRACE_END(span, EUPD_SPAN_COMPARE, url, 0, 1, cRet);
+		if (!EUPD_IS_WARNING(tRet))
+			tRet = cRet;
+
+		/* The link is only borrowed for the duration of the callback */
+		result.link = (match != NULL) ? match->link : NULL;
+
+		if (callback(idx, &result, user_data))
+			break;
+	}
+
+out:
+	release_list(manifest);
+
+	return metrics_check_done(tRet);
+}
+
+EUPDRetCode ECHMET_CC updater_manifest_fetch(const char *url, const int allow_insecure, EUPDManifest **manifest)
+{
+	stats_reset();
+
+	return make_list(manifest, url, allow_insecure, NULL);
+}
+
+EUPDRetCode ECHMET_CC updater_manifest_refresh(EUPDManifest *manifest, EUPDManifest **refreshed)
+{
+	stats_reset();
+
+	if (manifest == NULL)
+		return EUPD_E_INVALID_ARGUMENT;
+
+	return make_manifest(refreshed, manifest->url, manifest->allow_insecure, NULL, manifest);
+}
+
+EUPDRetCode ECHMET_CC updater_manifest_check(const EUPDManifest *manifest, const struct EUPDInSoftware *in_software_list,
+					     const size_t num_software, struct EUPDResultView *views)
+{
+	EUPDRetCode tRet;
+	size_t idx;
+	uint64_t start;
+	TraceSpan span;
+
+	stats_reset();
+
+	if (manifest == NULL || manifest->sw_list.shards != NULL)
+		return metrics_check_done(EUPD_E_INVALID_ARGUMENT);
+
+	for (idx = 0; idx < num_software; idx++) {
+		if (!check_input(&in_software_list[idx]))
+			return metrics_check_done(EUPD_E_INVALID_ARGUMENT);
+	}
+
+	TRACE_BEGIN(span, EUPD_SPAN_COMPARE, manifest->url, 0, num_software);
+	start = timing_now_ns();
+	tRet = manifest_check(manifest, in_software_list, num_software, views);
+	stats_current()->compare_ns = timing_now_ns() - start;
+	TRACE_END(span, EUPD_SPAN_COMPARE, manifest->url, 0, num_software, tRet);
+
+	return metrics_check_done(tRet);
+}
+
+EUPDRetCode ECHMET_CC updater_manifest_check_shards(const EUPDManifest *index, const struct EUPDInSoftware *in_software_list,
+						    const size_t num_software, struct EUPDResult **results, size_t *num_results)
+{
+	stats_reset();
+
+	if (index == NULL || index->sw_list.shards == NULL) {
+		*num_results = 0;
+		return metrics_check_done(EUPD_E_INVALID_ARGUMENT);
+	}
+
+	/* The check releases the snapshot when it is done */
+	manifest_ref((EUPDManifest *)index);
+
+	return check_many((EUPDManifest *)index, index->parse_ret, index->url, in_software_list, num_software,
+			  results, num_results);
+}
+
+EUPDManifest * ECHMET_CC updater_manifest_ref(EUPDManifest *manifest)
+{
+	manifest_ref(manifest);
+
+	return manifest;
+}
+
+void ECHMET_CC updater_manifest_unref(EUPDManifest *manifest)
+{
+	if (manifest != NULL)
+		manifest_unref(manifest);
+}
+
+EUPDRetCode ECHMET_CC updater_manifest_memory(const EUPDManifest *manifest, struct EUPDMemoryUsage *usage)
+{
+	if (manifest == NULL || usage == NULL)
+		return EUPD_E_INVALID_ARGUMENT;
+
+	manifest_memory(manifest, usage);
+
+	return EUPD_OK;
+}
+
+int ECHMET_CC updater_manifest_is_index(const EUPDManifest *manifest)
+{
+	return manifest != NULL && manifest->sw_list.shards != NULL;
+}
+
+EUPDRetCode ECHMET_CC updater_watch(const char *url, const struct EUPDInSoftware *in_software,
+				    const unsigned int interval, const unsigned int jitter,
+				    EUPDWatchCallback callback, void *user_data, const int allow_insecure,
+				    EUPDWatch **watch)
+{
+	if (url == NULL || callback == NULL || interval == 0)
+		return EUPD_E_INVALID_ARGUMENT;
+	if (!check_input(in_software))
+		return EUPD_E_INVALID_ARGUMENT;
+
+	return watcher_add(url, in_software, interval * 1000UL, jitter * 1000UL,
+			   callback, user_data, allow_insecure, watch);
+}
+
+EUPDRetCode ECHMET_CC updater_watch_snapshot(EUPDWatch *watch, EUPDManifest **manifest)
+{
+	EUPDManifest *m;
+
+	if (watch == NULL || manifest == NULL)
+		return EUPD_E_INVALID_ARGUMENT;
+
+	m = watcher_snapshot(watch);
+	if (m == NULL)
+		return EUPD_W_NOT_FOUND;
+
+	*manifest = m;
+
+	return EUPD_OK;
+}
+
+void ECHMET_CC updater_unwatch(EUPDWatch *watch)
+{
+	if (watch != NULL)
+		watcher_remove(watch);
+}
+
+EUPDRetCode ECHMET_CC updater_queue_new(EUPDQueue **queue)
+{
+	EUPDRetCode tRet;
+
+	if (queue == NULL)
+		return EUPD_E_INVALID_ARGUMENT;
+
+	tRet = fetcher_init();
+	if (tRet != EUPD_OK)
+		return tRet;
+
+	return queue_new(queue, queue_manifest, check_many);
+}
+
+int ECHMET_CC updater_queue_fd(const EUPDQueue *queue)
+{
+	return queue_fd(queue);
+}
+
+EUPDRetCode ECHMET_CC updater_queue_submit(EUPDQueue *queue, const char *url,
+					   const struct EUPDInSoftware *in_software_list,
+					   const size_t num_software, const int allow_insecure,
+					   void *user_data)
+{
+	size_t idx;
+
+	if (queue == NULL || url == NULL)
+		return EUPD_E_INVALID_ARGUMENT;
+
+	for (idx = 0; idx < num_software; idx++) {
+		if (!check_input(&in_software_list[idx]))
+			return EUPD_E_INVALID_ARGUMENT;
+	}
+
+	return queue_submit(queue, url, in_software_list, num_software, allow_insecure, user_data);
+}
+
+size_t ECHMET_CC updater_queue_collect(EUPDQueue *queue, struct EUPDCompletion *completions,
+				       const size_t max_completions)
+{
+	return queue_collect(queue, completions, max_completions);
+}
+
+void ECHMET_CC updater_queue_free(EUPDQueue *queue)
+{
+	queue_free(queue);
+}
+
+void ECHMET_CC updater_set_trace_callback(EUPDTraceCallback callback, void *user_data)
+{
+	trace_set_callback(callback, user_data);
+}
+
+void ECHMET_CC updater_set_parse_limits(const struct EUPDParseLimits *limits)
+{
+	parser_set_limits(limits);
+}
+
+EUPDRetCode ECHMET_CC updater_set_cache_daemon(const char *socket_path)
+{
+	return cache_client_set_socket(socket_path);
+}
+
+EUPDRetCode ECHMET_CC updater_set_check_server(const char *server_url)
+{
+	return server_client_set_url(server_url);
+}
+
+EUPDRetCode ECHMET_CC updater_set_transport(const struct EUPDTransport *transport)
+{
+	return fetcher_set_transport(transport);
+}
+
+EUPDRetCode ECHMET_CC updater_metrics_dump(char **text)
+{
+	if (text == NULL)
+		return EUPD_E_INVALID_ARGUMENT;
+
+	return metrics_dump(text);
+}
+
+void ECHMET_CC updater_last_stats(struct EUPDStats *stats)
+{
+	*stats = *stats_current();
 }
 
 void ECHMET_CC updater_free_result(struct EUPDResult *result)
 {
-	free(result->link);
+	mem_free(result->link);
 }
 
 void ECHMET_CC updater_free_result_list(struct EUPDResult *results, const size_t num_results)
@@ -298,7 +1319,17 @@ void ECHMET_CC updater_free_result_list(struct EUPDResult *results, const size_t
 	size_t idx;
 	for (idx = 0; idx < num_results; idx++)
 		updater_free_result(&results[idx]);
-	free(results);
+	mem_free(results);
+}
+
+void ECHMET_CC updater_free_string(char *str)
+{
+	mem_free(str);
+}
+
+void ECHMET_CC updater_free_result_block(struct EUPDResult *results)
+{
+	mem_free(results);
 }
 
 const char * ECHMET_CC updater_error_to_str(const EUPDRetCode tRet)
@@ -318,6 +1349,7 @@ const char * ECHMET_CC updater_error_to_str(const EUPDRetCode tRet)
 		ERROR_CODE_CASE(EUPD_E_UNKW_NETWORK);
 		ERROR_CODE_CASE(EUPD_E_MALFORMED_LIST);
 		ERROR_CODE_CASE(EUPD_E_INVALID_ARGUMENT);
+		ERROR_CODE_CASE(EUPD_E_LIMIT_EXCEEDED);
 	default:
 		return "Unknown error";
 	}
@@ -0,0 +1,536 @@
+#include "watcher.h"
+#include "allocator.h"
+#include "atomics.h"
+#include "hazard.h"
+#include "manifest.h"
+#include "threading.h"
+#include "timing.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NS_PER_MS 1000000ULL
+
+typedef enum _ThreadState {
+	THREAD_NONE,
+	THREAD_RUNNING,
+	THREAD_EXITED
+} ThreadState;
+
+/*!
+ * List of updates shared by all watches with the same URL
+ */
+struct WatchSource {
+	char *url;			/*!< URL of the list */
+	int allow_insecure;		/*!< Allow HTTP and ignore TLS errors */
+	void * volatile current;	/*!< Last successfully fetched snapshot of the list, may be <tt>NULL</tt>.
+					     Published for lock-free readers, see \p publish() */
+	size_t num_watches;		/*!< Number of watches using this source */
+	struct WatchSource *next;
+};
+
+struct EUPDWatch {
+	struct WatchSource *source;	/*!< Source of the list of updates */
+	struct EUPDInSoftware software;	/*!< Watched software */
+	uint64_t interval_ns;		/*!< Refresh interval */
+	uint64_t jitter_ns;		/*!< Maximum random delay added to the refresh interval */
+	uint64_t due_ns;		/*!< Time of the next refresh */
+	EUPDWatchCallback callback;
+	void *user_data;
+	int has_result;			/*!< Non-zero if the callback has been called at least once */
+	EUPDUpdateStatus status;	/*!< Last reported update status */
+	struct EUPDVersion version;	/*!< Last reported latest version */
+	int removed;			/*!< Non-zero if the watch has been unregistered */
+	struct EUPDWatch *next;
+};
+
+static struct {
+	Mutex lock;
+	CondVar cond;
+	Thread thread;
+	ThreadState thread_state;
+	int stop;
+	struct EUPDWatch *watches;
+	struct WatchSource *sources;
+	struct WatchSource *released;		/*!< Sources without watches waiting to be freed by \p reclaim() */
+	const struct EUPDWatch *in_callback;	/*!< Watch whose callback is being executed */
+	uint64_t rng;
+} watcher;
+
+static OnceFlag init_flag = ONCE_FLAG_INIT;
+static int init_ok = 0;
+
+static
+void init_watcher(void)
+{
+	if (mutex_init(&watcher.lock))
+		return;
+	if (cond_init(&watcher.cond)) {
+		mutex_destroy(&watcher.lock);
+		return;
+	}
+
+	watcher.thread_state = THREAD_NONE;
+	watcher.rng = timing_now_ns() ^ (uint64_t)(uintptr_t)&watcher;
+	if (watcher.rng == 0)
+		watcher.rng = 1;
+
+	init_ok = 1;
+}
+
+/*!
+ * Returns pseudo-random delay within the jitter window of a watch.
+ * Shall be called with the lock held.
+ *
+ * @param[in] w The watch
+ *
+ * @return Delay in nanoseconds
+ */
+static
+uint64_t random_jitter(const struct EUPDWatch *w)
+{
+	/* xorshift64* */
+	watcher.rng ^= watcher.rng >> 12;
+	watcher.rng ^= watcher.rng << 25;
+	watcher.rng ^= watcher.rng >> 27;
+
+	if (w->jitter_ns == 0)
+		return 0;
+	return (watcher.rng * 2685821657736338717ULL) % (w->jitter_ns + 1);
+}
+
+/*!
+ * Returns the current snapshot of a source. Only the refresher may use this
+ * function, readers have to go through \p watcher_snapshot().
+ *
+ * @param[in] src The source
+ *
+ * @return The snapshot, may be <tt>NULL</tt>
+ */
+static
+EUPDManifest * current_manifest(struct WatchSource *src)
+{
+	return atomic_ptr_load(&src->current);
+}
+
+/*!
+ * Replaces the current snapshot of a source. Readers that already hold a reference
+ * to the previous snapshot keep using it.
+ *
+ * @param[in] src The source
+ * @param[in] manifest New snapshot. The source takes over the caller's reference.
+ *
+ * @return The previous snapshot that shall be passed to \p retire() once the lock
+ *         is released, <tt>NULL</tt> if there is none
+ */
+static
+EUPDManifest * publish(struct WatchSource *src, EUPDManifest *manifest)
+{
+	/* Refreshing an unchanged list returns the current snapshot, which stays published */
+	if (manifest == current_manifest(src)) {
+		manifest_unref(manifest);
+		return NULL;
+	}
+
+	return atomic_ptr_exchange(&src->current, manifest);
+}
+
+/*!
+ * Releases a snapshot that is no longer published once no reader may be acquiring it.
+ * Shall be called without the lock so that readers cannot stall the other users of the lock.
+ *
+ * @param[in] manifest The unpublished snapshot, may be <tt>NULL</tt>
+ */
+static
+void retire(EUPDManifest *manifest)
+{
+	if (manifest == NULL)
+		return;
+
+	hazard_synchronize(manifest);
+	manifest_unref(manifest);
+}
+
+/*!
+ * Frees sources released by the last of their watches.
+ * Shall be called with the lock held. The lock is released while the sources are freed.
+ */
+static
+void reclaim(void)
+{
+	struct WatchSource *src = watcher.released;
+
+	if (src == NULL)
+		return;
+
+	watcher.released = NULL;
+	mutex_unlock(&watcher.lock);
+
+	while (src != NULL) {
+		struct WatchSource *next = src->next;
+
+		retire(atomic_ptr_exchange(&src->current, NULL));
+		mem_free(src->url);
+		mem_free(src);
+
+		src = next;
+	}
+
+	mutex_lock(&watcher.lock);
+}
+
+/*!
+ * Drops a reference to a source. A source without watches is unlinked
+ * and freed by the next call of \p reclaim(). Shall be called with the lock held.
+ *
+ * @param[in] src The source
+ */
+static
+void release_source(struct WatchSource *src)
+{
+	struct WatchSource **pp;
+
+	if (--src->num_watches > 0)
+		return;
+
+	for (pp = &watcher.sources; *pp != NULL; pp = &(*pp)->next) {
+		if (*pp == src) {
+			*pp = src->next;
+			break;
+		}
+	}
+
+	src->next = watcher.released;
+	watcher.released = src;
+}
+
+static
+struct WatchSource * acquire_source(const char *url, const int allow_insecure)
+{
+	struct WatchSource *src;
+	size_t len;
+
+	for (src = watcher.sources; src != NULL; src = src->next) {
+		if (src->allow_insecure == allow_insecure && !strcmp(src->url, url)) {
+			src->num_watches++;
+			return src;
+		}
+	}
+
+	src = mem_malloc(sizeof(struct WatchSource));
+	if (src == NULL)
+		return NULL;
+
+	len = strlen(url);
+	src->url = mem_malloc(len + 1);
+	if (src->url == NULL) {
+		mem_free(src);
+		return NULL;
+	}
+	memcpy(src->url, url, len + 1);
+
+	src->allow_insecure = allow_insecure;
+	src->current = NULL;
+	src->num_watches = 1;
+	src->next = watcher.sources;
+	watcher.sources = src;
+
+	return src;
+}
+
+/*!
+ * Frees all watches that have been unregistered.
+ * Shall be called with the lock held.
+ */
+static
+void purge_removed(void)
+{
+	struct EUPDWatch **pp = &watcher.watches;
+
+	while (*pp != NULL) {
+		struct EUPDWatch *w = *pp;
+
+		if (w->removed) {
+			*pp = w->next;
+			release_source(w->source);
+			mem_free(w);
+		} else
+			pp = &w->next;
+	}
+}
+
+/*!
+ * Evaluates all watches of a source against its current snapshot and calls
+ * callbacks of those whose status has changed.
+ * Shall be called with the lock held. The lock is released while callbacks are executing.
+ *
+ * @param[in] src The source
+ */
+static
+void notify(struct WatchSource *src)
+{
+	EUPDManifest *m = current_manifest(src);
+	struct EUPDWatch *w;
+
+	manifest_ref(m);
+
+	for (w = watcher.watches; w != NULL; w = w->next) {
+		struct EUPDResultView view;
+		struct EUPDResult result;
+
+		if (w->source != src || w->removed)
+			continue;
+
+		manifest_check(m, &w->software, 1, &view);
+
+		if (w->has_result &&
+		    w->status == view.status &&
+		    !memcmp(&w->version, &view.version, sizeof(struct EUPDVersion)))
+			continue;
+
+		w->has_result = 1;
+		w->status = view.status;
+		w->version = view.version;
+
+		result.status = view.status;
+		result.version = view.version;
+		result.link = (char *)view.link;
+
+		watcher.in_callback = w;
+		mutex_unlock(&watcher.lock);
+
+		w->callback(w, &result, w->user_data);
+
+		mutex_lock(&watcher.lock);
+		watcher.in_callback = NULL;
+		cond_broadcast(&watcher.cond);
+	}
+
+	manifest_unref(m);
+}
+
+/*!
+ * Fetches the list of updates of a source and reschedules its watches.
+ * Shall be called with the lock held. The lock is released during the fetch.
+ *
+ * @param[in] src The source
+ */
+static
+void refresh(struct WatchSource *src)
+{
+	EUPDManifest *cached = current_manifest(src);
+	EUPDManifest *fresh = NULL;
+	EUPDManifest *replaced = NULL;
+	EUPDRetCode tRet;
+	struct EUPDWatch *w;
+	uint64_t now;
+
+	/* Keep the source alive while the lock is released */
+	src->num_watches++;
+	if (cached != NULL)
+		manifest_ref(cached);
+
+	mutex_unlock(&watcher.lock);
+
+	if (cached != NULL)
+		tRet = updater_manifest_refresh(cached, &fresh);
+	else
+		tRet = updater_manifest_fetch(src->url, src->allow_insecure, &fresh);
+
+	mutex_lock(&watcher.lock);
+
+	now = timing_now_ns();
+
+	/* Watches that would be due shortly anyway share this fetch */
+	for (w = watcher.watches; w != NULL; w = w->next) {
+		if (w->source != src || w->removed)
+			continue;
+		if (w->due_ns <= now + w->jitter_ns)
+			w->due_ns = now + w->interval_ns + random_jitter(w);
+	}
+
+	if (cached != NULL)
+		manifest_unref(cached);
+
+	if (!EUPD_IS_ERROR(tRet)) {
+		replaced = publish(src, fresh);
+
+		/* Even an unchanged list has to be evaluated for newly added watches */
+		notify(src);
+	}
+
+	release_source(src);
+
+	if (replaced != NULL) {
+		mutex_unlock(&watcher.lock);
+		retire(replaced);
+		mutex_lock(&watcher.lock);
+	}
+}
+
+static
+void watcher_loop(void *arg)
+{
+	(void)arg;
+
+	mutex_lock(&watcher.lock);
+
+	for (;;) {
+		struct EUPDWatch *w;
+		struct EUPDWatch *earliest = NULL;
+		uint64_t now;
+
+		purge_removed();
+		reclaim();
+
+		if (watcher.stop || watcher.watches == NULL)
+			break;
+
+		for (w = watcher.watches; w != NULL; w = w->next) {
+			if (earliest == NULL || w->due_ns < earliest->due_ns)
+				earliest = w;
+		}
+
+		now = timing_now_ns();
+		if (earliest->due_ns > now) {
+			const uint64_t wait_ms = (earliest->due_ns - now + NS_PER_MS - 1) / NS_PER_MS;
+
+			cond_wait_timed(&watcher.cond, &watcher.lock, (unsigned long)wait_ms);
+			continue;
+		}
+
+		refresh(earliest->source);
+	}
+
+	watcher.thread_state = THREAD_EXITED;
+	cond_broadcast(&watcher.cond);
+
+	mutex_unlock(&watcher.lock);
+}
+
+EUPDRetCode watcher_add(const char *url, const struct EUPDInSoftware *in_software,
+			const unsigned long interval_ms, const unsigned long jitter_ms,
+			EUPDWatchCallback callback, void *user_data, const int allow_insecure,
+			EUPDWatch **watch)
+{
+	struct EUPDWatch *w;
+
+	thread_once(&init_flag, init_watcher);
+	if (!init_ok)
+		return EUPD_E_NO_MEMORY;
+
+	w = mem_malloc(sizeof(struct EUPDWatch));
+	if (w == NULL)
+		return EUPD_E_NO_MEMORY;
+
+	memset(w, 0, sizeof(struct EUPDWatch));
+	w->software = *in_software;
+	w->interval_ns = (uint64_t)interval_ms * NS_PER_MS;
+	w->jitter_ns = (uint64_t)jitter_ms * NS_PER_MS;
+	w->due_ns = timing_now_ns();
+	w->callback = callback;
+	w->user_data = user_data;
+
+	mutex_lock(&watcher.lock);
+
+	w->source = acquire_source(url, allow_insecure);
+	if (w->source == NULL)
+		goto err_out;
+
+	if (watcher.thread_state == THREAD_EXITED) {
+		thread_join(&watcher.thread);
+		watcher.thread_state = THREAD_NONE;
+	}
+
+	w->next = watcher.watches;
+	watcher.watches = w;
+
+	if (watcher.thread_state == THREAD_NONE) {
+		watcher.stop = 0;
+		if (thread_create(&watcher.thread, watcher_loop, NULL)) {
+			watcher.watches = w->next;
+			release_source(w->source);
+			goto err_out;
+		}
+		watcher.thread_state = THREAD_RUNNING;
+	}
+
+	cond_broadcast(&watcher.cond);
+	mutex_unlock(&watcher.lock);
+
+	*watch = w;
+
+	return EUPD_OK;
+
+err_out:
+	reclaim();
+	mutex_unlock(&watcher.lock);
+	mem_free(w);
+
+	return EUPD_E_NO_MEMORY;
+}
+
+EUPDManifest * watcher_snapshot(EUPDWatch *watch)
+{
+	EUPDManifest *m;
+	size_t slot;
+
+	/* The source cannot go away while the watch is registered */
+	m = hazard_acquire(&watch->source->current, &slot);
+	if (m != NULL)
+		manifest_ref(m);
+	hazard_release(slot);
+
+	return m;
+}
+
+void watcher_remove(EUPDWatch *watch)
+{
+	mutex_lock(&watcher.lock);
+
+	watch->removed = 1;
+
+	if (watcher.thread_state == THREAD_RUNNING) {
+		if (!thread_is_current(&watcher.thread)) {
+			while (watcher.in_callback == watch)
+				cond_wait(&watcher.cond, &watcher.lock);
+		}
+		cond_broadcast(&watcher.cond);
+	} else {
+		purge_removed();
+		reclaim();
+	}
+
+	mutex_unlock(&watcher.lock);
+}
+
+void watcher_shutdown(void)
+{
+	if (!init_ok)
+		return;
+
+	mutex_lock(&watcher.lock);
+
+	watcher.stop = 1;
+	cond_broadcast(&watcher.cond);
+
+	if (watcher.thread_state != THREAD_NONE) {
+		mutex_unlock(&watcher.lock);
+		thread_join(&watcher.thread);
+		mutex_lock(&watcher.lock);
+
+		watcher.thread_state = THREAD_NONE;
+	}
+
+	while (watcher.watches != NULL) {
+		struct EUPDWatch *w = watcher.watches;
+
+		watcher.watches = w->next;
+		release_source(w->source);
+		mem_free(w);
+	}
+	reclaim();
+
+	mutex_unlock(&watcher.lock);
+}
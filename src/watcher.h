@@ -0,0 +1,59 @@
+#ifndef ECHMET_UPD_WATCHER_H
+#define ECHMET_UPD_WATCHER_H
+
+#include <echmetupdatecheck.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*!
+ * Registers software whose update status shall be watched by the background refresher.
+ * The refresher thread is started if it is not running already.
+ *
+ * @param[in] url URL of updates list file
+ * @param[in] in_software Descriptor of the watched software
+ * @param[in] interval_ms Refresh interval in milliseconds
+ * @param[in] jitter_ms Maximum random delay added to each refresh interval in milliseconds
+ * @param[in] callback Function to call when the update status changes
+ * @param[in] user_data Pointer passed to \p callback
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[out] watch Handle of the registration
+ *
+ * @retval EUPD_OK Success
+ * @retval EUPD_E_NO_MEMORY Insufficient memory or the refresher thread cannot be started
+ */
+EUPDRetCode watcher_add(const char *url, const struct EUPDInSoftware *in_software,
+			const unsigned long interval_ms, const unsigned long jitter_ms,
+			EUPDWatchCallback callback, void *user_data, const int allow_insecure,
+			EUPDWatch **watch);
+
+/*!
+ * Returns the most recent snapshot of the list of updates of a watch.
+ * This function never blocks.
+ *
+ * @param[in] watch Handle of the registration
+ *
+ * @return New reference to the snapshot or <tt>NULL</tt> if no snapshot is available yet
+ */
+EUPDManifest * watcher_snapshot(EUPDWatch *watch);
+
+/*!
+ * Unregisters watched software. Once this function returns the callback
+ * of the registration will not be called again unless this function is called
+ * from within the callback itself.
+ *
+ * @param[in] watch Handle of the registration
+ */
+void watcher_remove(EUPDWatch *watch);
+
+/*!
+ * Stops the refresher thread and drops all registrations.
+ */
+void watcher_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* ECHMET_UPD_WATCHER_H */
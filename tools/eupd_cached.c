@@ -0,0 +1,827 @@
+#define _POSIX_C_SOURCE 200809L
+/* setgroups() */
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+
+#include "../src/allocator.h"
+#include "../src/cache_client.h"
+#include "../src/check_protocol.h"
+#include "../src/threading.h"
+#include "../src/timing.h"
+
+#include <echmetupdatecheck.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+	#define SEND_FLAGS MSG_NOSIGNAL
+#else
+	#define SEND_FLAGS 0
+#endif /* MSG_NOSIGNAL */
+
+#define ACCEPT_POLL_MS 100
+
+struct Options {
+	const char *socket_path;
+	const char *user;
+	unsigned long max_age_s;
+	unsigned long retry_s;
+	unsigned long idle_timeout_s;
+	size_t max_entries;
+	size_t max_clients;
+};
+
+/*!
+ * Snapshot of one list of updates kept by the daemon
+ */
+struct CacheEntry {
+	char *url;
+	int allow_insecure;
+	EUPDManifest *manifest;
+	uint64_t validated_at;		/*!< Time the snapshot was last confirmed to be current */
+	uint64_t retry_at;		/*!< Time before which a failed revalidation is not attempted again */
+	uint64_t used_at;		/*!< Time the snapshot was last used to answer a check */
+	int refreshing;			/*!< Non-zero while a client thread revalidates the snapshot */
+	struct CacheEntry *next;
+};
+
+struct Counters {
+	unsigned long requests;
+	unsigned long hits;		/*!< Checks answered from a snapshot without contacting the server */
+	unsigned long revalidated;	/*!< Snapshots confirmed to be current by the server */
+	unsigned long fetched;		/*!< Lists fetched and parsed */
+	unsigned long stale;		/*!< Checks answered from a snapshot that could not have been revalidated */
+	unsigned long errors;		/*!< Checks that failed */
+};
+
+struct Cache {
+	Mutex lock;
+	struct CacheEntry *entries;
+	size_t num_entries;
+	size_t max_entries;
+	uint64_t max_age_ns;
+	uint64_t retry_ns;
+	struct Counters counters;
+};
+
+/*!
+ * Connection of one client served by its own thread
+ */
+struct Connection {
+	int fd;
+	Thread thread;
+	struct Cache *cache;
+	int finished;
+	struct Connection *next;
+};
+
+static volatile sig_atomic_t terminate;
+
+static
+void on_signal(int sig)
+{
+	(void)sig;
+	terminate = 1;
+}
+
+static
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"Fetches and caches lists of updates for all processes of the host that use libECHMETUpdateCheck.\n"
+		"  --socket PATH        Path of the listening socket (default $%s or %s)\n"
+		"  --user NAME          Serve as user NAME, required if started by the superuser\n"
+		"  --max-age S          Seconds a list is used without revalidation (default 60)\n"
+		"  --retry-after S      Seconds before a failed revalidation is attempted again (default 10)\n"
+		"  --max-entries N      Maximum number of cached lists (default 256)\n"
+		"  --max-clients N      Maximum number of connected clients (default 256)\n"
+		"  --idle-timeout S     Seconds after which idle clients are disconnected (default 60)\n",
+		name, CACHE_SOCKET_ENV, CACHE_DEFAULT_SOCKET);
+}
+
+static
+int parse_ulong(const char *str, unsigned long *value)
+{
+	char *end;
+
+	*value = strtoul(str, &end, 10);
+
+	return (*str == '\0' || *end != '\0') ? -1 : 0;
+}
+
+static
+struct CacheEntry * find_entry(const struct Cache *cache, const char *url, const int allow_insecure)
+{
+	struct CacheEntry *e;
+
+	for (e = cache->entries; e != NULL; e = e->next) {
+		if (e->allow_insecure == allow_insecure && strcmp(e->url, url) == 0)
+			return e;
+	}
+
+	return NULL;
+}
+
+static
+void free_entry(struct CacheEntry *e)
+{
+	updater_manifest_unref(e->manifest);
+	free(e->url);
+	free(e);
+}
+
+/*!
+ * Removes the least recently used snapshot. The cache shall be locked.
+ */
+static
+void evict_entry(struct Cache *cache)
+{
+	struct CacheEntry **victim = NULL;
+	struct CacheEntry **pe;
+
+	for (pe = &cache->entries; *pe != NULL; pe = &(*pe)->next) {
+		if (!(*pe)->refreshing && (victim == NULL || (*pe)->used_at < (*victim)->used_at))
+			victim = pe;
+	}
+
+	if (victim != NULL) {
+		struct CacheEntry *e = *victim;
+
+		*victim = e->next;
+		free_entry(e);
+		cache->num_entries--;
+	}
+}
+
+/*!
+ * Stores a freshly fetched snapshot. The cache shall be locked.
+ */
+static
+void insert_entry(struct Cache *cache, const char *url, const int allow_insecure, EUPDManifest *manifest,
+		  const uint64_t now)
+{
+	struct CacheEntry *e = find_entry(cache, url, allow_insecure);
+
+	/* Another client fetched the same list meanwhile */
+	if (e != NULL) {
+		updater_manifest_unref(e->manifest);
+		e->manifest = updater_manifest_ref(manifest);
+		e->validated_at = now;
+		e->used_at = now;
+		return;
+	}
+
+	if (cache->num_entries >= cache->max_entries)
+		evict_entry(cache);
+
+	e = calloc(1, sizeof(struct CacheEntry));
+	if (e == NULL)
+		return;
+	e->url = malloc(strlen(url) + 1);
+	if (e->url == NULL) {
+		free(e);
+		return;
+	}
+	strcpy(e->url, url);
+
+	e->allow_insecure = allow_insecure;
+	e->manifest = updater_manifest_ref(manifest);
+	e->validated_at = now;
+	e->used_at = now;
+	e->next = cache->entries;
+	cache->entries = e;
+	cache->num_entries++;
+}
+
+/*!
+ * Obtains current snapshot of a list of updates. The snapshot is revalidated with
+ * the server once it gets older than the maximum age. Clients that ask for a snapshot
+ * that is being revalidated by another client are served the old snapshot.
+ *
+ * @param[in] cache The cache
+ * @param[in] url URL of the list
+ * @param[in] allow_insecure Allow HTTP and ignore TLS errors
+ * @param[out] manifest The snapshot. The caller holds a reference to it.
+ * @param[out] outcome How the snapshot has been obtained, one of \p PROTOCOL_OUTCOME_ values
+ *
+ * @return EUPD_OK or warning on success, appropriate error code otherwise
+ */
+static
+EUPDRetCode get_snapshot(struct Cache *cache, const char *url, const int allow_insecure, EUPDManifest **manifest,
+			 uint32_t *outcome)
+{
+	struct CacheEntry *e;
+	EUPDManifest *old;
+	EUPDManifest *fresh;
+	EUPDRetCode tRet;
+	uint64_t now = timing_now_ns();
+
+	mutex_lock(&cache->lock);
+	e = find_entry(cache, url, allow_insecure);
+	if (e != NULL) {
+		e->used_at = now;
+		*manifest = updater_manifest_ref(e->manifest);
+
+		if (now - e->validated_at < cache->max_age_ns || e->refreshing) {
+			cache->counters.hits++;
+			mutex_unlock(&cache->lock);
+			*outcome = PROTOCOL_OUTCOME_CACHED;
+			return EUPD_OK;
+		}
+
+		/* The server has recently failed, do not make another client wait for it */
+		if (now < e->retry_at) {
+			cache->counters.stale++;
+			mutex_unlock(&cache->lock);
+			*outcome = PROTOCOL_OUTCOME_STALE;
+			return EUPD_OK;
+		}
+
+		e->refreshing = 1;
+		old = *manifest;
+		mutex_unlock(&cache->lock);
+
+		tRet = updater_manifest_refresh(old, &fresh);
+		now = timing_now_ns();
+
+		mutex_lock(&cache->lock);
+		e = find_entry(cache, url, allow_insecure);
+		if (EUPD_IS_ERROR(tRet)) {
+			/* Keep serving the old snapshot while the server is unavailable */
+			cache->counters.stale++;
+			if (e != NULL) {
+				e->refreshing = 0;
+				e->retry_at = now + cache->retry_ns;
+			}
+			mutex_unlock(&cache->lock);
+			*outcome = PROTOCOL_OUTCOME_STALE;
+			return EUPD_OK;
+		}
+
+		if (fresh == old) {
+			cache->counters.revalidated++;
+			*outcome = PROTOCOL_OUTCOME_REVALIDATED;
+		} else {
+			cache->counters.fetched++;
+			*outcome = PROTOCOL_OUTCOME_FETCHED;
+		}
+
+		if (e != NULL) {
+			e->refreshing = 0;
+			e->validated_at = now;
+			if (e->manifest != fresh) {
+				updater_manifest_unref(e->manifest);
+				e->manifest = updater_manifest_ref(fresh);
+			}
+		} else
+			insert_entry(cache, url, allow_insecure, fresh, now);
+		mutex_unlock(&cache->lock);
+
+		updater_manifest_unref(old);
+		*manifest = fresh;
+
+		return tRet;
+	}
+	mutex_unlock(&cache->lock);
+
+	*outcome = PROTOCOL_OUTCOME_FETCHED;
+	tRet = updater_manifest_fetch(url, allow_insecure, &fresh);
+	if (EUPD_IS_ERROR(tRet))
+		return tRet;
+
+	mutex_lock(&cache->lock);
+	cache->counters.fetched++;
+	insert_entry(cache, url, allow_insecure, fresh, timing_now_ns());
+	mutex_unlock(&cache->lock);
+
+	*manifest = fresh;
+
+	return tRet;
+}
+
+static
+int write_all(const int fd, const char *data, size_t length)
+{
+	while (length > 0) {
+		const ssize_t sent = send(fd, data, length, SEND_FLAGS);
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		data += sent;
+		length -= (size_t)sent;
+	}
+
+	return 0;
+}
+
+static
+int read_all(const int fd, char *data, size_t length)
+{
+	while (length > 0) {
+		const ssize_t got = recv(fd, data, length, 0);
+		if (got < 0) {
+			if (errno == EINTR && !terminate)
+				continue;
+			return -1;
+		} else if (got == 0)
+			return -1;
+
+		data += got;
+		length -= (size_t)got;
+	}
+
+	return 0;
+}
+
+/*!
+ * Serializes results of a check and sends them to the client
+ *
+ * @return Zero on success, -1 if the results cannot be sent
+ */
+static
+int send_results(const int fd, const EUPDRetCode tRet, const uint32_t outcome, const struct EUPDResultView *views,
+		 const size_t num_views)
+{
+	char *resp;
+	size_t length;
+	int ret;
+
+	resp = protocol_encode_response(tRet, outcome, views, num_views, &length);
+	if (resp == NULL)
+		resp = protocol_encode_response(EUPD_E_NO_MEMORY, outcome, NULL, 0, &length);
+	if (resp == NULL)
+		return -1;
+
+	ret = write_all(fd, resp, length);
+	mem_free(resp);
+
+	return ret;
+}
+
+/*!
+ * Checks software against a snapshot and sends the results to the client
+ *
+ * @return Zero on success, -1 if the results cannot be sent
+ */
+static
+int answer(const int fd, const EUPDManifest *manifest, uint32_t outcome, const struct EUPDInSoftware *in_list,
+	   const size_t num_software)
+{
+	struct EUPDResultView *views = calloc(num_software > 0 ? num_software : 1, sizeof(struct EUPDResultView));
+	struct EUPDResult *results = NULL;
+	size_t num_results = 0;
+	EUPDRetCode tRet;
+	int ret;
+
+	if (views == NULL)
+		return send_results(fd, EUPD_E_NO_MEMORY, outcome, NULL, 0);
+
+	if (!updater_manifest_is_index(manifest))
+		tRet = updater_manifest_check(manifest, in_list, num_software, views);
+	else {
+		/* Indexes of sharded lists are checked by fetching the needed shards */
+		tRet = updater_manifest_check_shards(manifest, in_list, num_software, &results, &num_results);
+		outcome = PROTOCOL_OUTCOME_FETCHED;
+		if (!EUPD_IS_ERROR(tRet)) {
+			size_t idx;
+
+			for (idx = 0; idx < num_results; idx++) {
+				views[idx].status = results[idx].status;
+				views[idx].version = results[idx].version;
+				views[idx].link = results[idx].link;
+				views[idx].link_length = results[idx].link != NULL ? strlen(results[idx].link) : 0;
+			}
+		}
+	}
+
+	ret = send_results(fd, tRet, outcome, views, num_software);
+
+	if (results != NULL)
+		updater_free_result_list(results, num_results);
+	free(views);
+
+	return ret;
+}
+
+/*!
+ * Reads one request and answers it
+ *
+ * @return Zero if the connection may be used for another request, -1 otherwise
+ */
+static
+int serve_request(const int fd, struct Cache *cache)
+{
+	char hdr_data[PROTOCOL_REQUEST_HEADER_SIZE];
+	struct ProtocolRequest hdr;
+	struct EUPDInSoftware *in_list = NULL;
+	EUPDManifest *manifest;
+	char *url = NULL;
+	char *records = NULL;
+	uint32_t outcome = PROTOCOL_OUTCOME_CACHED;
+	EUPDRetCode tRet;
+	int ret = -1;
+
+	if (read_all(fd, hdr_data, PROTOCOL_REQUEST_HEADER_SIZE) != 0)
+		return -1;
+	if (protocol_decode_request(hdr_data, &hdr) != 0)
+		return -1;
+
+	url = malloc(hdr.url_length + 1);
+	records = malloc(hdr.num_software > 0 ? hdr.num_software * PROTOCOL_SOFTWARE_SIZE : 1);
+	in_list = calloc(hdr.num_software > 0 ? hdr.num_software : 1, sizeof(struct EUPDInSoftware));
+	if (url == NULL || records == NULL || in_list == NULL)
+		goto out;
+
+	if (read_all(fd, url, hdr.url_length) != 0)
+		goto out;
+	url[hdr.url_length] = '\0';
+	if (strlen(url) != hdr.url_length)
+		goto out;
+
+	if (read_all(fd, records, hdr.num_software * PROTOCOL_SOFTWARE_SIZE) != 0)
+		goto out;
+	protocol_decode_software(records, hdr.num_software, in_list);
+
+	mutex_lock(&cache->lock);
+	cache->counters.requests++;
+	mutex_unlock(&cache->lock);
+
+	/* Clients may be processes of other users, files are never read on their behalf */
+	if (protocol_is_http_url(url))
+		tRet = get_snapshot(cache, url, (hdr.flags & PROTOCOL_FLAG_ALLOW_INSECURE) != 0, &manifest, &outcome);
+	else
+		tRet = EUPD_E_INVALID_ARGUMENT;
+	if (EUPD_IS_ERROR(tRet)) {
+		mutex_lock(&cache->lock);
+		cache->counters.errors++;
+		mutex_unlock(&cache->lock);
+
+		ret = send_results(fd, tRet, outcome, NULL, 0);
+		goto out;
+	}
+
+	ret = answer(fd, manifest, outcome, in_list, hdr.num_software);
+	updater_manifest_unref(manifest);
+
+out:
+	free(url);
+	free(records);
+	free(in_list);
+
+	return ret;
+}
+
+static
+void serve_connection(void *arg)
+{
+	struct Connection *conn = arg;
+
+	while (!terminate) {
+		if (serve_request(conn->fd, conn->cache) != 0)
+			break;
+	}
+
+	mutex_lock(&conn->cache->lock);
+	conn->finished = 1;
+	mutex_unlock(&conn->cache->lock);
+}
+
+/*!
+ * Joins threads of the clients that have disconnected
+ *
+ * @param[in,out] conns List of connections
+ * @param[in] cache The cache whose lock guards the \p finished flags
+ * @param[in] all Disconnect and join all clients
+ *
+ * @return Number of remaining connections
+ */
+static
+size_t reap_connections(struct Connection **conns, struct Cache *cache, const int all)
+{
+	struct Connection **pc = conns;
+	size_t remaining = 0;
+
+	while (*pc != NULL) {
+		struct Connection *c = *pc;
+		int finished;
+
+		if (all)
+			shutdown(c->fd, SHUT_RDWR);
+
+		mutex_lock(&cache->lock);
+		finished = c->finished;
+		mutex_unlock(&cache->lock);
+
+		if (finished || all) {
+			thread_join(&c->thread);
+			close(c->fd);
+			*pc = c->next;
+			free(c);
+		} else {
+			pc = &c->next;
+			remaining++;
+		}
+	}
+
+	return remaining;
+}
+
+/*!
+ * Creates the listening socket. A stale socket left behind by a daemon
+ * that has not exited cleanly is replaced.
+ *
+ * @return The descriptor, -1 on failure
+ */
+static
+int listen_on(const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int fd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Path of the socket is too long\n");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(struct sockaddr_un));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	if (lstat(path, &st) == 0) {
+		if (!S_ISSOCK(st.st_mode)) {
+			fprintf(stderr, "%s exists and is not a socket\n", path);
+			close(fd);
+			return -1;
+		}
+
+		if (connect(fd, (const struct sockaddr *)&addr, sizeof(struct sockaddr_un)) == 0) {
+			fprintf(stderr, "Another daemon is listening on %s\n", path);
+			close(fd);
+			return -1;
+		}
+		unlink(path);
+
+		close(fd);
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0) {
+			perror("socket");
+			return -1;
+		}
+	}
+
+	if (bind(fd, (const struct sockaddr *)&addr, sizeof(struct sockaddr_un)) != 0) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+
+	/* Processes of all users of the host may use the daemon. They trust the socket
+	 * only if it is owned by the superuser or by themselves. */
+	chmod(path, 0666);
+
+	if (listen(fd, SOMAXCONN) != 0) {
+		perror("listen");
+		close(fd);
+		unlink(path);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*!
+ * Switches to an unprivileged user. The socket created by the superuser
+ * beforehand stays owned by the superuser so that clients of all users trust it.
+ *
+ * @return Zero on success, -1 on failure
+ */
+static
+int drop_privileges(const char *user)
+{
+	const struct passwd *pw = getpwnam(user);
+
+	if (pw == NULL) {
+		fprintf(stderr, "Unknown user %s\n", user);
+		return -1;
+	}
+	if (pw->pw_uid == 0) {
+		fprintf(stderr, "The daemon must not serve as the superuser\n");
+		return -1;
+	}
+
+	if (setgroups(0, NULL) != 0 || setgid(pw->pw_gid) != 0 || setuid(pw->pw_uid) != 0) {
+		perror("Cannot switch user");
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct Options opts;
+	struct Cache cache;
+	struct Connection *conns = NULL;
+	struct sigaction sa;
+	size_t num_conns = 0;
+	int listen_fd;
+	int idx;
+
+	opts.socket_path = getenv(CACHE_SOCKET_ENV);
+	if (opts.socket_path == NULL || opts.socket_path[0] == '\0')
+		opts.socket_path = CACHE_DEFAULT_SOCKET;
+	opts.user = NULL;
+	opts.max_age_s = 60;
+	opts.retry_s = 10;
+	opts.idle_timeout_s = 60;
+	opts.max_entries = 256;
+	opts.max_clients = 256;
+
+	for (idx = 1; idx < argc; idx++) {
+		const char *arg = argv[idx];
+		unsigned long value = 0;
+
+		if (strcmp(arg, "--help") == 0) {
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		}
+
+		if (idx + 1 >= argc) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		if (strcmp(arg, "--socket") == 0) {
+			opts.socket_path = argv[++idx];
+			continue;
+		}
+		if (strcmp(arg, "--user") == 0) {
+			opts.user = argv[++idx];
+			continue;
+		}
+
+		if (parse_ulong(argv[++idx], &value) != 0) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		if (strcmp(arg, "--max-age") == 0)
+			opts.max_age_s = value;
+		else if (strcmp(arg, "--retry-after") == 0)
+			opts.retry_s = value;
+		else if (strcmp(arg, "--idle-timeout") == 0 && value > 0)
+			opts.idle_timeout_s = value;
+		else if (strcmp(arg, "--max-entries") == 0 && value > 0)
+			opts.max_entries = value;
+		else if (strcmp(arg, "--max-clients") == 0 && value > 0)
+			opts.max_clients = value;
+		else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* The daemon fetches lists chosen by other users, it must not do so with the rights of the superuser */
+	if (geteuid() == 0 && opts.user == NULL) {
+		fprintf(stderr, "Refusing to serve as the superuser, use --user\n");
+		return EXIT_FAILURE;
+	}
+	if (geteuid() != 0 && opts.user != NULL) {
+		fprintf(stderr, "--user requires the daemon to be started by the superuser\n");
+		return EXIT_FAILURE;
+	}
+
+	/* The daemon must never ask itself */
+	updater_set_cache_daemon(NULL);
+
+	if (updater_global_init() != EUPD_OK) {
+		fprintf(stderr, "Cannot initialize the library\n");
+		return EXIT_FAILURE;
+	}
+
+	memset(&cache, 0, sizeof(struct Cache));
+	cache.max_entries = opts.max_entries;
+	cache.max_age_ns = (uint64_t)opts.max_age_s * 1000000000ULL;
+	cache.retry_ns = (uint64_t)opts.retry_s * 1000000000ULL;
+	if (mutex_init(&cache.lock) != 0) {
+		updater_global_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	listen_fd = listen_on(opts.socket_path);
+	if (listen_fd < 0) {
+		mutex_destroy(&cache.lock);
+		updater_global_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	if (opts.user != NULL && drop_privileges(opts.user) != 0) {
+		close(listen_fd);
+		unlink(opts.socket_path);
+		mutex_destroy(&cache.lock);
+		updater_global_cleanup();
+		return EXIT_FAILURE;
+	}
+
+	/* Interrupt blocking reads of the client threads */
+	memset(&sa, 0, sizeof(struct sigaction));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("Listening on %s\n", opts.socket_path);
+	fflush(stdout);
+
+	while (!terminate) {
+		struct pollfd pfd;
+		struct Connection *c;
+		struct timeval tv;
+		int fd;
+
+		pfd.fd = listen_fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		num_conns = reap_connections(&conns, &cache, 0);
+
+		if (poll(&pfd, 1, ACCEPT_POLL_MS) <= 0)
+			continue;
+
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		/* Clients fall back to fetching on their own */
+		if (num_conns >= opts.max_clients) {
+			close(fd);
+			continue;
+		}
+
+		tv.tv_sec = (time_t)opts.idle_timeout_s;
+		tv.tv_usec = 0;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+		c = calloc(1, sizeof(struct Connection));
+		if (c == NULL) {
+			close(fd);
+			continue;
+		}
+		c->fd = fd;
+		c->cache = &cache;
+
+		if (thread_create(&c->thread, serve_connection, c) != 0) {
+			close(fd);
+			free(c);
+			continue;
+		}
+
+		c->next = conns;
+		conns = c;
+	}
+
+	close(listen_fd);
+	unlink(opts.socket_path);
+
+	reap_connections(&conns, &cache, 1);
+
+	printf("Answered %lu requests: %lu from cache, %lu revalidated, %lu fetched, %lu stale, %lu failed\n",
+	       cache.counters.requests, cache.counters.hits, cache.counters.revalidated,
+	       cache.counters.fetched, cache.counters.stale, cache.counters.errors);
+
+	while (cache.entries != NULL) {
+		struct CacheEntry *e = cache.entries;
+
+		cache.entries = e->next;
+		free_entry(e);
+	}
+	mutex_destroy(&cache.lock);
+
+	updater_global_cleanup();
+
+	return EXIT_SUCCESS;
+}
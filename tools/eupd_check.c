@@ -0,0 +1,1060 @@
+#ifndef _WIN32
+	#define _POSIX_C_SOURCE 200809L
+#endif /* _WIN32 */
+
+#include "../src/threading.h"
+#include "../src/timing.h"
+
+#include <echmetupdatecheck.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_JOBS 8
+#define MAX_JOBS 256
+
+typedef enum _InventoryFormat {
+	FORMAT_AUTO,
+	FORMAT_CSV,
+	FORMAT_JSONL
+} InventoryFormat;
+
+struct Options {
+	const char *path;
+	InventoryFormat format;
+	size_t jobs;
+	int allow_insecure;
+};
+
+/*!
+ * One row of the inventory
+ */
+struct Entry {
+	size_t line;			/*!< Line of the inventory file the entry was read from */
+	size_t group;			/*!< Index of the group of the URL of the entry */
+	size_t position;		/*!< Position of the entry within its group */
+};
+
+/*!
+ * Entries that share the same list of updates
+ */
+struct Group {
+	char *url;
+	struct EUPDInSoftware *in_list;
+	size_t num_entries;
+	size_t capacity;
+
+	EUPDRetCode tRet;
+	EUPDManifest *manifest;
+	struct EUPDResultView *views;
+	struct EUPDResult *results;		/*!< Results of sharded lists that own their links */
+	size_t num_results;
+	struct EUPDStats fetch_stats;
+	struct EUPDStats check_stats;
+	uint64_t fetch_ns;
+	uint64_t check_ns;
+};
+
+struct Inventory {
+	struct Entry *entries;
+	size_t num_entries;
+	size_t entries_capacity;
+
+	struct Group *groups;
+	size_t num_groups;
+	size_t groups_capacity;
+
+	size_t *slots;			/*!< Open-addressing table of group indices by URL, (size_t)-1 marks empty slots */
+	size_t num_slots;
+
+	size_t num_invalid;
+};
+
+/*!
+ * State shared by the worker threads
+ */
+struct WorkQueue {
+	struct Inventory *inv;
+	int allow_insecure;
+	Mutex lock;
+	size_t next;
+};
+
+/*!
+ * Fields of one inventory row as read from the file
+ */
+struct Row {
+	char *name;
+	char *version;
+	char *url;
+};
+
+static
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] INVENTORY\n"
+		"Checks update status of all software listed in INVENTORY, '-' reads standard input.\n"
+		"Each list of updates is fetched once. Results are written as JSON lines.\n"
+		"  --format FORMAT    Format of the inventory, csv or jsonl (default derived from the file name)\n"
+		"  --jobs N           Number of lists fetched at once, 1 to %d (default %d)\n"
+		"  --allow-insecure   Allow HTTP and ignore TLS errors\n"
+		"\n"
+		"CSV rows contain name,version,url. A header row that starts with \"name\" is skipped.\n"
+		"JSON lines are objects with \"name\", \"version\" and \"url\" members. The version\n"
+		"may be given as \"major\", \"minor\" and \"revision\" members instead.\n"
+		"Versions are written as MAJOR.MINOR followed by an optional revision of up to 4 characters.\n",
+		name, MAX_JOBS, DEFAULT_JOBS);
+}
+
+static
+int parse_ulong(const char *str, unsigned long *value)
+{
+	char *end;
+
+	*value = strtoul(str, &end, 10);
+
+	return (*str == '\0' || *end != '\0') ? -1 : 0;
+}
+
+static
+char * dup_string(const char *str, const size_t length)
+{
+	char *copy = malloc(length + 1);
+	if (copy == NULL)
+		return NULL;
+
+	memcpy(copy, str, length);
+	copy[length] = '\0';
+
+	return copy;
+}
+
+/*!
+ * Reads one line of arbitrary length without the line terminator
+ *
+ * @param[in] fh The file
+ * @param[in,out] buf Buffer that is grown as needed
+ * @param[in,out] capacity Size of the buffer
+ *
+ * @return Length of the line, -1 at the end of the file or if there is not enough memory
+ */
+static
+long read_line(FILE *fh, char **buf, size_t *capacity)
+{
+	size_t length = 0;
+
+	for (;;) {
+		if (*capacity - length < 2) {
+			const size_t grown_capacity = *capacity > 0 ? *capacity * 2 : 256;
+			char *grown = realloc(*buf, grown_capacity);
+			if (grown == NULL)
+				return -1;
+			*buf = grown;
+			*capacity = grown_capacity;
+		}
+
+		if (fgets(*buf + length, (int)(*capacity - length), fh) == NULL)
+			break;
+
+		length += strlen(*buf + length);
+		if (length > 0 && (*buf)[length - 1] == '\n')
+			break;
+	}
+
+	if (length == 0 && feof(fh))
+		return -1;
+
+	while (length > 0 && ((*buf)[length - 1] == '\n' || (*buf)[length - 1] == '\r'))
+		length--;
+	(*buf)[length] = '\0';
+
+	return (long)length;
+}
+
+static
+const char * skip_space(const char *p)
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+
+	return p;
+}
+
+static
+void free_row(struct Row *row)
+{
+	free(row->name);
+	free(row->version);
+	free(row->url);
+}
+
+/*!
+ * Reads one field of a CSV row. Fields may be enclosed in double quotes,
+ * quotes inside such fields are doubled.
+ *
+ * @param[in,out] p Position in the row, moved past the field and its separator
+ * @param[out] field The field
+ *
+ * @return Zero on success, -1 on malformed field or insufficient memory
+ */
+static
+int csv_field(const char **p, char **field)
+{
+	const char *s = skip_space(*p);
+	size_t length;
+
+	if (*s == '"') {
+		char *out = malloc(strlen(s));
+		size_t jdx = 0;
+
+		if (out == NULL)
+			return -1;
+
+		s++;
+		for (;;) {
+			if (*s == '\0') {
+				free(out);
+				return -1;
+			}
+			if (*s == '"') {
+				if (s[1] != '"')
+					break;
+				s++;
+			}
+			out[jdx++] = *s++;
+		}
+		out[jdx] = '\0';
+		s = skip_space(s + 1);
+		if (*s != ',' && *s != '\0') {
+			free(out);
+			return -1;
+		}
+
+		*field = out;
+		*p = *s == ',' ? s + 1 : s;
+
+		return 0;
+	}
+
+	length = strcspn(s, ",");
+	*p = s[length] == ',' ? s + length + 1 : s + length;
+	while (length > 0 && (s[length - 1] == ' ' || s[length - 1] == '\t'))
+		length--;
+
+	*field = dup_string(s, length);
+
+	return *field == NULL ? -1 : 0;
+}
+
+static
+const char * parse_csv(const char *line, struct Row *row)
+{
+	const char *p = line;
+
+	if (csv_field(&p, &row->name) != 0)
+		return "Malformed name";
+	if (*p == '\0')
+		return "Expected name,version,url";
+	if (csv_field(&p, &row->version) != 0)
+		return "Malformed version";
+	if (*p == '\0')
+		return "Expected name,version,url";
+	if (csv_field(&p, &row->url) != 0)
+		return "Malformed URL";
+
+	return NULL;
+}
+
+static
+int hex_digit(const char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+/*!
+ * Reads a JSON string and decodes its escape sequences to UTF-8
+ *
+ * @param[in,out] p Position of the opening quote, moved past the closing quote
+ * @param[out] str The decoded string
+ *
+ * @return Zero on success, -1 on malformed string or insufficient memory
+ */
+static
+int json_string(const char **p, char **str)
+{
+	const char *s = *p + 1;
+	char *out = malloc(strlen(s) + 1);
+	size_t jdx = 0;
+
+	if (out == NULL)
+		return -1;
+
+	while (*s != '"') {
+		unsigned long cp = 0;
+		int idx;
+
+		if ((unsigned char)*s < 0x20)
+			goto err;
+		if (*s != '\\') {
+			out[jdx++] = *s++;
+			continue;
+		}
+
+		s++;
+		switch (*s) {
+		case '"':
+		case '\\':
+		case '/':
+			out[jdx++] = *s;
+			break;
+		case 'b':
+			out[jdx++] = '\b';
+			break;
+		case 'f':
+			out[jdx++] = '\f';
+			break;
+		case 'n':
+			out[jdx++] = '\n';
+			break;
+		case 'r':
+			out[jdx++] = '\r';
+			break;
+		case 't':
+			out[jdx++] = '\t';
+			break;
+		case 'u':
+			for (idx = 1; idx <= 4; idx++) {
+				const int d = hex_digit(s[idx]);
+				if (d < 0)
+					goto err;
+				cp = cp * 16 + (unsigned long)d;
+			}
+			s += 4;
+
+			/* Surrogate pairs are not needed for names, versions nor URLs */
+			if (cp >= 0xD800 && cp <= 0xDFFF)
+				goto err;
+
+			/* The escape takes six bytes, its UTF-8 encoding at most three */
+			if (cp < 0x80) {
+				out[jdx++] = (char)cp;
+			} else if (cp < 0x800) {
+				out[jdx++] = (char)(0xC0 | (cp >> 6));
+				out[jdx++] = (char)(0x80 | (cp & 0x3F));
+			} else {
+				out[jdx++] = (char)(0xE0 | (cp >> 12));
+				out[jdx++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+				out[jdx++] = (char)(0x80 | (cp & 0x3F));
+			}
+			break;
+		default:
+			goto err;
+		}
+		s++;
+	}
+	out[jdx] = '\0';
+
+	*str = out;
+	*p = s + 1;
+
+	return 0;
+
+err:
+	free(out);
+
+	return -1;
+}
+
+/*!
+ * Reads a JSON value that is not a string. Only scalar values are accepted.
+ *
+ * @param[in,out] p Position of the value, moved past the value
+ * @param[out] str Text of the value
+ *
+ * @return Zero on success, -1 on unsupported value or insufficient memory
+ */
+static
+int json_scalar(const char **p, char **str)
+{
+	const char *s = *p;
+	size_t length = 0;
+
+	while (s[length] != '\0' && s[length] != ',' && s[length] != '}' &&
+	       s[length] != ' ' && s[length] != '\t')
+		length++;
+	if (length == 0 || *s == '{' || *s == '[')
+		return -1;
+
+	*str = dup_string(s, length);
+	*p = s + length;
+
+	return *str == NULL ? -1 : 0;
+}
+
+static
+const char * parse_jsonl(const char *line, struct Row *row)
+{
+	const char *p = skip_space(line);
+	char *major = NULL;
+	char *minor = NULL;
+	char *revision = NULL;
+	const char *error = NULL;
+
+	if (*p != '{')
+		return "Expected JSON object";
+	p = skip_space(p + 1);
+
+	while (*p != '}') {
+		char *key;
+		char *value;
+		char **target;
+
+		if (*p != '"' || json_string(&p, &key) != 0)
+			return "Malformed member name";
+		p = skip_space(p);
+		if (*p != ':') {
+			free(key);
+			return "Expected ':'";
+		}
+		p = skip_space(p + 1);
+
+		if ((*p == '"' ? json_string(&p, &value) : json_scalar(&p, &value)) != 0) {
+			free(key);
+			error = "Unsupported or malformed value";
+			goto out;
+		}
+
+		if (strcmp(key, "name") == 0)
+			target = &row->name;
+		else if (strcmp(key, "version") == 0)
+			target = &row->version;
+		else if (strcmp(key, "url") == 0)
+			target = &row->url;
+		else if (strcmp(key, "major") == 0)
+			target = &major;
+		else if (strcmp(key, "minor") == 0)
+			target = &minor;
+		else if (strcmp(key, "revision") == 0)
+			target = &revision;
+		else
+			target = NULL;
+		free(key);
+
+		if (target != NULL) {
+			free(*target);
+			*target = value;
+		} else
+			free(value);
+
+		p = skip_space(p);
+		if (*p == ',')
+			p = skip_space(p + 1);
+		else if (*p != '}') {
+			error = "Expected ',' or '}'";
+			goto out;
+		}
+	}
+
+	if (row->version == NULL && major != NULL && minor != NULL) {
+		const size_t length = strlen(major) + strlen(minor) + (revision != NULL ? strlen(revision) : 0) + 2;
+
+		row->version = malloc(length);
+		if (row->version == NULL) {
+			error = "Insufficient memory";
+			goto out;
+		}
+		snprintf(row->version, length, "%s.%s%s", major, minor, revision != NULL ? revision : "");
+	}
+
+	if (row->name == NULL || row->version == NULL || row->url == NULL)
+		error = "Expected \"name\", \"version\" and \"url\" members";
+
+out:
+	free(major);
+	free(minor);
+	free(revision);
+
+	return error;
+}
+
+/*!
+ * Parses a version in the MAJOR.MINOR[REVISION] form. The revision must
+ * follow the same rules the library enforces: a letter followed by
+ * up to three letters or digits.
+ *
+ * @return Zero on success, -1 if the version is malformed
+ */
+static
+int parse_version(const char *str, struct EUPDVersion *version)
+{
+	char *end;
+	long major;
+	long minor;
+	size_t length;
+	size_t idx;
+
+	if (!isdigit((unsigned char)*str))
+		return -1;
+	major = strtol(str, &end, 10);
+	if (*end != '.' || !isdigit((unsigned char)end[1]))
+		return -1;
+	minor = strtol(end + 1, &end, 10);
+
+	length = strlen(end);
+	if (major > 0x7FFFFFFFL || minor > 0x7FFFFFFFL || length > sizeof(version->revision))
+		return -1;
+	if (length > 0 && !isalpha((unsigned char)end[0]))
+		return -1;
+	for (idx = 1; idx < length; idx++) {
+		if (!isalnum((unsigned char)end[idx]))
+			return -1;
+	}
+
+	version->major = (int)major;
+	version->minor = (int)minor;
+	memset(version->revision, 0, sizeof(version->revision));
+	memcpy(version->revision, end, length);
+
+	return 0;
+}
+
+static
+size_t hash_url(const char *url)
+{
+	/* FNV-1a */
+	size_t h = (size_t)2166136261UL;
+
+	while (*url != '\0') {
+		h ^= (unsigned char)*url++;
+		h *= (size_t)16777619UL;
+	}
+
+	return h;
+}
+
+static
+int grow_slots(struct Inventory *inv)
+{
+	const size_t num_slots = inv->num_slots > 0 ? inv->num_slots * 2 : 64;
+	size_t *slots = malloc(num_slots * sizeof(size_t));
+	size_t idx;
+
+	if (slots == NULL)
+		return -1;
+
+	for (idx = 0; idx < num_slots; idx++)
+		slots[idx] = (size_t)-1;
+
+	for (idx = 0; idx < inv->num_groups; idx++) {
+		size_t slot = hash_url(inv->groups[idx].url) & (num_slots - 1);
+
+		while (slots[slot] != (size_t)-1)
+			slot = (slot + 1) & (num_slots - 1);
+		slots[slot] = idx;
+	}
+
+	free(inv->slots);
+	inv->slots = slots;
+	inv->num_slots = num_slots;
+
+	return 0;
+}
+
+/*!
+ * Finds the group of entries of a URL and creates it if it does not exist yet
+ *
+ * @return Index of the group, (size_t)-1 if there is not enough memory
+ */
+static
+size_t find_group(struct Inventory *inv, const char *url)
+{
+	struct Group *g;
+	size_t slot;
+
+	if ((inv->num_groups + 1) * 2 > inv->num_slots) {
+		if (grow_slots(inv) != 0)
+			return (size_t)-1;
+	}
+
+	slot = hash_url(url) & (inv->num_slots - 1);
+	while (inv->slots[slot] != (size_t)-1) {
+		if (strcmp(inv->groups[inv->slots[slot]].url, url) == 0)
+			return inv->slots[slot];
+		slot = (slot + 1) & (inv->num_slots - 1);
+	}
+
+	if (inv->num_groups == inv->groups_capacity) {
+		const size_t capacity = inv->groups_capacity > 0 ? inv->groups_capacity * 2 : 16;
+		struct Group *grown = realloc(inv->groups, capacity * sizeof(struct Group));
+		if (grown == NULL)
+			return (size_t)-1;
+		inv->groups = grown;
+		inv->groups_capacity = capacity;
+	}
+
+	g = &inv->groups[inv->num_groups];
+	memset(g, 0, sizeof(struct Group));
+	g->url = dup_string(url, strlen(url));
+	if (g->url == NULL)
+		return (size_t)-1;
+
+	inv->slots[slot] = inv->num_groups;
+
+	return inv->num_groups++;
+}
+
+static
+int add_entry(struct Inventory *inv, const size_t line, const struct Row *row, const struct EUPDVersion *version)
+{
+	struct Entry *e;
+	struct Group *g;
+	const size_t group = find_group(inv, row->url);
+
+	if (group == (size_t)-1)
+		return -1;
+	g = &inv->groups[group];
+
+	if (g->num_entries == g->capacity) {
+		const size_t capacity = g->capacity > 0 ? g->capacity * 2 : 16;
+		struct EUPDInSoftware *grown = realloc(g->in_list, capacity * sizeof(struct EUPDInSoftware));
+		if (grown == NULL)
+			return -1;
+		g->in_list = grown;
+		g->capacity = capacity;
+	}
+
+	if (inv->num_entries == inv->entries_capacity) {
+		const size_t capacity = inv->entries_capacity > 0 ? inv->entries_capacity * 2 : 256;
+		struct Entry *grown = realloc(inv->entries, capacity * sizeof(struct Entry));
+		if (grown == NULL)
+			return -1;
+		inv->entries = grown;
+		inv->entries_capacity = capacity;
+	}
+
+	memset(&g->in_list[g->num_entries], 0, sizeof(struct EUPDInSoftware));
+	memcpy(g->in_list[g->num_entries].name, row->name, strlen(row->name));
+	g->in_list[g->num_entries].version = *version;
+
+	e = &inv->entries[inv->num_entries++];
+	e->line = line;
+	e->group = group;
+	e->position = g->num_entries++;
+
+	return 0;
+}
+
+static
+InventoryFormat format_from_path(const char *path)
+{
+	const char *ext = strrchr(path, '.');
+
+	if (ext != NULL && (strcmp(ext, ".jsonl") == 0 || strcmp(ext, ".ndjson") == 0 || strcmp(ext, ".json") == 0))
+		return FORMAT_JSONL;
+
+	return FORMAT_CSV;
+}
+
+/*!
+ * Reads the inventory and groups its entries by URL.
+ * Malformed rows are reported and skipped.
+ *
+ * @return Zero on success, -1 if the file cannot be read
+ */
+static
+int read_inventory(const struct Options *opts, struct Inventory *inv)
+{
+	const int use_stdin = strcmp(opts->path, "-") == 0;
+	FILE *fh = use_stdin ? stdin : fopen(opts->path, "rb");
+	InventoryFormat format = opts->format;
+	char *buf = NULL;
+	size_t capacity = 0;
+	size_t line = 0;
+	long length;
+	int ret = 0;
+
+	if (fh == NULL) {
+		fprintf(stderr, "Cannot open %s\n", opts->path);
+		return -1;
+	}
+
+	if (format == FORMAT_AUTO)
+		format = use_stdin ? FORMAT_CSV : format_from_path(opts->path);
+
+	while ((length = read_line(fh, &buf, &capacity)) >= 0) {
+		struct Row row = { NULL, NULL, NULL };
+		struct EUPDVersion version;
+		const char *error;
+		const char *p = skip_space(buf);
+
+		line++;
+		if (*p == '\0' || *p == '#')
+			continue;
+
+		error = format == FORMAT_JSONL ? parse_jsonl(buf, &row) : parse_csv(buf, &row);
+		if (error == NULL && format == FORMAT_CSV && line == 1 && strcmp(row.name, "name") == 0) {
+			free_row(&row);
+			continue;
+		}
+
+		if (error == NULL) {
+			if (row.name[0] == '\0' || strlen(row.name) > sizeof(((struct EUPDInSoftware *)0)->name))
+				error = "Name is empty or longer than 32 characters";
+			else if (parse_version(row.version, &version) != 0)
+				error = "Malformed version";
+			else if (row.url[0] == '\0')
+				error = "URL is empty";
+			else if (add_entry(inv, line, &row, &version) != 0) {
+				free_row(&row);
+				fprintf(stderr, "Insufficient memory to read the inventory\n");
+				ret = -1;
+				break;
+			}
+		}
+
+		if (error != NULL) {
+			fprintf(stderr, "%s:%lu: %s\n", opts->path, (unsigned long)line, error);
+			inv->num_invalid++;
+		}
+		free_row(&row);
+	}
+
+	if (ferror(fh)) {
+		fprintf(stderr, "Cannot read %s\n", opts->path);
+		ret = -1;
+	}
+
+	free(buf);
+	if (!use_stdin)
+		fclose(fh);
+
+	return ret;
+}
+
+static
+void free_inventory(struct Inventory *inv)
+{
+	size_t idx;
+
+	for (idx = 0; idx < inv->num_groups; idx++) {
+		struct Group *g = &inv->groups[idx];
+
+		free(g->url);
+		free(g->in_list);
+		free(g->views);
+		if (g->results != NULL)
+			updater_free_result_list(g->results, g->num_results);
+		if (g->manifest != NULL)
+			updater_manifest_unref(g->manifest);
+	}
+
+	free(inv->groups);
+	free(inv->entries);
+	free(inv->slots);
+}
+
+/*!
+ * Fetches the list of updates of a group once and checks all entries of the group against it
+ */
+static
+void check_group(struct Group *g, const int allow_insecure)
+{
+	uint64_t start = timing_now_ns();
+
+	g->tRet = updater_manifest_fetch(g->url, allow_insecure, &g->manifest);
+	updater_last_stats(&g->fetch_stats);
+	g->fetch_ns = timing_now_ns() - start;
+	if (EUPD_IS_ERROR(g->tRet)) {
+		g->manifest = NULL;
+		return;
+	}
+
+	g->views = calloc(g->num_entries, sizeof(struct EUPDResultView));
+	if (g->views == NULL) {
+		g->tRet = EUPD_E_NO_MEMORY;
+		return;
+	}
+
+	start = timing_now_ns();
+	if (!updater_manifest_is_index(g->manifest))
+		g->tRet = updater_manifest_check(g->manifest, g->in_list, g->num_entries, g->views);
+	else {
+		g->tRet = updater_manifest_check_shards(g->manifest, g->in_list, g->num_entries,
+							&g->results, &g->num_results);
+		if (!EUPD_IS_ERROR(g->tRet)) {
+			size_t idx;
+
+			for (idx = 0; idx < g->num_results; idx++) {
+				struct EUPDResultView *v = &g->views[idx];
+
+				v->status = g->results[idx].status;
+				v->version = g->results[idx].version;
+				v->link = g->results[idx].link;
+				v->link_length = v->link != NULL ? strlen(v->link) : 0;
+			}
+		}
+	}
+	updater_last_stats(&g->check_stats);
+	g->check_ns = timing_now_ns() - start;
+}
+
+static
+void worker(void *arg)
+{
+	struct WorkQueue *wq = arg;
+
+	for (;;) {
+		size_t idx;
+
+		mutex_lock(&wq->lock);
+		idx = wq->next++;
+		mutex_unlock(&wq->lock);
+
+		if (idx >= wq->inv->num_groups)
+			break;
+
+		check_group(&wq->inv->groups[idx], wq->allow_insecure);
+	}
+}
+
+/*!
+ * Checks all groups of the inventory using a pool of threads
+ *
+ * @return Zero on success, -1 if no thread can be started
+ */
+static
+int check_inventory(struct Inventory *inv, const struct Options *opts)
+{
+	struct WorkQueue wq;
+	Thread threads[MAX_JOBS];
+	size_t num_threads = opts->jobs < inv->num_groups ? opts->jobs : inv->num_groups;
+	size_t idx;
+
+	wq.inv = inv;
+	wq.allow_insecure = opts->allow_insecure;
+	wq.next = 0;
+	if (mutex_init(&wq.lock) != 0)
+		return -1;
+
+	for (idx = 0; idx < num_threads; idx++) {
+		if (thread_create(&threads[idx], worker, &wq) != 0)
+			break;
+	}
+	num_threads = idx;
+
+	/* The calling thread helps so that the checks are done even if no thread could have been started */
+	worker(&wq);
+
+	for (idx = 0; idx < num_threads; idx++)
+		thread_join(&threads[idx]);
+
+	mutex_destroy(&wq.lock);
+
+	return 0;
+}
+
+/*!
+ * Writes a string escaped for JSON
+ *
+ * @param[in] str The string
+ * @param[in] max_length Maximum number of characters to write
+ * @param[in] quote Enclose the string in quotes
+ */
+static
+void print_string(const char *str, const size_t max_length, const int quote)
+{
+	size_t idx;
+
+	if (quote)
+		putchar('"');
+	for (idx = 0; idx < max_length && str[idx] != '\0'; idx++) {
+		const unsigned char c = (unsigned char)str[idx];
+
+		if (c == '"' || c == '\\')
+			printf("\\%c", c);
+		else if (c < 0x20)
+			printf("\\u%04x", c);
+		else
+			putchar(c);
+	}
+	if (quote)
+		putchar('"');
+}
+
+static
+void print_version(const struct EUPDVersion *version)
+{
+	char rev[sizeof(version->revision) + 1];
+
+	memcpy(rev, version->revision, sizeof(version->revision));
+	rev[sizeof(version->revision)] = '\0';
+
+	printf("\"%d.%d", version->major, version->minor);
+	print_string(rev, sizeof(rev), 0);
+	putchar('"');
+}
+
+static
+void print_group(const struct Group *g)
+{
+	const struct EUPDStats *f = &g->fetch_stats;
+	const struct EUPDStats *c = &g->check_stats;
+
+	printf("{\"type\":\"manifest\",\"url\":");
+	print_string(g->url, (size_t)-1, 1);
+	printf(",\"ret\":\"%s\",\"entries\":%lu", updater_error_to_str(g->tRet), (unsigned long)g->num_entries);
+	printf(",\"fetch_ns\":%llu,\"check_ns\":%llu", (unsigned long long)g->fetch_ns, (unsigned long long)g->check_ns);
+	printf(",\"transfer_ns\":%llu,\"bytes\":%llu,\"parse_ns\":%llu,\"compare_ns\":%llu}\n",
+	       f->total_ns + c->total_ns, f->bytes_downloaded + c->bytes_downloaded,
+	       f->parse_ns + c->parse_ns, c->compare_ns);
+}
+
+static
+void print_entry(const struct Inventory *inv, const struct Entry *e)
+{
+	const struct Group *g = &inv->groups[e->group];
+	const struct EUPDInSoftware *in_sw = &g->in_list[e->position];
+
+	printf("{\"type\":\"result\",\"line\":%lu,\"name\":", (unsigned long)e->line);
+	print_string(in_sw->name, sizeof(in_sw->name), 1);
+	printf(",\"version\":");
+	print_version(&in_sw->version);
+	printf(",\"url\":");
+	print_string(g->url, (size_t)-1, 1);
+
+	/* Warnings of the whole group do not necessarily concern this entry */
+	if (EUPD_IS_ERROR(g->tRet) || g->views[e->position].status == EUST_UNKNOWN) {
+		printf(",\"ret\":\"%s\",\"status\":\"%s\"}\n",
+		       updater_error_to_str(EUPD_IS_ERROR(g->tRet) ? g->tRet : EUPD_W_NOT_FOUND),
+		       updater_status_to_str(EUST_UNKNOWN));
+		return;
+	}
+
+	printf(",\"ret\":\"%s\",\"status\":\"%s\",\"latest\":", updater_error_to_str(EUPD_OK),
+	       updater_status_to_str(g->views[e->position].status));
+	print_version(&g->views[e->position].version);
+	printf(",\"link\":");
+	print_string(g->views[e->position].link, g->views[e->position].link_length, 1);
+	printf("}\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct Options opts;
+	struct Inventory inv;
+	uint64_t start;
+	uint64_t read_ns;
+	uint64_t check_ns;
+	size_t num_failed = 0;
+	size_t idx;
+	int ret = EXIT_SUCCESS;
+
+	opts.path = NULL;
+	opts.format = FORMAT_AUTO;
+	opts.jobs = DEFAULT_JOBS;
+	opts.allow_insecure = 0;
+
+	for (idx = 1; idx < (size_t)argc; idx++) {
+		const char *arg = argv[idx];
+		unsigned long value;
+
+		if (strcmp(arg, "--allow-insecure") == 0) {
+			opts.allow_insecure = 1;
+			continue;
+		} else if (strcmp(arg, "--help") == 0) {
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		} else if (arg[0] != '-' || strcmp(arg, "-") == 0) {
+			if (opts.path != NULL) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			opts.path = arg;
+			continue;
+		}
+
+		if (idx + 1 >= (size_t)argc) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+
+		if (strcmp(arg, "--format") == 0) {
+			const char *format = argv[++idx];
+
+			if (strcmp(format, "csv") == 0)
+				opts.format = FORMAT_CSV;
+			else if (strcmp(format, "jsonl") == 0)
+				opts.format = FORMAT_JSONL;
+			else {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+		} else if (strcmp(arg, "--jobs") == 0 && parse_ulong(argv[++idx], &value) == 0 &&
+			   value >= 1 && value <= MAX_JOBS) {
+			opts.jobs = value;
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (opts.path == NULL) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (updater_global_init() != EUPD_OK) {
+		fprintf(stderr, "Cannot initialize the library\n");
+		return EXIT_FAILURE;
+	}
+
+	memset(&inv, 0, sizeof(struct Inventory));
+
+	start = timing_now_ns();
+	if (read_inventory(&opts, &inv) != 0) {
+		ret = EXIT_FAILURE;
+		goto out;
+	}
+	read_ns = timing_now_ns() - start;
+
+	if (check_inventory(&inv, &opts) != 0) {
+		fprintf(stderr, "Cannot start the checks\n");
+		ret = EXIT_FAILURE;
+		goto out;
+	}
+	check_ns = timing_now_ns() - start - read_ns;
+
+	for (idx = 0; idx < inv.num_groups; idx++) {
+		print_group(&inv.groups[idx]);
+		if (EUPD_IS_ERROR(inv.groups[idx].tRet))
+			num_failed++;
+	}
+	for (idx = 0; idx < inv.num_entries; idx++)
+		print_entry(&inv, &inv.entries[idx]);
+
+	printf("{\"type\":\"summary\",\"entries\":%lu,\"invalid\":%lu,\"manifests\":%lu,\"failed\":%lu",
+	       (unsigned long)inv.num_entries, (unsigned long)inv.num_invalid,
+	       (unsigned long)inv.num_groups, (unsigned long)num_failed);
+	printf(",\"read_ns\":%llu,\"check_ns\":%llu,\"total_ns\":%llu}\n",
+	       (unsigned long long)read_ns, (unsigned long long)check_ns,
+	       (unsigned long long)(timing_now_ns() - start));
+
+	if (inv.num_invalid > 0 || num_failed > 0)
+		ret = EXIT_FAILURE;
+
+out:
+	free_inventory(&inv);
+	updater_global_cleanup();
+
+	return ret;
+}
@@ -0,0 +1,1183 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "../src/allocator.h"
+#include "../src/check_protocol.h"
+#include "../src/server_client.h"
+#include "../src/threading.h"
+#include "../src/timing.h"
+
+#include <echmetupdatecheck.h>
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#ifdef MSG_NOSIGNAL
+	#define SEND_FLAGS MSG_NOSIGNAL
+#else
+	#define SEND_FLAGS 0
+#endif /* MSG_NOSIGNAL */
+
+#define ACCEPT_POLL_MS 100
+#define MAX_HEADER_SIZE 8192
+#define MAX_BODY_SIZE (PROTOCOL_REQUEST_HEADER_SIZE + PROTOCOL_MAX_URL_LENGTH + PROTOCOL_MAX_SOFTWARE * PROTOCOL_SOFTWARE_SIZE)
+#define MAX_THREADS 256
+#define MEMO_LOCKS 64
+
+struct Options {
+	const char *bind_address;
+	const char *port;
+	const char *path;
+	unsigned long refresh_s;
+	unsigned long idle_timeout_s;
+	unsigned long request_timeout_s;
+	size_t num_threads;
+	size_t memo_entries;
+	int allow_insecure;
+};
+
+/*!
+ * List of updates held in memory and served to the clients
+ */
+struct ServedList {
+	const char *url;
+	EUPDManifest *manifest;		/*!< <tt>NULL</tt> until the list is fetched for the first time */
+	uint64_t generation;		/*!< Incremented whenever the snapshot changes */
+	int sharded;			/*!< The snapshot is an index of a sharded list, such a list is not served */
+};
+
+/*!
+ * Memoized response to an inventory checked against one generation of a list
+ */
+struct MemoSlot {
+	size_t list;
+	uint64_t generation;
+	uint64_t hash;
+	char *key;			/*!< Software records of the request */
+	size_t key_length;
+	char *response;			/*!< Stored in the same block as \p key */
+	size_t response_length;
+};
+
+/*!
+ * Direct-mapped cache of responses. Slots are guarded by striped locks.
+ */
+struct Memo {
+	struct MemoSlot *slots;
+	size_t num_slots;
+	Mutex locks[MEMO_LOCKS];
+};
+
+struct Counters {
+	unsigned long requests;
+	unsigned long answered;		/*!< Inventories checked */
+	unsigned long memoized;		/*!< Inventories answered from the memoization cache */
+	unsigned long rejected;		/*!< Requests answered with an HTTP error */
+	unsigned long refreshed;	/*!< Lists that changed on refresh */
+};
+
+struct Server {
+	struct Options *opts;
+	struct ServedList *lists;
+	size_t num_lists;
+	struct Memo memo;
+
+	Mutex lock;			/*!< Guards the snapshots, the queue and the counters */
+	CondVar queue_cv;
+	CondVar refresh_cv;
+	int *queue;			/*!< Accepted connections waiting for a worker */
+	size_t queue_capacity;
+	size_t queue_head;
+	size_t queue_length;
+	int *active;			/*!< Connection served by each worker, -1 if idle */
+	int stopping;
+
+	struct Counters counters;
+};
+
+/*!
+ * Parsed HTTP request
+ */
+struct HttpRequest {
+	const char *method;
+	size_t method_length;
+	const char *target;
+	size_t target_length;
+	size_t header_length;		/*!< Length of the request line and headers including the empty line */
+	size_t content_length;
+	int has_length;
+	int chunked;
+	int expect_continue;
+	int keep_alive;
+};
+
+struct Worker {
+	struct Server *server;
+	size_t index;
+	Thread thread;
+};
+
+static volatile sig_atomic_t terminate;
+
+static
+void on_signal(int sig)
+{
+	(void)sig;
+	terminate = 1;
+}
+
+static
+void usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s --list URL [--list URL ...] [options]\n"
+		"Holds lists of updates in memory and checks inventories posted by libECHMETUpdateCheck clients.\n"
+		"  --list URL           List of updates to serve, may be given multiple times\n"
+		"  --bind ADDRESS       Address to listen on (default 127.0.0.1)\n"
+		"  --port PORT          Port to listen on (default 8080)\n"
+		"  --path PATH          Path of the check endpoint (default /check)\n"
+		"  --threads N          Number of worker threads (default 8)\n"
+		"  --refresh S          Seconds between revalidations of the lists (default 60)\n"
+		"  --memo N             Memoize responses to up to N distinct inventories (default 0, disabled)\n"
+		"  --idle-timeout S     Seconds after which idle connections are closed (default 5)\n"
+		"  --request-timeout S  Seconds a client has to send a whole request (default 10)\n"
+		"  --allow-insecure     Allow HTTP and ignore TLS errors when fetching the lists\n"
+		"Clients use the server if $%s or updater_set_check_server() points to it. Clients that require\n"
+		"TLS post only to https:// URLs, put a reverse proxy that terminates TLS in front of the server.\n",
+		name, SERVER_URL_ENV);
+}
+
+static
+int parse_ulong(const char *str, unsigned long *value)
+{
+	char *end;
+
+	*value = strtoul(str, &end, 10);
+
+	return (*str == '\0' || *end != '\0') ? -1 : 0;
+}
+
+static
+uint64_t fnv1a(const char *data, const size_t length)
+{
+	uint64_t h = 14695981039346656037ULL;
+	size_t idx;
+
+	for (idx = 0; idx < length; idx++) {
+		h ^= (unsigned char)data[idx];
+		h *= 1099511628211ULL;
+	}
+
+	return h;
+}
+
+static
+int memo_init(struct Memo *memo, const size_t num_slots)
+{
+	size_t idx;
+
+	memo->num_slots = num_slots;
+	if (num_slots == 0)
+		return 0;
+
+	memo->slots = calloc(num_slots, sizeof(struct MemoSlot));
+	if (memo->slots == NULL)
+		return -1;
+
+	for (idx = 0; idx < MEMO_LOCKS; idx++) {
+		if (mutex_init(&memo->locks[idx]) != 0) {
+			while (idx-- > 0)
+				mutex_destroy(&memo->locks[idx]);
+			free(memo->slots);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static
+void memo_destroy(struct Memo *memo)
+{
+	size_t idx;
+
+	if (memo->num_slots == 0)
+		return;
+
+	for (idx = 0; idx < memo->num_slots; idx++)
+		free(memo->slots[idx].key);
+	for (idx = 0; idx < MEMO_LOCKS; idx++)
+		mutex_destroy(&memo->locks[idx]);
+	free(memo->slots);
+}
+
+/*!
+ * Looks up a memoized response
+ *
+ * @param[out] response Copy of the response allocated with \p malloc()
+ *
+ * @return Non-zero if the response has been found
+ */
+static
+int memo_lookup(struct Memo *memo, const size_t list, const uint64_t generation, const uint64_t hash,
+		const char *key, const size_t key_length, char **response, size_t *response_length)
+{
+	const size_t idx = (size_t)(hash % memo->num_slots);
+	struct MemoSlot *slot = &memo->slots[idx];
+	Mutex *lock = &memo->locks[idx % MEMO_LOCKS];
+	int found = 0;
+
+	mutex_lock(lock);
+	if (slot->key != NULL && slot->list == list && slot->generation == generation && slot->hash == hash &&
+	    slot->key_length == key_length && memcmp(slot->key, key, key_length) == 0) {
+		*response = malloc(slot->response_length);
+		if (*response != NULL) {
+			memcpy(*response, slot->response, slot->response_length);
+			*response_length = slot->response_length;
+			found = 1;
+		}
+	}
+	mutex_unlock(lock);
+
+	return found;
+}
+
+/*!
+ * Stores a response, replacing whatever occupied its slot
+ */
+static
+void memo_store(struct Memo *memo, const size_t list, const uint64_t generation, const uint64_t hash,
+		const char *key, const size_t key_length, const char *response, const size_t response_length)
+{
+	const size_t idx = (size_t)(hash % memo->num_slots);
+	struct MemoSlot *slot = &memo->slots[idx];
+	Mutex *lock = &memo->locks[idx % MEMO_LOCKS];
+	char *block = malloc(key_length + response_length + 1);
+
+	if (block == NULL)
+		return;
+	memcpy(block, key, key_length);
+	memcpy(block + key_length, response, response_length);
+
+	mutex_lock(lock);
+	free(slot->key);
+	slot->list = list;
+	slot->generation = generation;
+	slot->hash = hash;
+	slot->key = block;
+	slot->key_length = key_length;
+	slot->response = block + key_length;
+	slot->response_length = response_length;
+	mutex_unlock(lock);
+}
+
+/*!
+ * Fetches a list for the first time or revalidates it with its origin
+ *
+ * @return Non-zero if the snapshot has changed
+ */
+static
+int update_list(struct Server *server, struct ServedList *list)
+{
+	EUPDManifest *old;
+	EUPDManifest *fresh;
+	EUPDRetCode tRet;
+	int sharded;
+
+	mutex_lock(&server->lock);
+	old = list->manifest != NULL ? updater_manifest_ref(list->manifest) : NULL;
+	mutex_unlock(&server->lock);
+
+	if (old == NULL)
+		tRet = updater_manifest_fetch(list->url, server->opts->allow_insecure, &fresh);
+	else {
+		tRet = updater_manifest_refresh(old, &fresh);
+		updater_manifest_unref(old);
+	}
+
+	if (EUPD_IS_ERROR(tRet)) {
+		/* Keep serving the old snapshot while the origin is unavailable */
+		fprintf(stderr, "Cannot %s %s: %s\n", old == NULL ? "fetch" : "refresh", list->url, updater_error_to_str(tRet));
+		return 0;
+	}
+
+	/* Shards would have to be fetched for every check, which the server never does on behalf of a client */
+	sharded = updater_manifest_is_index(fresh);
+
+	mutex_lock(&server->lock);
+	if (fresh == list->manifest) {
+		mutex_unlock(&server->lock);
+		updater_manifest_unref(fresh);
+		return 0;
+	}
+
+	old = list->manifest;
+	list->manifest = fresh;
+	list->sharded = sharded;
+	list->generation++;
+	mutex_unlock(&server->lock);
+
+	if (old != NULL)
+		updater_manifest_unref(old);
+
+	if (sharded)
+		fprintf(stderr, "%s is an index of a sharded list, checks against it are answered with 503\n", list->url);
+
+	return 1;
+}
+
+static
+void refresh_lists(void *arg)
+{
+	struct Server *server = arg;
+	const uint64_t period_ns = (uint64_t)server->opts->refresh_s * 1000000000ULL;
+	uint64_t last = timing_now_ns();
+
+	mutex_lock(&server->lock);
+	while (!server->stopping) {
+		const uint64_t now = timing_now_ns();
+		size_t idx;
+
+		if (now - last < period_ns) {
+			cond_wait_timed(&server->refresh_cv, &server->lock,
+					(unsigned long)((period_ns - (now - last)) / 1000000ULL) + 1);
+			continue;
+		}
+		mutex_unlock(&server->lock);
+
+		for (idx = 0; idx < server->num_lists; idx++) {
+			if (update_list(server, &server->lists[idx])) {
+				mutex_lock(&server->lock);
+				server->counters.refreshed++;
+				mutex_unlock(&server->lock);
+			}
+		}
+		last = timing_now_ns();
+
+		mutex_lock(&server->lock);
+	}
+	mutex_unlock(&server->lock);
+}
+
+static
+int write_all(const int fd, const char *data, size_t length)
+{
+	while (length > 0) {
+		const ssize_t sent = send(fd, data, length, SEND_FLAGS);
+		if (sent < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		data += sent;
+		length -= (size_t)sent;
+	}
+
+	return 0;
+}
+
+/*!
+ * Sends a complete HTTP response
+ *
+ * @return Zero on success, -1 if the response cannot be sent
+ */
+static
+int send_response(const int fd, const int status, const char *reason, const char *body, const size_t length,
+		  const int keep_alive)
+{
+	char header[256];
+	char *resp;
+	int header_length;
+	int ret;
+
+	header_length = snprintf(header, sizeof(header),
+				 "HTTP/1.1 %d %s\r\n"
+				 "Content-Type: %s\r\n"
+				 "Content-Length: %lu\r\n"
+				 "%s"
+				 "Connection: %s\r\n"
+				 "\r\n",
+				 status, reason,
+				 status == 200 ? SERVER_RESULT_CONTENT_TYPE : "text/plain",
+				 (unsigned long)length,
+				 status == 405 ? "Allow: POST\r\n" : "",
+				 keep_alive ? "keep-alive" : "close");
+
+	/* One write avoids waiting for a delayed acknowledgement of the header */
+	resp = malloc((size_t)header_length + length);
+	if (resp == NULL)
+		return -1;
+	memcpy(resp, header, (size_t)header_length);
+	memcpy(resp + header_length, body, length);
+
+	ret = write_all(fd, resp, (size_t)header_length + length);
+	free(resp);
+
+	return ret;
+}
+
+static
+int send_error(const int fd, const int status, const char *reason, const int keep_alive)
+{
+	return send_response(fd, status, reason, reason, strlen(reason), keep_alive);
+}
+
+/*!
+ * Checks whether a header line has a given name and returns its value
+ *
+ * @return Value of the header without leading whitespace, <tt>NULL</tt> if the name does not match
+ */
+static
+const char * header_value(const char *line, const size_t length, const char *name, size_t *value_length)
+{
+	const size_t name_length = strlen(name);
+	size_t idx;
+
+	if (length <= name_length || strncasecmp(line, name, name_length) != 0 || line[name_length] != ':')
+		return NULL;
+
+	idx = name_length + 1;
+	while (idx < length && (line[idx] == ' ' || line[idx] == '\t'))
+		idx++;
+
+	*value_length = length - idx;
+	while (*value_length > 0 && (line[idx + *value_length - 1] == ' ' || line[idx + *value_length - 1] == '\t'))
+		(*value_length)--;
+
+	return line + idx;
+}
+
+/*!
+ * Parses request line and headers of an HTTP request
+ *
+ * @param[in] data Received data, contains the terminating empty line
+ * @param[in] header_length Length of the request line and headers including the empty line
+ * @param[out] req The request
+ *
+ * @return Zero on success, -1 if the request is malformed
+ */
+static
+int parse_request(const char *data, const size_t header_length, struct HttpRequest *req)
+{
+	const char *end = data + header_length - 2;
+	const char *line = data;
+	const char *eol;
+	const char *sp;
+	int http10;
+
+	memset(req, 0, sizeof(struct HttpRequest));
+	req->header_length = header_length;
+
+	eol = strstr(line, "\r\n");
+	sp = memchr(line, ' ', (size_t)(eol - line));
+	if (sp == NULL)
+		return -1;
+	req->method = line;
+	req->method_length = (size_t)(sp - line);
+
+	req->target = sp + 1;
+	sp = memchr(req->target, ' ', (size_t)(eol - req->target));
+	if (sp == NULL)
+		return -1;
+	req->target_length = (size_t)(sp - req->target);
+
+	if ((size_t)(eol - sp - 1) != 8 || strncmp(sp + 1, "HTTP/1.", 7) != 0)
+		return -1;
+	http10 = sp[8] == '0';
+	req->keep_alive = !http10;
+
+	for (line = eol + 2; line < end; line = eol + 2) {
+		const char *value;
+		size_t length;
+
+		eol = strstr(line, "\r\n");
+
+		if ((value = header_value(line, (size_t)(eol - line), "Content-Length", &length)) != NULL) {
+			char buf[24];
+			unsigned long cl;
+
+			if (length == 0 || length >= sizeof(buf))
+				return -1;
+			memcpy(buf, value, length);
+			buf[length] = '\0';
+			if (parse_ulong(buf, &cl) != 0)
+				return -1;
+
+			req->content_length = cl;
+			req->has_length = 1;
+		} else if ((value = header_value(line, (size_t)(eol - line), "Transfer-Encoding", &length)) != NULL)
+			req->chunked = 1;
+		else if ((value = header_value(line, (size_t)(eol - line), "Expect", &length)) != NULL)
+			req->expect_continue = length == 12 && strncasecmp(value, "100-continue", 12) == 0;
+		else if ((value = header_value(line, (size_t)(eol - line), "Connection", &length)) != NULL) {
+			if (length == 5 && strncasecmp(value, "close", 5) == 0)
+				req->keep_alive = 0;
+			else if (length == 10 && strncasecmp(value, "keep-alive", 10) == 0)
+				req->keep_alive = 1;
+		}
+	}
+
+	return 0;
+}
+
+/*!
+ * Checks an inventory against a snapshot
+ *
+ * @return The response allocated with \p mem_malloc(), <tt>NULL</tt> if there is not enough memory
+ */
+static
+char * evaluate(const EUPDManifest *manifest, const char *records, const size_t num_software, size_t *length)
+{
+	struct EUPDInSoftware *in_list;
+	struct EUPDResultView *views;
+	EUPDRetCode tRet;
+	char *resp = NULL;
+
+	in_list = calloc(num_software > 0 ? num_software : 1, sizeof(struct EUPDInSoftware));
+	views = calloc(num_software > 0 ? num_software : 1, sizeof(struct EUPDResultView));
+	if (in_list == NULL || views == NULL)
+		goto out;
+
+	protocol_decode_software(records, num_software, in_list);
+
+	tRet = updater_manifest_check(manifest, in_list, num_software, views);
+	resp = protocol_encode_response(tRet, PROTOCOL_OUTCOME_CACHED, views, num_software, length);
+
+out:
+	free(views);
+	free(in_list);
+
+	return resp;
+}
+
+/*!
+ * Answers a check request
+ *
+ * @return Zero if the connection may be used for another request, -1 otherwise
+ */
+static
+int serve_check(struct Server *server, const int fd, const char *body, const size_t length, const int keep_alive)
+{
+	struct ProtocolRequest hdr;
+	const char *url;
+	const char *records;
+	size_t records_length;
+	struct ServedList *list = NULL;
+	EUPDManifest *manifest;
+	uint64_t generation;
+	uint64_t hash = 0;
+	char *resp = NULL;
+	size_t resp_length = 0;
+	int memoized = 0;
+	size_t idx;
+	int ret;
+
+	if (length < PROTOCOL_REQUEST_HEADER_SIZE || protocol_decode_request(body, &hdr) != 0 ||
+	    length != PROTOCOL_REQUEST_HEADER_SIZE + (size_t)hdr.url_length + (size_t)hdr.num_software * PROTOCOL_SOFTWARE_SIZE)
+		goto bad_request;
+
+	url = body + PROTOCOL_REQUEST_HEADER_SIZE;
+	records = url + hdr.url_length;
+	records_length = (size_t)hdr.num_software * PROTOCOL_SOFTWARE_SIZE;
+
+	/* Only the configured lists are served, the server never fetches on behalf of the clients */
+	for (idx = 0; idx < server->num_lists; idx++) {
+		const char *u = server->lists[idx].url;
+
+		if (strlen(u) == hdr.url_length && memcmp(u, url, hdr.url_length) == 0) {
+			list = &server->lists[idx];
+			break;
+		}
+	}
+	/* Clients that require verified TLS shall not get answers from lists fetched without it */
+	if (list == NULL || (server->opts->allow_insecure && !(hdr.flags & PROTOCOL_FLAG_ALLOW_INSECURE))) {
+		mutex_lock(&server->lock);
+		server->counters.rejected++;
+		mutex_unlock(&server->lock);
+
+		return send_error(fd, 404, "Not Found", keep_alive) != 0 || !keep_alive ? -1 : 0;
+	}
+
+	mutex_lock(&server->lock);
+	manifest = list->manifest != NULL && !list->sharded ? updater_manifest_ref(list->manifest) : NULL;
+	generation = list->generation;
+	if (manifest == NULL)
+		server->counters.rejected++;
+	mutex_unlock(&server->lock);
+
+	if (manifest == NULL)
+		return send_error(fd, 503, "Service Unavailable", keep_alive) != 0 || !keep_alive ? -1 : 0;
+
+	if (server->memo.num_slots > 0) {
+		hash = fnv1a(records, records_length);
+		memoized = memo_lookup(&server->memo, idx, generation, hash, records, records_length, &resp, &resp_length);
+	}
+
+	if (!memoized) {
+		struct ProtocolResponse checked;
+
+		resp = evaluate(manifest, records, hdr.num_software, &resp_length);
+		if (resp != NULL && server->memo.num_slots > 0 &&
+		    protocol_decode_response(resp, &checked) == 0 && !EUPD_IS_ERROR(checked.ret))
+			memo_store(&server->memo, idx, generation, hash, records, records_length, resp, resp_length);
+	}
+	updater_manifest_unref(manifest);
+
+	if (resp == NULL) {
+		send_error(fd, 500, "Internal Server Error", 0);
+		return -1;
+	}
+
+	mutex_lock(&server->lock);
+	server->counters.answered++;
+	if (memoized)
+		server->counters.memoized++;
+	mutex_unlock(&server->lock);
+
+	ret = send_response(fd, 200, "OK", resp, resp_length, keep_alive);
+
+	/* Memoized responses are copied with malloc(), evaluated ones come from the library allocator */
+	if (memoized)
+		free(resp);
+	else
+		mem_free(resp);
+
+	return ret != 0 || !keep_alive ? -1 : 0;
+
+bad_request:
+	mutex_lock(&server->lock);
+	server->counters.rejected++;
+	mutex_unlock(&server->lock);
+
+	send_error(fd, 400, "Bad Request", 0);
+
+	return -1;
+}
+
+/*!
+ * Waits until data can be read from a connection
+ *
+ * @param[in] server The server
+ * @param[in] fd The connection
+ * @param[in] deadline Monotonic time after which the wait fails
+ * @param[in] idle Non-zero if the connection waits for a new request. Such a connection
+ *                 is given up as soon as other connections wait for a worker.
+ *
+ * @return Zero if data can be read, -1 otherwise
+ */
+static
+int wait_readable(struct Server *server, const int fd, const uint64_t deadline, const int idle)
+{
+	for (;;) {
+		const uint64_t now = timing_now_ns();
+		struct pollfd pfd;
+		int timeout_ms = ACCEPT_POLL_MS;
+		int ready;
+
+		if (terminate || now >= deadline)
+			return -1;
+
+		if (idle) {
+			int queued;
+
+			mutex_lock(&server->lock);
+			queued = server->queue_length > 0;
+			mutex_unlock(&server->lock);
+
+			if (queued)
+				return -1;
+		}
+
+		if (deadline - now < (uint64_t)ACCEPT_POLL_MS * 1000000ULL)
+			timeout_ms = (int)((deadline - now) / 1000000ULL) + 1;
+
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		ready = poll(&pfd, 1, timeout_ms);
+		if (ready > 0)
+			return 0;
+		if (ready < 0 && errno != EINTR)
+			return -1;
+	}
+}
+
+/*!
+ * Receives data that is known to be available
+ *
+ * @return Zero on success, -1 if the connection has been closed or has failed
+ */
+static
+int receive(const int fd, char *buf, const size_t length, size_t *filled)
+{
+	for (;;) {
+		const ssize_t got = recv(fd, buf, length, 0);
+		if (got < 0 && errno == EINTR && !terminate)
+			continue;
+		if (got <= 0)
+			return -1;
+
+		*filled += (size_t)got;
+		return 0;
+	}
+}
+
+/*!
+ * Serves HTTP requests received over one connection.
+ *
+ * A worker is not pinned to a connection for longer than necessary. Each request
+ * shall be received completely within the request timeout and a connection
+ * that waits for its next request is closed after the idle timeout or as soon
+ * as other connections wait for a worker.
+ */
+static
+void serve_connection(struct Server *server, const int fd)
+{
+	const uint64_t idle_timeout_ns = (uint64_t)server->opts->idle_timeout_s * 1000000000ULL;
+	const uint64_t request_timeout_ns = (uint64_t)server->opts->request_timeout_s * 1000000000ULL;
+	size_t capacity = MAX_HEADER_SIZE;
+	size_t filled = 0;
+	int first = 1;
+	char *buf = malloc(capacity + 1);
+
+	if (buf == NULL)
+		return;
+
+	while (!terminate) {
+		struct HttpRequest req;
+		const char *end_of_header;
+		uint64_t deadline;
+		size_t total;
+
+		if (!first && filled == 0) {
+			if (wait_readable(server, fd, timing_now_ns() + idle_timeout_ns, 1) != 0)
+				goto out;
+		}
+		first = 0;
+
+		deadline = timing_now_ns() + request_timeout_ns;
+
+		for (;;) {
+			buf[filled] = '\0';
+			end_of_header = strstr(buf, "\r\n\r\n");
+			if (end_of_header != NULL)
+				break;
+
+			if (filled >= MAX_HEADER_SIZE) {
+				send_error(fd, 431, "Request Header Fields Too Large", 0);
+				goto out;
+			}
+
+			if (wait_readable(server, fd, deadline, 0) != 0 ||
+			    receive(fd, buf + filled, MAX_HEADER_SIZE - filled, &filled) != 0)
+				goto out;
+		}
+
+		mutex_lock(&server->lock);
+		server->counters.requests++;
+		mutex_unlock(&server->lock);
+
+		if (parse_request(buf, (size_t)(end_of_header - buf) + 4, &req) != 0) {
+			send_error(fd, 400, "Bad Request", 0);
+			goto out;
+		}
+
+		/* Errors close the connection, their bodies are never read */
+		{
+			const char *query = memchr(req.target, '?', req.target_length);
+			const size_t path_length = query != NULL ? (size_t)(query - req.target) : req.target_length;
+			int status = 0;
+			const char *reason = NULL;
+
+			if (path_length != strlen(server->opts->path) ||
+			    memcmp(req.target, server->opts->path, path_length) != 0) {
+				status = 404;
+				reason = "Not Found";
+			} else if (req.method_length != 4 || memcmp(req.method, "POST", 4) != 0) {
+				status = 405;
+				reason = "Method Not Allowed";
+			} else if (req.chunked || !req.has_length) {
+				status = 411;
+				reason = "Length Required";
+			} else if (req.content_length > MAX_BODY_SIZE) {
+				status = 413;
+				reason = "Payload Too Large";
+			}
+
+			if (status != 0) {
+				mutex_lock(&server->lock);
+				server->counters.rejected++;
+				mutex_unlock(&server->lock);
+
+				send_error(fd, status, reason, 0);
+				goto out;
+			}
+		}
+
+		total = req.header_length + req.content_length;
+		if (total > capacity) {
+			char *grown = realloc(buf, total + 1);
+			if (grown == NULL)
+				goto out;
+			buf = grown;
+			capacity = total;
+		}
+
+		if (req.expect_continue && filled < total) {
+			static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+
+			if (write_all(fd, CONTINUE, sizeof(CONTINUE) - 1) != 0)
+				goto out;
+		}
+
+		while (filled < total) {
+			if (wait_readable(server, fd, deadline, 0) != 0 ||
+			    receive(fd, buf + filled, capacity - filled, &filled) != 0)
+				goto out;
+		}
+
+		if (serve_check(server, fd, buf + req.header_length, req.content_length, req.keep_alive) != 0)
+			goto out;
+
+		/* Keep pipelined requests */
+		memmove(buf, buf + total, filled - total);
+		filled -= total;
+	}
+
+out:
+	free(buf);
+}
+
+static
+void run_worker(void *arg)
+{
+	struct Worker *w = arg;
+	struct Server *server = w->server;
+
+	for (;;) {
+		int fd;
+
+		mutex_lock(&server->lock);
+		while (server->queue_length == 0 && !server->stopping)
+			cond_wait(&server->queue_cv, &server->lock);
+		if (server->stopping) {
+			mutex_unlock(&server->lock);
+			break;
+		}
+
+		fd = server->queue[server->queue_head];
+		server->queue_head = (server->queue_head + 1) % server->queue_capacity;
+		server->queue_length--;
+		server->active[w->index] = fd;
+		mutex_unlock(&server->lock);
+
+		serve_connection(server, fd);
+
+		mutex_lock(&server->lock);
+		server->active[w->index] = -1;
+		mutex_unlock(&server->lock);
+
+		close(fd);
+	}
+}
+
+/*!
+ * Creates the listening socket
+ *
+ * @return The descriptor, -1 on failure
+ */
+static
+int listen_on(const char *address, const char *port)
+{
+	struct addrinfo hints;
+	struct addrinfo *res;
+	struct addrinfo *ai;
+	int fd = -1;
+	int gai;
+
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	gai = getaddrinfo(address, port, &hints, &res);
+	if (gai != 0) {
+		fprintf(stderr, "Cannot resolve %s:%s: %s\n", address, port, gai_strerror(gai));
+		return -1;
+	}
+
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		const int on = 1;
+
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+		if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0)
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+
+	if (fd < 0)
+		fprintf(stderr, "Cannot listen on %s:%s\n", address, port);
+
+	return fd;
+}
+
+int main(int argc, char *argv[])
+{
+	struct Options opts;
+	struct Server server;
+	struct Worker *workers = NULL;
+	Thread refresher;
+	struct sigaction sa;
+	size_t num_workers = 0;
+	int refresher_running = 0;
+	int listen_fd = -1;
+	int ret = EXIT_FAILURE;
+	size_t idx;
+	int arg_idx;
+
+	opts.bind_address = "127.0.0.1";
+	opts.port = "8080";
+	opts.path = "/check";
+	opts.refresh_s = 60;
+	opts.idle_timeout_s = 5;
+	opts.request_timeout_s = 10;
+	opts.num_threads = 8;
+	opts.memo_entries = 0;
+	opts.allow_insecure = 0;
+
+	memset(&server, 0, sizeof(struct Server));
+	server.opts = &opts;
+	server.lists = calloc((size_t)argc, sizeof(struct ServedList));
+	if (server.lists == NULL)
+		return EXIT_FAILURE;
+
+	for (arg_idx = 1; arg_idx < argc; arg_idx++) {
+		const char *arg = argv[arg_idx];
+		unsigned long value = 0;
+
+		if (strcmp(arg, "--help") == 0) {
+			usage(argv[0]);
+			free(server.lists);
+			return EXIT_SUCCESS;
+		}
+
+		if (strcmp(arg, "--allow-insecure") == 0) {
+			opts.allow_insecure = 1;
+			continue;
+		}
+
+		if (arg_idx + 1 >= argc)
+			goto bad_usage;
+
+		if (strcmp(arg, "--list") == 0) {
+			const char *url = argv[++arg_idx];
+
+			if (url[0] == '\0' || strlen(url) > PROTOCOL_MAX_URL_LENGTH)
+				goto bad_usage;
+			server.lists[server.num_lists++].url = url;
+			continue;
+		} else if (strcmp(arg, "--bind") == 0) {
+			opts.bind_address = argv[++arg_idx];
+			continue;
+		} else if (strcmp(arg, "--port") == 0) {
+			opts.port = argv[++arg_idx];
+			continue;
+		} else if (strcmp(arg, "--path") == 0) {
+			opts.path = argv[++arg_idx];
+			if (opts.path[0] != '/')
+				goto bad_usage;
+			continue;
+		}
+
+		if (parse_ulong(argv[++arg_idx], &value) != 0)
+			goto bad_usage;
+
+		if (strcmp(arg, "--threads") == 0 && value > 0 && value <= MAX_THREADS)
+			opts.num_threads = value;
+		else if (strcmp(arg, "--refresh") == 0 && value > 0)
+			opts.refresh_s = value;
+		else if (strcmp(arg, "--memo") == 0)
+			opts.memo_entries = value;
+		else if (strcmp(arg, "--idle-timeout") == 0 && value > 0)
+			opts.idle_timeout_s = value;
+		else if (strcmp(arg, "--request-timeout") == 0 && value > 0)
+			opts.request_timeout_s = value;
+		else
+			goto bad_usage;
+	}
+
+	if (server.num_lists == 0)
+		goto bad_usage;
+
+	/* The server must never ask itself or the caching daemon */
+	updater_set_cache_daemon(NULL);
+	updater_set_check_server(NULL);
+
+	if (updater_global_init() != EUPD_OK) {
+		fprintf(stderr, "Cannot initialize the library\n");
+		free(server.lists);
+		return EXIT_FAILURE;
+	}
+
+	if (mutex_init(&server.lock) != 0)
+		goto out_lib;
+	if (cond_init(&server.queue_cv) != 0)
+		goto out_lock;
+	if (cond_init(&server.refresh_cv) != 0)
+		goto out_queue_cv;
+	if (memo_init(&server.memo, opts.memo_entries) != 0) {
+		fprintf(stderr, "Insufficient memory for the memoization cache\n");
+		goto out_refresh_cv;
+	}
+
+	server.queue_capacity = opts.num_threads * 16;
+	server.queue = calloc(server.queue_capacity, sizeof(int));
+	server.active = malloc(opts.num_threads * sizeof(int));
+	workers = calloc(opts.num_threads, sizeof(struct Worker));
+	if (server.queue == NULL || server.active == NULL || workers == NULL)
+		goto out;
+	for (idx = 0; idx < opts.num_threads; idx++)
+		server.active[idx] = -1;
+
+	/* Lists that cannot be fetched now are answered with 503 until a refresh succeeds */
+	for (idx = 0; idx < server.num_lists; idx++) {
+		if (update_list(&server, &server.lists[idx]) && !server.lists[idx].sharded)
+			printf("Serving %s\n", server.lists[idx].url);
+	}
+
+	listen_fd = listen_on(opts.bind_address, opts.port);
+	if (listen_fd < 0)
+		goto out;
+
+	memset(&sa, 0, sizeof(struct sigaction));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	for (num_workers = 0; num_workers < opts.num_threads; num_workers++) {
+		workers[num_workers].server = &server;
+		workers[num_workers].index = num_workers;
+		if (thread_create(&workers[num_workers].thread, run_worker, &workers[num_workers]) != 0)
+			break;
+	}
+	if (num_workers == 0)
+		goto out;
+
+	refresher_running = thread_create(&refresher, refresh_lists, &server) == 0;
+
+	printf("Listening on %s:%s%s with %lu threads\n", opts.bind_address, opts.port, opts.path,
+	       (unsigned long)num_workers);
+	fflush(stdout);
+
+	while (!terminate) {
+		struct pollfd pfd;
+		struct timeval tv;
+		int queued = 0;
+		int fd;
+
+		pfd.fd = listen_fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		if (poll(&pfd, 1, ACCEPT_POLL_MS) <= 0)
+			continue;
+
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		/* Receiving is bounded by the deadlines of serve_connection() */
+		tv.tv_sec = (time_t)opts.request_timeout_s;
+		tv.tv_usec = 0;
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+		mutex_lock(&server.lock);
+		if (server.queue_length < server.queue_capacity) {
+			server.queue[(server.queue_head + server.queue_length) % server.queue_capacity] = fd;
+			server.queue_length++;
+			cond_signal(&server.queue_cv);
+			queued = 1;
+		}
+		mutex_unlock(&server.lock);
+
+		/* Clients fall back to fetching the list on their own */
+		if (!queued)
+			close(fd);
+	}
+
+	ret = EXIT_SUCCESS;
+
+out:
+	mutex_lock(&server.lock);
+	server.stopping = 1;
+	for (idx = 0; idx < num_workers; idx++) {
+		if (server.active[idx] >= 0)
+			shutdown(server.active[idx], SHUT_RDWR);
+	}
+	cond_broadcast(&server.queue_cv);
+	cond_broadcast(&server.refresh_cv);
+	mutex_unlock(&server.lock);
+
+	for (idx = 0; idx < num_workers; idx++)
+		thread_join(&workers[idx].thread);
+	if (refresher_running)
+		thread_join(&refresher);
+
+	for (; server.queue_length > 0; server.queue_length--) {
+		close(server.queue[server.queue_head]);
+		server.queue_head = (server.queue_head + 1) % server.queue_capacity;
+	}
+	if (listen_fd >= 0)
+		close(listen_fd);
+
+	if (ret == EXIT_SUCCESS) {
+		printf("Received %lu requests: %lu inventories checked, %lu memoized, %lu rejected, %lu list updates\n",
+		       server.counters.requests, server.counters.answered, server.counters.memoized,
+		       server.counters.rejected, server.counters.refreshed);
+	}
+
+	for (idx = 0; idx < server.num_lists; idx++) {
+		if (server.lists[idx].manifest != NULL)
+			updater_manifest_unref(server.lists[idx].manifest);
+	}
+	free(workers);
+	free(server.active);
+	free(server.queue);
+	memo_destroy(&server.memo);
+out_refresh_cv:
+	cond_destroy(&server.refresh_cv);
+out_queue_cv:
+	cond_destroy(&server.queue_cv);
+out_lock:
+	mutex_destroy(&server.lock);
+out_lib:
+	updater_global_cleanup();
+	free(server.lists);
+
+	return ret;
+
+bad_usage:
+	usage(argv[0]);
+	free(server.lists);
+
+	return EXIT_FAILURE;
+}